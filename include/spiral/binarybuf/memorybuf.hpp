@@ -23,13 +23,13 @@ namespace spiral {
         template <bool B = std::is_default_constructible_v<C>, typename = std::enable_if_t<B>>
         basic_imemorybuf() : _container(), _curr(std::end(_container)) {}
 
-        template <bool B = std::is_move_constructible<C>, typename = std::enable_if_t<B>>
+        template <bool B = std::is_move_constructible_v<C>, typename = std::enable_if_t<B>>
         basic_imemorybuf(C&& container) : _container(std::move(container)), _curr(std::begin(_container)) {}
 
-        template <bool B = std::is_move_constructible<C>, typename = std::enable_if_t<B>>
+        template <bool B = std::is_move_constructible_v<C>, typename = std::enable_if_t<B>>
         basic_imemorybuf(basic_imemorybuf<T, C>&& other) : _container(std::move(other._container)), _curr(std::exchange(other._curr, std::end(other._curr))) {}
 
-        template <bool B = std::is_swappable<C>, typename = std::enable_if_t<B>>
+        template <bool B = std::is_swappable_v<C>, typename = std::enable_if_t<B>>
         basic_imemorybuf& operator=(basic_imemorybuf<T, C>&& other) {
             swap(*this, other);
         }
@@ -108,4 +108,95 @@ namespace spiral {
     template <typename C>
     using memorybuf = basic_imemorybuf<typename C::element_type, C>;
 
+    // requires: T is PODType, C is a type with begin() and end() that returns mutable ContiguousIterators (e.g. ContiguousContainer or span)
+    // The buffer does not grow: the container must be given the final size up front.
+    template <typename T, typename C>
+    class basic_omemorybuf {
+
+    public:
+        using element_type = T;
+        using container_type = C;
+
+        template <bool B = std::is_move_constructible_v<C>, typename = std::enable_if_t<B>>
+        basic_omemorybuf(C&& container) : _container(std::move(container)), _curr(std::begin(_container)) {}
+
+        basic_omemorybuf(const basic_omemorybuf<T, C>&) = delete;
+        basic_omemorybuf& operator=(const basic_omemorybuf<T, C>&) = delete;
+
+        ~basic_omemorybuf() {}
+
+        /**
+         * Writes a single byte to the buffer.
+         * Throws eof_exception if the buffer is full.
+         */
+        inline void write(T t) {
+            if (!full()) {
+                write_unchecked(t);
+            }
+            else {
+                throw eof_exception("No more space in memorybuf!");
+            }
+        }
+
+        /**
+         * Writes the given number of bytes to the buffer.
+         * Throws eof_exception if there is not enough space.  (When an exception is thrown, zero bytes will be written.)
+         */
+        template <typename InIt>
+        inline void write(InIt in_begin, size_t nbytes) {
+            if (available(nbytes)) {
+                write_unchecked(in_begin, nbytes);
+            }
+            else {
+                throw eof_exception("Not enough space in memorybuf!");
+            }
+        }
+
+        /**
+         * Writes a single byte to the buffer.
+         * Undefined behaviour if the buffer is full.
+         */
+        inline void write_unchecked(T t) {
+            *_curr++ = t;
+        }
+
+        /**
+         * Writes the given number of bytes to the buffer.
+         * Undefined behaviour if there is not enough space.
+         */
+        template <typename InIt>
+        inline void write_unchecked(InIt in_begin, size_t nbytes) {
+            _curr = std::copy_n(in_begin, nbytes, _curr);
+        }
+
+        /**
+         * Checks whether the buffer is full.
+         */
+        inline bool full() {
+            return _curr == std::end(_container);
+        }
+
+        /**
+         * Checks whether there is space for at least nbytes.
+         */
+        inline bool available(size_t nbytes) {
+            return nbytes <= static_cast<size_t>(std::distance(_curr, std::end(_container)));
+        }
+
+        /**
+         * Returns the number of bytes written.
+         */
+        inline size_t size() {
+            return static_cast<size_t>(std::distance(std::begin(_container), _curr));
+        }
+
+    private:
+        C _container;
+        typename C::iterator _curr;
+
+    };
+
+    template <typename C>
+    using omemorybuf = basic_omemorybuf<typename C::element_type, C>;
+
 }
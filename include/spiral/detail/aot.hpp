@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#define SPIRAL_AOT_DLOPEN
+#endif
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/compiled_module.hpp>
+#include <spiral/detail/native_abi.hpp>
+#include <spiral/detail/cpp_emitter.hpp>
+#include <spiral/detail/code_cache.hpp>
+#include <spiral/detail/perf.hpp>
+#include <spiral/detail/hash.hpp>
+#include <spiral/detail/telemetry.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+/**
+ * Ahead-of-time compilation: the module is translated to C++ (see cpp_emitter.hpp) and built by the system compiler
+ * into a shared object, which is later loaded into a CompiledModule with aot_load.
+ * aot_load_cached does both through a code_cache, so that a module that was built before (with the same compiler, flags
+ * and CPU) is loaded without running the compiler.
+ */
+
+namespace spiral {
+
+    struct aot_options {
+        std::string compiler = "c++";
+        std::vector<std::string> flags = { "-std=c++17", "-O2", "-fPIC", "-shared", "-fvisibility=hidden", "-fno-exceptions", "-fno-rtti" };
+        bool keep_source = false; // keep the generated C++ next to the output (as <output>.cpp)
+        bool debug_info = false; // build with -g, so that perf maps PCs to Spiral instructions while the shared object is on disk (see perf.hpp)
+        telemetry* sink = nullptr; // if not null, emission and native compilation are recorded to it
+        perf_output* perf = nullptr; // if not null, aot_load_cached reports the loaded code to it (see aot_load)
+    };
+
+    namespace detail {
+
+        inline std::string shell_quote(const std::string& str) {
+            std::string ret = "'";
+            for (const char c : str) {
+                if (c == '\'') {
+                    ret += "'\\''";
+                }
+                else {
+                    ret += c;
+                }
+            }
+            ret += '\'';
+            return ret;
+        }
+    }
+
+    /**
+     * Compiles the module into a shared object at the given path.  Throws aot_exception on failure.
+     */
+    inline void aot_compile(const Module& module, const std::filesystem::path& output, const aot_options& options = {}) {
+        const std::string source = emit_cpp(module, options.sink);
+        telemetry::scope scope(options.sink, "native_compile");
+        const std::filesystem::path source_path = output.string() + ".cpp";
+        {
+            std::ofstream file(source_path, std::ios::binary | std::ios::trunc);
+            file << source;
+            if (!file) throw aot_exception("Cannot write " + source_path.string() + "!");
+        }
+        std::string command = detail::shell_quote(options.compiler);
+        for (const std::string& flag : options.flags) {
+            command += ' ' + detail::shell_quote(flag);
+        }
+        if (options.debug_info) command += " -g";
+        command += " -o " + detail::shell_quote(output.string()) + ' ' + detail::shell_quote(source_path.string());
+        const int status = std::system(command.c_str());
+        if (!options.keep_source) {
+            std::error_code ec;
+            std::filesystem::remove(source_path, ec);
+        }
+        if (status != 0) throw aot_exception("Compiler failed: " + command);
+    }
+
+    /**
+     * A loaded shared object.  Code from it must not be called after it is destroyed.
+     */
+    class shared_library {
+    public:
+        shared_library() noexcept = default;
+        explicit shared_library(void* handle) noexcept : handle(handle) {}
+        shared_library(shared_library&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        shared_library& operator=(shared_library&& other) noexcept {
+            std::swap(handle, other.handle);
+            return *this;
+        }
+        ~shared_library() {
+#ifdef SPIRAL_AOT_DLOPEN
+            if (handle != nullptr) dlclose(handle);
+#endif
+        }
+
+        /**
+         * Returns the address of the given symbol, or nullptr if there is no such symbol.
+         */
+        void* get_symbol(const char* name) const noexcept {
+#ifdef SPIRAL_AOT_DLOPEN
+            return dlsym(handle, name);
+#else
+            (void)name;
+            return nullptr;
+#endif
+        }
+
+    private:
+        void* handle = nullptr;
+    };
+
+    namespace detail {
+        struct aot_code_range {
+            uint64_t functionid;
+            const void* start;
+        };
+
+        /**
+         * Adds the functions in the shared object to the pc_table of the compiled module, and reports them to perf if it is not null.
+         * Each function is taken to extend up to the next one (the generated functions are all in one section).
+         */
+        inline void aot_load_code_ranges(CompiledModule& compiled, const shared_library& library, perf_output* perf) {
+            const auto* const ranges = static_cast<const aot_code_range*>(library.get_symbol(aot_code_ranges_symbol));
+            const auto* const num_ranges = static_cast<const uint64_t*>(library.get_symbol(aot_num_code_ranges_symbol));
+            const auto* const end = static_cast<const void* const*>(library.get_symbol(aot_code_end_symbol));
+            if (ranges == nullptr || num_ranges == nullptr || end == nullptr) return;
+            std::vector<aot_code_range> sorted(ranges, ranges + *num_ranges);
+            std::sort(sorted.begin(), sorted.end(), [](const aot_code_range& a, const aot_code_range& b) { return a.start < b.start; });
+            for (size_t i = 0; i != sorted.size(); ++i) {
+                const uintptr_t start = reinterpret_cast<uintptr_t>(sorted[i].start);
+                const uintptr_t next = reinterpret_cast<uintptr_t>(i + 1 != sorted.size() ? sorted[i + 1].start : *end);
+                if (next <= start) continue;
+                const functionid_t functionid = static_cast<functionid_t>(sorted[i].functionid);
+                compiled.add_code(start, next - start, functionid);
+                if (perf != nullptr) perf->code_load(sorted[i].start, next - start, aot_entry_symbol(functionid));
+            }
+        }
+    }
+
+    /**
+     * Loads a shared object produced by aot_compile from the module, and installs its entry points into the compiled module
+     * (which keeps the shared object loaded).  Throws aot_exception if it cannot be loaded.
+     * If sink is not null, the installation is recorded to it.
+     * If perf is not null, every loaded function is reported to it (to the perf map, and with its code to jitdump), so that
+     * perf can name the code even after the shared object has been deleted (as aot_load_cached does).
+     */
+    inline void aot_load(CompiledModule& compiled, const std::filesystem::path& path, telemetry* sink = nullptr, perf_output* perf = nullptr) {
+        telemetry::scope scope(sink, "install");
+#ifdef SPIRAL_AOT_DLOPEN
+        void* const handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == nullptr) throw aot_exception(std::string("Cannot load shared object: ") + dlerror());
+        auto library = std::make_shared<const shared_library>(handle);
+        for (const Code& code : compiled.get_module().get_codes()) {
+            if (void* const entry = library->get_symbol(aot_entry_symbol(code.get_functionid()).c_str())) {
+                compiled.set_entry(code.get_functionid(), reinterpret_cast<native_function_t>(entry));
+            }
+        }
+        detail::aot_load_code_ranges(compiled, *library, perf);
+        compiled.add_owner(std::move(library));
+#else
+        (void)compiled;
+        (void)path;
+        (void)sink;
+        (void)perf;
+        throw aot_exception("Loading shared objects is not supported on this platform!");
+#endif
+    }
+
+    namespace detail {
+
+        /**
+         * Key of the shared object of the module in the cache: the module's content hash, with everything else that goes into
+         * the shared object (the prelude, the compiler and its flags).  The cache adds the CPU features and compiler version.
+         */
+        inline uint64_t aot_cache_key(const code_cache& cache, const Module& module, const aot_options& options) {
+            std::vector<byte> build(sizeof(uint64_t) * 2);
+            const uint64_t content_hash = module.content_hash();
+            const uint64_t prelude_hash = hash_bytes(reinterpret_cast<const byte*>(cpp_prelude), std::strlen(cpp_prelude));
+            std::memcpy(build.data(), &content_hash, sizeof(content_hash));
+            std::memcpy(build.data() + sizeof(content_hash), &prelude_hash, sizeof(prelude_hash));
+            const auto append = [&build](const std::string& str) {
+                build.insert(build.end(), reinterpret_cast<const byte*>(str.data()), reinterpret_cast<const byte*>(str.data() + str.size() + 1));
+            };
+            append(options.compiler);
+            for (const std::string& flag : options.flags) {
+                append(flag);
+            }
+            if (options.debug_info) append("-g");
+            return cache.make_key(span<const byte>(build.data(), build.size()));
+        }
+
+        inline std::vector<byte> read_library(const std::filesystem::path& path) {
+            std::error_code ec;
+            const uintmax_t size = std::filesystem::file_size(path, ec);
+            std::ifstream file(path, std::ios::binary);
+            std::vector<byte> ret(ec ? 0 : static_cast<size_t>(size));
+            if (ec || !file.read(reinterpret_cast<char*>(ret.data()), static_cast<std::streamsize>(ret.size()))) throw aot_exception("Cannot read " + path.string() + "!");
+            return ret;
+        }
+
+        inline void write_library(const std::filesystem::path& path, span<const byte> contents) {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(contents.data()), static_cast<std::streamsize>(contents.size()));
+            if (!file) throw aot_exception("Cannot write " + path.string() + "!");
+        }
+    }
+
+    /**
+     * Installs compiled code for the module of the compiled module (like aot_compile followed by aot_load), taking the shared
+     * object from the cache if it was built before, and otherwise compiling it and storing it in the cache.
+     * The shared object is the whole cache entry (without relocations), keyed by detail::aot_cache_key.
+     * On a hit, the mapped entry is copied to a temporary file for the dynamic loader, so the compiler does not run.
+     * The file is deleted once loaded, so perf and the profiler can only name the functions of the code (see perf.hpp).
+     * Returns whether the code came from the cache.  Throws aot_exception if the code cannot be compiled or loaded.
+     */
+    inline bool aot_load_cached(CompiledModule& compiled, code_cache& cache, const aot_options& options = {}) {
+        static std::atomic<uint64_t> counter{ 0 };
+        const uint64_t key = detail::aot_cache_key(cache, compiled.get_module(), options);
+        const std::filesystem::path library = std::filesystem::temp_directory_path() / ("spiral_aot_" + std::to_string(key) + "_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "_" + std::to_string(counter++) + ".so");
+        bool hit = false;
+        try {
+            if (const std::optional<cached_code> cached = cache.lookup(key)) {
+                detail::write_library(library, cached->get_code());
+                hit = true;
+            }
+            else {
+                aot_compile(compiled.get_module(), library, options);
+                const std::vector<byte> contents = detail::read_library(library);
+                cache.store(key, compiled_code{ span<const byte>(contents.data(), contents.size()), {}, {} });
+            }
+            aot_load(compiled, library, options.sink, options.perf);
+        }
+        catch (...) {
+            std::error_code ec;
+            std::filesystem::remove(library, ec);
+            throw;
+        }
+        std::error_code ec;
+        std::filesystem::remove(library, ec); // the loaded shared object stays mapped
+        return hit;
+    }
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/native_abi.hpp>
+#include <spiral/detail/instance.hpp>
+#include <spiral/detail/span.hpp>
+
+namespace spiral {
+
+    namespace detail {
+
+        template <typename Outputs>
+        struct batch_output_spans;
+        template <typename... O>
+        struct batch_output_spans<type_list<O...>> {
+            using type = std::tuple<span<O>...>;
+        };
+
+        template <typename Signature>
+        struct batch_spans;
+        template <typename R, typename... Args>
+        struct batch_spans<R(Args...)> {
+            using inputs = std::tuple<span<const Args>...>;
+            using outputs = typename batch_output_spans<typename host_outputs<R>::type>::type;
+        };
+
+        /**
+         * Calls the entry point once for each row in [begin, end).
+         */
+        template <typename Entry, typename... Args, typename... O, size_t... I, size_t... J>
+        inline void invoke_rows(Entry entry, native_context* context, const std::tuple<const Args*...>& inputs, const std::tuple<O*...>& outputs, size_t begin, size_t end, std::index_sequence<I...>, std::index_sequence<J...>) {
+            for (size_t row = begin; row != end; ++row) {
+                if constexpr (sizeof...(O) == 0) {
+                    entry(context, std::get<I>(inputs)[row]...);
+                }
+                else if constexpr (sizeof...(O) == 1) {
+                    ((std::get<J>(outputs)[row] = entry(context, std::get<I>(inputs)[row]...)), ...);
+                }
+                else {
+                    const auto results = entry(context, std::get<I>(inputs)[row]...);
+                    ((std::get<J>(outputs)[row] = results.template get<J>()), ...);
+                }
+            }
+        }
+
+        template <typename... T, size_t... I>
+        inline std::tuple<T*...> span_data(const std::tuple<span<T>...>& spans, std::index_sequence<I...>) noexcept {
+            return { std::get<I>(spans).data()... };
+        }
+
+        template <typename Columns>
+        inline bool columns_have_size(const Columns& columns, size_t num_rows) noexcept {
+            return std::apply([num_rows](const auto&... column) { return ((static_cast<size_t>(column.size()) == num_rows) && ... && true); }, columns);
+        }
+
+        /**
+         * Rows below which a batch is not worth splitting across another thread.
+         */
+        constexpr size_t min_rows_per_thread = 4096;
+
+        /**
+         * Worker threads that are joined on destruction, so that the ones already started are joined (rather than
+         * terminating the program) when starting another one throws.
+         */
+        struct joining_threads {
+            std::vector<std::thread> threads;
+
+            joining_threads() = default;
+            joining_threads(const joining_threads&) = delete;
+            joining_threads& operator=(const joining_threads&) = delete;
+            ~joining_threads() {
+                for (std::thread& thread : threads) {
+                    if (thread.joinable()) thread.join();
+                }
+            }
+        };
+    }
+
+    template <typename Signature>
+    using batch_inputs_t = typename detail::batch_spans<Signature>::inputs;
+    template <typename Signature>
+    using batch_outputs_t = typename detail::batch_spans<Signature>::outputs;
+
+    /**
+     * Calls an export once per row, with the inputs and outputs given column-wise (one span per parameter, all of the same length).
+     * Row i is function(std::get<0>(inputs)[i], ...), and its outputs are written to std::get<0>(outputs)[i], ...
+     * The rows run in a single tight loop that calls the native entry point directly, without packing or unpacking tuples.
+     * If num_threads > 1, the rows are split into contiguous chunks across up to num_threads threads (including the calling thread).
+     * The calling thread waits for all the chunks to finish.
+     * Throws std::invalid_argument (before calling anything) if the columns do not all have the same length.
+     */
+    template <typename Signature>
+    void invoke_batch(const export_function<Signature>& function, const batch_inputs_t<Signature>& inputs, const batch_outputs_t<Signature>& outputs, size_t num_threads = 1) {
+        constexpr size_t num_inputs = std::tuple_size_v<batch_inputs_t<Signature>>;
+        constexpr size_t num_outputs = std::tuple_size_v<batch_outputs_t<Signature>>;
+        static_assert(num_inputs != 0 || num_outputs != 0, "Batches need at least one input or output column to determine the number of rows!");
+        size_t num_rows;
+        if constexpr (num_inputs != 0) {
+            num_rows = std::get<0>(inputs).size();
+        }
+        else {
+            num_rows = std::get<0>(outputs).size();
+        }
+        if (!detail::columns_have_size(inputs, num_rows) || !detail::columns_have_size(outputs, num_rows)) {
+            throw std::invalid_argument("Batch columns must all have the same length!");
+        }
+
+        const auto input_data = detail::span_data(inputs, std::make_index_sequence<num_inputs>{});
+        const auto output_data = detail::span_data(outputs, std::make_index_sequence<num_outputs>{});
+        const auto entry = function.get_entry();
+        native_context* const context = function.get_context();
+        const auto run = [&](size_t begin, size_t end) {
+            detail::invoke_rows(entry, context, input_data, output_data, begin, end, std::make_index_sequence<num_inputs>{}, std::make_index_sequence<num_outputs>{});
+        };
+
+        num_threads = std::max<size_t>(1, std::min(num_threads, num_rows / detail::min_rows_per_thread));
+        if (num_threads == 1) {
+            run(0, num_rows);
+            return;
+        }
+        const size_t chunk = (num_rows + num_threads - 1) / num_threads;
+        detail::joining_threads workers;
+        workers.threads.reserve(num_threads - 1);
+        for (size_t begin = chunk; begin < num_rows; begin += chunk) {
+            workers.threads.emplace_back(run, begin, std::min(begin + chunk, num_rows));
+        }
+        run(0, std::min(chunk, num_rows));
+    }
+
+}
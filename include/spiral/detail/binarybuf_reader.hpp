@@ -1,6 +1,8 @@
 #pragma once
 
 #include <climits>
+#include <cstddef>
+#include <limits>
 #include <stdexcept>
 #include <type_traits>
 
@@ -24,7 +26,7 @@ namespace spiral {
         template <typename T>
         void read_integral(T& t) {
             t = 0;
-            read_integral_impl<0, sizeof(T) * CHAR_BIT>(reinterpret_cast<std::make_unsigned<T>&>(t));
+            read_integral_impl<0, sizeof(T) * CHAR_BIT>(reinterpret_cast<std::make_unsigned_t<T>&>(t));
         }
 
         /**
@@ -33,8 +35,19 @@ namespace spiral {
          */
         template <typename T>
         void read_varint(T& t) {
+            if (!try_read_varint(t)) {
+                throw std::out_of_range("varint too large!");
+            }
+        }
+
+        /**
+         * Like read_varint, but returns false instead of throwing if the varint is out of range for the given integer type.
+         * (The underlying binarybuf may still throw.)
+         */
+        template <typename T>
+        bool try_read_varint(T& t) {
             t = 0;
-            read_varint_impl<0, sizeof(T) * CHAR_BIT>(t);
+            return read_varint_impl<0, sizeof(T) * CHAR_BIT>(t);
         }
 
     private:
@@ -42,82 +55,80 @@ namespace spiral {
         inline void read_integral_impl(T& t) {
             static_assert(I <= N, "Asserting (I <= N) failed!");
             if constexpr (I != N) {
-                t |= ((static_cast<T>(buf.read()) << I);
+                t |= (static_cast<T>(next_byte()) << I);
                 read_integral_impl<I + CHAR_BIT, N>(t);
             }
         }
 
-        inline typename IBinaryBuf::element_type varint_byte_low_bits(typename IBinaryBuf::element_type x) {
-            return x & ~(static_cast<typename IBinaryBuf::element_type>(1) << (CHAR_BIT - 1));
+        inline uint8_t next_byte() {
+            return std::to_integer<uint8_t>(buf.read());
+        }
+
+        static inline uint8_t varint_byte_low_bits(uint8_t x) noexcept {
+            return x & ~(static_cast<uint8_t>(1) << (CHAR_BIT - 1));
         }
 
-        inline bool varint_byte_high_bit(typename IBinaryBuf::element_type x) {
-            return (x & (static_cast<typename IBinaryBuf::element_type>(1) << (CHAR_BIT - 1))) != 0;
+        static inline bool varint_byte_high_bit(uint8_t x) noexcept {
+            return (x & (static_cast<uint8_t>(1) << (CHAR_BIT - 1))) != 0;
         }
 
         template <size_t I, size_t N, typename T>
-        inline void read_varint_impl(T& t) {
+        inline bool read_varint_impl(T& t) {
             static_assert(I < N, "Asserting (I < N) failed!");
-            using unsigned_T = std::make_unsigned<T>;
+            using unsigned_T = std::make_unsigned_t<T>;
 
-            const typename IBinaryBuf::element_type nextbyte = buf.read();
+            const uint8_t nextbyte = next_byte();
 
             if constexpr (I + (CHAR_BIT - 1) <= N) { // can read the whole block of (CHAR_BIT - 1) bits
-                const typename IBinaryBuf::element_type lowbits = varint_byte_low_bits(nextbyte);
+                const uint8_t lowbits = varint_byte_low_bits(nextbyte);
                 const bool highbit = varint_byte_high_bit(nextbyte);
 
-                t |= (static_cast<unsigned_T>(lowbits) << I);
+                t |= static_cast<T>(static_cast<unsigned_T>(lowbits) << I);
                 if (!highbit) {
                     // no more bytes
                     if constexpr (std::numeric_limits<T>::is_signed && I + (CHAR_BIT - 1) < N) {
                         // the integer is signed and there is at least one unwritten character
-                        if (lowbits & (static_cast<typename IBinaryBuf::element_type>(1) << (CHAR_BIT - 2))) {
+                        if (lowbits & (static_cast<uint8_t>(1) << (CHAR_BIT - 2))) {
                             // the number is negative
                             // do sign extension:
-                            t |= ~((static_cast<unsigned_T>(1) << (I + (CHAR_BIT - 1))) - static_cast<unsigned_T>(1));
+                            t |= static_cast<T>(~((static_cast<unsigned_T>(1) << (I + (CHAR_BIT - 1))) - static_cast<unsigned_T>(1)));
                         }
                     }
                 }
                 else {
                     if constexpr (I + (CHAR_BIT - 1) < N) {
-                        read_varint_impl<I + (CHAR_BIT - 1), N>(t);
+                        return read_varint_impl<I + (CHAR_BIT - 1), N>(t);
                     }
                     else {
-                        throw std::out_of_range("varint too large!");
+                        return false;
                     }
                 }
             }
             else {
+                // expecting 0 followed by the remaining bits, then (for signed negative numbers) 1..1, or (otherwise) 0..0
+                constexpr uint8_t excessbits_bitmask = static_cast<uint8_t>(~((static_cast<uint8_t>(1) << (N - I)) - static_cast<uint8_t>(1)));
                 if constexpr (std::numeric_limits<T>::is_signed) {
-                    constexpr typename IBinaryBuf::element_type signbit_bitmask = static_cast<typename IBinaryBuf::element_type>(1) << (N - I - 1);
+                    constexpr uint8_t signbit_bitmask = static_cast<uint8_t>(1) << (N - I - 1);
                     if (nextbyte & signbit_bitmask) { // is negative number
-                        // expecting 01..1X..X
-                        constexpr typename IBinaryBuf::element_type excessbits_bitmask = ~((static_cast<typename IBinaryBuf::element_type>(1) << (N - I)) - static_cast<typename IBinaryBuf::element_type>(1));
-                        constexpr typename IBinaryBuf::element_type testbits_bitmask = ~((~excessbits_bitmask) | static_cast<typename IBinaryBuf::element_type>(1) << (CHAR_BIT - 1));
+                        constexpr uint8_t testbits_bitmask = excessbits_bitmask & ~(static_cast<uint8_t>(1) << (CHAR_BIT - 1));
                         if ((nextbyte & excessbits_bitmask) != testbits_bitmask) {
-                            throw std::out_of_range("varint too large!");
+                            return false;
                         }
                     }
                     else {
-                        // same as unsigned case
-                        // expecting 00..0X..X
-                        constexpr typename IBinaryBuf::element_type excessbits_bitmask = ~((static_cast<typename IBinaryBuf::element_type>(1) << (N - I)) - static_cast<typename IBinaryBuf::element_type>(1));
                         if (nextbyte & excessbits_bitmask) {
-                            throw std::out_of_range("varint too large!");
+                            return false;
                         }
                     }
-                    
                 }
                 else {
-                    // expecting 00..0X..X
-                    constexpr typename IBinaryBuf::element_type excessbits_bitmask = ~((static_cast<typename IBinaryBuf::element_type>(1) << (N - I)) - static_cast<typename IBinaryBuf::element_type>(1));
                     if (nextbyte & excessbits_bitmask) {
-                        throw std::out_of_range("varint too large!");
+                        return false;
                     }
                 }
-                t |= (static_cast<unsigned_T>(nextbyte) << I); // excess bits just get shifted out of the integer
+                t |= static_cast<T>(static_cast<unsigned_T>(nextbyte) << I); // excess bits just get shifted out of the integer
             }
-
+            return true;
         }
 
         IBinaryBuf& buf;
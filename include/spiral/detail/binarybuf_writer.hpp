@@ -0,0 +1,180 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/int128.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * Helper classes for writing integers and varints (the counterpart of binarybuf_reader), and for sizing them beforehand.
+ */
+
+namespace spiral {
+
+    namespace detail {
+        /**
+         * Number of leading zero bits of a nonzero value.
+         */
+        inline unsigned leading_zeros(uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_clzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanReverse64(&index, x);
+            return 63 - static_cast<unsigned>(index);
+#else
+            unsigned ret = 0;
+            for (uint64_t bit = uint64_t{ 1 } << 63; !(x & bit); bit >>= 1) ++ret;
+            return ret;
+#endif
+        }
+
+        /**
+         * Number of 7-bit groups needed for the given number of significant bits (the division by a constant compiles to a multiply).
+         */
+        constexpr size_t varint_groups(unsigned bits) noexcept {
+            return (bits + 6) / 7;
+        }
+
+        /**
+         * Number of bytes of the varint encoding of value.
+         */
+        template <typename T>
+        inline size_t varint_size(T value) noexcept {
+            static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t));
+            if constexpr (std::is_signed_v<T>) {
+                // significant bits, plus the sign bit
+                const int64_t x = static_cast<int64_t>(value);
+                return varint_groups(65 - leading_zeros(static_cast<uint64_t>(x ^ (x >> 63)) | 1));
+            }
+            else {
+                return varint_groups(64 - leading_zeros(static_cast<uint64_t>(value) | 1));
+            }
+        }
+
+        inline size_t varint_size(int128_t value) noexcept {
+            const uint64_t sign = static_cast<uint64_t>(value.get_upper() >> 63);
+            const uint64_t upper = static_cast<uint64_t>(value.get_upper()) ^ sign;
+            const uint64_t lower = value.get_lower() ^ sign;
+            if (upper != 0) return varint_groups(129 - leading_zeros(upper));
+            return varint_groups(65 - leading_zeros(lower | 1));
+        }
+    }
+
+    namespace detail {
+        template <typename OBinaryBuf, typename = void>
+        struct has_unchecked_write : std::false_type {};
+        template <typename OBinaryBuf>
+        struct has_unchecked_write<OBinaryBuf, std::void_t<decltype(std::declval<OBinaryBuf&>().available(size_t{})), decltype(std::declval<OBinaryBuf&>().write_unchecked(byte{}))>> : std::true_type {};
+    }
+
+    /**
+     * Writes integers and varints to an output binary buffer (which provides write(byte), and optionally available(size_t) and write_unchecked(byte)).
+     * The length of a varint is computed up front, so it is encoded without branching on each byte, and the space in the
+     * buffer is checked once for the whole varint.
+     */
+    template <typename OBinaryBuf, typename = std::enable_if_t<std::is_same_v<typename OBinaryBuf::element_type, byte>>>
+    class binarybuf_writer {
+
+        static_assert(CHAR_BIT == 8, "CHAR_BIT must be equal to 8!");
+        static_assert(-1 == ~0, "2's complement integers must be used!");
+
+    public:
+        binarybuf_writer(OBinaryBuf& buf) noexcept : buf(buf) {}
+
+        /**
+         * Writes t as sizeof(T) bytes, least significant first.
+         */
+        template <typename T>
+        void write_integral(T t) {
+            static_assert(std::is_integral_v<T>);
+            std::make_unsigned_t<T> bits = static_cast<std::make_unsigned_t<T>>(t);
+            byte block[sizeof(T)];
+            for (size_t i = 0; i != sizeof(T); ++i) {
+                block[i] = static_cast<byte>(bits & 0xff);
+                if constexpr (sizeof(T) > 1) bits >>= CHAR_BIT;
+            }
+            write_bytes(block, sizeof(T));
+        }
+
+        template <typename T>
+        void write_varint(T t) {
+            static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t));
+            // for signed values, the arithmetic shift keeps the sign in the last group
+            std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t> value = t;
+            const size_t size = detail::varint_size(t);
+            byte block[10];
+            for (size_t i = 0; i != size - 1; ++i) {
+                block[i] = static_cast<byte>((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            block[size - 1] = static_cast<byte>(value & 0x7f);
+            write_bytes(block, size);
+        }
+
+        void write_varint(int128_t t) {
+            uint64_t lower = t.get_lower();
+            int64_t upper = t.get_upper();
+            const size_t size = detail::varint_size(t);
+            byte block[19];
+            for (size_t i = 0; i != size - 1; ++i) {
+                block[i] = static_cast<byte>((lower & 0x7f) | 0x80);
+                lower = (lower >> 7) | (static_cast<uint64_t>(upper) << 57);
+                upper >>= 7;
+            }
+            block[size - 1] = static_cast<byte>(lower & 0x7f);
+            write_bytes(block, size);
+        }
+
+        void write_bytes(const byte* data, size_t size) {
+            if constexpr (detail::has_unchecked_write<OBinaryBuf>::value) {
+                if (buf.available(size)) {
+                    for (size_t i = 0; i != size; ++i) {
+                        buf.write_unchecked(data[i]);
+                    }
+                    return;
+                }
+            }
+            // throws when the buffer runs out
+            for (size_t i = 0; i != size; ++i) {
+                buf.write(data[i]);
+            }
+        }
+
+    private:
+        OBinaryBuf& buf;
+    };
+
+    /**
+     * Same interface as binarybuf_writer, but only adds up the number of bytes that would be written.
+     */
+    class binarybuf_sizer {
+    public:
+        template <typename T>
+        void write_integral(T) noexcept {
+            size += sizeof(T);
+        }
+
+        template <typename T>
+        void write_varint(T t) noexcept {
+            size += detail::varint_size(t);
+        }
+
+        void write_bytes(const byte*, size_t count) noexcept {
+            size += count;
+        }
+
+        size_t get_size() const noexcept { return size; }
+
+    private:
+        size_t size = 0;
+    };
+}
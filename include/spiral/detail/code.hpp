@@ -1,16 +1,42 @@
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include <spiral/detail/typeid.hpp>
 #include <spiral/detail/function.hpp>
+#include <spiral/detail/instruction.hpp>
 
 namespace spiral {
 
     class Code {
-        functionid_t functionid;
+    public:
+        Code() = default;
+        Code(functionid_t functionid, std::vector<typeid_t> locals, std::vector<Instruction> instructions, std::vector<referenceid_t> call_operands = {}) :
+            functionid(functionid), locals(std::move(locals)), instructions(std::move(instructions)), call_operands(std::move(call_operands)) {}
+
+        functionid_t get_functionid() const noexcept { return functionid; }
+        const std::vector<typeid_t>& get_locals() const noexcept { return locals; }
+        std::vector<typeid_t>& get_locals() noexcept { return locals; }
+        const std::vector<Instruction>& get_instructions() const noexcept { return instructions; }
+        std::vector<Instruction>& get_instructions() noexcept { return instructions; }
+
+        /**
+         * Operand pool of the calls in this code: each call instruction refers to the parameters of its callee (inputs, then outputs) by offset.
+         */
+        const std::vector<referenceid_t>& get_call_operands() const noexcept { return call_operands; }
+        std::vector<referenceid_t>& get_call_operands() noexcept { return call_operands; }
+
+        /**
+         * Returns the parameters of a call instruction in this code.  The pointer is invalidated when the pool grows.
+         */
+        const referenceid_t* get_call_params(const InstructionParamTypes::Call& call) const noexcept { return call_operands.data() + call.params; }
+
+    private:
+        functionid_t functionid = 0;
         std::vector<typeid_t> locals;
         std::vector<Instruction> instructions;
+        std::vector<referenceid_t> call_operands;
     };
 
 }
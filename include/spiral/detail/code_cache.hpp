@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SPIRAL_CODE_CACHE_POSIX
+#endif
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/hash.hpp>
+#include <spiral/detail/span.hpp>
+
+/**
+ * Persistent on-disk cache of compiled code.
+ *
+ * Each cache file holds the compiled code of one function: the machine code, its relocations, and opaque backend metadata.
+ * (The AOT backend, which builds whole modules, stores the shared object of a module as one entry; see aot_load_cached.)
+ * Files are named by a key, which is a hash of the function's Code bytes seeded with the environment (CPU features and
+ * compiler version), so a cache directory can be shared between different machines and compiler builds.
+ * Files are written atomically (written to a temporary file and renamed into place), looked up by mmap, and evicted in
+ * least-recently-used order (by modification time, which is refreshed on every hit) when the directory exceeds its size bound.
+ * Only local filesystems are supported (rename and mmap semantics are not reliable on network filesystems).
+ * On platforms other than POSIX, the cache is always empty.
+ */
+
+namespace spiral {
+
+    /**
+     * A location in compiled code that has to be patched when the code is loaded.  The meaning of kind and target is up to the backend.
+     */
+    struct code_relocation {
+        uint32_t offset;
+        uint32_t kind;
+        uint64_t target;
+    };
+
+    /**
+     * Compiled code of one function, to be stored in the cache.
+     */
+    struct compiled_code {
+        span<const byte> code;
+        span<const code_relocation> relocations;
+        span<const byte> metadata;
+    };
+
+    namespace detail {
+
+        struct code_cache_header {
+            char magic[8];
+            uint64_t key;
+            uint64_t environment;
+            uint64_t code_offset;
+            uint64_t code_size;
+            uint64_t num_relocations;
+            uint64_t metadata_size;
+        };
+
+        constexpr char code_cache_magic[8] = { 'S', 'P', 'R', 'L', 'C', 'C', '\0', '\1' };
+        constexpr std::string_view code_cache_extension = ".spc";
+
+        /**
+         * The code starts on its own page, so that a backend may map it executable in place.
+         */
+        constexpr uint64_t code_cache_alignment = 4096;
+
+        constexpr uint64_t align_up(uint64_t value, uint64_t alignment) noexcept {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        /**
+         * Bitmask of the CPU features that compiled code may depend on.
+         */
+        inline uint64_t cpu_features() noexcept {
+            uint64_t ret = 0;
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            __builtin_cpu_init();
+            size_t bit = 0;
+            for (const bool supported : { __builtin_cpu_supports("sse4.2") != 0, __builtin_cpu_supports("popcnt") != 0, __builtin_cpu_supports("avx") != 0, __builtin_cpu_supports("avx2") != 0, __builtin_cpu_supports("bmi") != 0, __builtin_cpu_supports("bmi2") != 0, __builtin_cpu_supports("fma") != 0, __builtin_cpu_supports("avx512f") != 0 }) {
+                ret |= static_cast<uint64_t>(supported) << bit++;
+            }
+#endif
+            return ret;
+        }
+    }
+
+    /**
+     * Cached compiled code of one function, mapped read-only into memory.  The spans are valid as long as this object.
+     */
+    class cached_code {
+    public:
+        cached_code(cached_code&& other) noexcept : mapping(std::exchange(other.mapping, nullptr)), mapping_size(std::exchange(other.mapping_size, 0)) {}
+        cached_code& operator=(cached_code&& other) noexcept {
+            std::swap(mapping, other.mapping);
+            std::swap(mapping_size, other.mapping_size);
+            return *this;
+        }
+        ~cached_code() {
+#ifdef SPIRAL_CODE_CACHE_POSIX
+            if (mapping != nullptr) munmap(mapping, mapping_size);
+#endif
+        }
+
+        span<const byte> get_code() const noexcept {
+            return span<const byte>(base() + header().code_offset, header().code_size);
+        }
+        span<const code_relocation> get_relocations() const noexcept {
+            return span<const code_relocation>(reinterpret_cast<const code_relocation*>(base() + relocations_offset(header())), header().num_relocations);
+        }
+        span<const byte> get_metadata() const noexcept {
+            return span<const byte>(base() + metadata_offset(header()), header().metadata_size);
+        }
+
+    private:
+        friend class code_cache;
+
+        cached_code(void* mapping, size_t mapping_size) noexcept : mapping(mapping), mapping_size(mapping_size) {}
+
+        const byte* base() const noexcept { return static_cast<const byte*>(mapping); }
+        const detail::code_cache_header& header() const noexcept { return *static_cast<const detail::code_cache_header*>(mapping); }
+
+        static uint64_t relocations_offset(const detail::code_cache_header& header) noexcept {
+            return detail::align_up(header.code_offset + header.code_size, alignof(code_relocation));
+        }
+        static uint64_t metadata_offset(const detail::code_cache_header& header) noexcept {
+            return relocations_offset(header) + header.num_relocations * sizeof(code_relocation);
+        }
+
+        void* mapping;
+        size_t mapping_size;
+    };
+
+    /**
+     * A cache directory, bounded to max_bytes (of cache files) on disk.
+     * Several processes may use the same directory at the same time.  Failures never throw; they behave like cache misses.
+     */
+    class code_cache {
+    public:
+        code_cache(std::filesystem::path directory, uint64_t max_bytes, std::string_view compiler_version) : directory(std::move(directory)), max_bytes(max_bytes) {
+            const uint64_t features = detail::cpu_features();
+            environment = hash_bytes(reinterpret_cast<const byte*>(compiler_version.data()), compiler_version.size(), features);
+            std::error_code ec;
+            std::filesystem::create_directories(this->directory, ec);
+        }
+
+        /**
+         * Returns the key for the given Code bytes in this environment.
+         */
+        uint64_t make_key(span<const byte> code_bytes) const noexcept {
+            return hash_bytes(code_bytes.data(), code_bytes.size(), environment);
+        }
+
+        /**
+         * Maps the cached code with the given key, or returns nullopt if it is not in the cache (or the cached file is invalid).
+         */
+        std::optional<cached_code> lookup(uint64_t key) const {
+#ifdef SPIRAL_CODE_CACHE_POSIX
+            const std::string path = path_of(key).string();
+            const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) return std::nullopt;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(detail::code_cache_header)) {
+                close(fd);
+                return std::nullopt;
+            }
+            const size_t size = static_cast<size_t>(st.st_size);
+            void* const mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) return std::nullopt;
+            cached_code ret(mapping, size);
+            if (!is_valid(ret.header(), key, size)) return std::nullopt;
+            utimensat(AT_FDCWD, path.c_str(), nullptr, 0); // mark as recently used
+            return ret;
+#else
+            (void)key;
+            return std::nullopt;
+#endif
+        }
+
+        /**
+         * Stores compiled code with the given key (atomically replacing any existing entry), then evicts entries if the cache is over its size bound.
+         * Returns whether the code was stored.
+         */
+        bool store(uint64_t key, const compiled_code& compiled) {
+#ifdef SPIRAL_CODE_CACHE_POSIX
+            detail::code_cache_header header;
+            std::memcpy(header.magic, detail::code_cache_magic, sizeof(header.magic));
+            header.key = key;
+            header.environment = environment;
+            header.code_offset = detail::code_cache_alignment;
+            header.code_size = compiled.code.size();
+            header.num_relocations = compiled.relocations.size();
+            header.metadata_size = compiled.metadata.size();
+
+            std::vector<byte> contents(cached_code::metadata_offset(header) + header.metadata_size);
+            std::memcpy(contents.data(), &header, sizeof(header));
+            std::copy(compiled.code.begin(), compiled.code.end(), contents.begin() + header.code_offset);
+            if (!compiled.relocations.empty()) {
+                std::memcpy(contents.data() + cached_code::relocations_offset(header), compiled.relocations.data(), compiled.relocations.size() * sizeof(code_relocation));
+            }
+            std::copy(compiled.metadata.begin(), compiled.metadata.end(), contents.begin() + cached_code::metadata_offset(header));
+
+            static std::atomic<uint64_t> counter{ 0 };
+            const std::filesystem::path final_path = path_of(key);
+            const std::string temp_path = final_path.string() + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++);
+            const int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd == -1) return false;
+            bool ok = write_all(fd, contents.data(), contents.size()) && fsync(fd) == 0;
+            ok = close(fd) == 0 && ok;
+            if (!ok || rename(temp_path.c_str(), final_path.c_str()) != 0) {
+                unlink(temp_path.c_str());
+                return false;
+            }
+            evict();
+            return true;
+#else
+            (void)key;
+            (void)compiled;
+            return false;
+#endif
+        }
+
+        /**
+         * Removes least recently used entries until the cache is within its size bound.
+         */
+        void evict() const {
+            struct entry {
+                std::filesystem::file_time_type last_used;
+                uint64_t size;
+                std::filesystem::path path;
+            };
+            std::vector<entry> entries;
+            uint64_t total = 0;
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+                if (it->path().extension() != detail::code_cache_extension) continue;
+                std::error_code entry_ec;
+                const uint64_t size = it->file_size(entry_ec);
+                const auto last_used = it->last_write_time(entry_ec);
+                if (entry_ec) continue;
+                entries.push_back({ last_used, size, it->path() });
+                total += size;
+            }
+            if (total <= max_bytes) return;
+            std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) { return a.last_used < b.last_used; });
+            for (const entry& e : entries) {
+                if (total <= max_bytes) break;
+                if (std::filesystem::remove(e.path, ec)) total -= e.size;
+            }
+        }
+
+        const std::filesystem::path& get_directory() const noexcept { return directory; }
+        uint64_t get_max_bytes() const noexcept { return max_bytes; }
+        uint64_t get_environment() const noexcept { return environment; }
+
+    private:
+        std::filesystem::path path_of(uint64_t key) const {
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string name(16, '0');
+            for (size_t i = 16; i-- != 0; key >>= 4) {
+                name[i] = digits[key & 0xf];
+            }
+            name += detail::code_cache_extension;
+            return directory / name;
+        }
+
+        bool is_valid(const detail::code_cache_header& header, uint64_t key, uint64_t size) const noexcept {
+            if (std::memcmp(header.magic, detail::code_cache_magic, sizeof(header.magic)) != 0) return false;
+            if (header.key != key || header.environment != environment) return false;
+            if (header.code_offset < sizeof(header) || header.code_offset > size || header.code_size > size - header.code_offset) return false;
+            if (header.num_relocations > size / sizeof(code_relocation)) return false;
+            return cached_code::metadata_offset(header) <= size && header.metadata_size == size - cached_code::metadata_offset(header);
+        }
+
+#ifdef SPIRAL_CODE_CACHE_POSIX
+        static bool write_all(int fd, const byte* data, size_t size) noexcept {
+            while (size != 0) {
+                const ssize_t written = write(fd, data, size);
+                if (written <= 0) return false;
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+#endif
+
+        std::filesystem::path directory;
+        uint64_t max_bytes;
+        uint64_t environment;
+    };
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/global_layout.hpp>
+#include <spiral/detail/pc_table.hpp>
+#include <spiral/detail/native_abi.hpp>
+
+namespace spiral {
+
+    /**
+     * A decoded module together with the entry points of its compiled functions.
+     *
+     * Backends install entry points while preparing it.  Afterwards it is shared as std::shared_ptr<const CompiledModule>
+     * by every Instance of the module, so instantiation does not copy anything whose size depends on the module.
+     */
+    class CompiledModule {
+    public:
+        explicit CompiledModule(std::shared_ptr<const Module> module) : module(std::move(module)), entries(this->module->get_functions().size(), nullptr), globals(this->module->get_globals()) {}
+        explicit CompiledModule(Module&& module) : CompiledModule(std::make_shared<const Module>(std::move(module))) {}
+
+        CompiledModule(const CompiledModule&) = delete;
+        CompiledModule& operator=(const CompiledModule&) = delete;
+
+        /**
+         * Sets the compiled entry point of a function (which must follow the native calling convention).
+         */
+        void set_entry(functionid_t functionid, native_function_t entry) noexcept {
+            entries[functionid - 1] = entry;
+        }
+
+        native_function_t get_entry(functionid_t functionid) const noexcept {
+            return entries[functionid - 1];
+        }
+
+        /**
+         * Records where the code of a function lives, so that native PCs can be mapped back to it (see pc_table).
+         */
+        void add_code(uintptr_t start, size_t size, functionid_t functionid) {
+            pcs.add(start, size, functionid);
+        }
+
+        /**
+         * Keeps the given object (e.g. the shared object or executable memory that holds the entry points) alive as long as this module.
+         */
+        void add_owner(std::shared_ptr<const void> owner) {
+            owners.push_back(std::move(owner));
+        }
+
+        const Module& get_module() const noexcept { return *module; }
+        const std::shared_ptr<const Module>& get_shared_module() const noexcept { return module; }
+        const global_layout& get_global_layout() const noexcept { return globals; }
+        const pc_table& get_pc_table() const noexcept { return pcs; }
+
+        /**
+         * Returns Module::content_hash of the module, computed on first use (e.g. to match snapshots to the module).
+         */
+        uint64_t get_content_hash() const {
+            std::call_once(content_hash_once, [this] { content_hash = module->content_hash(); });
+            return content_hash;
+        }
+
+    private:
+        std::shared_ptr<const Module> module;
+        std::vector<native_function_t> entries; // indexed by functionid - 1; nullptr if not compiled
+        std::vector<std::shared_ptr<const void>> owners;
+        global_layout globals;
+        pc_table pcs;
+        mutable std::once_flag content_hash_once;
+        mutable uint64_t content_hash = 0;
+    };
+
+}
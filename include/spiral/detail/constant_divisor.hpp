@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cassert>
+#include <climits>
+#include <type_traits>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/wide_arithmetic.hpp>
+
+/**
+ * Strength reduction of division by an invariant integer (div/divu/divex/divuex with a constant divisor).
+ * The divisor is preprocessed once into a magic multiplier and shift (Granlund and Montgomery), so that every division
+ * afterwards is a multiply-high followed by shifts and at most one add, and never a hardware divide.
+ * The fields are exposed so that a code generator can emit the same sequence inline.
+ */
+
+namespace spiral {
+
+    namespace detail {
+
+        constexpr unsigned floor_log2(uint64_t x) noexcept {
+            assert(x != 0);
+            unsigned ret = 0;
+            while (x >>= 1) ++ret;
+            return ret;
+        }
+
+        /**
+         * Returns the upper half of the full product of a and b.
+         */
+        template <typename T>
+        inline T mulhi(T a, T b) noexcept {
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                return static_cast<T>(mulex<T>(a, b).get_upper());
+            }
+            else {
+                return static_cast<T>(mulex<T>(a, b) >> (sizeof(T) * CHAR_BIT));
+            }
+        }
+
+        /**
+         * Returns floor((hi * 2^N) / d) and the remainder, where N is the width of T.  Requires hi < d.
+         */
+        template <typename T>
+        inline divex_result<T> divide_shifted(T hi, T d) noexcept {
+            static_assert(std::is_unsigned_v<T>);
+            assert(hi < d);
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                return divex<uint64_t>(uint128_t(0, hi), d);
+            }
+            else {
+                return divex<T>(static_cast<widened_t<T>>(static_cast<widened_t<T>>(hi) << (sizeof(T) * CHAR_BIT)), d);
+            }
+        }
+    }
+
+    /**
+     * Precomputed divisor for dividing integers of type T (any of the 8- to 64-bit integer types) by a constant.
+     * Rounds towards zero, like div/divu.
+     */
+    template <typename T>
+    class constant_divisor {
+        static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t), "constant_divisor requires an integral type of at most 64 bits!");
+        using unsigned_T = std::make_unsigned_t<T>;
+        static constexpr unsigned width = sizeof(T) * CHAR_BIT;
+
+    public:
+        explicit constant_divisor(T divisor) noexcept : divisor(divisor) {
+            assert(divisor != 0);
+            const unsigned_T abs_divisor = (std::is_signed_v<T> && divisor < 0) ? static_cast<unsigned_T>(~static_cast<unsigned_T>(divisor) + 1) : static_cast<unsigned_T>(divisor);
+            const unsigned floor_log2_divisor = detail::floor_log2(abs_divisor);
+            negative = std::is_signed_v<T> && divisor < 0;
+            if ((abs_divisor & (abs_divisor - 1)) == 0) {
+                // power of two: a shift is enough
+                magic = 0;
+                shift = floor_log2_divisor;
+                add = false;
+                return;
+            }
+            // signed division has one less bit of dividend magnitude, so it needs one less bit of precision
+            const unsigned precision_shift = std::is_signed_v<T> ? floor_log2_divisor - 1 : floor_log2_divisor;
+            const divex_result<unsigned_T> proposed = detail::divide_shifted<unsigned_T>(static_cast<unsigned_T>(static_cast<unsigned_T>(1) << precision_shift), abs_divisor);
+            unsigned_T proposed_magic = proposed.quotient;
+            const unsigned_T error = abs_divisor - proposed.remainder;
+            if (error < static_cast<unsigned_T>(static_cast<unsigned_T>(1) << floor_log2_divisor)) {
+                // this power works
+                shift = precision_shift;
+                add = false;
+            }
+            else {
+                // need one more bit of magic than fits in T, so we add the dividend back after the multiplication
+                proposed_magic += proposed_magic;
+                const unsigned_T twice_remainder = proposed.remainder + proposed.remainder;
+                if (twice_remainder >= abs_divisor || twice_remainder < proposed.remainder) {
+                    proposed_magic += 1;
+                }
+                shift = floor_log2_divisor;
+                add = true;
+            }
+            proposed_magic += 1;
+            magic = (std::is_signed_v<T> && negative) ? static_cast<unsigned_T>(~proposed_magic + 1) : proposed_magic;
+        }
+
+        inline T quotient(T dividend) const noexcept {
+            if constexpr (std::is_signed_v<T>) {
+                const unsigned_T sign = negative ? ~static_cast<unsigned_T>(0) : 0;
+                if (magic == 0) {
+                    // round towards zero by biasing negative dividends before the arithmetic shift
+                    const unsigned_T mask = static_cast<unsigned_T>((static_cast<unsigned_T>(1) << shift) - 1);
+                    const unsigned_T biased = static_cast<unsigned_T>(static_cast<unsigned_T>(dividend) + (static_cast<unsigned_T>(dividend >> (width - 1)) & mask));
+                    const T q = static_cast<T>(static_cast<T>(biased) >> shift);
+                    return static_cast<T>((static_cast<unsigned_T>(q) ^ sign) - sign);
+                }
+                unsigned_T uq = static_cast<unsigned_T>(detail::mulhi<T>(static_cast<T>(magic), dividend));
+                if (add) {
+                    uq = static_cast<unsigned_T>(uq + ((static_cast<unsigned_T>(dividend) ^ sign) - sign));
+                }
+                T q = static_cast<T>(static_cast<T>(uq) >> shift);
+                q = static_cast<T>(q + (q < 0 ? 1 : 0));
+                return q;
+            }
+            else {
+                if (magic == 0) {
+                    return static_cast<T>(dividend >> shift);
+                }
+                const T q = detail::mulhi<T>(magic, dividend);
+                if (add) {
+                    return static_cast<T>((static_cast<T>(static_cast<T>(dividend - q) >> 1) + q) >> shift);
+                }
+                return static_cast<T>(q >> shift);
+            }
+        }
+
+        inline T remainder(T dividend) const noexcept {
+            return static_cast<T>(static_cast<unsigned_T>(dividend) - static_cast<unsigned_T>(quotient(dividend)) * static_cast<unsigned_T>(divisor));
+        }
+
+        inline divex_result<T> divide(T dividend) const noexcept {
+            const T q = quotient(dividend);
+            return { q, static_cast<T>(static_cast<unsigned_T>(dividend) - static_cast<unsigned_T>(q) * static_cast<unsigned_T>(divisor)) };
+        }
+
+        T get_divisor() const noexcept { return divisor; }
+        unsigned_T get_magic() const noexcept { return magic; }
+        unsigned get_shift() const noexcept { return shift; }
+        bool is_add() const noexcept { return add; }
+        bool is_negative() const noexcept { return negative; }
+
+    private:
+        T divisor;
+        unsigned_T magic; // zero if the divisor is a power of two
+        unsigned shift;
+        bool add;
+        bool negative;
+    };
+
+    /**
+     * Precomputed divisor for divex/divuex: divides an integer of twice the width of T by a constant of type T.
+     * Undefined behaviour if the quotient does not fit in T (same as divex/divuex).
+     * For narrow types this is a constant_divisor of the wider type; for 64-bit divisors it uses a precomputed
+     * reciprocal of the normalized divisor (Moller and Granlund), i.e. two multiplications and a few adds.
+     * The reciprocal fields (meaningful for 64-bit divisors only) are exposed for code generators, like those of constant_divisor.
+     */
+    template <typename T>
+    class constant_divisor_ex {
+        static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(uint64_t), "constant_divisor_ex requires an integral type of at most 64 bits!");
+
+    public:
+        explicit constant_divisor_ex(T divisor) noexcept : narrow_divisor(divisor) {
+            assert(divisor != 0);
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                const uint64_t abs_divisor = (std::is_signed_v<T> && divisor < 0) ? ~static_cast<uint64_t>(divisor) + 1 : static_cast<uint64_t>(divisor);
+                normalization_shift = 63 - detail::floor_log2(abs_divisor);
+                normalized_divisor = abs_divisor << normalization_shift;
+                // reciprocal = floor((2^128 - 1) / normalized_divisor) - 2^64
+                reciprocal = divex<uint64_t>(uint128_t(~static_cast<uint64_t>(0), ~normalized_divisor), normalized_divisor).quotient;
+            }
+        }
+
+        inline divex_result<T> divide(widened_t<T> dividend) const noexcept {
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                if constexpr (std::is_signed_v<T>) {
+                    // divide the magnitudes, then fix up the signs (truncating division)
+                    const bool negative_dividend = dividend.get_upper() < 0;
+                    uint64_t hi = static_cast<uint64_t>(dividend.get_upper());
+                    uint64_t lo = dividend.get_lower();
+                    if (negative_dividend) {
+                        lo = ~lo + 1;
+                        hi = ~hi + (lo == 0 ? 1 : 0);
+                    }
+                    const divex_result<uint64_t> res = divide_unsigned(hi, lo);
+                    const bool negative_quotient = negative_dividend != (narrow_divisor < 0);
+                    return { static_cast<T>(negative_quotient ? ~res.quotient + 1 : res.quotient), static_cast<T>(negative_dividend ? ~res.remainder + 1 : res.remainder) };
+                }
+                else {
+                    return divide_unsigned(dividend.get_upper(), dividend.get_lower());
+                }
+            }
+            else {
+                const divex_result<widened_t<T>> res = wide_divisor.divide(dividend);
+                return { static_cast<T>(res.quotient), static_cast<T>(res.remainder) };
+            }
+        }
+
+        T get_divisor() const noexcept { return narrow_divisor; }
+        uint64_t get_normalized_divisor() const noexcept { return normalized_divisor; }
+        uint64_t get_reciprocal() const noexcept { return reciprocal; }
+        unsigned get_normalization_shift() const noexcept { return normalization_shift; }
+
+    private:
+        /**
+         * Divides (hi:lo) by the (absolute value of the) divisor using the precomputed reciprocal.  Requires hi < divisor.
+         */
+        inline divex_result<uint64_t> divide_unsigned(uint64_t hi, uint64_t lo) const noexcept {
+            if (normalization_shift != 0) {
+                hi = (hi << normalization_shift) | (lo >> (64 - normalization_shift));
+                lo <<= normalization_shift;
+            }
+            const uint128_t product = mulex<uint64_t>(reciprocal, hi);
+            const uint64_t q0 = product.get_lower() + lo;
+            uint64_t q1 = product.get_upper() + hi + 1 + (q0 < lo ? 1 : 0);
+            uint64_t r = lo - q1 * normalized_divisor;
+            if (r > q0) {
+                --q1;
+                r += normalized_divisor;
+            }
+            if (r >= normalized_divisor) {
+                ++q1;
+                r -= normalized_divisor;
+            }
+            return { q1, r >> normalization_shift };
+        }
+
+        struct empty {};
+        T narrow_divisor;
+        std::conditional_t<sizeof(T) == sizeof(uint64_t), empty, constant_divisor<widened_t<T>>> wide_divisor{ wide_divisor_init(narrow_divisor) };
+        uint64_t normalized_divisor = 0;
+        uint64_t reciprocal = 0;
+        unsigned normalization_shift = 0;
+
+        static auto wide_divisor_init(T divisor) noexcept {
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                return empty{};
+            }
+            else {
+                return constant_divisor<widened_t<T>>(static_cast<widened_t<T>>(divisor));
+            }
+        }
+    };
+
+}
@@ -0,0 +1,768 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/instruction.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/telemetry.hpp>
+
+/**
+ * Conditional constant propagation and folding.
+ *
+ * Spiral code is not in SSA form, so this uses the data-flow formulation of Wegman and Zadeck's conditional constant
+ * propagation: every variable gets a lattice value (constant or overdefined) at the entry of each block, and only edges
+ * that can actually be taken (given what is known about the branch conditions) propagate values.  This finds the same
+ * constants as SCCP, at the cost of one environment per reachable block.
+ *
+ * Only primitive variables of at most 64 bits are tracked; all arithmetic follows the exact wraparound semantics of
+ * the width in the instruction.  Operations that are undefined behaviour (e.g. division by zero) are never folded.
+ */
+
+namespace spiral {
+
+    struct constant_propagation_result {
+        size_t instructions_folded = 0; // instructions replaced by imm or jmp
+        size_t instructions_removed = 0; // including the instructions of removed blocks
+        size_t blocks_removed = 0;
+    };
+
+    namespace detail {
+
+        /**
+         * Skip the analysis if the block environments would exceed this many entries.
+         */
+        constexpr size_t constant_propagation_max_environment = static_cast<size_t>(1) << 20;
+
+        struct lattice_value {
+            bool constant;
+            uint64_t bits;
+
+            static lattice_value make_constant(uint64_t bits) noexcept { return { true, bits }; }
+            static lattice_value make_overdefined() noexcept { return { false, 0 }; }
+
+            /**
+             * Meets other into this value, and returns true if this value changed.
+             */
+            bool meet(const lattice_value& other) noexcept {
+                if (constant && (!other.constant || other.bits != bits)) {
+                    constant = false;
+                    bits = 0;
+                    return true;
+                }
+                return false;
+            }
+        };
+
+        constexpr uint64_t width_mask(size_t width) noexcept {
+            return width >= 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << width) - 1;
+        }
+
+        constexpr int64_t sign_extend(uint64_t bits, size_t width) noexcept {
+            return width >= 64 ? static_cast<int64_t>(bits) : static_cast<int64_t>(bits << (64 - width)) >> (64 - width);
+        }
+
+        constexpr size_t count_ones(uint64_t bits) noexcept {
+            size_t ret = 0;
+            for (; bits != 0; bits &= bits - 1) ++ret;
+            return ret;
+        }
+
+        constexpr size_t count_leading_zeros(uint64_t bits, size_t width) noexcept {
+            size_t ret = 0;
+            for (size_t i = width; i-- > 0 && !((bits >> i) & 1);) ++ret;
+            return ret;
+        }
+
+        constexpr size_t count_trailing_zeros(uint64_t bits, size_t width) noexcept {
+            size_t ret = 0;
+            for (size_t i = 0; i < width && !((bits >> i) & 1); ++i) ++ret;
+            return ret;
+        }
+
+        inline uint64_t float_to_bits(double value, size_t width) noexcept {
+            if (width == 32) {
+                const float f = static_cast<float>(value);
+                uint32_t ret;
+                std::memcpy(&ret, &f, sizeof(ret));
+                return ret;
+            }
+            uint64_t ret;
+            std::memcpy(&ret, &value, sizeof(ret));
+            return ret;
+        }
+
+        inline double bits_to_float(uint64_t bits, size_t width) noexcept {
+            if (width == 32) {
+                const uint32_t narrow = static_cast<uint32_t>(bits);
+                float f;
+                std::memcpy(&f, &narrow, sizeof(f));
+                return f;
+            }
+            double ret;
+            std::memcpy(&ret, &bits, sizeof(ret));
+            return ret;
+        }
+
+        inline uint64_t immediate_bits(const InstructionParamTypes::Immediate& params) noexcept {
+            switch (primitive_width(static_cast<typeid_underlying_t>(params.type))) {
+            case 8:
+                return static_cast<uint8_t>(params.value.i8);
+            case 16:
+                return static_cast<uint16_t>(params.value.i16);
+            case 32:
+                return static_cast<uint32_t>(params.value.i32);
+            default:
+                return static_cast<uint64_t>(params.value.i64);
+            }
+        }
+
+        inline InstructionParamTypes::any_signed_integral make_immediate_value(uint64_t bits, size_t width) noexcept {
+            InstructionParamTypes::any_signed_integral ret;
+            switch (width) {
+            case 8:
+                ret.i8 = static_cast<int8_t>(bits);
+                break;
+            case 16:
+                ret.i16 = static_cast<int16_t>(bits);
+                break;
+            case 32:
+                ret.i32 = static_cast<int32_t>(bits);
+                break;
+            default:
+                ret.i64 = static_cast<int64_t>(bits);
+                break;
+            }
+            return ret;
+        }
+
+        /**
+         * Folds conv/convu/reinterpret.  Conversions involving floats are only folded if they are exact, so the result never depends on the rounding mode.
+         */
+        inline std::optional<uint64_t> fold_conversion(opcode_t opcode, typeid_primitive_t operand_type, typeid_primitive_t result_type, uint64_t bits) noexcept {
+            const typeid_underlying_t from = static_cast<typeid_underlying_t>(operand_type);
+            const typeid_underlying_t to = static_cast<typeid_underlying_t>(result_type);
+            const size_t from_width = primitive_width(from);
+            const size_t to_width = primitive_width(to);
+            if (opcode == opcode_t::REINTERPRET) {
+                if (from_width != to_width) return std::nullopt;
+                return bits;
+            }
+            const bool is_signed = is_signed_instruction(opcode);
+            if (is_integral_typeid(from) && is_integral_typeid(to)) {
+                const uint64_t extended = is_signed ? static_cast<uint64_t>(sign_extend(bits, from_width)) : bits;
+                return extended & width_mask(to_width);
+            }
+            if (is_integral_typeid(from)) {
+                // integer to float
+                double value;
+                if (is_signed) {
+                    const int64_t integer = sign_extend(bits, from_width);
+                    value = static_cast<double>(integer);
+                    if (value >= 0x1p63 || static_cast<int64_t>(value) != integer) return std::nullopt;
+                }
+                else {
+                    value = static_cast<double>(bits);
+                    if (value >= 0x1p64 || static_cast<uint64_t>(value) != bits) return std::nullopt;
+                }
+                if (to_width == 32 && static_cast<double>(static_cast<float>(value)) != value) return std::nullopt;
+                return float_to_bits(value, to_width);
+            }
+            const double value = bits_to_float(bits, from_width);
+            if (std::isnan(value)) return std::nullopt;
+            if (is_float_typeid(to)) {
+                if (to_width == 32 && std::isfinite(value) && static_cast<double>(static_cast<float>(value)) != value) return std::nullopt;
+                return float_to_bits(value, to_width);
+            }
+            // float to integer
+            if (!std::isfinite(value) || std::trunc(value) != value) return std::nullopt;
+            if (is_signed) {
+                const double limit = std::ldexp(1.0, static_cast<int>(to_width) - 1);
+                if (value < -limit || value >= limit) return std::nullopt;
+                return static_cast<uint64_t>(static_cast<int64_t>(value)) & width_mask(to_width);
+            }
+            if (value < 0 || value >= std::ldexp(1.0, static_cast<int>(to_width))) return std::nullopt;
+            return static_cast<uint64_t>(value);
+        }
+
+        inline std::optional<uint64_t> fold_two_operand(opcode_t opcode, size_t width, uint64_t a, uint64_t b) noexcept {
+            const uint64_t mask = width_mask(width);
+            switch (opcode) {
+            case opcode_t::SLT:
+                return sign_extend(a, width) < sign_extend(b, width) ? 1 : 0;
+            case opcode_t::SLTU:
+                return a < b ? 1 : 0;
+            case opcode_t::SEQ:
+                return a == b ? 1 : 0;
+            case opcode_t::ADD:
+            case opcode_t::ADDU:
+                return (a + b) & mask;
+            case opcode_t::SUB:
+            case opcode_t::SUBU:
+                return (a - b) & mask;
+            case opcode_t::MUL:
+            case opcode_t::MULU:
+                return (a * b) & mask;
+            case opcode_t::DIV: {
+                const int64_t dividend = sign_extend(a, width);
+                const int64_t divisor = sign_extend(b, width);
+                if (divisor == 0 || (divisor == -1 && a == (static_cast<uint64_t>(1) << (width - 1)))) return std::nullopt;
+                return static_cast<uint64_t>(dividend / divisor) & mask;
+            }
+            case opcode_t::DIVU:
+                if (b == 0) return std::nullopt;
+                return a / b;
+            case opcode_t::AND:
+                return a & b;
+            case opcode_t::OR:
+                return a | b;
+            case opcode_t::XOR:
+                return a ^ b;
+            default:
+                return std::nullopt;
+            }
+        }
+
+        inline std::optional<uint64_t> fold_shift(opcode_t opcode, size_t width, uint64_t a, uint64_t shamt) noexcept {
+            const uint64_t mask = width_mask(width);
+            switch (opcode) {
+            case opcode_t::SLL:
+                if (shamt >= width) return std::nullopt;
+                return (a << shamt) & mask;
+            case opcode_t::SRL:
+                if (shamt >= width) return std::nullopt;
+                return a >> shamt;
+            case opcode_t::SRA:
+                if (shamt >= width) return std::nullopt;
+                return static_cast<uint64_t>(sign_extend(a, width) >> shamt) & mask;
+            case opcode_t::ROTL:
+            case opcode_t::ROTR: {
+                shamt %= width;
+                if (shamt == 0) return a;
+                if (opcode == opcode_t::ROTR) shamt = width - shamt;
+                return ((a << shamt) | (a >> (width - shamt))) & mask;
+            }
+            default:
+                return std::nullopt;
+            }
+        }
+
+        /**
+         * The data-flow analysis: the lattice values at the entry of every reachable block, and the effect of each instruction on them.
+         */
+        class constant_analysis {
+        public:
+            constant_analysis(const Code& code, const std::vector<Function>& functions) : code(code), functions(functions), function(functions[code.get_functionid() - 1]) {
+                num_params = static_cast<variableid_t>(function.get_inputs().size() + function.get_outputs().size());
+                variable_widths.resize(num_params + 1 + code.get_locals().size(), 0);
+                for (size_t i = 0; i != function.get_inputs().size(); ++i) {
+                    set_variable_width(-1 - static_cast<variableid_t>(i), function.get_inputs()[i]);
+                }
+                for (size_t i = 0; i != function.get_outputs().size(); ++i) {
+                    set_variable_width(-1 - static_cast<variableid_t>(function.get_inputs().size() + i), function.get_outputs()[i]);
+                }
+                for (size_t i = 0; i != code.get_locals().size(); ++i) {
+                    set_variable_width(static_cast<variableid_t>(i + 1), code.get_locals()[i]);
+                }
+            }
+
+            /**
+             * Returns, for every div/divu/divex/divuex whose divisor is the same nonzero constant on every path that reaches
+             * it, the bits of the divisor (indexed by instructionid; nothing for every other instruction).
+             */
+            std::vector<std::optional<uint64_t>> constant_divisors() {
+                namespace P = InstructionParamTypes;
+                const std::vector<Instruction>& instructions = code.get_instructions();
+                std::vector<std::optional<uint64_t>> ret(instructions.size());
+                if (!prepare()) return ret;
+                for (size_t block = 0; block != block_begins.size(); ++block) {
+                    if (!block_entries[block]) continue;
+                    std::vector<lattice_value> env = *block_entries[block];
+                    for (instructionid_t i = block_begins[block]; i != block_end(block); ++i) {
+                        const Instruction& instruction = instructions[i];
+                        instruction.get_params([&](const auto& params) {
+                            using params_type = std::decay_t<decltype(params)>;
+                            if constexpr (std::is_same_v<params_type, P::Divide> || std::is_same_v<params_type, P::DivEx>) {
+                                const lattice_value divisor = read(params.divisor, env);
+                                if (divisor.constant && divisor.bits != 0) ret[i] = divisor.bits;
+                            }
+                        });
+                        if (!is_jump_conditional_instruction(instruction.get_opcode())) transfer(instruction, env);
+                    }
+                }
+                return ret;
+            }
+
+        protected:
+            /**
+             * Finds the blocks and runs the analysis.  Returns false if there is nothing to analyze, or too much.
+             */
+            bool prepare() {
+                if (code.get_instructions().empty()) return false;
+                build_blocks();
+                if (block_begins.size() * variable_widths.size() > constant_propagation_max_environment) return false;
+                analyze();
+                return true;
+            }
+
+            struct folded_value {
+                referenceid_t result;
+                typeid_primitive_t type;
+                uint64_t bits;
+            };
+
+            void set_variable_width(variableid_t variableid, const typeid_t& type) {
+                if (type.is_primitive() && primitive_width(type.get_typeid()) <= 64) {
+                    variable_widths[variableid + num_params] = primitive_width(type.get_typeid());
+                }
+            }
+
+            /**
+             * Returns the slot of a tracked variable, if the reference refers to a whole tracked variable.
+             */
+            std::optional<size_t> slot_of(const referenceid_t& ref) const noexcept {
+                if (ref.variableid == 0 || ref.variableid < -num_params || ref.variableid + num_params >= static_cast<variableid_t>(variable_widths.size())) return std::nullopt;
+                const size_t slot = static_cast<size_t>(ref.variableid + num_params);
+                if (variable_widths[slot] == 0) return std::nullopt;
+                return slot;
+            }
+
+            lattice_value read(const referenceid_t& ref, const std::vector<lattice_value>& env) const noexcept {
+                const std::optional<size_t> slot = slot_of(ref);
+                return slot ? env[*slot] : lattice_value::make_overdefined();
+            }
+
+            void write(const referenceid_t& ref, lattice_value value, std::vector<lattice_value>& env) const noexcept {
+                const std::optional<size_t> slot = slot_of(ref);
+                if (slot) env[*slot] = value;
+            }
+
+            void build_blocks() {
+                const std::vector<Instruction>& instructions = code.get_instructions();
+                const size_t num_instructions = instructions.size();
+                std::vector<bool> leaders(num_instructions + 1, false);
+                leaders[0] = true;
+                for (instructionid_t i = 0; i != num_instructions; ++i) {
+                    const opcode_descriptor& descriptor = get_descriptor(instructions[i].get_opcode());
+                    if (descriptor.has(OpcodeFlags::Branch)) {
+                        const instructionid_t target = jump_target(instructions[i]);
+                        assert(target <= num_instructions);
+                        leaders[target] = true;
+                    }
+                    if (descriptor.has(OpcodeFlags::Branch | OpcodeFlags::NoFallthrough)) {
+                        leaders[i + 1] = true;
+                    }
+                }
+                block_of.resize(num_instructions + 1);
+                for (instructionid_t i = 0; i != num_instructions; ++i) {
+                    if (leaders[i]) block_begins.push_back(i);
+                    block_of[i] = block_begins.size() - 1;
+                }
+                block_of[num_instructions] = block_begins.size(); // the exit
+            }
+
+            instructionid_t block_end(size_t block) const noexcept {
+                return block + 1 == block_begins.size() ? code.get_instructions().size() : block_begins[block + 1];
+            }
+
+            static instructionid_t jump_target(const Instruction& instruction) noexcept {
+                instructionid_t target = 0;
+                instruction.get_params([&](const auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, InstructionParamTypes::Jump> || std::is_same_v<params_type, InstructionParamTypes::JumpConditional>) {
+                        target = params.target;
+                    }
+                });
+                return target;
+            }
+
+            static void set_jump_target(Instruction& instruction, instructionid_t target) noexcept {
+                instruction.get_params([&](auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, InstructionParamTypes::Jump> || std::is_same_v<params_type, InstructionParamTypes::JumpConditional>) {
+                        params.target = target;
+                    }
+                });
+            }
+
+            /**
+             * Returns whether the conditional jump is taken, or nothing if the condition is not a constant.
+             */
+            std::optional<bool> branch_taken(const Instruction& instruction, const std::vector<lattice_value>& env) const noexcept {
+                std::optional<bool> ret;
+                instruction.get_params([&](const auto& params) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(params)>, InstructionParamTypes::JumpConditional>) {
+                        const lattice_value condition = read(params.condition, env);
+                        if (condition.constant) {
+                            const bool is_zero = (condition.bits & width_mask(primitive_width(static_cast<typeid_underlying_t>(params.type)))) == 0;
+                            ret = (instruction.get_opcode() == opcode_t::JZ) == is_zero;
+                        }
+                    }
+                });
+                return ret;
+            }
+
+            /**
+             * Applies the effect of a (non-jump) instruction to env.
+             * If the instruction is a pure computation of a single result that turns out to be constant, returns the value so the instruction can be replaced by imm.
+             */
+            std::optional<folded_value> transfer(const Instruction& instruction, std::vector<lattice_value>& env) const {
+                namespace P = InstructionParamTypes;
+                const opcode_t opcode = instruction.get_opcode();
+                std::optional<folded_value> ret;
+                const auto set_result = [&](const referenceid_t& result, typeid_primitive_t type, std::optional<uint64_t> bits) {
+                    const size_t width = primitive_width(static_cast<typeid_underlying_t>(type));
+                    if (bits && width <= 64) {
+                        write(result, lattice_value::make_constant(*bits & width_mask(width)), env);
+                        if (result.variableid != 0) ret = folded_value{ result, type, *bits & width_mask(width) };
+                    }
+                    else {
+                        write(result, lattice_value::make_overdefined(), env);
+                    }
+                };
+                const auto operand = [&](const referenceid_t& ref) -> std::optional<uint64_t> {
+                    const lattice_value value = read(ref, env);
+                    if (!value.constant) return std::nullopt;
+                    return value.bits;
+                };
+                instruction.get_params([&](const auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, P::Call>) {
+                        if (params.target == 0 || params.target > functions.size()) return;
+                        const Function& callee = functions[params.target - 1];
+                        const size_t num_inputs = callee.get_inputs().size();
+                        const referenceid_t* const call_params = code.get_call_params(params);
+                        for (size_t i = 0; i != callee.get_outputs().size(); ++i) {
+                            write(call_params[num_inputs + i], lattice_value::make_overdefined(), env);
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Immediate>) {
+                        if (primitive_width(static_cast<typeid_underlying_t>(params.type)) <= 64) {
+                            write(params.variable, lattice_value::make_constant(immediate_bits(params) & width_mask(primitive_width(static_cast<typeid_underlying_t>(params.type)))), env);
+                        }
+                        else {
+                            write(params.variable, lattice_value::make_overdefined(), env);
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Transfer>) {
+                        const lattice_value source = read(params.source, env);
+                        if (opcode == opcode_t::SWAP) {
+                            const lattice_value destination = read(params.destination, env);
+                            write(params.source, destination, env);
+                            write(params.destination, source, env);
+                            return;
+                        }
+                        if (opcode == opcode_t::MOVE) {
+                            // the source is left in an unspecified state
+                            write(params.source, lattice_value::make_overdefined(), env);
+                        }
+                        if (primitive_width(params.type) != 0) {
+                            set_result(params.destination, static_cast<typeid_primitive_t>(params.type), source.constant ? std::optional<uint64_t>(source.bits) : std::nullopt);
+                        }
+                        else {
+                            write(params.destination, lattice_value::make_overdefined(), env);
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::GlobalAccess>) {
+                        // globals may be changed by other calls and by the host, so loads are never constant
+                        if (opcode == opcode_t::GGET) write(params.variable, lattice_value::make_overdefined(), env);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::OneOperandInt>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.type));
+                        const std::optional<uint64_t> a = operand(params.operand);
+                        std::optional<uint64_t> bits;
+                        if (a) bits = opcode == opcode_t::NOT ? ~*a : (*a == 0 ? 1 : 0);
+                        set_result(params.result, static_cast<typeid_primitive_t>(params.type), width <= 64 ? bits : std::nullopt);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::TwoOperandInt>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.type));
+                        const std::optional<uint64_t> a = operand(params.operand1);
+                        const std::optional<uint64_t> b = operand(params.operand2);
+                        set_result(params.result, static_cast<typeid_primitive_t>(params.type), (a && b && width <= 64) ? fold_two_operand(opcode, width, *a, *b) : std::nullopt);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Divide>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.type));
+                        const std::optional<uint64_t> a = operand(params.dividend);
+                        const std::optional<uint64_t> b = operand(params.divisor);
+                        lattice_value quotient = lattice_value::make_overdefined();
+                        lattice_value remainder = lattice_value::make_overdefined();
+                        if (a && b && width <= 64) {
+                            if (const std::optional<uint64_t> q = fold_two_operand(opcode, width, *a, *b)) {
+                                quotient = lattice_value::make_constant(*q);
+                                remainder = lattice_value::make_constant((*a - *q * *b) & width_mask(width));
+                            }
+                        }
+                        write(params.quotient, quotient, env);
+                        write(params.remainder, remainder, env);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::BitCount>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.operand_type));
+                        const std::optional<uint64_t> a = operand(params.operand);
+                        std::optional<uint64_t> bits;
+                        if (a && width <= 64) {
+                            switch (opcode) {
+                            case opcode_t::POPCNT:
+                                bits = count_ones(*a);
+                                break;
+                            case opcode_t::CLZ:
+                                bits = count_leading_zeros(*a, width);
+                                break;
+                            default:
+                                bits = count_trailing_zeros(*a, width);
+                                break;
+                            }
+                        }
+                        set_result(params.result, static_cast<typeid_primitive_t>(params.result_type), bits);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Shift>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.type));
+                        const std::optional<uint64_t> a = operand(params.operand);
+                        const std::optional<uint64_t> shamt = operand(params.shamt);
+                        set_result(params.result, static_cast<typeid_primitive_t>(params.type), (a && shamt && width <= 64) ? fold_shift(opcode, width, *a, *shamt) : std::nullopt);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::MulEx>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.operand_type));
+                        const typeid_primitive_t result_type = static_cast<typeid_primitive_t>(static_cast<typeid_underlying_t>(params.operand_type) - 1);
+                        const std::optional<uint64_t> a = operand(params.operand1);
+                        const std::optional<uint64_t> b = operand(params.operand2);
+                        std::optional<uint64_t> bits;
+                        if (a && b && width <= 32) {
+                            bits = is_signed_instruction(opcode) ? static_cast<uint64_t>(sign_extend(*a, width) * sign_extend(*b, width)) : *a * *b;
+                        }
+                        set_result(params.result, result_type, bits);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::DivEx>) {
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.result_type));
+                        const std::optional<uint64_t> a = operand(params.dividend);
+                        const std::optional<uint64_t> b = operand(params.divisor);
+                        lattice_value quotient = lattice_value::make_overdefined();
+                        lattice_value remainder = lattice_value::make_overdefined();
+                        if (a && b && *b != 0 && width <= 32) {
+                            if (is_signed_instruction(opcode)) {
+                                const int64_t dividend = sign_extend(*a, width * 2);
+                                const int64_t divisor = sign_extend(*b, width);
+                                // the quotient of the smallest 64-bit dividend by -1 overflows the host division (and does not fit anyway)
+                                const bool overflows = divisor == -1 && dividend == std::numeric_limits<int64_t>::min();
+                                const int64_t q = overflows ? 0 : dividend / divisor;
+                                if (!overflows && sign_extend(static_cast<uint64_t>(q), width) == q) {
+                                    quotient = lattice_value::make_constant(static_cast<uint64_t>(q) & width_mask(width));
+                                    remainder = lattice_value::make_constant(static_cast<uint64_t>(dividend % divisor) & width_mask(width));
+                                }
+                            }
+                            else if (*a / *b <= width_mask(width)) {
+                                quotient = lattice_value::make_constant(*a / *b);
+                                remainder = lattice_value::make_constant(*a % *b);
+                            }
+                        }
+                        write(params.quotient, quotient, env);
+                        write(params.remainder, remainder, env);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Convert> || std::is_same_v<params_type, P::Reinterpret>) {
+                        const std::optional<uint64_t> a = operand(params.operand);
+                        std::optional<uint64_t> bits;
+                        if (a && primitive_width(static_cast<typeid_underlying_t>(params.operand_type)) <= 64 && primitive_width(static_cast<typeid_underlying_t>(params.result_type)) <= 64) {
+                            bits = fold_conversion(opcode, params.operand_type, params.result_type, *a);
+                        }
+                        set_result(params.result, params.result_type, bits);
+                    }
+                });
+                return ret;
+            }
+
+            void analyze() {
+                const std::vector<Instruction>& instructions = code.get_instructions();
+                block_entries.assign(block_begins.size(), std::nullopt);
+                std::vector<bool> queued(block_begins.size(), false);
+                std::deque<size_t> worklist;
+
+                // parameters are unknown, but outputs and locals are zero-initialized
+                std::vector<lattice_value> entry(variable_widths.size(), lattice_value::make_constant(0));
+                for (size_t i = 0; i != function.get_inputs().size(); ++i) {
+                    entry[num_params - 1 - i] = lattice_value::make_overdefined();
+                }
+                block_entries[0] = std::move(entry);
+                worklist.push_back(0);
+                queued[0] = true;
+
+                const auto propagate = [&](size_t successor, const std::vector<lattice_value>& env) {
+                    if (successor == block_begins.size()) return; // the exit
+                    bool changed = false;
+                    if (!block_entries[successor]) {
+                        block_entries[successor] = env;
+                        changed = true;
+                    }
+                    else {
+                        std::vector<lattice_value>& successor_env = *block_entries[successor];
+                        for (size_t i = 0; i != env.size(); ++i) {
+                            changed |= successor_env[i].meet(env[i]);
+                        }
+                    }
+                    if (changed && !queued[successor]) {
+                        worklist.push_back(successor);
+                        queued[successor] = true;
+                    }
+                };
+
+                while (!worklist.empty()) {
+                    const size_t block = worklist.front();
+                    worklist.pop_front();
+                    queued[block] = false;
+                    std::vector<lattice_value> env = *block_entries[block];
+                    const instructionid_t begin = block_begins[block];
+                    const instructionid_t end = block_end(block);
+                    for (instructionid_t i = begin; i != end; ++i) {
+                        if (!is_jump_conditional_instruction(instructions[i].get_opcode())) {
+                            transfer(instructions[i], env);
+                        }
+                    }
+                    const Instruction& last = instructions[end - 1];
+                    const opcode_t opcode = last.get_opcode();
+                    if (is_jump_instruction(opcode)) {
+                        propagate(block_of[jump_target(last)], env);
+                    }
+                    else if (is_jump_conditional_instruction(opcode)) {
+                        const std::optional<bool> taken = branch_taken(last, env);
+                        if (!taken || *taken) propagate(block_of[jump_target(last)], env);
+                        if (!taken || !*taken) propagate(block_of[end], env);
+                    }
+                    else if (!get_descriptor(opcode).has(OpcodeFlags::NoFallthrough)) {
+                        propagate(block_of[end], env);
+                    }
+                }
+            }
+
+            const Code& code;
+            const std::vector<Function>& functions;
+            const Function& function;
+            variableid_t num_params;
+            std::vector<size_t> variable_widths; // indexed by variableid + num_params; zero if the variable is not tracked
+            std::vector<instructionid_t> block_begins;
+            std::vector<size_t> block_of; // block containing each instruction; block_of[num_instructions] is the exit
+            std::vector<std::optional<std::vector<lattice_value>>> block_entries; // nothing if the block is unreachable
+        };
+
+        class constant_propagation : public constant_analysis {
+        public:
+            constant_propagation(Code& code, const std::vector<Function>& functions) : constant_analysis(code, functions), target(code) {}
+
+            constant_propagation_result run() {
+                if (!prepare()) return {};
+                const std::vector<Instruction>& instructions = code.get_instructions();
+
+                constant_propagation_result result;
+                const size_t num_instructions = instructions.size();
+                std::vector<bool> removed(num_instructions, false);
+                std::vector<std::pair<instructionid_t, Instruction>> replacements;
+                for (size_t block = 0; block != block_begins.size(); ++block) {
+                    const instructionid_t begin = block_begins[block];
+                    const instructionid_t end = block_end(block);
+                    if (!block_entries[block]) {
+                        ++result.blocks_removed;
+                        for (instructionid_t i = begin; i != end; ++i) removed[i] = true;
+                        continue;
+                    }
+                    std::vector<lattice_value> env = *block_entries[block];
+                    for (instructionid_t i = begin; i != end; ++i) {
+                        const Instruction& instruction = instructions[i];
+                        if (is_jump_conditional_instruction(instruction.get_opcode())) {
+                            const std::optional<bool> taken = branch_taken(instruction, env);
+                            if (taken) {
+                                if (*taken) {
+                                    instruction.get_params([&](const auto& params) {
+                                        if constexpr (std::is_same_v<std::decay_t<decltype(params)>, InstructionParamTypes::JumpConditional>) {
+                                            replacements.emplace_back(i, Instruction(opcode_t::JMP, InstructionParamTypes::Jump{ params.target }));
+                                        }
+                                    });
+                                    ++result.instructions_folded;
+                                }
+                                else {
+                                    removed[i] = true;
+                                }
+                            }
+                            continue;
+                        }
+                        const std::optional<folded_value> folded = transfer(instruction, env);
+                        if (folded) {
+                            InstructionParamTypes::Immediate params;
+                            params.type = folded->type;
+                            params.variable = folded->result;
+                            params.value = make_immediate_value(folded->bits, primitive_width(static_cast<typeid_underlying_t>(folded->type)));
+                            replacements.emplace_back(i, Instruction(opcode_t::IMM, params));
+                            ++result.instructions_folded;
+                        }
+                    }
+                }
+
+                std::vector<Instruction>& mutable_instructions = target.get_instructions();
+                for (auto& [index, instruction] : replacements) {
+                    mutable_instructions[index] = std::move(instruction);
+                }
+                result.instructions_removed = compact(removed);
+                return result;
+            }
+
+        private:
+            /**
+             * Erases the removed instructions and remaps jump targets.  Returns the number of instructions erased.
+             */
+            size_t compact(const std::vector<bool>& removed) {
+                std::vector<Instruction>& instructions = target.get_instructions();
+                const size_t num_instructions = instructions.size();
+                std::vector<instructionid_t> new_index(num_instructions + 1);
+                instructionid_t next = 0;
+                for (instructionid_t i = 0; i != num_instructions; ++i) {
+                    new_index[i] = next;
+                    if (!removed[i]) ++next;
+                }
+                new_index[num_instructions] = next;
+                if (next == num_instructions) return 0;
+
+                std::vector<Instruction> compacted;
+                compacted.reserve(next);
+                for (instructionid_t i = 0; i != num_instructions; ++i) {
+                    if (removed[i]) continue;
+                    if (get_descriptor(instructions[i].get_opcode()).has(OpcodeFlags::Branch)) {
+                        set_jump_target(instructions[i], new_index[jump_target(instructions[i])]);
+                    }
+                    compacted.push_back(std::move(instructions[i]));
+                }
+                instructions = std::move(compacted);
+                return num_instructions - next;
+            }
+
+            Code& target;
+        };
+    }
+
+    /**
+     * Runs conditional constant propagation on code, folding constant computations into imm, turning conditional
+     * jumps with constant conditions into jmp (or removing them), and removing unreachable blocks.
+     * functions is the function section of the module (functionids start from 1).
+     * If sink is not null, the pass is recorded to it.
+     */
+    inline constant_propagation_result propagate_constants(Code& code, const std::vector<Function>& functions, telemetry* sink = nullptr) {
+        telemetry::scope scope(sink, "constant_propagation", code.get_functionid());
+        scope.set_instructions(code.get_instructions().size());
+        return detail::constant_propagation(code, functions).run();
+    }
+
+    /**
+     * Finds the divisors of div/divu/divex/divuex that are the same nonzero constant whenever the instruction runs (from an
+     * imm, or computed from constants), so that a backend can divide by them without a hardware divide.
+     * Returns the bits of each such divisor, indexed by instructionid (and nothing for every other instruction).
+     */
+    inline std::vector<std::optional<uint64_t>> find_constant_divisors(const Code& code, const std::vector<Function>& functions) {
+        return detail::constant_analysis(code, functions).constant_divisors();
+    }
+
+}
@@ -0,0 +1,1002 @@
+#pragma once
+
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/record.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/instruction.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/constant_divisor.hpp>
+#include <spiral/detail/constant_propagation.hpp>
+#include <spiral/detail/global_layout.hpp>
+#include <spiral/detail/native_abi.hpp>
+#include <spiral/detail/telemetry.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+/**
+ * Backend that translates a module into a C++ translation unit, to be built by the system compiler (see aot.hpp).
+ *
+ * Every Code becomes an internal C++ function that takes its inputs by value and its outputs by reference.
+ * Every function whose parameters are all primitives additionally gets an extern "C" entry point named by
+ * aot_entry_symbol, with the native calling convention of native_abi.hpp, so it can be installed into a CompiledModule.
+ * Integers are held in unsigned types of their width (signedness is a property of the operation, not the variable),
+ * arrays are bounds-checked (out of range accesses trap), and all variables are zero-initialized.
+ * Globals are accessed at constant offsets (from global_layout) from the base of the global block, which every function
+ * that uses globals loads from its context once on entry, so it stays in a register.
+ * Divisions whose divisor is a known constant (see find_constant_divisors) become a multiply-high and shifts, with the
+ * magic numbers of constant_divisor.hpp, instead of a hardware divide.
+ * divex/divuex of 128-bit dividends use a single divq/idivq (sp_divex/sp_divuex, like spiral::divex) rather than a 128-bit division.
+ * Each instruction is preceded by a #line directive naming file "spiral/function_<id>" and line instructionid + 1, so
+ * that compiler diagnostics and debug info (and hence perf report/annotate, see perf.hpp) refer to Spiral instructions.
+ * Requires a compiler with __int128 (GCC or Clang).
+ */
+
+namespace spiral {
+
+    /**
+     * Name of the native entry point of a function in AOT-compiled code.
+     */
+    inline std::string aot_entry_symbol(functionid_t functionid) {
+        return "spiral_entry_" + std::to_string(functionid);
+    }
+
+    namespace detail {
+
+        constexpr const char* aot_code_ranges_symbol = "spiral_code_ranges";
+        constexpr const char* aot_num_code_ranges_symbol = "spiral_num_code_ranges";
+        constexpr const char* aot_code_end_symbol = "spiral_code_end";
+
+        /**
+         * Support code at the start of every emitted translation unit.
+         * sp_context must have the same layout as native_context.
+         */
+        constexpr const char* cpp_prelude = R"(#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using u8 = std::uint8_t;
+using u16 = std::uint16_t;
+using u32 = std::uint32_t;
+using u64 = std::uint64_t;
+using u128 = unsigned __int128;
+using i8 = std::int8_t;
+using i16 = std::int16_t;
+using i32 = std::int32_t;
+using i64 = std::int64_t;
+using i128 = __int128;
+
+struct sp_context {
+    void (**imports)();
+    u8* globals;
+    void (*(*resolve_import)(const sp_context*, u64))();
+    const void* import_table;
+};
+
+// all generated functions go into one section, whose bounds let the loader find where each function ends
+#define SP_TEXT __attribute__((section("spiral_text")))
+
+struct sp_code_range {
+    u64 functionid;
+    const void* start;
+};
+
+template <typename T>
+inline T sp_load_global(const u8* globals, u64 offset) {
+    T ret;
+    std::memcpy(&ret, globals + offset, sizeof(T));
+    return ret;
+}
+
+template <typename T>
+inline void sp_store_global(u8* globals, u64 offset, T value) {
+    std::memcpy(globals + offset, &value, sizeof(T));
+}
+
+// 128-bit values at the native ABI boundary (same layout as spiral::int128_t)
+struct sp_i128 {
+    u64 lower;
+    i64 upper;
+};
+
+template <u64 N>
+struct sp_results {
+    u64 slots[N];
+};
+
+[[noreturn]] inline void sp_trap() {
+    __builtin_trap();
+}
+
+// first call of a lazily resolved import (whose slot is still null): the host fills the slot, or there is no such function
+[[gnu::cold, gnu::noinline]] inline void (*sp_resolve_import(const sp_context* ctx, u64 index))() {
+    void (*const ret)() = ctx->resolve_import(ctx, index);
+    if (ret == nullptr) sp_trap();
+    return ret;
+}
+
+template <typename F>
+inline F sp_import(const sp_context* ctx, u64 index) {
+    void (*ret)() = __atomic_load_n(&ctx->imports[index], __ATOMIC_ACQUIRE);
+    if (__builtin_expect(ret == nullptr, 0)) ret = sp_resolve_import(ctx, index);
+    return reinterpret_cast<F>(ret);
+}
+
+template <typename T>
+class sp_array {
+public:
+    template <typename I>
+    T& at(I index) {
+        if (index >= elements.size()) sp_trap();
+        return elements[static_cast<std::size_t>(index)];
+    }
+    template <typename I>
+    void resize(I size) {
+        if (size > elements.max_size()) sp_trap();
+        elements.resize(static_cast<std::size_t>(size));
+    }
+    template <typename I>
+    void create(I size) {
+        elements.clear();
+        resize(size);
+    }
+    void clear() {
+        elements.clear();
+        elements.shrink_to_fit();
+    }
+
+private:
+    std::vector<T> elements;
+};
+
+// arithmetic type in which T does not get promoted to a signed int
+template <typename T>
+using sp_arith = std::conditional_t<(sizeof(T) < sizeof(unsigned)), unsigned, T>;
+
+template <typename T> struct sp_signed { using type = std::make_signed_t<T>; };
+template <> struct sp_signed<u128> { using type = i128; };
+template <typename T> using sp_signed_t = typename sp_signed<T>::type;
+
+template <typename To, typename From>
+inline To sp_bit_cast(From from) {
+    static_assert(sizeof(To) == sizeof(From));
+    To to;
+    std::memcpy(&to, &from, sizeof(to));
+    return to;
+}
+
+template <typename T>
+inline unsigned sp_popcount(T x) {
+    if constexpr (sizeof(T) == 16) return __builtin_popcountll(static_cast<u64>(x)) + __builtin_popcountll(static_cast<u64>(x >> 64));
+    else return __builtin_popcountll(x);
+}
+template <typename T>
+inline unsigned sp_clz(T x) {
+    constexpr unsigned width = sizeof(T) * 8;
+    if (x == 0) return width;
+    if constexpr (sizeof(T) == 16) return static_cast<u64>(x >> 64) != 0 ? __builtin_clzll(static_cast<u64>(x >> 64)) : 64 + __builtin_clzll(static_cast<u64>(x));
+    else return __builtin_clzll(x) - (64 - width);
+}
+template <typename T>
+inline unsigned sp_ctz(T x) {
+    if (x == 0) return sizeof(T) * 8;
+    if constexpr (sizeof(T) == 16) return static_cast<u64>(x) != 0 ? __builtin_ctzll(static_cast<u64>(x)) : 64 + __builtin_ctzll(static_cast<u64>(x >> 64));
+    else return __builtin_ctzll(x);
+}
+template <typename T, typename S>
+inline unsigned sp_shamt(S shamt) {
+    return static_cast<unsigned>(shamt & static_cast<S>(sizeof(T) * 8 - 1));
+}
+template <typename T, typename S>
+inline T sp_rotl(T x, S shamt) {
+    const unsigned s = sp_shamt<T>(shamt);
+    return s == 0 ? x : static_cast<T>((static_cast<sp_arith<T>>(x) << s) | (static_cast<sp_arith<T>>(x) >> (sizeof(T) * 8 - s)));
+}
+template <typename T, typename S>
+inline T sp_rotr(T x, S shamt) {
+    const unsigned s = sp_shamt<T>(shamt);
+    return s == 0 ? x : static_cast<T>((static_cast<sp_arith<T>>(x) >> s) | (static_cast<sp_arith<T>>(x) << (sizeof(T) * 8 - s)));
+}
+
+// division by a constant, with the magic numbers of spiral::constant_divisor and constant_divisor_ex (constant_divisor.hpp)
+template <typename T> struct sp_wider;
+template <> struct sp_wider<u8> { using type = u16; };
+template <> struct sp_wider<u16> { using type = u32; };
+template <> struct sp_wider<u32> { using type = u64; };
+template <> struct sp_wider<u64> { using type = u128; };
+template <> struct sp_wider<i8> { using type = i16; };
+template <> struct sp_wider<i16> { using type = i32; };
+template <> struct sp_wider<i32> { using type = i64; };
+template <> struct sp_wider<i64> { using type = i128; };
+
+template <typename T>
+struct sp_divided {
+    T quotient;
+    T remainder;
+};
+
+template <typename T>
+inline T sp_mulhi(T a, T b) {
+    using W = typename sp_wider<T>::type;
+    return static_cast<T>(static_cast<W>(static_cast<sp_arith<W>>(a) * static_cast<sp_arith<W>>(b)) >> (sizeof(T) * 8));
+}
+template <typename T>
+inline T sp_divu_constant(T n, T magic, unsigned shift, bool add) {
+    if (magic == 0) return static_cast<T>(n >> shift);
+    const T q = sp_mulhi<T>(magic, n);
+    if (add) return static_cast<T>((static_cast<T>(static_cast<T>(n - q) >> 1) + q) >> shift);
+    return static_cast<T>(q >> shift);
+}
+template <typename T>
+inline T sp_div_constant(T n, T magic, unsigned shift, bool add, bool negative) {
+    using S = sp_signed_t<T>;
+    const T sign = negative ? static_cast<T>(~static_cast<T>(0)) : static_cast<T>(0);
+    if (magic == 0) {
+        const T mask = static_cast<T>((static_cast<T>(1) << shift) - 1);
+        const T biased = static_cast<T>(n + (static_cast<T>(static_cast<S>(n) >> (sizeof(T) * 8 - 1)) & mask));
+        const S q = static_cast<S>(static_cast<S>(biased) >> shift);
+        return static_cast<T>((static_cast<T>(q) ^ sign) - sign);
+    }
+    T uq = static_cast<T>(sp_mulhi<S>(static_cast<S>(magic), static_cast<S>(n)));
+    if (add) uq = static_cast<T>(uq + ((n ^ sign) - sign));
+    S q = static_cast<S>(static_cast<S>(uq) >> shift);
+    q = static_cast<S>(q + (q < 0 ? 1 : 0));
+    return static_cast<T>(q);
+}
+// divex/divuex of a 128-bit dividend by a variable: one divq/idivq, which gives both the quotient and remainder
+// (the 128-bit division operator would call __udivti3/__divti3, as the compiler cannot assume the quotient fits);
+// the quotient must fit in 64 bits (same as spiral::divex)
+inline sp_divided<u64> sp_divuex(u128 n, u64 d) {
+#if defined(__x86_64__)
+    u64 quotient, remainder;
+    __asm__("divq %[d]" : "=a"(quotient), "=d"(remainder) : [d] "rm"(d), "a"(static_cast<u64>(n)), "d"(static_cast<u64>(n >> 64)));
+    return { quotient, remainder };
+#else
+    return { static_cast<u64>(n / d), static_cast<u64>(n % d) };
+#endif
+}
+inline sp_divided<u64> sp_divex(u128 n, u64 d) {
+#if defined(__x86_64__)
+    u64 quotient, remainder;
+    __asm__("idivq %[d]" : "=a"(quotient), "=d"(remainder) : [d] "rm"(d), "a"(static_cast<u64>(n)), "d"(static_cast<u64>(n >> 64)));
+    return { quotient, remainder };
+#else
+    const i128 dividend = static_cast<i128>(n);
+    const i64 divisor = static_cast<i64>(d);
+    return { static_cast<u64>(dividend / divisor), static_cast<u64>(dividend % divisor) };
+#endif
+}
+inline sp_divided<u64> sp_divuex_constant(u128 n, u64 normalized_divisor, u64 reciprocal, unsigned normalization_shift) {
+    u64 hi = static_cast<u64>(n >> 64);
+    u64 lo = static_cast<u64>(n);
+    if (normalization_shift != 0) {
+        hi = (hi << normalization_shift) | (lo >> (64 - normalization_shift));
+        lo <<= normalization_shift;
+    }
+    const u128 product = static_cast<u128>(reciprocal) * hi;
+    const u64 q0 = static_cast<u64>(product) + lo;
+    u64 q1 = static_cast<u64>(product >> 64) + hi + 1 + (q0 < lo ? 1 : 0);
+    u64 r = lo - q1 * normalized_divisor;
+    if (r > q0) {
+        --q1;
+        r += normalized_divisor;
+    }
+    if (r >= normalized_divisor) {
+        ++q1;
+        r -= normalized_divisor;
+    }
+    return { q1, r >> normalization_shift };
+}
+inline sp_divided<u64> sp_divex_constant(u128 n, u64 normalized_divisor, u64 reciprocal, unsigned normalization_shift, bool negative) {
+    const bool negative_dividend = static_cast<i64>(static_cast<u64>(n >> 64)) < 0;
+    const sp_divided<u64> res = sp_divuex_constant(negative_dividend ? -n : n, normalized_divisor, reciprocal, normalization_shift);
+    return { negative_dividend != negative ? -res.quotient : res.quotient, negative_dividend ? -res.remainder : res.remainder };
+}
+
+inline sp_i128 sp_to_abi(u128 x) {
+    return { static_cast<u64>(x), static_cast<i64>(static_cast<u64>(x >> 64)) };
+}
+inline u128 sp_from_abi(sp_i128 x) {
+    return (static_cast<u128>(static_cast<u64>(x.upper)) << 64) | x.lower;
+}
+template <typename T>
+inline T sp_to_abi(T x) {
+    return x;
+}
+template <typename T>
+inline T sp_from_abi(T x) {
+    return x;
+}
+
+template <typename T>
+inline void sp_store_slots(u64* slots, T value) {
+    std::memcpy(slots, &value, sizeof(value));
+}
+template <typename T>
+inline T sp_load_slots(const u64* slots) {
+    T value;
+    std::memcpy(&value, slots, sizeof(value));
+    return value;
+}
+
+}
+)";
+
+        class cpp_emitter {
+        public:
+            explicit cpp_emitter(const Module& module, telemetry* sink = nullptr) : module(module), import_indices(module.get_functions().size(), npos), globals(module.get_globals()), sink(sink) {
+                for (size_t i = 0; i != module.get_imports().size(); ++i) {
+                    import_indices[module.get_imports()[i].get_functionid() - 1] = i;
+                }
+            }
+
+            std::string emit() {
+                telemetry::scope scope(sink, "emit");
+                out << "// Generated by the Spiral AOT backend.\n\n" << cpp_prelude << "\nnamespace {\n\n";
+                emit_records();
+                for (const Code& code : module.get_codes()) {
+                    emit_declaration(code.get_functionid());
+                    out << ";\n";
+                }
+                out << '\n';
+                size_t num_instructions = 0;
+                for (const Code& code : module.get_codes()) {
+                    telemetry::scope function_scope(sink, "emit_function", code.get_functionid());
+                    function_scope.set_instructions(code.get_instructions().size());
+                    emit_function(code);
+                    num_instructions += code.get_instructions().size();
+                }
+                scope.set_instructions(num_instructions);
+                out << "}\n\n";
+                for (const Code& code : module.get_codes()) {
+                    emit_entry(code.get_functionid());
+                }
+                emit_code_ranges();
+                return out.str();
+            }
+
+        private:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            static const char* primitive_name(typeid_underlying_t type) {
+                switch (type) {
+                case TypeIDs::I8:
+                    return "u8";
+                case TypeIDs::I16:
+                    return "u16";
+                case TypeIDs::I32:
+                    return "u32";
+                case TypeIDs::I64:
+                    return "u64";
+                case TypeIDs::I128:
+                    return "u128";
+                case TypeIDs::F32:
+                    return "float";
+                case TypeIDs::F64:
+                    return "double";
+                default:
+                    throw aot_exception("f128 is not supported by the AOT backend!");
+                }
+            }
+
+            static std::string type_name(typeid_underlying_t type, int32_t array_dimension = 0) {
+                std::string ret = type > 0 ? "sp_record_" + std::to_string(type) : primitive_name(type);
+                for (int32_t i = 0; i != array_dimension; ++i) {
+                    ret = "sp_array<" + ret + ">";
+                }
+                return ret;
+            }
+
+            static std::string type_name(const typeid_t& type) {
+                return type_name(type.get_typeid(), type.get_array_dimension());
+            }
+
+            static std::string abi_type_name(const typeid_t& type) {
+                return type.get_typeid() == TypeIDs::I128 ? "sp_i128" : type_name(type);
+            }
+
+            static bool has_native_signature(const Function& function) noexcept {
+                for (const typeid_t& type : function.get_inputs()) {
+                    if (!type.is_primitive() || type.get_typeid() == TypeIDs::F128) return false;
+                }
+                for (const typeid_t& type : function.get_outputs()) {
+                    if (!type.is_primitive() || type.get_typeid() == TypeIDs::F128) return false;
+                }
+                return true;
+            }
+
+            static size_t num_slots(const std::vector<typeid_t>& types) noexcept {
+                size_t ret = 0;
+                for (const typeid_t& type : types) {
+                    ret += native_slot_count(primitive_width(type.get_typeid()) / 8);
+                }
+                return ret;
+            }
+
+            static std::string abi_return_type(const Function& function) {
+                const std::vector<typeid_t>& outputs = function.get_outputs();
+                if (outputs.empty()) return "void";
+                if (outputs.size() == 1) return abi_type_name(outputs[0]);
+                return "sp_results<" + std::to_string(num_slots(outputs)) + ">";
+            }
+
+            /**
+             * Records are defined in an order where every record comes after the records it contains by value.
+             */
+            void emit_records() {
+                const std::vector<Record>& records = module.get_records();
+                for (size_t i = 1; i <= records.size(); ++i) {
+                    out << "struct sp_record_" << i << ";\n";
+                }
+                std::vector<int> state(records.size(), 0); // 0: not emitted, 1: being emitted, 2: emitted
+                for (size_t i = 1; i <= records.size(); ++i) {
+                    emit_record(i, state);
+                }
+                out << '\n';
+            }
+
+            void emit_record(recordid_t recordid, std::vector<int>& state) {
+                if (state[recordid - 1] == 2) return;
+                if (state[recordid - 1] == 1) throw aot_exception("Record contains itself by value!");
+                state[recordid - 1] = 1;
+                const std::vector<typeid_t>& fields = module.get_records()[recordid - 1].get_fields();
+                for (const typeid_t& field : fields) {
+                    if (field.is_record()) emit_record(static_cast<recordid_t>(field.get_typeid()), state);
+                }
+                out << "struct sp_record_" << recordid << " {\n";
+                for (size_t i = 0; i != fields.size(); ++i) {
+                    out << "    " << type_name(fields[i]) << " f" << i << "{};\n";
+                }
+                out << "};\n";
+                state[recordid - 1] = 2;
+            }
+
+            void emit_declaration(functionid_t functionid) {
+                const Function& function = module.get_functions()[functionid - 1];
+                out << "SP_TEXT void sp_fn_" << functionid << "(sp_context* ctx";
+                size_t k = 1;
+                for (const typeid_t& type : function.get_inputs()) {
+                    out << ", " << type_name(type) << " p" << k++;
+                }
+                for (const typeid_t& type : function.get_outputs()) {
+                    out << ", " << type_name(type) << "& p" << k++;
+                }
+                out << ')';
+            }
+
+            static std::string variable_name(variableid_t variableid) {
+                return variableid > 0 ? "v" + std::to_string(variableid) : "p" + std::to_string(-variableid);
+            }
+
+            const typeid_t& variable_type(variableid_t variableid) const {
+                if (variableid > 0) return curr_code->get_locals()[variableid - 1];
+                const size_t index = static_cast<size_t>(-variableid) - 1;
+                const size_t num_inputs = curr_function->get_inputs().size();
+                return index < num_inputs ? curr_function->get_inputs()[index] : curr_function->get_outputs()[index - num_inputs];
+            }
+
+            std::string reference(const referenceid_t& ref) const {
+                const std::string name = variable_name(ref.variableid);
+                const typeid_t& type = variable_type(ref.variableid);
+                if (type.is_array() && ref.array_index_variableid != 0) {
+                    return name + ".at(" + variable_name(ref.array_index_variableid) + ")";
+                }
+                if (type.is_record() && ref.record_fieldindex != -1) {
+                    return name + ".f" + std::to_string(ref.record_fieldindex);
+                }
+                return name;
+            }
+
+            static bool is_unused(const referenceid_t& ref) noexcept {
+                return ref.variableid == 0;
+            }
+
+            static std::string integral_name(typeid_integral_t type) {
+                return primitive_name(static_cast<typeid_underlying_t>(type));
+            }
+
+            static std::string signed_name(typeid_primitive_t type) {
+                return "sp_signed_t<" + std::string(primitive_name(static_cast<typeid_underlying_t>(type))) + ">";
+            }
+
+            static std::string signed_name(typeid_integral_t type) {
+                return signed_name(static_cast<typeid_primitive_t>(type));
+            }
+
+            static std::string widened_name(typeid_integral_t type) {
+                return primitive_name(static_cast<typeid_underlying_t>(type) - 1);
+            }
+
+            static std::string hex(uint64_t value) {
+                std::ostringstream ret;
+                ret << "0x" << std::hex << value << "ull";
+                return ret.str();
+            }
+
+            static std::string immediate(const InstructionParamTypes::Immediate& params) {
+                const std::string type = primitive_name(static_cast<typeid_underlying_t>(params.type));
+                switch (params.type) {
+                case typeid_primitive_t::I8:
+                    return "static_cast<u8>(" + hex(static_cast<uint8_t>(params.value.i8)) + ")";
+                case typeid_primitive_t::I16:
+                    return "static_cast<u16>(" + hex(static_cast<uint16_t>(params.value.i16)) + ")";
+                case typeid_primitive_t::I32:
+                    return "static_cast<u32>(" + hex(static_cast<uint32_t>(params.value.i32)) + ")";
+                case typeid_primitive_t::I64:
+                    return "static_cast<u64>(" + hex(static_cast<uint64_t>(params.value.i64)) + ")";
+                case typeid_primitive_t::I128:
+                    return "((static_cast<u128>(" + hex(static_cast<uint64_t>(params.value.i128.get_upper())) + ") << 64) | " + hex(params.value.i128.get_lower()) + ")";
+                case typeid_primitive_t::F32:
+                    return "sp_bit_cast<float>(static_cast<u32>(" + hex(static_cast<uint32_t>(params.value.i32)) + "))";
+                case typeid_primitive_t::F64:
+                    return "sp_bit_cast<double>(static_cast<u64>(" + hex(static_cast<uint64_t>(params.value.i64)) + "))";
+                default:
+                    throw aot_exception("f128 is not supported by the AOT backend!");
+                }
+            }
+
+            static const char* two_operand_operator(opcode_t opcode) noexcept {
+                switch (opcode) {
+                case opcode_t::ADD:
+                case opcode_t::ADDU:
+                    return "+";
+                case opcode_t::SUB:
+                case opcode_t::SUBU:
+                    return "-";
+                case opcode_t::MUL:
+                case opcode_t::MULU:
+                    return "*";
+                case opcode_t::AND:
+                    return "&";
+                case opcode_t::OR:
+                    return "|";
+                case opcode_t::XOR:
+                    return "^";
+                default:
+                    return nullptr;
+                }
+            }
+
+            void emit_function(const Code& code) {
+                curr_code = &code;
+                curr_function = &module.get_functions()[code.get_functionid() - 1];
+                constant_divisors = find_constant_divisors(code, module.get_functions());
+                const std::vector<Instruction>& instructions = code.get_instructions();
+
+                std::vector<bool> is_target(instructions.size() + 1, false);
+                bool uses_globals = false;
+                for (const Instruction& instruction : instructions) {
+                    instruction.get_params([&](const auto& params) {
+                        using params_type = std::decay_t<decltype(params)>;
+                        if constexpr (std::is_same_v<params_type, InstructionParamTypes::Jump> || std::is_same_v<params_type, InstructionParamTypes::JumpConditional>) {
+                            is_target[params.target] = true;
+                        }
+                        else if constexpr (std::is_same_v<params_type, InstructionParamTypes::GlobalAccess>) {
+                            uses_globals = true;
+                        }
+                    });
+                }
+
+                emit_declaration(code.get_functionid());
+                out << " {\n";
+                emit_line(code.get_functionid(), 0);
+                out << "    (void)ctx;\n";
+                if (uses_globals) out << "    u8* const g = ctx->globals;\n";
+                for (size_t i = 0; i != code.get_locals().size(); ++i) {
+                    out << "    " << type_name(code.get_locals()[i]) << " v" << (i + 1) << "{};\n";
+                }
+                for (instructionid_t i = 0; i != instructions.size(); ++i) {
+                    if (is_target[i]) out << "L" << i << ":;\n";
+                    if (i != 0) emit_line(code.get_functionid(), i);
+                    curr_instruction = i;
+                    emit_instruction(instructions[i], instructions.size());
+                }
+                out << "}\n\n";
+            }
+
+            void emit_line(functionid_t functionid, instructionid_t instructionid) {
+                out << "#line " << (instructionid + 1) << " \"spiral/function_" << functionid << "\"\n";
+            }
+
+            void emit_jump(instructionid_t target, size_t num_instructions) {
+                if (target == num_instructions) {
+                    out << "return;\n";
+                }
+                else {
+                    out << "goto L" << target << ";\n";
+                }
+            }
+
+            void emit_assign(const referenceid_t& result, const std::string& value) {
+                if (!is_unused(result)) out << "    " << reference(result) << " = " << value << ";\n";
+            }
+
+            void emit_instruction(const Instruction& instruction, size_t num_instructions) {
+                namespace P = InstructionParamTypes;
+                const opcode_t opcode = instruction.get_opcode();
+                instruction.get_params([&](const auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, P::Empty>) {
+                        if (opcode == opcode_t::UNREACHABLE) {
+                            out << "    __builtin_unreachable();\n";
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Jump>) {
+                        out << "    ";
+                        emit_jump(params.target, num_instructions);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::JumpConditional>) {
+                        out << "    if (" << reference(params.condition) << (opcode == opcode_t::JZ ? " == 0" : " != 0") << ") ";
+                        emit_jump(params.target, num_instructions);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Call>) {
+                        emit_call(params);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Immediate>) {
+                        emit_assign(params.variable, immediate(params));
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Transfer>) {
+                        if (opcode == opcode_t::SWAP) {
+                            out << "    std::swap(" << reference(params.source) << ", " << reference(params.destination) << ");\n";
+                        }
+                        else if (!is_unused(params.destination)) {
+                            emit_assign(params.destination, opcode == opcode_t::MOVE ? "std::move(" + reference(params.source) + ")" : reference(params.source));
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::GlobalAccess>) {
+                        const std::string type = primitive_name(static_cast<typeid_underlying_t>(params.type));
+                        const std::string offset = std::to_string(globals.get_offset(params.global));
+                        if (opcode == opcode_t::GGET) {
+                            emit_assign(params.variable, "sp_load_global<" + type + ">(g, " + offset + ")");
+                        }
+                        else {
+                            out << "    sp_store_global<" << type << ">(g, " << offset << ", " << reference(params.variable) << ");\n";
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::OneOperandInt>) {
+                        const std::string type = integral_name(params.type);
+                        if (opcode == opcode_t::NOT) {
+                            emit_assign(params.result, "static_cast<" + type + ">(~static_cast<sp_arith<" + type + ">>(" + reference(params.operand) + "))");
+                        }
+                        else {
+                            emit_assign(params.result, "static_cast<" + type + ">(" + reference(params.operand) + " == 0)");
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::TwoOperandInt>) {
+                        const std::string type = integral_name(params.type);
+                        const std::string a = reference(params.operand1);
+                        const std::string b = reference(params.operand2);
+                        switch (opcode) {
+                        case opcode_t::SLT:
+                            emit_assign(params.result, "static_cast<" + type + ">(static_cast<" + signed_name(params.type) + ">(" + a + ") < static_cast<" + signed_name(params.type) + ">(" + b + "))");
+                            break;
+                        case opcode_t::SLTU:
+                            emit_assign(params.result, "static_cast<" + type + ">(" + a + " < " + b + ")");
+                            break;
+                        case opcode_t::SEQ:
+                            emit_assign(params.result, "static_cast<" + type + ">(" + a + " == " + b + ")");
+                            break;
+                        default:
+                            emit_assign(params.result, "static_cast<" + type + ">(static_cast<sp_arith<" + type + ">>(" + a + ") " + two_operand_operator(opcode) + " static_cast<sp_arith<" + type + ">>(" + b + "))");
+                            break;
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Divide>) {
+                        const std::optional<uint64_t>& divisor = constant_divisors[curr_instruction];
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.type));
+                        if (divisor && width <= 64) {
+                            const std::string type = integral_name(params.type);
+                            emit_constant_divide(type, type, reference(params.dividend), constant_quotient(width, is_signed_instruction(opcode), *divisor), hex(*divisor), params.quotient, params.remainder);
+                        }
+                        else {
+                            const std::string type = is_signed_instruction(opcode) ? signed_name(params.type) : integral_name(params.type);
+                            emit_divide(type, integral_name(params.type), reference(params.dividend), reference(params.divisor), params.quotient, params.remainder);
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::BitCount>) {
+                        const char* function = opcode == opcode_t::POPCNT ? "sp_popcount" : opcode == opcode_t::CLZ ? "sp_clz" : "sp_ctz";
+                        emit_assign(params.result, "static_cast<" + integral_name(params.result_type) + ">(" + function + "(" + reference(params.operand) + "))");
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Shift>) {
+                        const std::string type = integral_name(params.type);
+                        const std::string a = reference(params.operand);
+                        const std::string shamt = "sp_shamt<" + type + ">(" + reference(params.shamt) + ")";
+                        switch (opcode) {
+                        case opcode_t::SLL:
+                            emit_assign(params.result, "static_cast<" + type + ">(static_cast<sp_arith<" + type + ">>(" + a + ") << " + shamt + ")");
+                            break;
+                        case opcode_t::SRL:
+                            emit_assign(params.result, "static_cast<" + type + ">(" + a + " >> " + shamt + ")");
+                            break;
+                        case opcode_t::SRA:
+                            emit_assign(params.result, "static_cast<" + type + ">(static_cast<" + signed_name(params.type) + ">(" + a + ") >> " + shamt + ")");
+                            break;
+                        case opcode_t::ROTL:
+                            emit_assign(params.result, "sp_rotl(" + a + ", " + reference(params.shamt) + ")");
+                            break;
+                        default:
+                            emit_assign(params.result, "sp_rotr(" + a + ", " + reference(params.shamt) + ")");
+                            break;
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::MulEx>) {
+                        const std::string wide = widened_name(params.operand_type);
+                        if (is_signed_instruction(opcode)) {
+                            const std::string signed_wide = "sp_signed_t<" + wide + ">";
+                            const std::string cast = "static_cast<" + signed_wide + ">(static_cast<" + signed_name(params.operand_type) + ">(";
+                            emit_assign(params.result, "static_cast<" + wide + ">(" + cast + reference(params.operand1) + ")) * " + cast + reference(params.operand2) + ")))");
+                        }
+                        else {
+                            emit_assign(params.result, "static_cast<" + wide + ">(static_cast<sp_arith<" + wide + ">>(" + reference(params.operand1) + ") * static_cast<sp_arith<" + wide + ">>(" + reference(params.operand2) + "))");
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::DivEx>) {
+                        const std::string narrow = integral_name(params.result_type);
+                        const std::string wide = widened_name(params.result_type);
+                        const std::optional<uint64_t>& divisor = constant_divisors[curr_instruction];
+                        const size_t width = primitive_width(static_cast<typeid_underlying_t>(params.result_type));
+                        if (divisor && width == 64) {
+                            emit_constant_divide_ex(is_signed_instruction(opcode), reference(params.dividend), *divisor, params.quotient, params.remainder);
+                        }
+                        else if (divisor) {
+                            // the dividend fits in 64 bits, so divide it by the divisor extended to its width
+                            const bool is_signed = is_signed_instruction(opcode);
+                            const uint64_t wide_divisor = (is_signed ? static_cast<uint64_t>(sign_extend(*divisor, width)) : *divisor) & width_mask(width * 2);
+                            emit_constant_divide(wide, narrow, reference(params.dividend), constant_quotient(width * 2, is_signed, wide_divisor), hex(wide_divisor), params.quotient, params.remainder);
+                        }
+                        else if (width == 64) {
+                            out << "    {\n";
+                            out << "        const sp_divided<u64> r = " << (is_signed_instruction(opcode) ? "sp_divex(" : "sp_divuex(") << reference(params.dividend) << ", " << reference(params.divisor) << ");\n";
+                            if (!is_unused(params.quotient)) out << "        " << reference(params.quotient) << " = r.quotient;\n";
+                            if (!is_unused(params.remainder)) out << "        " << reference(params.remainder) << " = r.remainder;\n";
+                            out << "    }\n";
+                        }
+                        else if (is_signed_instruction(opcode)) {
+                            const std::string signed_wide = "sp_signed_t<" + wide + ">";
+                            emit_divide(signed_wide, narrow, "static_cast<" + signed_wide + ">(" + reference(params.dividend) + ")", "static_cast<" + signed_name(params.result_type) + ">(" + reference(params.divisor) + ")", params.quotient, params.remainder);
+                        }
+                        else {
+                            emit_divide(wide, narrow, reference(params.dividend), reference(params.divisor), params.quotient, params.remainder);
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::ArraySized>) {
+                        out << "    " << reference(params.array) << (opcode == opcode_t::RESIZE ? ".resize(" : ".create(") << reference(params.size) << ");\n";
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::ArrayClear>) {
+                        out << "    " << reference(params.array) << ".clear();\n";
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Convert>) {
+                        const std::string result_type = primitive_name(static_cast<typeid_underlying_t>(params.result_type));
+                        const bool from_integral = is_integral_typeid(static_cast<typeid_underlying_t>(params.operand_type));
+                        const bool to_integral = is_integral_typeid(static_cast<typeid_underlying_t>(params.result_type));
+                        std::string value = reference(params.operand);
+                        if (is_signed_instruction(opcode) && from_integral) {
+                            // sign-extend (or convert as signed)
+                            value = "static_cast<" + signed_name(params.operand_type) + ">(" + value + ")";
+                        }
+                        else if (is_signed_instruction(opcode) && to_integral) {
+                            // float to signed integer
+                            value = "static_cast<" + signed_name(params.result_type) + ">(" + value + ")";
+                        }
+                        emit_assign(params.result, "static_cast<" + result_type + ">(" + value + ")");
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Reinterpret>) {
+                        emit_assign(params.result, "sp_bit_cast<" + std::string(primitive_name(static_cast<typeid_underlying_t>(params.result_type))) + ">(" + reference(params.operand) + ")");
+                    }
+                    else {
+                        static_assert(always_false<params_type>::value, "Unhandled instruction parameter type!");
+                    }
+                });
+            }
+
+            /**
+             * The operands are read into temporaries first, since the quotient may alias the divisor.
+             */
+            void emit_divide(const std::string& type, const std::string& result_type, const std::string& dividend, const std::string& divisor, const referenceid_t& quotient, const referenceid_t& remainder) {
+                out << "    {\n";
+                out << "        const " << type << " a = " << dividend << ";\n";
+                out << "        const " << type << " b = " << divisor << ";\n";
+                if (!is_unused(quotient)) out << "        " << reference(quotient) << " = static_cast<" << result_type << ">(a / b);\n";
+                if (!is_unused(remainder)) out << "        " << reference(remainder) << " = static_cast<" << result_type << ">(a % b);\n";
+                out << "    }\n";
+            }
+
+            /**
+             * The quotient of the variable a (of the given width) by a constant, as a multiply-high and shifts (or just a shift).
+             */
+            static std::string constant_quotient(size_t width, bool is_signed, uint64_t divisor) {
+                switch (width) {
+                case 8:
+                    return is_signed ? constant_quotient(constant_divisor<int8_t>(static_cast<int8_t>(divisor))) : constant_quotient(constant_divisor<uint8_t>(static_cast<uint8_t>(divisor)));
+                case 16:
+                    return is_signed ? constant_quotient(constant_divisor<int16_t>(static_cast<int16_t>(divisor))) : constant_quotient(constant_divisor<uint16_t>(static_cast<uint16_t>(divisor)));
+                case 32:
+                    return is_signed ? constant_quotient(constant_divisor<int32_t>(static_cast<int32_t>(divisor))) : constant_quotient(constant_divisor<uint32_t>(static_cast<uint32_t>(divisor)));
+                default:
+                    return is_signed ? constant_quotient(constant_divisor<int64_t>(static_cast<int64_t>(divisor))) : constant_quotient(constant_divisor<uint64_t>(divisor));
+                }
+            }
+
+            template <typename T>
+            static std::string constant_quotient(const constant_divisor<T>& divisor) {
+                const std::string type = "u" + std::to_string(sizeof(T) * 8);
+                std::string ret = (std::is_signed_v<T> ? "sp_div_constant<" : "sp_divu_constant<") + type + ">(a, static_cast<" + type + ">(" + hex(divisor.get_magic()) + "), " + std::to_string(divisor.get_shift()) + ", " + (divisor.is_add() ? "true" : "false");
+                if constexpr (std::is_signed_v<T>) ret += divisor.is_negative() ? ", true" : ", false";
+                return ret + ")";
+            }
+
+            /**
+             * Division of a variable of the given type by a constant, with the quotient computed by the given expression of a.
+             * The remainder is a - q * divisor (in the same type).
+             */
+            void emit_constant_divide(const std::string& type, const std::string& result_type, const std::string& dividend, const std::string& quotient_expression, const std::string& divisor, const referenceid_t& quotient, const referenceid_t& remainder) {
+                out << "    {\n";
+                out << "        const " << type << " a = " << dividend << ";\n";
+                out << "        const " << type << " q = " << quotient_expression << ";\n";
+                if (!is_unused(quotient)) out << "        " << reference(quotient) << " = static_cast<" << result_type << ">(q);\n";
+                if (!is_unused(remainder)) out << "        " << reference(remainder) << " = static_cast<" << result_type << ">(static_cast<sp_arith<" << type << ">>(a) - static_cast<sp_arith<" << type << ">>(q) * static_cast<sp_arith<" << type << ">>(" << divisor << "));\n";
+                out << "    }\n";
+            }
+
+            /**
+             * divex/divuex of a 128-bit dividend by a 64-bit constant, through the precomputed reciprocal of constant_divisor_ex.
+             */
+            void emit_constant_divide_ex(bool is_signed, const std::string& dividend, uint64_t divisor, const referenceid_t& quotient, const referenceid_t& remainder) {
+                out << "    {\n";
+                if (is_signed) {
+                    const constant_divisor_ex<int64_t> d(static_cast<int64_t>(divisor));
+                    out << "        const sp_divided<u64> r = sp_divex_constant(" << dividend << ", " << hex(d.get_normalized_divisor()) << ", " << hex(d.get_reciprocal()) << ", " << d.get_normalization_shift() << ", " << (static_cast<int64_t>(divisor) < 0 ? "true" : "false") << ");\n";
+                }
+                else {
+                    const constant_divisor_ex<uint64_t> d(divisor);
+                    out << "        const sp_divided<u64> r = sp_divuex_constant(" << dividend << ", " << hex(d.get_normalized_divisor()) << ", " << hex(d.get_reciprocal()) << ", " << d.get_normalization_shift() << ");\n";
+                }
+                if (!is_unused(quotient)) out << "        " << reference(quotient) << " = r.quotient;\n";
+                if (!is_unused(remainder)) out << "        " << reference(remainder) << " = r.remainder;\n";
+                out << "    }\n";
+            }
+
+            void emit_call(const InstructionParamTypes::Call& params) {
+                const Function& target = module.get_functions()[params.target - 1];
+                const size_t num_inputs = target.get_inputs().size();
+                const size_t num_outputs = target.get_outputs().size();
+                const referenceid_t* const call_params = curr_code->get_call_params(params);
+                out << "    {\n";
+                for (size_t k = 0; k != num_outputs; ++k) {
+                    out << "        " << type_name(target.get_outputs()[k]) << " r" << k << "{};\n";
+                }
+                const size_t import_index = import_indices[params.target - 1];
+                if (import_index == npos) {
+                    out << "        sp_fn_" << params.target << "(ctx";
+                    for (size_t k = 0; k != num_inputs; ++k) {
+                        out << ", " << reference(call_params[k]);
+                    }
+                    for (size_t k = 0; k != num_outputs; ++k) {
+                        out << ", r" << k;
+                    }
+                    out << ");\n";
+                }
+                else {
+                    if (!has_native_signature(target)) throw aot_exception("Imports must have only primitive parameters!");
+                    const std::string return_type = abi_return_type(target);
+                    out << "        using import_type = " << return_type << " (*)(";
+                    for (size_t k = 0; k != num_inputs; ++k) {
+                        out << (k == 0 ? "" : ", ") << abi_type_name(target.get_inputs()[k]);
+                    }
+                    out << ");\n";
+                    out << "        " << (num_outputs == 0 ? "" : "const auto ret = ") << "sp_import<import_type>(ctx, " << import_index << ")(";
+                    for (size_t k = 0; k != num_inputs; ++k) {
+                        out << (k == 0 ? "" : ", ") << "sp_to_abi(" << reference(call_params[k]) << ")";
+                    }
+                    out << ");\n";
+                    if (num_outputs == 1) {
+                        out << "        r0 = sp_from_abi(ret);\n";
+                    }
+                    else {
+                        size_t slot = 0;
+                        for (size_t k = 0; k != num_outputs; ++k) {
+                            out << "        r" << k << " = sp_load_slots<" << type_name(target.get_outputs()[k]) << ">(ret.slots + " << slot << ");\n";
+                            slot += native_slot_count(primitive_width(target.get_outputs()[k].get_typeid()) / 8);
+                        }
+                    }
+                }
+                for (size_t k = 0; k != num_outputs; ++k) {
+                    const referenceid_t& output = call_params[num_inputs + k];
+                    if (!is_unused(output)) out << "        " << reference(output) << " = std::move(r" << k << ");\n";
+                }
+                out << "    }\n";
+            }
+
+            void emit_entry(functionid_t functionid) {
+                const Function& function = module.get_functions()[functionid - 1];
+                if (!has_native_signature(function)) return;
+                const std::vector<typeid_t>& inputs = function.get_inputs();
+                const std::vector<typeid_t>& outputs = function.get_outputs();
+                out << "#line 1 \"spiral/entry_" << functionid << "\"\n";
+                out << "extern \"C\" __attribute__((visibility(\"default\"))) SP_TEXT " << abi_return_type(function) << ' ' << aot_entry_symbol(functionid) << "(sp_context* ctx";
+                for (size_t k = 0; k != inputs.size(); ++k) {
+                    out << ", " << abi_type_name(inputs[k]) << " a" << k;
+                }
+                out << ") {\n";
+                for (size_t k = 0; k != outputs.size(); ++k) {
+                    out << "    " << type_name(outputs[k]) << " r" << k << "{};\n";
+                }
+                out << "    sp_fn_" << functionid << "(ctx";
+                for (size_t k = 0; k != inputs.size(); ++k) {
+                    out << ", sp_from_abi(a" << k << ")";
+                }
+                for (size_t k = 0; k != outputs.size(); ++k) {
+                    out << ", r" << k;
+                }
+                out << ");\n";
+                if (outputs.size() == 1) {
+                    out << "    return sp_to_abi(r0);\n";
+                }
+                else if (outputs.size() > 1) {
+                    out << "    " << abi_return_type(function) << " ret{};\n";
+                    size_t slot = 0;
+                    for (size_t k = 0; k != outputs.size(); ++k) {
+                        out << "    sp_store_slots(ret.slots + " << slot << ", r" << k << ");\n";
+                        slot += native_slot_count(primitive_width(outputs[k].get_typeid()) / 8);
+                    }
+                    out << "    return ret;\n";
+                }
+                out << "}\n\n";
+            }
+
+            /**
+             * Exports the start of every generated function and the end of their section, from which aot_load fills the pc_table.
+             */
+            void emit_code_ranges() {
+                if (module.get_codes().empty()) return;
+                out << "#line 1 \"spiral/code_ranges\"\n";
+                out << "extern \"C\" __attribute__((visibility(\"default\"))) const sp_code_range " << aot_code_ranges_symbol << "[] = {\n";
+                size_t count = 0;
+                for (const Code& code : module.get_codes()) {
+                    const functionid_t functionid = code.get_functionid();
+                    out << "    { " << functionid << ", reinterpret_cast<const void*>(&sp_fn_" << functionid << ") },\n";
+                    ++count;
+                    if (has_native_signature(module.get_functions()[functionid - 1])) {
+                        out << "    { " << functionid << ", reinterpret_cast<const void*>(&" << aot_entry_symbol(functionid) << ") },\n";
+                        ++count;
+                    }
+                }
+                out << "};\n";
+                out << "extern \"C\" __attribute__((visibility(\"default\"))) const u64 " << aot_num_code_ranges_symbol << " = " << count << ";\n";
+                out << "extern \"C\" const char __stop_spiral_text[];\n";
+                out << "extern \"C\" __attribute__((visibility(\"default\"))) const void* const " << aot_code_end_symbol << " = __stop_spiral_text;\n";
+            }
+
+            const Module& module;
+            std::vector<size_t> import_indices; // indexed by functionid - 1
+            global_layout globals;
+            std::ostringstream out;
+            const Code* curr_code = nullptr;
+            const Function* curr_function = nullptr;
+            instructionid_t curr_instruction = 0;
+            std::vector<std::optional<uint64_t>> constant_divisors; // of the current function (see find_constant_divisors)
+            telemetry* sink;
+        };
+    }
+
+    /**
+     * Translates a module into C++ source (see cpp_emitter.hpp).  Throws aot_exception if the module uses something that the AOT backend does not support.
+     * If sink is not null, the emission of the module and of each function is recorded to it.
+     */
+    inline std::string emit_cpp(const Module& module, telemetry* sink = nullptr) {
+        return detail::cpp_emitter(module, sink).emit();
+    }
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cassert>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/exceptions.hpp>
+#include <spiral/binarybuf/exceptions.hpp>
+
+/**
+ * Result of the non-throwing decoder (Module::try_read): either the value, or what went wrong and where.
+ */
+
+namespace spiral {
+
+    enum class decode_errc : uint8_t {
+        truncated = 1, // the buffer ended in the middle of the module
+        varint_overflow, // a varint is out of range for its integer type
+        malformed // anything else (e.g. unknown opcode, type mismatch, or reference out of range)
+    };
+
+    struct decode_error {
+        decode_errc kind;
+        size_t offset; // byte at which the error was detected
+        const char* description; // static string
+
+        /**
+         * Returns the description, with the offset.
+         */
+        std::string message() const {
+            return std::string(description) + " (at byte " + std::to_string(offset) + ")";
+        }
+
+        /**
+         * Throws the exception that Module::read throws for this error (eof_exception if truncated, otherwise decode_exception).
+         */
+        [[noreturn]] void raise() const {
+            if (kind == decode_errc::truncated) throw eof_exception(message());
+            throw decode_exception(message());
+        }
+    };
+
+    /**
+     * Either a value or a decode_error, in the manner of std::expected.
+     */
+    template <typename T>
+    class decode_result {
+    public:
+        decode_result(T value) noexcept(std::is_nothrow_move_constructible_v<T>) : val(std::move(value)), err{} {}
+        decode_result(decode_error error) noexcept : err(error) {}
+
+        bool has_value() const noexcept { return val.has_value(); }
+        explicit operator bool() const noexcept { return has_value(); }
+
+        T& value() & noexcept {
+            assert(has_value());
+            return *val;
+        }
+        const T& value() const & noexcept {
+            assert(has_value());
+            return *val;
+        }
+        T&& value() && noexcept {
+            assert(has_value());
+            return std::move(*val);
+        }
+
+        const decode_error& error() const noexcept {
+            assert(!has_value());
+            return err;
+        }
+
+    private:
+        std::optional<T> val;
+        decode_error err;
+    };
+
+}
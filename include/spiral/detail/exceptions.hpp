@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace spiral {
+
+    /**
+     * Host bindings that do not match the module (e.g. missing import, or mismatched signature).
+     */
+    class link_exception : public std::runtime_error {
+    public:
+        explicit link_exception(const char* description) : std::runtime_error(description) {}
+        explicit link_exception(const std::string& description) : std::runtime_error(description) {}
+        virtual ~link_exception() noexcept {}
+    };
+
+    /**
+     * Malformed module (e.g. unknown opcode, type mismatch, or reference out of range).
+     */
+    class decode_exception : public std::runtime_error {
+    public:
+        explicit decode_exception(const char* description) : std::runtime_error(description) {}
+        explicit decode_exception(const std::string& description) : std::runtime_error(description) {}
+        virtual ~decode_exception() noexcept {}
+    };
+
+    /**
+     * Malformed module given to ModuleBuilder (e.g. type mismatch, or reference out of range).
+     */
+    class build_exception : public std::runtime_error {
+    public:
+        explicit build_exception(const char* description) : std::runtime_error(description) {}
+        explicit build_exception(const std::string& description) : std::runtime_error(description) {}
+        virtual ~build_exception() noexcept {}
+    };
+
+    /**
+     * Module that cannot be compiled ahead of time (e.g. unsupported type), or failure of the system compiler.
+     */
+    class aot_exception : public std::runtime_error {
+    public:
+        explicit aot_exception(const char* description) : std::runtime_error(description) {}
+        explicit aot_exception(const std::string& description) : std::runtime_error(description) {}
+        virtual ~aot_exception() noexcept {}
+    };
+
+    /**
+     * Instance snapshot that cannot be written or mapped, or that does not match the module.
+     */
+    class snapshot_exception : public std::runtime_error {
+    public:
+        explicit snapshot_exception(const char* description) : std::runtime_error(description) {}
+        explicit snapshot_exception(const std::string& description) : std::runtime_error(description) {}
+        virtual ~snapshot_exception() noexcept {}
+    };
+
+    /**
+     * Profiler that cannot be started (e.g. another one is running, or the platform is not supported).
+     */
+    class profiler_exception : public std::runtime_error {
+    public:
+        explicit profiler_exception(const char* description) : std::runtime_error(description) {}
+        explicit profiler_exception(const std::string& description) : std::runtime_error(description) {}
+        virtual ~profiler_exception() noexcept {}
+    };
+
+}
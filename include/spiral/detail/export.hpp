@@ -1,13 +1,22 @@
 #pragma once
 
 #include <string>
+#include <utility>
 
 #include <spiral/detail/function.hpp>
 
 namespace spiral {
 
     class Export {
-        functionid_t functionid;
+    public:
+        Export() = default;
+        Export(functionid_t functionid, std::string name) : functionid(functionid), name(std::move(name)) {}
+
+        functionid_t get_functionid() const noexcept { return functionid; }
+        const std::string& get_name() const noexcept { return name; }
+
+    private:
+        functionid_t functionid = 0;
         std::string name;
     };
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include <spiral/detail/typedefs.hpp>
@@ -10,6 +11,14 @@ namespace spiral {
     using functionid_t = size_t;
 
     class Function {
+    public:
+        Function() = default;
+        Function(std::vector<typeid_t> inputs, std::vector<typeid_t> outputs) : inputs(std::move(inputs)), outputs(std::move(outputs)) {}
+
+        const std::vector<typeid_t>& get_inputs() const noexcept { return inputs; }
+        const std::vector<typeid_t>& get_outputs() const noexcept { return outputs; }
+
+    private:
         std::vector<typeid_t> inputs;
         std::vector<typeid_t> outputs;
     };
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+
+namespace spiral {
+
+    using globalid_t = size_t;
+
+    namespace GlobalFlags {
+        enum : uint32_t {
+            Hot = 0x1, // accessed frequently (placed together at the start of the global block)
+            Shared = 0x2, // accessed by several host threads (placed on its own cache line)
+            All = Hot | Shared
+        };
+    }
+
+    class Global {
+    public:
+        Global() = default;
+        Global(typeid_underlying_t type, uint32_t flags) : type(type), flags(flags) {}
+
+        /**
+         * Returns the (primitive) type of this global.
+         */
+        typeid_underlying_t get_type() const noexcept { return type; }
+        uint32_t get_flags() const noexcept { return flags; }
+
+        bool is_hot() const noexcept { return flags & GlobalFlags::Hot; }
+        bool is_shared() const noexcept { return flags & GlobalFlags::Shared; }
+
+    private:
+        typeid_underlying_t type = 0;
+        uint32_t flags = 0;
+    };
+
+}
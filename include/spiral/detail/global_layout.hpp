@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define SPIRAL_GLOBAL_BLOCK_MMAP
+#endif
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/global.hpp>
+#include <spiral/detail/hash.hpp>
+
+namespace spiral {
+
+    /**
+     * Cache line size assumed when separating shared globals.
+     */
+    constexpr size_t global_cache_line_size = 64;
+
+    /**
+     * Placement of the globals of a module in the per-instance global block.
+     *
+     * Hot globals come first, then cold globals, each group sorted by decreasing alignment so that there is no
+     * padding between them and the hot ones share as few cache lines as possible.  Every shared global gets a cache
+     * line of its own after that, so that host threads writing different globals do not contend for a line.
+     * The block itself is aligned to a cache line.
+     */
+    class global_layout {
+    public:
+        global_layout() = default;
+        explicit global_layout(const std::vector<Global>& globals) : offsets(globals.size(), 0) {
+            std::vector<globalid_t> order(globals.size());
+            std::iota(order.begin(), order.end(), 1);
+            const auto rank = [&](globalid_t globalid) {
+                const Global& global = globals[globalid - 1];
+                return global.is_shared() ? 2 : global.is_hot() ? 0 : 1;
+            };
+            std::stable_sort(order.begin(), order.end(), [&](globalid_t a, globalid_t b) {
+                if (rank(a) != rank(b)) return rank(a) < rank(b);
+                return width_of(globals[a - 1]) > width_of(globals[b - 1]);
+            });
+            size_t offset = 0;
+            for (const globalid_t globalid : order) {
+                const Global& global = globals[globalid - 1];
+                const size_t size = width_of(global);
+                const size_t alignment = global.is_shared() ? global_cache_line_size : size;
+                offset = (offset + alignment - 1) / alignment * alignment;
+                offsets[globalid - 1] = offset;
+                offset += global.is_shared() ? std::max(size, global_cache_line_size) : size;
+            }
+            size = (offset + global_cache_line_size - 1) / global_cache_line_size * global_cache_line_size;
+            fingerprint = size;
+            for (const Global& global : globals) {
+                const uint64_t description[2] = { static_cast<uint64_t>(global.get_type()), global.get_flags() };
+                fingerprint = hash_bytes(reinterpret_cast<const byte*>(description), sizeof(description), fingerprint);
+            }
+        }
+
+        /**
+         * Returns the byte offset of a global from the start of the block.
+         */
+        size_t get_offset(globalid_t globalid) const noexcept { return offsets[globalid - 1]; }
+        size_t get_size() const noexcept { return size; }
+        static constexpr size_t get_alignment() noexcept { return global_cache_line_size; }
+
+        /**
+         * Returns a hash of the global section, which identifies blocks with this layout (e.g. in snapshots).
+         */
+        uint64_t get_fingerprint() const noexcept { return fingerprint; }
+
+    private:
+        static size_t width_of(const Global& global) noexcept {
+            return primitive_width(global.get_type()) / 8;
+        }
+
+        std::vector<size_t> offsets; // indexed by globalid - 1
+        size_t size = 0;
+        uint64_t fingerprint = 0;
+    };
+
+    namespace detail {
+        /**
+         * Frees a global block, which is either allocated by make_global_block or (if mapped_size is nonzero) mapped from a snapshot.
+         */
+        struct global_block_deleter {
+            size_t mapped_size = 0;
+
+            void operator()(byte* block) const noexcept {
+                if (mapped_size != 0) {
+#ifdef SPIRAL_GLOBAL_BLOCK_MMAP
+                    munmap(block, mapped_size);
+#endif
+                }
+                else {
+                    ::operator delete(block, std::align_val_t(global_layout::get_alignment()));
+                }
+            }
+        };
+    }
+
+    using global_block = std::unique_ptr<byte[], detail::global_block_deleter>;
+
+    /**
+     * Allocates a zero-initialized global block for the given layout (nullptr if the module has no globals).
+     */
+    inline global_block make_global_block(const global_layout& layout) {
+        if (layout.get_size() == 0) return nullptr;
+        byte* const block = static_cast<byte*>(::operator new(layout.get_size(), std::align_val_t(global_layout::get_alignment())));
+        std::memset(block, 0, layout.get_size());
+        return global_block(block);
+    }
+
+}
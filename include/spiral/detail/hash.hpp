@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstring>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/wide_arithmetic.hpp>
+
+namespace spiral {
+
+    namespace detail {
+
+        /**
+         * Multiplies two 64-bit values and folds the 128-bit product (the mixing step of wyhash).
+         */
+        inline uint64_t hash_mix(uint64_t a, uint64_t b) noexcept {
+            const uint128_t product = mullu(a, b);
+            return product.get_lower() ^ product.get_upper();
+        }
+
+        inline uint64_t hash_read64(const byte* data) noexcept {
+            uint64_t ret;
+            std::memcpy(&ret, data, sizeof(ret));
+            return ret;
+        }
+
+        inline uint64_t hash_read_tail(const byte* data, size_t size) noexcept {
+            uint64_t ret = 0;
+            if (size != 0) std::memcpy(&ret, data, size);
+            return ret;
+        }
+
+        constexpr uint64_t hash_secret[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+    }
+
+    /**
+     * Fast non-cryptographic 64-bit hash of a byte string (consumes 16 bytes per step, with one 64x64->128 multiply per step).
+     * The result is the same on every platform of the same endianness.
+     */
+    inline uint64_t hash_bytes(const byte* data, size_t size, uint64_t seed = 0) noexcept {
+        using namespace detail;
+        uint64_t state = seed ^ hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+        size_t remaining = size;
+        for (; remaining > 16; remaining -= 16, data += 16) {
+            state = hash_mix(hash_read64(data) ^ hash_secret[1], hash_read64(data + 8) ^ state);
+        }
+        const uint64_t a = hash_read_tail(data, remaining > 8 ? 8 : remaining);
+        const uint64_t b = remaining > 8 ? hash_read_tail(data + 8, remaining - 8) : 0;
+        return hash_mix(hash_secret[1] ^ size, hash_mix(a ^ hash_secret[1], b ^ state));
+    }
+
+}
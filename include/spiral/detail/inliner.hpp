@@ -0,0 +1,396 @@
+#pragma once
+
+#include <cassert>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/instruction.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/telemetry.hpp>
+
+/**
+ * Inlining of calls to functions defined in the same module.
+ *
+ * A call is replaced by the callee body, with the callee parameters and locals remapped to fresh locals of the caller:
+ * the inputs are copied in, the body runs, and the outputs are moved out to the call's output references.
+ * Jumps to the end of the callee (i.e. returns) become jumps to the output moves.
+ * Since the fresh locals are zero-initialized only once on entry to the caller, call sites that can execute more than
+ * once (those inside a loop) also get an explicit re-initialization of the callee outputs and locals.
+ */
+
+namespace spiral {
+
+    struct inliner_options {
+        size_t max_callee_size = 16; // largest callee (in instructions) to inline at a cold call site
+        size_t max_hot_callee_size = 64; // largest callee to inline at a call site inside a loop
+        size_t max_caller_size = 4096; // stop inlining into a function once it grows beyond this
+        size_t module_budget = 16384; // total number of instructions that may be added to the module
+    };
+
+    struct inliner_result {
+        size_t calls_inlined = 0;
+        size_t instructions_added = 0;
+    };
+
+    namespace detail {
+
+        class inliner {
+        public:
+            inliner(std::vector<Code>& codes, const std::vector<Function>& functions, const inliner_options& options) : codes(codes), functions(functions), options(options), code_of(functions.size() + 1, no_code) {
+                for (size_t i = 0; i != codes.size(); ++i) {
+                    assert(codes[i].get_functionid() != 0 && codes[i].get_functionid() <= functions.size());
+                    code_of[codes[i].get_functionid()] = i;
+                }
+            }
+
+            inliner_result run() {
+                // process callees before their callers, so that inlined bodies have already been through the inliner
+                std::vector<char> visited(codes.size(), 0);
+                std::vector<size_t> order;
+                for (size_t i = 0; i != codes.size(); ++i) {
+                    visit(i, visited, order);
+                }
+                for (const size_t index : order) {
+                    if (result.instructions_added >= options.module_budget) break;
+                    inline_into(codes[index]);
+                }
+                return result;
+            }
+
+        private:
+            static constexpr size_t no_code = static_cast<size_t>(-1);
+
+            void visit(size_t index, std::vector<char>& visited, std::vector<size_t>& order) const {
+                if (visited[index]) return;
+                visited[index] = 1;
+                for (const Instruction& instruction : codes[index].get_instructions()) {
+                    instruction.get_params([&](const auto& params) {
+                        if constexpr (std::is_same_v<std::decay_t<decltype(params)>, InstructionParamTypes::Call>) {
+                            if (params.target < code_of.size() && code_of[params.target] != no_code) {
+                                visit(code_of[params.target], visited, order);
+                            }
+                        }
+                    });
+                }
+                order.push_back(index);
+            }
+
+            /**
+             * Checks whether every variable of the callee can be given a fresh caller local (and reset to zero if needed).
+             */
+            bool is_inlinable(const Code& callee) const {
+                const Function& function = functions[callee.get_functionid() - 1];
+                for (const typeid_t& type : function.get_inputs()) {
+                    if (!type.is_primitive()) return false;
+                }
+                for (const typeid_t& type : function.get_outputs()) {
+                    if (!type.is_primitive()) return false;
+                }
+                for (const typeid_t& type : callee.get_locals()) {
+                    if (type.is_record()) return false;
+                }
+                return true;
+            }
+
+            /**
+             * Returns, for every instruction, whether it is inside a loop (i.e. between the target and the source of a backward jump).
+             */
+            static std::vector<bool> find_loops(const std::vector<Instruction>& instructions) {
+                std::vector<int> depth_change(instructions.size() + 1, 0);
+                for (instructionid_t i = 0; i != instructions.size(); ++i) {
+                    if (get_descriptor(instructions[i].get_opcode()).has(OpcodeFlags::Branch)) {
+                        const instructionid_t target = jump_target(instructions[i]);
+                        if (target <= i) {
+                            ++depth_change[target];
+                            --depth_change[i + 1];
+                        }
+                    }
+                }
+                std::vector<bool> ret(instructions.size());
+                int depth = 0;
+                for (instructionid_t i = 0; i != instructions.size(); ++i) {
+                    depth += depth_change[i];
+                    ret[i] = depth > 0;
+                }
+                return ret;
+            }
+
+            static instructionid_t jump_target(const Instruction& instruction) noexcept {
+                instructionid_t target = 0;
+                instruction.get_params([&](const auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, InstructionParamTypes::Jump> || std::is_same_v<params_type, InstructionParamTypes::JumpConditional>) {
+                        target = params.target;
+                    }
+                });
+                return target;
+            }
+
+            struct call_site {
+                instructionid_t index;
+                const Code* callee;
+                bool reinitialize;
+                size_t length; // length of the inlined sequence
+            };
+
+            void inline_into(Code& caller) {
+                std::vector<Instruction>& instructions = caller.get_instructions();
+                const std::vector<bool> in_loop = find_loops(instructions);
+                size_t caller_size = instructions.size();
+
+                std::vector<call_site> sites;
+                for (instructionid_t i = 0; i != instructions.size(); ++i) {
+                    instructions[i].get_params([&](const auto& params) {
+                        if constexpr (std::is_same_v<std::decay_t<decltype(params)>, InstructionParamTypes::Call>) {
+                            if (params.target >= code_of.size() || code_of[params.target] == no_code || params.target == caller.get_functionid()) return;
+                            const Code& callee = codes[code_of[params.target]];
+                            const size_t callee_size = callee.get_instructions().size();
+                            if (callee_size > (in_loop[i] ? options.max_hot_callee_size : options.max_callee_size) || !is_inlinable(callee)) return;
+                            const Function& function = functions[params.target - 1];
+                            const size_t num_inputs = function.get_inputs().size();
+                            const size_t num_outputs = function.get_outputs().size();
+                            size_t length = num_inputs + callee_size;
+                            const referenceid_t* const call_params = caller.get_call_params(params);
+                            for (size_t k = 0; k != num_outputs; ++k) {
+                                if (call_params[num_inputs + k].variableid != 0) ++length;
+                            }
+                            if (in_loop[i]) length += num_outputs + callee.get_locals().size();
+                            const size_t added = length - 1;
+                            if (caller_size + added > options.max_caller_size || result.instructions_added + added > options.module_budget) return;
+                            caller_size += added;
+                            result.instructions_added += added;
+                            ++result.calls_inlined;
+                            sites.push_back({ i, &callee, in_loop[i], length });
+                        }
+                    });
+                }
+                if (sites.empty()) return;
+
+                // new position of every old instruction (and of the end of the function)
+                std::vector<instructionid_t> new_index(instructions.size() + 1);
+                {
+                    size_t site = 0;
+                    instructionid_t next = 0;
+                    for (instructionid_t i = 0; i != instructions.size(); ++i) {
+                        new_index[i] = next;
+                        if (site != sites.size() && sites[site].index == i) {
+                            next += sites[site++].length;
+                        }
+                        else {
+                            ++next;
+                        }
+                    }
+                    new_index[instructions.size()] = next;
+                }
+
+                std::vector<Instruction> result_instructions;
+                result_instructions.reserve(new_index.back());
+                size_t site = 0;
+                for (instructionid_t i = 0; i != instructions.size(); ++i) {
+                    if (site != sites.size() && sites[site].index == i) {
+                        emit_inlined(caller, instructions[i], sites[site], new_index[i], result_instructions);
+                        ++site;
+                        continue;
+                    }
+                    instructions[i].get_params([&](auto& params) {
+                        using params_type = std::decay_t<decltype(params)>;
+                        if constexpr (std::is_same_v<params_type, InstructionParamTypes::Jump> || std::is_same_v<params_type, InstructionParamTypes::JumpConditional>) {
+                            params.target = new_index[params.target];
+                        }
+                    });
+                    result_instructions.push_back(std::move(instructions[i]));
+                }
+                assert(result_instructions.size() == new_index.back());
+                instructions = std::move(result_instructions);
+            }
+
+            void emit_inlined(Code& caller, const Instruction& call, const call_site& site, instructionid_t start, std::vector<Instruction>& out) const {
+                namespace P = InstructionParamTypes;
+                const Code& callee = *site.callee;
+                const Function& function = functions[callee.get_functionid() - 1];
+                const size_t num_inputs = function.get_inputs().size();
+                const size_t num_outputs = function.get_outputs().size();
+                const P::Call* call_params = nullptr;
+                call.get_params([&](const auto& params) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(params)>, P::Call>) {
+                        call_params = &params;
+                    }
+                });
+                assert(call_params != nullptr);
+
+                // indexed rather than by pointer, since cloning the calls of the callee appends to the pool
+                std::vector<referenceid_t>& call_operands = caller.get_call_operands();
+                const size_t call_params_begin = call_params->params;
+
+                // fresh caller locals: first the callee parameters, then the callee locals
+                std::vector<typeid_t>& locals = caller.get_locals();
+                const variableid_t param_base = static_cast<variableid_t>(locals.size()) + 1;
+                locals.insert(locals.end(), function.get_inputs().begin(), function.get_inputs().end());
+                locals.insert(locals.end(), function.get_outputs().begin(), function.get_outputs().end());
+                const variableid_t local_base = static_cast<variableid_t>(locals.size()) + 1;
+                locals.insert(locals.end(), callee.get_locals().begin(), callee.get_locals().end());
+
+                const auto remap_variable = [&](variableid_t variableid) -> variableid_t {
+                    if (variableid > 0) return local_base + variableid - 1;
+                    if (variableid < 0) return param_base - variableid - 1;
+                    return 0;
+                };
+                const auto is_array_variable = [&](variableid_t variableid) -> bool {
+                    return variableid > 0 && callee.get_locals()[variableid - 1].is_array();
+                };
+                const auto remap = [&](referenceid_t ref) -> referenceid_t {
+                    if (is_array_variable(ref.variableid)) {
+                        ref.array_index_variableid = remap_variable(ref.array_index_variableid);
+                    }
+                    ref.variableid = remap_variable(ref.variableid);
+                    return ref;
+                };
+
+                if (site.reinitialize) {
+                    for (size_t k = 0; k != num_outputs; ++k) {
+                        out.push_back(make_zero(function.get_outputs()[k], referenceid_t(param_base + static_cast<variableid_t>(num_inputs + k))));
+                    }
+                    for (size_t k = 0; k != callee.get_locals().size(); ++k) {
+                        out.push_back(make_zero(callee.get_locals()[k], referenceid_t(local_base + static_cast<variableid_t>(k))));
+                    }
+                }
+                for (size_t k = 0; k != num_inputs; ++k) {
+                    out.push_back(Instruction(opcode_t::COPY, P::Transfer{ function.get_inputs()[k].get_typeid(), call_operands[call_params_begin + k], referenceid_t(param_base + static_cast<variableid_t>(k)) }));
+                }
+                const instructionid_t body_start = start + (site.reinitialize ? num_outputs + callee.get_locals().size() : 0) + num_inputs;
+                assert(body_start == out.size());
+                for (const Instruction& instruction : callee.get_instructions()) {
+                    out.push_back(clone(instruction, callee, body_start, remap, call_operands));
+                }
+                for (size_t k = 0; k != num_outputs; ++k) {
+                    const referenceid_t destination = call_operands[call_params_begin + num_inputs + k];
+                    if (destination.variableid == 0) continue;
+                    out.push_back(Instruction(opcode_t::MOVE, P::Transfer{ function.get_outputs()[k].get_typeid(), referenceid_t(param_base + static_cast<variableid_t>(num_inputs + k)), destination }));
+                }
+            }
+
+            static Instruction make_zero(const typeid_t& type, referenceid_t variable) {
+                namespace P = InstructionParamTypes;
+                if (type.is_array()) {
+                    return Instruction(opcode_t::CLEAR, P::ArrayClear{ type.get_typeid(), variable });
+                }
+                P::Immediate params;
+                params.type = static_cast<typeid_primitive_t>(type.get_typeid());
+                params.variable = variable;
+                params.value.i128 = int128_t(0, 0);
+                return Instruction(opcode_t::IMM, params);
+            }
+
+            /**
+             * Copies a callee instruction, remapping its variables and offsetting its jump targets by body_start.
+             * The parameters of a call are copied into call_operands (the pool of the caller).
+             */
+            template <typename Remap>
+            Instruction clone(const Instruction& instruction, const Code& callee, instructionid_t body_start, const Remap& remap, std::vector<referenceid_t>& call_operands) const {
+                namespace P = InstructionParamTypes;
+                const opcode_t opcode = instruction.get_opcode();
+                std::optional<Instruction> ret;
+                instruction.get_params([&](const auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, P::Empty>) {
+                        ret.emplace(opcode, P::Empty{});
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Jump>) {
+                        ret.emplace(opcode, P::Jump{ body_start + params.target });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::JumpConditional>) {
+                        ret.emplace(opcode, P::JumpConditional{ params.type, body_start + params.target, remap(params.condition) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Call>) {
+                        const Function& target = functions[params.target - 1];
+                        const size_t num_params = target.get_inputs().size() + target.get_outputs().size();
+                        const referenceid_t* const call_params = callee.get_call_params(params);
+                        ret.emplace(opcode, P::Call{ params.target, call_operands.size() });
+                        for (size_t k = 0; k != num_params; ++k) {
+                            call_operands.push_back(remap(call_params[k]));
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Immediate>) {
+                        P::Immediate copy = params;
+                        copy.variable = remap(params.variable);
+                        ret.emplace(opcode, copy);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Transfer>) {
+                        ret.emplace(opcode, P::Transfer{ params.type, remap(params.source), remap(params.destination) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::GlobalAccess>) {
+                        ret.emplace(opcode, P::GlobalAccess{ params.type, params.global, remap(params.variable) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::OneOperandInt>) {
+                        ret.emplace(opcode, P::OneOperandInt{ params.type, remap(params.operand), remap(params.result) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::TwoOperandInt>) {
+                        ret.emplace(opcode, P::TwoOperandInt{ params.type, remap(params.operand1), remap(params.operand2), remap(params.result) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Divide>) {
+                        ret.emplace(opcode, P::Divide{ params.type, remap(params.dividend), remap(params.divisor), remap(params.quotient), remap(params.remainder) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::BitCount>) {
+                        ret.emplace(opcode, P::BitCount{ params.operand_type, params.result_type, remap(params.operand), remap(params.result) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Shift>) {
+                        ret.emplace(opcode, P::Shift{ params.type, params.shamt_type, remap(params.operand), remap(params.shamt), remap(params.result) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::MulEx>) {
+                        ret.emplace(opcode, P::MulEx{ params.operand_type, remap(params.operand1), remap(params.operand2), remap(params.result) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::DivEx>) {
+                        ret.emplace(opcode, P::DivEx{ params.result_type, remap(params.dividend), remap(params.divisor), remap(params.quotient), remap(params.remainder) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::ArraySized>) {
+                        ret.emplace(opcode, P::ArraySized{ params.element_type, remap(params.array), remap(params.size) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::ArrayClear>) {
+                        ret.emplace(opcode, P::ArrayClear{ params.element_type, remap(params.array) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Convert>) {
+                        ret.emplace(opcode, P::Convert{ params.operand_type, params.result_type, remap(params.operand), remap(params.result) });
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Reinterpret>) {
+                        ret.emplace(opcode, P::Reinterpret{ params.operand_type, params.result_type, remap(params.operand), remap(params.result) });
+                    }
+                    else {
+                        static_assert(always_false<params_type>::value, "Unhandled instruction parameter type!");
+                    }
+                });
+                return std::move(*ret);
+            }
+
+            std::vector<Code>& codes;
+            const std::vector<Function>& functions;
+            const inliner_options& options;
+            std::vector<size_t> code_of; // index into codes for each functionid, or no_code for imports
+            inliner_result result;
+        };
+    }
+
+    /**
+     * Inlines small functions into their callers within a module, subject to the size limits and the module budget in options.
+     * Call sites inside loops are treated as hot and may inline larger callees.
+     * functions is the function section of the module (functionids start from 1); codes are modified in place.
+     * If sink is not null, the pass is recorded to it.
+     */
+    inline inliner_result inline_calls(std::vector<Code>& codes, const std::vector<Function>& functions, const inliner_options& options = {}, telemetry* sink = nullptr) {
+        telemetry::scope scope(sink, "inline");
+        inliner_result ret = detail::inliner(codes, functions, options).run();
+        if (sink != nullptr) {
+            size_t num_instructions = 0;
+            for (const Code& code : codes) {
+                num_instructions += code.get_instructions().size();
+            }
+            scope.set_instructions(num_instructions);
+        }
+        return ret;
+    }
+
+}
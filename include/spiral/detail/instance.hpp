@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cassert>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/export.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/compiled_module.hpp>
+#include <spiral/detail/global.hpp>
+#include <spiral/detail/global_layout.hpp>
+#include <spiral/detail/snapshot.hpp>
+#include <spiral/detail/linker.hpp>
+#include <spiral/detail/native_abi.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+namespace spiral {
+
+    template <typename Signature>
+    class export_function;
+
+    /**
+     * Typed handle to an exported function, obtained from Instance::get_export.
+     * The signature has already been checked, so calling it is a single indirect call into the compiled entry point,
+     * with the arguments in registers (and up to two 64-bit outputs returned in registers).
+     * R is void, a single native type, or a std::tuple of native types (for multiple outputs).
+     * The handle is two pointers wide, and is valid as long as the instance that it came from.
+     */
+    template <typename R, typename... Args>
+    class export_function<R(Args...)> {
+        static_assert(std::conjunction_v<is_native_type<Args>...>, "Export parameters must be native types!");
+
+    public:
+        using inputs = type_list<Args...>;
+        using outputs = typename host_outputs<R>::type;
+        using return_type = native_return_t<outputs>;
+        using entry_type = return_type (*)(native_context*, Args...);
+
+        export_function(entry_type entry, native_context* context) noexcept : entry(entry), context(context) {}
+
+        inline R operator()(Args... args) const {
+            if constexpr (std::is_same_v<return_type, R>) {
+                return entry(context, args...);
+            }
+            else {
+                return detail::from_native_results(entry(context, args...), std::make_index_sequence<std::tuple_size_v<R>>{});
+            }
+        }
+
+        entry_type get_entry() const noexcept { return entry; }
+        native_context* get_context() const noexcept { return context; }
+
+    private:
+        entry_type entry;
+        native_context* context;
+    };
+
+    /**
+     * Per-instance state of a module: the context that compiled code receives, the import bindings, and the globals.
+     * The module and its compiled code are shared (and immutable), so instantiation only allocates the context and the global block.
+     */
+    class Instance {
+    public:
+        Instance(std::shared_ptr<const CompiledModule> compiled, std::shared_ptr<const import_bindings> imports) : Instance(compiled, std::move(imports), make_global_block(compiled->get_global_layout())) {}
+
+        /**
+         * Throws link_exception if some import is not bound.
+         */
+        Instance(std::shared_ptr<const CompiledModule> compiled, const Linker& linker) : Instance(std::move(compiled), linker.link()) {}
+
+        /**
+         * Starts from a snapshot of an instance of the same module instead of zero-initialized globals.
+         * The globals are mapped copy-on-write from the image, so pages are only copied when this instance writes to them.
+         * Throws snapshot_exception if the image does not match the module or cannot be mapped.
+         */
+        Instance(std::shared_ptr<const CompiledModule> compiled, std::shared_ptr<const import_bindings> imports, const snapshot_image& image) : Instance(compiled, std::move(imports), image.map_globals(compiled->get_global_layout(), compiled->get_content_hash())) {}
+
+        /**
+         * Returns a typed handle to the export with the given name, e.g. get_export<std::tuple<int64_t, int64_t>(int32_t)>("name").
+         * The signature is checked here, once.  Throws link_exception if there is no such export, the signature does not match, or the function has not been compiled.
+         */
+        template <typename Signature>
+        export_function<Signature> get_export(std::string_view name) const {
+            return get_export<Signature>(hashed_name(name));
+        }
+
+        /**
+         * Same as above, with the hash of the name computed beforehand (for names that are looked up repeatedly).
+         */
+        template <typename Signature>
+        export_function<Signature> get_export(const hashed_name& name) const {
+            using handle_type = export_function<Signature>;
+            const Module& module = compiled->get_module();
+            const Export& ex = find_export(name);
+            const Function& function = module.get_functions()[ex.get_functionid() - 1];
+            if (!detail::types_match(function.get_inputs(), native_typeids(typename handle_type::inputs{})) || !detail::types_match(function.get_outputs(), native_typeids(typename handle_type::outputs{}))) {
+                throw link_exception("Signature does not match export \"" + ex.get_name() + "\"!");
+            }
+            const native_function_t entry = compiled->get_entry(ex.get_functionid());
+            if (entry == nullptr) {
+                throw link_exception("Export \"" + ex.get_name() + "\" has not been compiled!");
+            }
+            return handle_type(reinterpret_cast<typename handle_type::entry_type>(entry), context.get());
+        }
+
+        /**
+         * Returns the given global of this instance, e.g. get_global<int64_t>(1).  Throws link_exception if there is no such global or its type does not match.
+         * Accesses to shared globals are not synchronized with compiled code.
+         */
+        template <typename T>
+        T& get_global(globalid_t globalid) const {
+            static_assert(is_native_type_v<T>, "Globals must be primitives!");
+            const std::vector<Global>& module_globals = compiled->get_module().get_globals();
+            if (globalid == 0 || globalid > module_globals.size()) {
+                throw link_exception("No global with id " + std::to_string(globalid) + "!");
+            }
+            if (module_globals[globalid - 1].get_type() != native_typeid<T>::value) {
+                throw link_exception("Type does not match global " + std::to_string(globalid) + "!");
+            }
+            return *std::launder(reinterpret_cast<T*>(globals.get() + compiled->get_global_layout().get_offset(globalid)));
+        }
+
+        /**
+         * Writes the globals of this instance to an image, from which new instances can be started.  Throws snapshot_exception on failure.
+         * Must not be called while compiled code of this instance is running.
+         */
+        void save_snapshot(const std::filesystem::path& path) const {
+            write_snapshot(compiled->get_global_layout(), compiled->get_content_hash(), globals.get(), path);
+        }
+
+        const Module& get_module() const noexcept { return compiled->get_module(); }
+        const std::shared_ptr<const CompiledModule>& get_compiled() const noexcept { return compiled; }
+        native_context* get_context() const noexcept { return context.get(); }
+
+    private:
+        /**
+         * Both public constructors end here, with the global block that the instance starts from.
+         */
+        Instance(std::shared_ptr<const CompiledModule> compiled, std::shared_ptr<const import_bindings> imports, global_block globals) : compiled(std::move(compiled)), imports(std::move(imports)), context(std::make_unique<native_context>()), globals(std::move(globals)) {
+            assert(this->imports->size() == this->compiled->get_module().get_imports().size());
+            context->imports = this->imports->data();
+            context->resolve_import = &import_bindings::resolve_entry;
+            context->import_table = this->imports.get();
+            context->globals = this->globals.get();
+        }
+
+        const Export& find_export(const hashed_name& name) const {
+            const Module& module = compiled->get_module();
+            const Export* const ex = module.find_export(name);
+            if (ex == nullptr) {
+                throw link_exception("No export named \"" + std::string(name.get_name()) + "\"!");
+            }
+            if (ex->get_functionid() == 0 || ex->get_functionid() > module.get_functions().size()) {
+                throw link_exception("Export \"" + ex->get_name() + "\" refers to a nonexistent function!");
+            }
+            return *ex;
+        }
+
+        std::shared_ptr<const CompiledModule> compiled;
+        std::shared_ptr<const import_bindings> imports;
+        std::unique_ptr<native_context> context;
+        global_block globals;
+    };
+
+}
@@ -1,7 +1,7 @@
 #pragma once
 
+#include <array>
 #include <cassert>
-#include <memory>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -10,6 +10,7 @@
 #include <spiral/detail/typedefs.hpp>
 #include <spiral/detail/typeid.hpp>
 #include <spiral/detail/function.hpp>
+#include <spiral/detail/global.hpp>
 #include <spiral/detail/untagged_union.hpp>
 
 namespace spiral {
@@ -43,6 +44,10 @@ namespace spiral {
     };
 
     class referenceid_t {
+    public:
+        referenceid_t() noexcept : variableid(0), array_index_variableid(0) {}
+        explicit referenceid_t(variableid_t variableid) noexcept : variableid(variableid), array_index_variableid(0) {}
+
         variableid_t variableid;
         union {
             variableid_t array_index_variableid; // used for arrays only
@@ -62,7 +67,7 @@ namespace spiral {
         };
         struct Call {
             functionid_t target;
-            std::unique_ptr<referenceid_t[]> params;
+            size_t params; // offset of the inputs and then the outputs in Code::get_call_operands()
         };
         union any_signed_integral {
             int8_t i8;
@@ -81,6 +86,11 @@ namespace spiral {
             referenceid_t source;
             referenceid_t destination;
         };
+        struct GlobalAccess {
+            typeid_primitive_t type;
+            globalid_t global;
+            referenceid_t variable;
+        };
         struct OneOperandInt {
             typeid_integral_t type;
             referenceid_t operand;
@@ -92,6 +102,13 @@ namespace spiral {
             referenceid_t operand2;
             referenceid_t result;
         };
+        struct Divide {
+            typeid_integral_t type;
+            referenceid_t dividend;
+            referenceid_t divisor;
+            referenceid_t quotient;
+            referenceid_t remainder;
+        };
         struct BitCount {
             typeid_integral_t operand_type;
             typeid_integral_t result_type;
@@ -155,6 +172,9 @@ namespace spiral {
         MOVE = 0x11,
         SWAP = 0x12,
 
+        GGET = 0x18,
+        GSET = 0x19,
+
         SLT = 0x20,
         SLTU = 0x21,
         SEQ = 0x22,
@@ -194,295 +214,296 @@ namespace spiral {
         REINTERPRET = 0x82
     };
 
-    inline bool is_valid(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::UNREACHABLE:
-        case opcode_t::NOP:
-        case opcode_t::JMP:
-        case opcode_t::JZ:
-        case opcode_t::JNZ:
-        case opcode_t::CALL:
-
-        case opcode_t::IMM:
-
-        case opcode_t::COPY:
-        case opcode_t::MOVE:
-        case opcode_t::SWAP:
-
-        case opcode_t::SLT:
-        case opcode_t::SLTU:
-        case opcode_t::SEQ:
-        case opcode_t::ADD:
-        case opcode_t::ADDU:
-        case opcode_t::SUB:
-        case opcode_t::SUBU:
-        case opcode_t::MUL:
-        case opcode_t::MULU:
-        case opcode_t::DIV:
-        case opcode_t::DIVU:
-        case opcode_t::MULEX:
-        case opcode_t::MULUEX:
-        case opcode_t::DIVEX:
-        case opcode_t::DIVUEX:
-
-        case opcode_t::AND:
-        case opcode_t::OR:
-        case opcode_t::XOR:
-        case opcode_t::NOT:
-        case opcode_t::NOTL:
-        case opcode_t::POPCNT:
-        case opcode_t::CLZ:
-        case opcode_t::CTZ:
-        case opcode_t::SLL:
-        case opcode_t::SRL:
-        case opcode_t::SRA:
-        case opcode_t::ROTL:
-        case opcode_t::ROTR:
-
-        case opcode_t::RESIZE:
-        case opcode_t::CREATE:
-        case opcode_t::CLEAR:
-
-        case opcode_t::CONV:
-        case opcode_t::CONVU:
-        case opcode_t::REINTERPRET:
-            return true;
-
-        default:
-            return false;
-        }
-    }
-
-    inline bool is_empty_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::UNREACHABLE:
-        case opcode_t::NOP:
-            return true;
-        default:
-            return false;
-        }
-    }
-
-    inline bool is_jump_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::JMP:
-            return true;
-        default:
-            return false;
-        }
-    }
+    /**
+     * Parameter type of an opcode (one per struct in InstructionParamTypes, in the same order), or Invalid if the value is not an opcode.
+     */
+    enum class param_kind_t : uint8_t {
+        Invalid = 0,
+        Empty,
+        Jump,
+        JumpConditional,
+        Call,
+        Immediate,
+        Transfer,
+        GlobalAccess,
+        OneOperandInt,
+        TwoOperandInt,
+        Divide,
+        BitCount,
+        Shift,
+        MulEx,
+        DivEx,
+        ArraySized,
+        ArrayClear,
+        Convert,
+        Reinterpret
+    };
 
-    inline bool is_jump_conditional_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::JZ:
-        case opcode_t::JNZ:
-            return true;
-        default:
-            return false;
-        }
-    }
+    /**
+     * How an instruction uses a reference operand.
+     */
+    enum class operand_role : uint8_t {
+        None = 0, // no such operand
+        In,
+        Out,
+        OptionalOut, // may be the unused reference (variableid 0)
+        InOut
+    };
 
-    inline bool is_call_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::CALL:
-            return true;
-        default:
-            return false;
-        }
+    namespace OpcodeFlags {
+        enum : uint8_t {
+            Branch = 0x1, // has a jump target
+            NoFallthrough = 0x2, // never continues with the next instruction
+            Signed = 0x4 // interprets integers as signed (the unsigned variant is a separate opcode)
+        };
     }
 
-    inline bool is_immediate_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::IMM:
-            return true;
-        default:
-            return false;
-        }
-    }
+    /**
+     * Everything that the decoder, the validators and the backends need to know about an opcode, apart from its semantics.
+     */
+    struct opcode_descriptor {
+        param_kind_t param_kind;
+        operand_role operands[4]; // reference operands, in encoding order (the parameters of a call come from its callee instead)
+        uint8_t flags;
 
-    inline bool is_transfer_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::COPY:
-        case opcode_t::MOVE:
-        case opcode_t::SWAP:
-            return true;
-        default:
-            return false;
-        }
-    }
+        bool has(uint8_t flag) const noexcept { return (flags & flag) != 0; }
+    };
 
-    inline bool is_one_operand_int_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::NOT:
-        case opcode_t::NOTL:
-            return true;
-        default:
-            return false;
+    namespace detail {
+        constexpr size_t num_opcode_values = static_cast<size_t>(opcode_t::REINTERPRET) + 1; // one more than the largest opcode
+
+        constexpr std::array<opcode_descriptor, num_opcode_values> make_opcode_descriptors() {
+            using K = param_kind_t;
+            using R = operand_role;
+            namespace F = OpcodeFlags;
+            std::array<opcode_descriptor, num_opcode_values> ret{};
+            const auto set = [&ret](opcode_t opcode, opcode_descriptor descriptor) {
+                ret[static_cast<size_t>(opcode)] = descriptor;
+            };
+            set(opcode_t::UNREACHABLE, { K::Empty, {}, F::NoFallthrough });
+            set(opcode_t::NOP, { K::Empty, {}, 0 });
+            set(opcode_t::JMP, { K::Jump, {}, F::Branch | F::NoFallthrough });
+            set(opcode_t::JZ, { K::JumpConditional, { R::In }, F::Branch });
+            set(opcode_t::JNZ, { K::JumpConditional, { R::In }, F::Branch });
+            set(opcode_t::CALL, { K::Call, {}, 0 });
+
+            set(opcode_t::IMM, { K::Immediate, { R::Out }, 0 });
+
+            set(opcode_t::COPY, { K::Transfer, { R::In, R::OptionalOut }, 0 });
+            set(opcode_t::MOVE, { K::Transfer, { R::InOut, R::OptionalOut }, 0 });
+            set(opcode_t::SWAP, { K::Transfer, { R::InOut, R::InOut }, 0 });
+
+            set(opcode_t::GGET, { K::GlobalAccess, { R::Out }, 0 });
+            set(opcode_t::GSET, { K::GlobalAccess, { R::In }, 0 });
+
+            set(opcode_t::SLT, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, F::Signed });
+            set(opcode_t::SLTU, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::SEQ, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::ADD, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::ADDU, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::SUB, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::SUBU, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::MUL, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::MULU, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::DIV, { K::Divide, { R::In, R::In, R::OptionalOut, R::OptionalOut }, F::Signed });
+            set(opcode_t::DIVU, { K::Divide, { R::In, R::In, R::OptionalOut, R::OptionalOut }, 0 });
+            set(opcode_t::MULEX, { K::MulEx, { R::In, R::In, R::OptionalOut }, F::Signed });
+            set(opcode_t::MULUEX, { K::MulEx, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::DIVEX, { K::DivEx, { R::In, R::In, R::OptionalOut, R::OptionalOut }, F::Signed });
+            set(opcode_t::DIVUEX, { K::DivEx, { R::In, R::In, R::OptionalOut, R::OptionalOut }, 0 });
+
+            set(opcode_t::AND, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::OR, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::XOR, { K::TwoOperandInt, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::NOT, { K::OneOperandInt, { R::In, R::OptionalOut }, 0 });
+            set(opcode_t::NOTL, { K::OneOperandInt, { R::In, R::OptionalOut }, 0 });
+            set(opcode_t::POPCNT, { K::BitCount, { R::In, R::OptionalOut }, 0 });
+            set(opcode_t::CLZ, { K::BitCount, { R::In, R::OptionalOut }, 0 });
+            set(opcode_t::CTZ, { K::BitCount, { R::In, R::OptionalOut }, 0 });
+            set(opcode_t::SLL, { K::Shift, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::SRL, { K::Shift, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::SRA, { K::Shift, { R::In, R::In, R::OptionalOut }, F::Signed });
+            set(opcode_t::ROTL, { K::Shift, { R::In, R::In, R::OptionalOut }, 0 });
+            set(opcode_t::ROTR, { K::Shift, { R::In, R::In, R::OptionalOut }, 0 });
+
+            set(opcode_t::RESIZE, { K::ArraySized, { R::InOut, R::In }, 0 });
+            set(opcode_t::CREATE, { K::ArraySized, { R::InOut, R::In }, 0 });
+            set(opcode_t::CLEAR, { K::ArrayClear, { R::Out }, 0 });
+
+            set(opcode_t::CONV, { K::Convert, { R::In, R::Out }, F::Signed });
+            set(opcode_t::CONVU, { K::Convert, { R::In, R::Out }, 0 });
+            set(opcode_t::REINTERPRET, { K::Reinterpret, { R::In, R::Out }, 0 });
+            return ret;
         }
     }
 
-    inline bool is_two_operand_int_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::SLT:
-        case opcode_t::SLTU:
-        case opcode_t::SEQ:
-        case opcode_t::ADD:
-        case opcode_t::ADDU:
-        case opcode_t::SUB:
-        case opcode_t::SUBU:
-        case opcode_t::MUL:
-        case opcode_t::MULU:
-        case opcode_t::DIV:
-        case opcode_t::DIVU:
-        case opcode_t::AND:
-        case opcode_t::OR:
-        case opcode_t::XOR:
-            return true;
-        default:
-            return false;
-        }
-    }
+    /**
+     * Descriptors of all opcodes, indexed by opcode value (with param_kind Invalid for the values that are not opcodes).
+     */
+    inline constexpr std::array<opcode_descriptor, detail::num_opcode_values> opcode_descriptors = detail::make_opcode_descriptors();
 
-    inline bool is_bit_count_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::POPCNT:
-        case opcode_t::CLZ:
-        case opcode_t::CTZ:
-            return true;
-        default:
-            return false;
-        }
+    inline bool is_valid(opcode_t opcode) noexcept {
+        const size_t index = static_cast<size_t>(opcode);
+        return index < opcode_descriptors.size() && opcode_descriptors[index].param_kind != param_kind_t::Invalid;
     }
 
-    inline bool is_shift_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::SLL:
-        case opcode_t::SRL:
-        case opcode_t::SRA:
-        case opcode_t::ROTL:
-        case opcode_t::ROTR:
-            return true;
-        default:
-            return false;
-        }
+    /**
+     * Returns the descriptor of a valid opcode.
+     */
+    inline const opcode_descriptor& get_descriptor(opcode_t opcode) noexcept {
+        assert(is_valid(opcode));
+        return opcode_descriptors[static_cast<size_t>(opcode)];
     }
 
-    inline bool is_mul_ex_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::MULEX:
-        case opcode_t::MULUEX:
-            return true;
-        default:
-            return false;
-        }
+    inline param_kind_t get_param_kind(opcode_t opcode) noexcept {
+        return get_descriptor(opcode).param_kind;
     }
 
-    inline bool is_div_ex_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::DIVEX:
-        case opcode_t::DIVUEX:
-            return true;
-        default:
-            return false;
-        }
+    /**
+     * Whether the opcode is the signed variant (e.g. div rather than divu, conv rather than convu).
+     */
+    inline bool is_signed_instruction(opcode_t opcode) noexcept {
+        return get_descriptor(opcode).has(OpcodeFlags::Signed);
     }
 
-    inline bool is_array_sized_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::RESIZE:
-        case opcode_t::CREATE:
-            return true;
+    inline bool is_empty_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Empty; }
+    inline bool is_jump_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Jump; }
+    inline bool is_jump_conditional_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::JumpConditional; }
+    inline bool is_call_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Call; }
+    inline bool is_immediate_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Immediate; }
+    inline bool is_transfer_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Transfer; }
+    inline bool is_global_access_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::GlobalAccess; }
+    inline bool is_one_operand_int_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::OneOperandInt; }
+    inline bool is_two_operand_int_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::TwoOperandInt; }
+    inline bool is_divide_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Divide; }
+    inline bool is_bit_count_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::BitCount; }
+    inline bool is_shift_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Shift; }
+    inline bool is_mul_ex_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::MulEx; }
+    inline bool is_div_ex_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::DivEx; }
+    inline bool is_array_sized_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::ArraySized; }
+    inline bool is_array_clear_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::ArrayClear; }
+    inline bool is_convert_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Convert; }
+    inline bool is_reinterpret_instruction(opcode_t opcode) noexcept { return get_param_kind(opcode) == param_kind_t::Reinterpret; }
+
+    /**
+     * Calls callback with tag<P>, where P is the parameter type of the given (valid) opcode.
+     * The parameter kind is a single table lookup, and the switch over it compiles to a jump table.
+     */
+    template <typename Callback>
+    inline void switch_by_opcode_param_type(opcode_t opcode, Callback&& callback) {
+        namespace P = InstructionParamTypes;
+        switch (get_param_kind(opcode)) {
+        case param_kind_t::Empty:
+            std::forward<Callback>(callback)(tag<P::Empty>{});
+            break;
+        case param_kind_t::Jump:
+            std::forward<Callback>(callback)(tag<P::Jump>{});
+            break;
+        case param_kind_t::JumpConditional:
+            std::forward<Callback>(callback)(tag<P::JumpConditional>{});
+            break;
+        case param_kind_t::Call:
+            std::forward<Callback>(callback)(tag<P::Call>{});
+            break;
+        case param_kind_t::Immediate:
+            std::forward<Callback>(callback)(tag<P::Immediate>{});
+            break;
+        case param_kind_t::Transfer:
+            std::forward<Callback>(callback)(tag<P::Transfer>{});
+            break;
+        case param_kind_t::GlobalAccess:
+            std::forward<Callback>(callback)(tag<P::GlobalAccess>{});
+            break;
+        case param_kind_t::OneOperandInt:
+            std::forward<Callback>(callback)(tag<P::OneOperandInt>{});
+            break;
+        case param_kind_t::TwoOperandInt:
+            std::forward<Callback>(callback)(tag<P::TwoOperandInt>{});
+            break;
+        case param_kind_t::Divide:
+            std::forward<Callback>(callback)(tag<P::Divide>{});
+            break;
+        case param_kind_t::BitCount:
+            std::forward<Callback>(callback)(tag<P::BitCount>{});
+            break;
+        case param_kind_t::Shift:
+            std::forward<Callback>(callback)(tag<P::Shift>{});
+            break;
+        case param_kind_t::MulEx:
+            std::forward<Callback>(callback)(tag<P::MulEx>{});
+            break;
+        case param_kind_t::DivEx:
+            std::forward<Callback>(callback)(tag<P::DivEx>{});
+            break;
+        case param_kind_t::ArraySized:
+            std::forward<Callback>(callback)(tag<P::ArraySized>{});
+            break;
+        case param_kind_t::ArrayClear:
+            std::forward<Callback>(callback)(tag<P::ArrayClear>{});
+            break;
+        case param_kind_t::Convert:
+            std::forward<Callback>(callback)(tag<P::Convert>{});
+            break;
+        case param_kind_t::Reinterpret:
+            std::forward<Callback>(callback)(tag<P::Reinterpret>{});
+            break;
         default:
-            return false;
+            assert(false);
         }
     }
 
-    inline bool is_array_clear_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::CLEAR:
-            return true;
-        default:
-            return false;
-        }
+    /**
+     * Checks whether U is the parameter type of the given opcode.
+     */
+    template <typename U>
+    inline bool is_param_type_of(opcode_t opcode) {
+        bool ret = false;
+        switch_by_opcode_param_type(opcode, [&](const auto params_tag) {
+            ret = std::is_same_v<typename decltype(params_tag)::type, U>;
+        });
+        return ret;
     }
 
-    inline bool is_convert_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::CONV:
-        case opcode_t::CONVU:
-            return true;
-        default:
-            return false;
-        }
-    }
+    /**
+     * An opcode and its parameters.  All parameter types are trivially copyable (the parameters of calls live in the
+     * operand pool of the Code), so instructions are copied and relocated bytewise, and need no destruction.
+     */
+    class Instruction {
+        using paramdata_t = untagged_union<
+            InstructionParamTypes::Empty,
+            InstructionParamTypes::Jump,
+            InstructionParamTypes::JumpConditional,
+            InstructionParamTypes::Call,
+            InstructionParamTypes::Immediate,
+            InstructionParamTypes::Transfer,
+            InstructionParamTypes::GlobalAccess,
+            InstructionParamTypes::OneOperandInt,
+            InstructionParamTypes::TwoOperandInt,
+            InstructionParamTypes::Divide,
+            InstructionParamTypes::BitCount,
+            InstructionParamTypes::Shift,
+            InstructionParamTypes::MulEx,
+            InstructionParamTypes::DivEx,
+            InstructionParamTypes::ArraySized,
+            InstructionParamTypes::ArrayClear,
+            InstructionParamTypes::Convert,
+            InstructionParamTypes::Reinterpret>;
 
-    inline bool is_reinterpret_instruction(opcode_t opcode) {
-        switch (opcode) {
-        case opcode_t::REINTERPRET:
-            return true;
-        default:
-            return false;
+    public:
+        /**
+         * Constructs an instruction from its opcode and parameters.  The parameter type must match the opcode.
+         */
+        template <typename U, typename = std::void_t<decltype(std::declval<paramdata_t&>().template emplace<std::decay_t<U>>(std::declval<U>()))>>
+        Instruction(opcode_t opcode, U&& params) : opcode(opcode) {
+            assert(is_valid(opcode));
+            assert(is_param_type_of<std::decay_t<U>>(opcode));
+            paramdata.emplace<std::decay_t<U>>(std::forward<U>(params));
         }
-    }
 
-    template <typename Callback>
-    inline void switch_by_opcode_param_type(opcode_t opcode, Callback&& callback) {
-        assert(is_valid(opcode));
-        if (is_empty_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Empty>{});
-        }
-        else if (is_jump_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Jump>{});
-        }
-        else if (is_jump_conditional_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::JumpConditional>{});
-        }
-        else if (is_call_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Call>{});
-        }
-        else if (is_immediate_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Immediate>{});
-        }
-        else if (is_transfer_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Transfer>{});
-        }
-        else if (is_one_operand_int_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::OneOperandInt>{});
-        }
-        else if (is_two_operand_int_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::TwoOperandInt>{});
-        }
-        else if (is_bit_count_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::BitCount>{});
-        }
-        else if (is_shift_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Shift>{});
+        opcode_t get_opcode() const noexcept {
+            return opcode;
         }
-        else if (is_mul_ex_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::MulEx>{});
-        }
-        else if (is_div_ex_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::DivEx>{});
-        }
-        else if (is_array_sized_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::ArraySized>{});
-        }
-        else if (is_array_clear_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::ArrayClear>{});
-        }
-        else if (is_convert_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Convert>{});
-        }
-        else if (is_reinterpret_instruction(opcode)) {
-            std::forward<Callback>(callback)(tag<InstructionParamTypes::Reinterpret>{});
-        }
-        else {
-            assert(false);
-        }
-    }
 
-    class Instruction {
-    public:
         template <typename Callback>
         inline void get_params(Callback&& callback) & {
             assert(is_valid(opcode));
@@ -506,32 +527,9 @@ namespace spiral {
         }
     private:
         opcode_t opcode;
-        untagged_union<
-            InstructionParamTypes::Empty,
-            InstructionParamTypes::Jump,
-            InstructionParamTypes::JumpConditional,
-            InstructionParamTypes::Call,
-            InstructionParamTypes::Immediate,
-            InstructionParamTypes::Transfer,
-            InstructionParamTypes::OneOperandInt,
-            InstructionParamTypes::TwoOperandInt,
-            InstructionParamTypes::BitCount,
-            InstructionParamTypes::Shift,
-            InstructionParamTypes::MulEx,
-            InstructionParamTypes::DivEx,
-            InstructionParamTypes::ArraySized,
-            InstructionParamTypes::ArrayClear,
-            InstructionParamTypes::Convert,
-            InstructionParamTypes::Reinterpret> paramdata;
-        template <typename U, typename... Args, typename = std::void_t<decltype(paramdata.emplace<U>(std::declval<Args>()...))>>
-        Instruction(opcode_t opcode, Args&&... args) : opcode(opcode) {
-            paramdata.emplace<U>(std::forward<Args>(args)...);
-        }
-        ~Instruction() {
-            switch_by_opcode_param_type(opcode, [this](const auto param_tag) {
-                paramdata.destroy<typename decltype(param_tag)::type>();
-            });
-        }
+        paramdata_t paramdata;
     };
 
+    static_assert(std::is_trivially_copyable_v<Instruction>);
+
 }
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/record.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/instruction.hpp>
+
+/**
+ * Typing rules of instructions, shared by the binary decoder (module_reader) and the in-memory builder (ModuleBuilder).
+ */
+
+namespace spiral {
+
+    namespace detail {
+
+        /**
+         * Type of a reference, as resolved by read_reference (a default-constructed typeid_t for an unused output).
+         */
+        struct typed_reference {
+            referenceid_t reference;
+            typeid_t type;
+
+            bool is_unused() const noexcept { return reference.variableid == 0; }
+        };
+
+        /**
+         * Checks the operands of one instruction and builds it.
+         * Operands supplies them in encoding order (see docs/Specification.md), through:
+         *   ok(), fail(description), read_target(), read_functionid() (already range-checked), read_globalid(),
+         *   check_global(globalid, type) (which may defer the check until the globals are known), read_variableid(),
+         *   read_appendage(whole) (where whole is the appendage that denotes the whole aggregate), and read_immediate(type).
+         * fail() need not throw: after a failure, the decoder only avoids out-of-range accesses, and the instruction it
+         * appends (if any) is meaningless.
+         */
+        template <typename Operands>
+        class instruction_decoder {
+        public:
+            instruction_decoder(Operands& operands, const std::vector<Record>& records, const std::vector<Function>& functions, const Function& function, const std::vector<typeid_t>& locals, std::vector<referenceid_t>& call_operands) noexcept :
+                operands(operands), records(records), functions(functions), function(function), locals(locals), call_operands(call_operands) {}
+
+            /**
+             * Reads the operands of an instruction with the given (valid) opcode, and appends the instruction to out
+             * (and the parameters of a call to the operand pool).
+             */
+            void decode(opcode_t opcode, std::vector<Instruction>& out) {
+                namespace P = InstructionParamTypes;
+                const opcode_descriptor& descriptor = get_descriptor(opcode);
+                // whether each operand may be unused comes from the opcode table
+                const auto read_operand = [&](size_t index) {
+                    return read_reference(descriptor.operands[index] == operand_role::OptionalOut);
+                };
+                switch_by_opcode_param_type(opcode, [&](const auto params_tag) {
+                    using params_type = typename decltype(params_tag)::type;
+                    params_type params{};
+                    if constexpr (std::is_same_v<params_type, P::Empty>) {
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Jump>) {
+                        params.target = operands.read_target();
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::JumpConditional>) {
+                        params.target = operands.read_target();
+                        const typed_reference condition = read_operand(0);
+                        params.type = integral_type(condition);
+                        params.condition = condition.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Call>) {
+                        params.target = operands.read_functionid();
+                        if (!operands.ok()) return;
+                        const Function& target = functions[params.target - 1];
+                        const size_t num_inputs = target.get_inputs().size();
+                        const size_t num_outputs = target.get_outputs().size();
+                        params.params = call_operands.size();
+                        for (size_t k = 0; k != num_inputs + num_outputs; ++k) {
+                            const typed_reference param = read_reference(k >= num_inputs);
+                            const typeid_t& expected = k < num_inputs ? target.get_inputs()[k] : target.get_outputs()[k - num_inputs];
+                            if (!param.is_unused() && !same_type(param.type, expected)) operands.fail("Call parameter type does not match the function!");
+                            call_operands.push_back(param.reference);
+                        }
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Immediate>) {
+                        const typed_reference variable = read_operand(0);
+                        params.type = primitive_type(variable);
+                        params.variable = variable.reference;
+                        params.value = operands.read_immediate(params.type);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Transfer>) {
+                        const typed_reference source = read_operand(0);
+                        const typed_reference destination = read_operand(1);
+                        check_result(destination, source.type);
+                        params.type = source.type.is_array() ? static_cast<typeid_underlying_t>(TypeIDs::Array) : source.type.get_typeid();
+                        params.source = source.reference;
+                        params.destination = destination.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::GlobalAccess>) {
+                        params.global = operands.read_globalid();
+                        const typed_reference variable = read_operand(0);
+                        params.type = primitive_type(variable);
+                        params.variable = variable.reference;
+                        operands.check_global(params.global, params.type);
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::OneOperandInt>) {
+                        const typed_reference operand = read_operand(0);
+                        const typed_reference result = read_operand(1);
+                        params.type = integral_type(operand);
+                        check_result(result, operand.type);
+                        params.operand = operand.reference;
+                        params.result = result.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::TwoOperandInt>) {
+                        const typed_reference operand1 = read_operand(0);
+                        const typed_reference operand2 = read_operand(1);
+                        const typed_reference result = read_operand(2);
+                        params.type = integral_type(operand1);
+                        check_result(operand2, operand1.type);
+                        check_result(result, operand1.type);
+                        params.operand1 = operand1.reference;
+                        params.operand2 = operand2.reference;
+                        params.result = result.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Divide>) {
+                        const typed_reference dividend = read_operand(0);
+                        const typed_reference divisor = read_operand(1);
+                        const typed_reference quotient = read_operand(2);
+                        const typed_reference remainder = read_operand(3);
+                        params.type = integral_type(dividend);
+                        check_result(divisor, dividend.type);
+                        check_result(quotient, dividend.type);
+                        check_result(remainder, dividend.type);
+                        params.dividend = dividend.reference;
+                        params.divisor = divisor.reference;
+                        params.quotient = quotient.reference;
+                        params.remainder = remainder.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::BitCount>) {
+                        const typed_reference operand = read_operand(0);
+                        const typed_reference result = read_operand(1);
+                        params.operand_type = integral_type(operand);
+                        check_result_integral(result);
+                        params.result_type = result.is_unused() ? params.operand_type : integral_type(result);
+                        params.operand = operand.reference;
+                        params.result = result.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Shift>) {
+                        const typed_reference operand = read_operand(0);
+                        const typed_reference shamt = read_operand(1);
+                        const typed_reference result = read_operand(2);
+                        params.type = integral_type(operand);
+                        params.shamt_type = integral_type(shamt);
+                        check_result(result, operand.type);
+                        params.operand = operand.reference;
+                        params.shamt = shamt.reference;
+                        params.result = result.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::MulEx>) {
+                        const typed_reference operand1 = read_operand(0);
+                        const typed_reference operand2 = read_operand(1);
+                        const typed_reference result = read_operand(2);
+                        params.operand_type = integral_type(operand1);
+                        if (params.operand_type == typeid_integral_t::I128) operands.fail("Widening multiply of the widest integer!");
+                        if (!operands.ok()) return; // the widened type below needs a valid integer type
+                        check_result(operand2, operand1.type);
+                        check_result(result, widened_integral(operand1.type));
+                        params.operand1 = operand1.reference;
+                        params.operand2 = operand2.reference;
+                        params.result = result.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::DivEx>) {
+                        const typed_reference dividend = read_operand(0);
+                        const typed_reference divisor = read_operand(1);
+                        const typed_reference quotient = read_operand(2);
+                        const typed_reference remainder = read_operand(3);
+                        params.result_type = integral_type(divisor);
+                        if (params.result_type == typeid_integral_t::I128) operands.fail("Widening divide of the widest integer!");
+                        if (!operands.ok()) return; // the widened type below needs a valid integer type
+                        check_result(dividend, widened_integral(divisor.type));
+                        check_result(quotient, divisor.type);
+                        check_result(remainder, divisor.type);
+                        params.dividend = dividend.reference;
+                        params.divisor = divisor.reference;
+                        params.quotient = quotient.reference;
+                        params.remainder = remainder.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::ArraySized>) {
+                        const typed_reference array = read_operand(0);
+                        const typed_reference size = read_operand(1);
+                        if (!array.type.is_array()) operands.fail("Operand must be an array!");
+                        integral_type(size);
+                        params.element_type = array.type.get_array_dimension() > 1 ? static_cast<typeid_underlying_t>(TypeIDs::Array) : array.type.get_typeid();
+                        params.array = array.reference;
+                        params.size = size.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::ArrayClear>) {
+                        const typed_reference array = read_operand(0);
+                        if (!array.type.is_array()) operands.fail("Operand must be an array!");
+                        params.element_type = array.type.get_array_dimension() > 1 ? static_cast<typeid_underlying_t>(TypeIDs::Array) : array.type.get_typeid();
+                        params.array = array.reference;
+                    }
+                    else if constexpr (std::is_same_v<params_type, P::Convert> || std::is_same_v<params_type, P::Reinterpret>) {
+                        const typed_reference operand = read_operand(0);
+                        const typed_reference result = read_operand(1);
+                        params.operand_type = primitive_type(operand);
+                        params.result_type = primitive_type(result);
+                        if constexpr (std::is_same_v<params_type, P::Reinterpret>) {
+                            if (primitive_width(operand.type.get_typeid()) != primitive_width(result.type.get_typeid())) operands.fail("Reinterpret between types of different widths!");
+                        }
+                        params.operand = operand.reference;
+                        params.result = result.reference;
+                    }
+                    else {
+                        static_assert(always_false<params_type>::value, "Unhandled instruction parameter type!");
+                    }
+                    out.emplace_back(opcode, std::move(params));
+                });
+            }
+
+        private:
+            typeid_t variable_type(variableid_t variableid) const {
+                if (variableid > 0) {
+                    if (static_cast<size_t>(variableid) <= locals.size()) return locals[variableid - 1];
+                    operands.fail("Reference to nonexistent local variable!");
+                    return typeid_t();
+                }
+                const size_t index = static_cast<size_t>(-variableid) - 1;
+                const size_t num_inputs = function.get_inputs().size();
+                if (index < num_inputs) return function.get_inputs()[index];
+                if (index - num_inputs < function.get_outputs().size()) return function.get_outputs()[index - num_inputs];
+                operands.fail("Reference to nonexistent parameter!");
+                return typeid_t();
+            }
+
+            typed_reference read_reference(bool allow_unused = false) {
+                typed_reference ret;
+                ret.reference.variableid = operands.read_variableid();
+                if (ret.reference.variableid == 0) {
+                    if (!allow_unused) operands.fail("Unused reference in an input!");
+                    return ret;
+                }
+                const typeid_t type = variable_type(ret.reference.variableid);
+                ret.type = type;
+                if (type.is_array()) {
+                    const variableid_t index = operands.read_appendage(0);
+                    ret.reference.array_index_variableid = index;
+                    if (index != 0) {
+                        const typeid_t index_type = variable_type(index);
+                        if (!index_type.is_primitive() || !is_integral_typeid(index_type.get_typeid())) operands.fail("Array index must be an integer!");
+                        ret.type = typeid_t(type.get_typeid(), type.get_array_dimension() - 1);
+                    }
+                }
+                else if (type.is_record()) {
+                    const ssize_t field = operands.read_appendage(-1);
+                    ret.reference.record_fieldindex = field;
+                    if (field != -1) {
+                        const std::vector<typeid_t>& fields = records[type.get_typeid() - 1].get_fields();
+                        if (field < 0 || static_cast<size_t>(field) >= fields.size()) {
+                            operands.fail("Reference to nonexistent record field!");
+                            return ret;
+                        }
+                        ret.type = fields[field];
+                    }
+                }
+                return ret;
+            }
+
+            static bool same_type(const typeid_t& a, const typeid_t& b) noexcept {
+                return a.get_typeid() == b.get_typeid() && a.get_array_dimension() == b.get_array_dimension();
+            }
+
+            static bool is_integral(const typeid_t& type) noexcept {
+                return type.is_primitive() && is_integral_typeid(type.get_typeid());
+            }
+
+            typeid_integral_t integral_type(const typed_reference& ref) const {
+                if (!is_integral(ref.type)) operands.fail("Operand must be an integer!");
+                return static_cast<typeid_integral_t>(ref.type.get_typeid());
+            }
+
+            typeid_primitive_t primitive_type(const typed_reference& ref) const {
+                if (!ref.type.is_primitive()) operands.fail("Operand must be a primitive!");
+                return static_cast<typeid_primitive_t>(ref.type.get_typeid());
+            }
+
+            /**
+             * Checks that an (optional) result has the given type.
+             */
+            void check_result(const typed_reference& result, const typeid_t& type) const {
+                if (!result.is_unused() && !same_type(result.type, type)) operands.fail("Result type does not match operand type!");
+            }
+
+            void check_result_integral(const typed_reference& result) const {
+                if (!result.is_unused() && !is_integral(result.type)) operands.fail("Result must be an integer!");
+            }
+
+            static typeid_t widened_integral(const typeid_t& type) noexcept {
+                return typeid_t(type.get_typeid() - 1);
+            }
+
+            Operands& operands;
+            const std::vector<Record>& records;
+            const std::vector<Function>& functions;
+            const Function& function;
+            const std::vector<typeid_t>& locals;
+            std::vector<referenceid_t>& call_operands;
+        };
+    }
+
+}
@@ -4,11 +4,29 @@
 
 namespace spiral {
 
+    /**
+     * 128-bit integers, stored as a pair of 64-bit words.
+     * These are trivially copyable and exactly two registers wide, so they are passed and returned in a register pair (e.g. RDX:RAX).
+     */
+
     class int128 {
-        std::int64_t lower, upper;
+    public:
+        int128() noexcept = default;
+        constexpr int128(std::uint64_t lower, std::int64_t upper) noexcept : lower(lower), upper(upper) {}
+        constexpr std::uint64_t get_lower() const noexcept { return lower; }
+        constexpr std::int64_t get_upper() const noexcept { return upper; }
+    private:
+        std::uint64_t lower;
+        std::int64_t upper;
     };
 
     class uint128 {
+    public:
+        uint128() noexcept = default;
+        constexpr uint128(std::uint64_t lower, std::uint64_t upper) noexcept : lower(lower), upper(upper) {}
+        constexpr std::uint64_t get_lower() const noexcept { return lower; }
+        constexpr std::uint64_t get_upper() const noexcept { return upper; }
+    private:
         std::uint64_t lower, upper;
     };
 
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/import.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/native_abi.hpp>
+#include <spiral/detail/name_table.hpp>
+#include <spiral/detail/span.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+namespace spiral {
+
+    /**
+     * Picks the host function for an import that was left unbound, the first time that it is called.
+     * Returns a host_function with a null entry if there is none.  May be called concurrently from the threads running the module.
+     */
+    using import_resolver = std::function<host_function(const Import&)>;
+
+    namespace detail {
+
+        /**
+         * Throws link_exception if the import at the given index (in import section order) cannot be bound to a host function with the given signature.
+         */
+        inline void check_import_signature(const Module& module, size_t index, span<const typeid_underlying_t> inputs, span<const typeid_underlying_t> outputs) {
+            const Import& import = module.get_imports()[index];
+            const functionid_t functionid = import.get_functionid();
+            if (functionid == 0 || functionid > module.get_functions().size()) {
+                throw link_exception("Import \"" + import.get_name() + "\" refers to a nonexistent function!");
+            }
+            const Function& function = module.get_functions()[functionid - 1];
+            if (!types_match(function.get_inputs(), inputs) || !types_match(function.get_outputs(), outputs)) {
+                throw link_exception("Host function signature does not match import \"" + import.get_name() + "\"!");
+            }
+        }
+    }
+
+    /**
+     * Call slots of the imports of a module (in import section order), shared by the instances of the module.
+     *
+     * Each slot holds the native entry point of its import.  Imports that were not bound before linking start with a
+     * null slot, and are resolved on their first call: compiled code calls resolve_entry, which asks the resolver for
+     * the host function, checks its signature, and stores it into the slot, so that later calls go directly to it.
+     * Linking therefore neither looks up nor checks the imports that are resolved lazily.  An import that cannot be resolved traps when it is called.
+     * The module must outlive the bindings.
+     */
+    class import_bindings {
+    public:
+        import_bindings(const Module& module, const std::vector<native_function_t>& entries, import_resolver resolver) : module(module), slots(std::make_unique<std::atomic<native_function_t>[]>(entries.size())), num_slots(entries.size()), resolver(std::move(resolver)) {
+            for (size_t i = 0; i != num_slots; ++i) {
+                if (entries[i] != nullptr) slots[i].store(entries[i], std::memory_order_relaxed);
+            }
+        }
+
+        size_t size() const noexcept { return num_slots; }
+
+        /**
+         * Returns the slots, for native_context::imports.
+         */
+        std::atomic<native_function_t>* data() const noexcept { return slots.get(); }
+
+        /**
+         * Returns the native entry point of the import at the given index, or nullptr if it has not been resolved yet.
+         */
+        native_function_t get(size_t index) const noexcept {
+            return slots[index].load(std::memory_order_acquire);
+        }
+
+        /**
+         * Resolves the import at the given index if it has not been resolved yet, and returns its native entry point (or nullptr if it cannot be resolved).
+         * Threads that race to resolve the same import all store the same entry point.
+         */
+        native_function_t resolve(size_t index) const noexcept {
+            if (const native_function_t entry = get(index)) return entry;
+            if (!resolver) return nullptr;
+            try {
+                const host_function function = resolver(module.get_imports()[index]);
+                if (function.entry == nullptr) return nullptr;
+                detail::check_import_signature(module, index, function.inputs, function.outputs);
+                slots[index].store(function.entry, std::memory_order_release);
+                return function.entry;
+            }
+            catch (...) {
+                // compiled code cannot propagate exceptions, so it traps instead
+                return nullptr;
+            }
+        }
+
+        /**
+         * Entry point for native_context::resolve_import.
+         */
+        static native_function_t resolve_entry(const native_context* context, size_t index) noexcept {
+            return static_cast<const import_bindings*>(context->import_table)->resolve(index);
+        }
+
+    private:
+        const Module& module;
+        std::unique_ptr<std::atomic<native_function_t>[]> slots;
+        size_t num_slots;
+        import_resolver resolver;
+    };
+
+    /**
+     * Binds the imports of a module to host functions.
+     *
+     * bind<&f>("name") checks the signature of f against the imported function once, at bind time, and records a
+     * native entry point for it: f itself if it already has the native signature, otherwise a thunk generated at compile
+     * time for f.  Compiled code then calls the entry point directly, with the arguments in registers.
+     * Imports that are left unbound can instead be resolved lazily, on their first call, by a resolver (see set_resolver).
+     * The module must outlive the linker.
+     */
+    class Linker {
+    public:
+        explicit Linker(const Module& module) : module(module), bindings(module.get_imports().size(), nullptr) {}
+
+        /**
+         * Binds the import with the given name to the host function F.
+         * Throws link_exception if there is no such import, or if the signature of F does not match it.
+         */
+        template <auto F>
+        void bind(std::string_view name) {
+            bind<F>(hashed_name(name));
+        }
+
+        /**
+         * Same as above, with the hash of the name computed beforehand.
+         */
+        template <auto F>
+        void bind(const hashed_name& name) {
+            bind(name, host_function::of<F>());
+        }
+
+        /**
+         * Binds the import with the given name to a host function chosen at run time.
+         * Throws link_exception if there is no such import, or if the signature of the function does not match it.
+         */
+        void bind(const hashed_name& name, const host_function& function) {
+            const size_t index = find_import(name);
+            detail::check_import_signature(module, index, function.inputs, function.outputs);
+            bindings[index] = function.entry;
+        }
+        void bind(std::string_view name, const host_function& function) {
+            bind(hashed_name(name), function);
+        }
+
+        /**
+         * Sets the resolver for the imports that are still unbound when link is called.  Without one, every import must be bound.
+         */
+        void set_resolver(import_resolver new_resolver) {
+            resolver = std::move(new_resolver);
+        }
+
+        /**
+         * Returns the native entry point bound to the import at the given index (in import section order), or nullptr if it is unbound.
+         */
+        native_function_t get_binding(size_t index) const noexcept {
+            return bindings[index];
+        }
+
+        const std::vector<native_function_t>& get_bindings() const noexcept {
+            return bindings;
+        }
+
+        /**
+         * Returns the bindings, to be shared by instances of the module.
+         * Throws link_exception if some import is not bound and there is no resolver.
+         */
+        std::shared_ptr<const import_bindings> link() const {
+            if (!resolver && !is_complete()) {
+                throw link_exception("Not all imports are bound!");
+            }
+            return std::make_shared<const import_bindings>(module, bindings, resolver);
+        }
+
+        /**
+         * Checks whether every import has been bound.
+         */
+        bool is_complete() const noexcept {
+            for (const native_function_t binding : bindings) {
+                if (binding == nullptr) return false;
+            }
+            return true;
+        }
+
+    private:
+        size_t find_import(const hashed_name& name) const {
+            const std::optional<size_t> index = module.find_import(name);
+            if (!index) throw link_exception("No import named \"" + std::string(name.get_name()) + "\"!");
+            return *index;
+        }
+
+        const Module& module;
+        std::vector<native_function_t> bindings;
+        import_resolver resolver;
+    };
+
+}
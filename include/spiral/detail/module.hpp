@@ -0,0 +1,147 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/record.hpp>
+#include <spiral/detail/sharedrecord.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/import.hpp>
+#include <spiral/detail/export.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/global.hpp>
+#include <spiral/detail/hash.hpp>
+#include <spiral/detail/name_table.hpp>
+#include <spiral/detail/decode_result.hpp>
+#include <spiral/detail/module_reader.hpp>
+#include <spiral/detail/module_writer.hpp>
+#include <spiral/detail/span.hpp>
+#include <spiral/binarybuf/memorybuf.hpp>
+#include <spiral/detail/telemetry.hpp>
+
+namespace spiral {
+
+    class ModuleBuilder;
+
+    /**
+     * Represents spiral bytecode (in uncompiled form).
+     * Modules are move-only; to share one between instances, wrap it in a CompiledModule.
+     */
+    class Module {
+    public:
+        Module() = default;
+        Module(Module&&) = default;
+        Module(const Module&) = delete;
+        Module& operator=(Module&&) = default;
+        Module& operator=(const Module&) = delete;
+
+        /**
+         * Constructs a module from a raw byte buffer.
+         * Throws decode_exception if the module is malformed, or eof_exception if it is truncated.
+         * If sink is not null, the decode and validation phases are recorded to it.
+         */
+        template <typename IBinaryBuf, typename = std::enable_if_t<std::is_same_v<typename IBinaryBuf::element_type, byte>>>
+        void read(IBinaryBuf& binary_buf, telemetry* sink = nullptr) {
+            Module ret;
+            detail::module_reader<IBinaryBuf> reader(binary_buf, sink);
+            reader.read(ret.records, ret.sharedrecords, ret.functions, ret.imports, ret.exports, ret.codes, ret.globals);
+            if (const std::optional<decode_error> error = reader.get_error()) error->raise();
+            ret.index_names();
+            *this = std::move(ret);
+        }
+
+        /**
+         * Like read, but returns the error (with its kind and byte offset) instead of throwing.
+         * The buffer must provide eof() and read_unchecked() (as memorybuf does), so that reading past its end does not throw.
+         */
+        template <typename IBinaryBuf, typename = std::enable_if_t<std::is_same_v<typename IBinaryBuf::element_type, byte>>>
+        static decode_result<Module> try_read(IBinaryBuf& binary_buf, telemetry* sink = nullptr) noexcept {
+            static_assert(detail::has_unchecked_read<IBinaryBuf>::value, "try_read requires a buffer with eof() and read_unchecked()!");
+            Module ret;
+            detail::module_reader<IBinaryBuf> reader(binary_buf, sink);
+            reader.read(ret.records, ret.sharedrecords, ret.functions, ret.imports, ret.exports, ret.codes, ret.globals);
+            if (const std::optional<decode_error> error = reader.get_error()) return *error;
+            ret.index_names();
+            return ret;
+        }
+
+        /**
+         * Writes the module in the binary format (which Module::read accepts).
+         * Throws the exceptions of the buffer (e.g. eof_exception if it is too small).
+         */
+        template <typename OBinaryBuf, typename = std::enable_if_t<std::is_same_v<typename OBinaryBuf::element_type, byte>>>
+        void write(OBinaryBuf& binary_buf) const {
+            detail::module_writer(records, sharedrecords, functions, imports, exports, codes, globals).write(binary_buf);
+        }
+
+        /**
+         * Returns the module in the binary format, written into a single allocation of exactly the encoded size.
+         */
+        std::vector<byte> write() const {
+            detail::module_writer writer(records, sharedrecords, functions, imports, exports, codes, globals);
+            std::vector<byte> ret(writer.get_size());
+            basic_omemorybuf<byte, span<byte>> buf(span<byte>(ret.data(), ret.size()));
+            writer.write(buf);
+            return ret;
+        }
+
+        /**
+         * Returns a hash of the binary encoding of the module (so two modules with the same contents have the same hash).
+         */
+        uint64_t content_hash() const {
+            const std::vector<byte> bytes = write();
+            return hash_bytes(bytes.data(), bytes.size());
+        }
+
+        const std::vector<Record>& get_records() const noexcept { return records; }
+        const std::vector<SharedRecord>& get_sharedrecords() const noexcept { return sharedrecords; }
+        const std::vector<Function>& get_functions() const noexcept { return functions; }
+        const std::vector<Import>& get_imports() const noexcept { return imports; }
+        const std::vector<Export>& get_exports() const noexcept { return exports; }
+        const std::vector<Code>& get_codes() const noexcept { return codes; }
+        std::vector<Code>& get_codes() noexcept { return codes; }
+        const std::vector<Global>& get_globals() const noexcept { return globals; }
+
+        /**
+         * Returns the export with the given name (the first one, if there are several), or nullptr.
+         * Takes constant time, through the perfect hash built when the module was read or built.
+         */
+        const Export* find_export(const hashed_name& name) const noexcept {
+            const size_t index = export_names.find(name, exports);
+            return index == detail::name_table::npos ? nullptr : &exports[index];
+        }
+        const Export* find_export(std::string_view name) const noexcept { return find_export(hashed_name(name)); }
+
+        /**
+         * Returns the index of the import with the given name (the first one, if there are several) in the import section, or nullopt.
+         */
+        std::optional<size_t> find_import(const hashed_name& name) const noexcept {
+            const size_t index = import_names.find(name, imports);
+            if (index == detail::name_table::npos) return std::nullopt;
+            return index;
+        }
+        std::optional<size_t> find_import(std::string_view name) const noexcept { return find_import(hashed_name(name)); }
+
+    private:
+        friend class ModuleBuilder;
+
+        void index_names() {
+            export_names = detail::name_table(exports);
+            import_names = detail::name_table(imports);
+        }
+
+        std::vector<Record> records;
+        std::vector<SharedRecord> sharedrecords;
+        std::vector<Function> functions;
+        std::vector<Import> imports;
+        std::vector<Export> exports;
+        std::vector<Code> codes;
+        std::vector<Global> globals;
+        detail::name_table export_names;
+        detail::name_table import_names;
+    };
+
+}
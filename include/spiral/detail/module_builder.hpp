@@ -0,0 +1,476 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/record.hpp>
+#include <spiral/detail/sharedrecord.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/import.hpp>
+#include <spiral/detail/export.hpp>
+#include <spiral/detail/instruction.hpp>
+#include <spiral/detail/instruction_decoder.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/global.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+/**
+ * Builds a Module in memory, for front ends that generate Spiral at runtime (without encoding it and reading it back).
+ * Everything is checked as it is added, by the same rules as Module::read; a malformed addition throws build_exception
+ * and leaves the builder unchanged.  Unlike the binary format, declarations must come before their uses:
+ * records before the types that name them (a record may name itself), and functions and globals before the code that uses them.
+ */
+
+namespace spiral {
+
+    /**
+     * Operand of an instruction added with CodeBuilder::add, given in the order of the binary encoding (see docs/Specification.md).
+     */
+    class Operand {
+    public:
+        enum class Kind : uint8_t {
+            Reference,
+            Target,
+            Label,
+            Function,
+            Global,
+            Immediate
+        };
+
+        /**
+         * A variable (the whole variable, if it is an array or a record), or 0 for an unused output.
+         */
+        static Operand reference(variableid_t variableid) noexcept {
+            return Operand(Kind::Reference, variableid, 0, false);
+        }
+
+        static Operand element(variableid_t array, variableid_t index) noexcept {
+            return Operand(Kind::Reference, array, index, true);
+        }
+
+        static Operand field(variableid_t record, ssize_t fieldindex) noexcept {
+            return Operand(Kind::Reference, record, fieldindex, true);
+        }
+
+        static Operand unused() noexcept {
+            return reference(0);
+        }
+
+        static Operand target(instructionid_t target) noexcept {
+            return Operand(Kind::Target, static_cast<int64_t>(target), 0, false);
+        }
+
+        /**
+         * Jump target given by a label of the CodeBuilder (see CodeBuilder::new_label).
+         */
+        static Operand label(size_t label) noexcept {
+            return Operand(Kind::Label, static_cast<int64_t>(label), 0, false);
+        }
+
+        static Operand function(functionid_t functionid) noexcept {
+            return Operand(Kind::Function, static_cast<int64_t>(functionid), 0, false);
+        }
+
+        static Operand global(globalid_t globalid) noexcept {
+            return Operand(Kind::Global, static_cast<int64_t>(globalid), 0, false);
+        }
+
+        /**
+         * Immediate value (for floating point types, the bit pattern).
+         */
+        static Operand immediate(int64_t value) noexcept {
+            return Operand(Kind::Immediate, value, value < 0 ? -1 : 0, false);
+        }
+
+        static Operand immediate(int128_t value) noexcept {
+            return Operand(Kind::Immediate, static_cast<int64_t>(value.get_lower()), value.get_upper(), false);
+        }
+
+        Kind get_kind() const noexcept { return kind; }
+
+    private:
+        friend class CodeBuilder;
+
+        Operand(Kind kind, int64_t value, int64_t appendage, bool has_appendage) noexcept : kind(kind), has_appendage(has_appendage), value(value), appendage(appendage) {}
+
+        Kind kind;
+        bool has_appendage; // for references
+        int64_t value;
+        int64_t appendage; // array index or record field for references, upper half for immediates
+    };
+
+    namespace detail {
+        /**
+         * Declarations of a ModuleBuilder that the code refers to.
+         */
+        struct module_declarations {
+            std::vector<Record> records;
+            std::vector<Function> functions;
+            std::vector<Global> globals;
+        };
+
+        /**
+         * Throws build_exception unless type is valid and names only records up to max_record.
+         */
+        inline void check_build_typeid(const typeid_t& type, recordid_t max_record) {
+            const typeid_underlying_t base = type.get_typeid();
+            if (base == 0 || type.get_array_dimension() < 0 || (base < 0 && primitive_width(base) == 0)) throw build_exception("Invalid typeid!");
+            if (base > 0 && static_cast<recordid_t>(base) > max_record) throw build_exception("Reference to nonexistent record!");
+        }
+    }
+
+    /**
+     * Builds the code of one function.  Obtained from ModuleBuilder::begin_code, and handed back with ModuleBuilder::add_code.
+     */
+    class CodeBuilder {
+    public:
+        CodeBuilder(CodeBuilder&&) = default;
+        CodeBuilder(const CodeBuilder&) = delete;
+        CodeBuilder& operator=(CodeBuilder&&) = default;
+        CodeBuilder& operator=(const CodeBuilder&) = delete;
+
+        functionid_t get_functionid() const noexcept { return functionid; }
+        instructionid_t get_num_instructions() const noexcept { return instructions.size(); }
+
+        /**
+         * Declares a local variable and returns its variableid.
+         */
+        variableid_t add_local(typeid_t type) {
+            detail::check_build_typeid(type, declarations->records.size());
+            locals.push_back(type);
+            return static_cast<variableid_t>(locals.size());
+        }
+
+        /**
+         * Reserves space for the given number of instructions, so that adding them does not reallocate.
+         */
+        void reserve(size_t num_instructions) {
+            instructions.reserve(num_instructions);
+        }
+
+        size_t new_label() {
+            labels.push_back(unbound);
+            return labels.size() - 1;
+        }
+
+        /**
+         * Binds the label to the next instruction added (or to the end of the code, which returns).
+         */
+        void bind(size_t label) {
+            if (label >= labels.size()) fail("Reference to nonexistent label!");
+            if (labels[label] != unbound) fail("Label is bound more than once!");
+            labels[label] = instructions.size();
+        }
+
+        /**
+         * Checks an instruction and appends it to the code.
+         * If the instruction is rejected (with build_exception), the builder is left as it was, so more instructions may be added.
+         */
+        void add(opcode_t opcode, std::initializer_list<Operand> operands) {
+            if (!is_valid(opcode)) fail("Invalid opcode!");
+            next = operands.begin();
+            end = operands.end();
+            current = nullptr;
+            pending_label = unbound;
+            const size_t num_instructions = instructions.size();
+            const size_t num_call_operands = call_operands.size();
+            const instructionid_t prev_max_target = max_target;
+            try {
+                detail::instruction_decoder<CodeBuilder>(*this, declarations->records, declarations->functions, declarations->functions[functionid - 1], locals, call_operands).decode(opcode, instructions);
+                if (next != end || (current != nullptr && current->has_appendage)) {
+                    instructions.pop_back();
+                    fail(next != end ? "Too many operands!" : "Appendage on a reference that is neither an array nor a record!");
+                }
+            }
+            catch (...) {
+                // the decoder may have appended call operands or raised max_target before it failed
+                instructions.erase(instructions.begin() + num_instructions, instructions.end());
+                call_operands.resize(num_call_operands);
+                max_target = prev_max_target;
+                throw;
+            }
+            if (pending_label != unbound) label_uses.push_back(label_use{ instructions.size() - 1, pending_label });
+        }
+
+    private:
+        friend class ModuleBuilder;
+        friend class detail::instruction_decoder<CodeBuilder>;
+
+        struct label_use {
+            instructionid_t instruction;
+            size_t label;
+        };
+
+        static constexpr size_t unbound = static_cast<size_t>(-1);
+
+        CodeBuilder(const detail::module_declarations& declarations, functionid_t functionid, std::vector<typeid_t> locals) : declarations(&declarations), functionid(functionid), locals(std::move(locals)) {}
+
+        bool ok() const noexcept { return true; } // fail() throws
+
+        [[noreturn]] void fail(const char* description) const {
+            throw build_exception(std::string(description) + " (function " + std::to_string(functionid) + ", instruction " + std::to_string(instructions.size()) + ")");
+        }
+
+        /**
+         * Resolves the labels into jump targets, and returns the finished code.
+         */
+        Code finish() && {
+            namespace P = InstructionParamTypes;
+            for (const label_use& use : label_uses) {
+                if (labels[use.label] == unbound) fail("Unbound label!");
+                instructions[use.instruction].get_params([&](auto& params) {
+                    using params_type = std::decay_t<decltype(params)>;
+                    if constexpr (std::is_same_v<params_type, P::Jump> || std::is_same_v<params_type, P::JumpConditional>) {
+                        params.target = labels[use.label];
+                    }
+                });
+            }
+            if (max_target > instructions.size()) fail("Jump target out of range!");
+            return Code(functionid, std::move(locals), std::move(instructions), std::move(call_operands));
+        }
+
+        // operands of instructions, for instruction_decoder
+
+        const Operand& take(Operand::Kind kind) {
+            if (current != nullptr && current->has_appendage) fail("Appendage on a reference that is neither an array nor a record!");
+            current = nullptr;
+            if (next == end) fail("Too few operands!");
+            if (next->kind != kind && !(kind == Operand::Kind::Target && next->kind == Operand::Kind::Label)) fail("Operand kind does not match the instruction!");
+            return *next++;
+        }
+
+        instructionid_t read_target() {
+            const Operand& operand = take(Operand::Kind::Target);
+            if (operand.kind == Operand::Kind::Label) {
+                if (static_cast<size_t>(operand.value) >= labels.size()) fail("Reference to nonexistent label!");
+                pending_label = static_cast<size_t>(operand.value);
+                return 0;
+            }
+            const instructionid_t target = static_cast<instructionid_t>(operand.value);
+            if (target > max_target) max_target = target;
+            return target;
+        }
+
+        functionid_t read_functionid() {
+            const functionid_t functionid = static_cast<functionid_t>(take(Operand::Kind::Function).value);
+            if (functionid == 0 || functionid > declarations->functions.size()) fail("Reference to nonexistent function!");
+            return functionid;
+        }
+
+        globalid_t read_globalid() {
+            return static_cast<globalid_t>(take(Operand::Kind::Global).value);
+        }
+
+        void check_global(globalid_t globalid, typeid_primitive_t type) const {
+            if (globalid == 0 || globalid > declarations->globals.size()) fail("Reference to nonexistent global!");
+            if (declarations->globals[globalid - 1].get_type() != static_cast<typeid_underlying_t>(type)) fail("Global type does not match the variable!");
+        }
+
+        variableid_t read_variableid() {
+            const Operand& operand = take(Operand::Kind::Reference);
+            current = &operand;
+            return static_cast<variableid_t>(operand.value);
+        }
+
+        ssize_t read_appendage(ssize_t whole) {
+            const ssize_t ret = current->has_appendage ? static_cast<ssize_t>(current->appendage) : whole;
+            current = nullptr;
+            return ret;
+        }
+
+        InstructionParamTypes::any_signed_integral read_immediate(typeid_primitive_t type) {
+            const Operand& operand = take(Operand::Kind::Immediate);
+            const int64_t value = operand.value;
+            const bool fits_int64 = operand.appendage == (value < 0 ? -1 : 0);
+            const auto check_range = [&](bool in_range) {
+                if (!in_range) fail("Immediate too large!");
+            };
+            InstructionParamTypes::any_signed_integral ret;
+            switch (type) {
+            case typeid_primitive_t::I8:
+                check_range(fits_int64 && value >= std::numeric_limits<int8_t>::min() && value <= std::numeric_limits<int8_t>::max());
+                ret.i8 = static_cast<int8_t>(value);
+                break;
+            case typeid_primitive_t::I16:
+                check_range(fits_int64 && value >= std::numeric_limits<int16_t>::min() && value <= std::numeric_limits<int16_t>::max());
+                ret.i16 = static_cast<int16_t>(value);
+                break;
+            case typeid_primitive_t::I32:
+                check_range(fits_int64 && value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max());
+                ret.i32 = static_cast<int32_t>(value);
+                break;
+            case typeid_primitive_t::I64:
+                check_range(fits_int64);
+                ret.i64 = value;
+                break;
+            case typeid_primitive_t::I128:
+                ret.i128 = int128_t(static_cast<uint64_t>(value), operand.appendage);
+                break;
+            case typeid_primitive_t::F32:
+                // the bit pattern, either as a signed or as an unsigned 32-bit integer
+                check_range(fits_int64 && value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<uint32_t>::max());
+                ret.i32 = static_cast<int32_t>(static_cast<uint32_t>(value));
+                break;
+            case typeid_primitive_t::F64:
+                check_range(fits_int64);
+                ret.i64 = value;
+                break;
+            default:
+                fail("Unsupported immediate type!");
+            }
+            return ret;
+        }
+
+        const detail::module_declarations* declarations;
+        functionid_t functionid;
+        std::vector<typeid_t> locals;
+        std::vector<Instruction> instructions;
+        std::vector<referenceid_t> call_operands;
+        std::vector<size_t> labels; // instructionid of each label
+        std::vector<label_use> label_uses;
+        instructionid_t max_target = 0; // largest jump target given as an instructionid
+        // operands of the instruction being added
+        const Operand* next = nullptr;
+        const Operand* end = nullptr;
+        const Operand* current = nullptr; // reference whose appendage is yet to be read
+        size_t pending_label = unbound;
+    };
+
+    /**
+     * Builds a Module from Record, Function, Import, Export, Code and Global objects directly.
+     * The objects are constructed in place in the vectors that build() hands over to the Module, so nothing is copied.
+     * Not movable, because the CodeBuilders refer to it.
+     */
+    class ModuleBuilder {
+    public:
+        ModuleBuilder() = default;
+        ModuleBuilder(ModuleBuilder&&) = delete;
+        ModuleBuilder(const ModuleBuilder&) = delete;
+        ModuleBuilder& operator=(ModuleBuilder&&) = delete;
+        ModuleBuilder& operator=(const ModuleBuilder&) = delete;
+
+        /**
+         * Reserves space for the given numbers of declarations, so that adding them does not reallocate.
+         */
+        void reserve(size_t num_records, size_t num_functions, size_t num_globals) {
+            declarations.records.reserve(num_records);
+            declarations.functions.reserve(num_functions);
+            declarations.globals.reserve(num_globals);
+            defined.reserve(num_functions);
+            codes.reserve(num_functions);
+        }
+
+        /**
+         * Adds a record and returns its recordid.  Its fields may name the records added before it, and itself.
+         */
+        recordid_t add_record(std::vector<typeid_t> fields) {
+            for (const typeid_t& type : fields) detail::check_build_typeid(type, declarations.records.size() + 1);
+            declarations.records.emplace_back(std::move(fields));
+            return declarations.records.size();
+        }
+
+        void add_sharedrecord(recordid_t recordid, std::string name) {
+            if (recordid == 0 || recordid > declarations.records.size()) throw build_exception("Reference to nonexistent record!");
+            sharedrecords.emplace_back(recordid, std::move(name));
+        }
+
+        /**
+         * Declares a function and returns its functionid.  It must later be either imported or defined (with begin_code and add_code).
+         */
+        functionid_t add_function(std::vector<typeid_t> inputs, std::vector<typeid_t> outputs) {
+            for (const typeid_t& type : inputs) detail::check_build_typeid(type, declarations.records.size());
+            for (const typeid_t& type : outputs) detail::check_build_typeid(type, declarations.records.size());
+            declarations.functions.emplace_back(std::move(inputs), std::move(outputs));
+            defined.push_back(false);
+            return declarations.functions.size();
+        }
+
+        void add_import(functionid_t functionid, std::string name) {
+            check_undefined(functionid);
+            imports.emplace_back(functionid, std::move(name));
+            defined[functionid - 1] = true;
+        }
+
+        void add_export(functionid_t functionid, std::string name) {
+            check_functionid(functionid);
+            exports.emplace_back(functionid, std::move(name));
+        }
+
+        /**
+         * Adds a global of the given primitive type and returns its globalid.
+         */
+        globalid_t add_global(typeid_underlying_t type, uint32_t flags = 0) {
+            if (type >= 0 || primitive_width(type) == 0) throw build_exception("Globals must be primitives!");
+            if (flags & ~static_cast<uint32_t>(GlobalFlags::All)) throw build_exception("Unknown global flags!");
+            declarations.globals.emplace_back(type, flags);
+            return declarations.globals.size();
+        }
+
+        /**
+         * Starts the code of a declared function that is neither imported nor defined yet.
+         */
+        CodeBuilder begin_code(functionid_t functionid, std::vector<typeid_t> locals = {}) {
+            check_undefined(functionid);
+            for (const typeid_t& type : locals) detail::check_build_typeid(type, declarations.records.size());
+            return CodeBuilder(declarations, functionid, std::move(locals));
+        }
+
+        /**
+         * Defines the function of the given code.  Throws build_exception if a label is unbound or a jump target is out of range.
+         */
+        void add_code(CodeBuilder&& code) {
+            if (code.declarations != &declarations) throw build_exception("Code belongs to another module!");
+            check_undefined(code.functionid);
+            const functionid_t functionid = code.functionid;
+            codes.push_back(std::move(code).finish());
+            defined[functionid - 1] = true;
+        }
+
+        /**
+         * Returns the module, after checking that every function is either imported or defined.  Leaves the builder empty.
+         */
+        Module build() && {
+            for (size_t i = 0; i != defined.size(); ++i) {
+                if (!defined[i]) throw build_exception("Function " + std::to_string(i + 1) + " is neither imported nor defined!");
+            }
+            Module ret;
+            ret.records = std::move(declarations.records);
+            ret.sharedrecords = std::move(sharedrecords);
+            ret.functions = std::move(declarations.functions);
+            ret.imports = std::move(imports);
+            ret.exports = std::move(exports);
+            ret.codes = std::move(codes);
+            ret.globals = std::move(declarations.globals);
+            ret.index_names();
+            defined.clear();
+            return ret;
+        }
+
+    private:
+        void check_functionid(functionid_t functionid) const {
+            if (functionid == 0 || functionid > declarations.functions.size()) throw build_exception("Reference to nonexistent function!");
+        }
+
+        void check_undefined(functionid_t functionid) const {
+            check_functionid(functionid);
+            if (defined[functionid - 1]) throw build_exception("Function is already imported or defined!");
+        }
+
+        detail::module_declarations declarations;
+        std::vector<SharedRecord> sharedrecords;
+        std::vector<Import> imports;
+        std::vector<Export> exports;
+        std::vector<Code> codes;
+        std::vector<bool> defined; // imported or defined, by functionid
+    };
+
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/record.hpp>
+#include <spiral/detail/sharedrecord.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/import.hpp>
+#include <spiral/detail/export.hpp>
+#include <spiral/detail/instruction.hpp>
+#include <spiral/detail/instruction_decoder.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/global.hpp>
+#include <spiral/detail/binarybuf_reader.hpp>
+#include <spiral/detail/decode_result.hpp>
+#include <spiral/detail/telemetry.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+/**
+ * Decoder for the binary module format (see docs/Specification.md).
+ */
+
+namespace spiral {
+
+    namespace SectionCodes {
+        enum : size_t {
+            Record = 1,
+            SharedRecord = 2,
+            Function = 3,
+            Import = 4,
+            Export = 5,
+            Code = 6,
+            Global = 7
+        };
+    }
+
+    namespace detail {
+
+        constexpr char module_magic[8] = { 's', 'p', 'i', 'r', 'a', 'l', 'I', 'R' };
+        constexpr size_t module_version = 1;
+
+        /**
+         * Whether the binary buffer can be checked for its end (with eof()) and read without the check (with read_unchecked()).
+         */
+        template <typename IBinaryBuf, typename = void>
+        struct has_unchecked_read : std::false_type {};
+        template <typename IBinaryBuf>
+        struct has_unchecked_read<IBinaryBuf, std::void_t<decltype(std::declval<IBinaryBuf&>().eof()), decltype(std::declval<IBinaryBuf&>().read_unchecked())>> : std::true_type {};
+
+        /**
+         * Counts in a module (of elements, bytes or instructions) come from the module itself, so at most this many
+         * elements are reserved up front; a truncated module claiming a huge count then fails at its end instead of
+         * allocating for the count.
+         */
+        constexpr size_t max_reserve = 4096;
+
+        /**
+         * Binary buffer adaptor that counts the bytes read, so that section and code lengths can be checked.
+         * If the buffer can be checked for its end, reading past it returns zero (which ends any varint) and marks the
+         * module as truncated, instead of throwing.
+         */
+        template <typename IBinaryBuf>
+        class counting_buf {
+        public:
+            using element_type = byte;
+
+            explicit counting_buf(IBinaryBuf& buf) noexcept : buf(buf) {}
+
+            inline byte read() noexcept(has_unchecked_read<IBinaryBuf>::value) {
+                if constexpr (has_unchecked_read<IBinaryBuf>::value) {
+                    if (buf.eof()) {
+                        truncated = true;
+                        return byte{ 0 };
+                    }
+                    ++offset;
+                    return buf.read_unchecked();
+                }
+                else {
+                    const byte ret = buf.read();
+                    ++offset;
+                    return ret;
+                }
+            }
+
+            size_t get_offset() const noexcept { return offset; }
+            bool is_truncated() const noexcept { return truncated; }
+
+        private:
+            IBinaryBuf& buf;
+            size_t offset = 0;
+            bool truncated = false;
+        };
+
+        /**
+         * Decodes a whole module.  Errors do not throw: the first one is recorded (see get_error), and the reader then
+         * stops.  Only a binary buffer without eof() and read_unchecked() may still throw (e.g. eof_exception if it is truncated).
+         */
+        template <typename IBinaryBuf>
+        class module_reader {
+        public:
+            explicit module_reader(IBinaryBuf& buf, telemetry* sink = nullptr) noexcept : in(buf), reader(in), sink(sink) {}
+
+            void read(std::vector<Record>& records, std::vector<SharedRecord>& sharedrecords, std::vector<Function>& functions, std::vector<Import>& imports, std::vector<Export>& exports, std::vector<Code>& codes, std::vector<Global>& globals) {
+                telemetry::scope decode_scope(sink, "decode");
+                bool has_magic = true;
+                for (const char c : module_magic) {
+                    has_magic &= static_cast<char>(std::to_integer<uint8_t>(in.read())) == c;
+                }
+                if (!has_magic) return fail("Not a Spiral module!");
+                if (read_varuint<size_t>() != module_version) return fail("Unsupported module version!");
+
+                const size_t num_sections = read_varuint<size_t>();
+                size_t last_section_code = 0;
+                for (size_t i = 0; i != num_sections && ok(); ++i) {
+                    const size_t section_code = read_varuint<size_t>();
+                    if (section_code <= last_section_code) return fail("Sections must be in increasing order of section code!");
+                    last_section_code = section_code;
+                    const size_t section_length = read_varuint<size_t>();
+                    const size_t section_start = in.get_offset();
+                    switch (section_code) {
+                    case SectionCodes::Record:
+                        read_records();
+                        break;
+                    case SectionCodes::SharedRecord:
+                        read_sharedrecords(sharedrecords);
+                        break;
+                    case SectionCodes::Function:
+                        read_functions();
+                        break;
+                    case SectionCodes::Import:
+                        read_imports(imports);
+                        break;
+                    case SectionCodes::Export:
+                        read_exports(exports);
+                        break;
+                    case SectionCodes::Code:
+                        read_codes(codes);
+                        break;
+                    case SectionCodes::Global:
+                        read_globals(globals);
+                        break;
+                    default:
+                        return fail("Unknown section code!");
+                    }
+                    if (ok() && in.get_offset() - section_start != section_length) return fail("Section length does not match its payload!");
+                }
+                if (!ok()) return;
+
+                telemetry::scope validate_scope(sink, "validate");
+                for (const Import& import : imports) {
+                    if (defined[import.get_functionid() - 1]) return fail("Imported function is also defined!");
+                    defined[import.get_functionid() - 1] = true;
+                }
+                for (size_t i = 0; i != this->functions.size(); ++i) {
+                    if (!defined[i]) return fail("Function is neither imported nor defined!");
+                }
+                for (const global_reference& ref : global_references) {
+                    if (ref.globalid == 0 || ref.globalid > globals.size()) return fail("Reference to nonexistent global!");
+                    if (globals[ref.globalid - 1].get_type() != static_cast<typeid_underlying_t>(ref.type)) return fail("Global type does not match the variable!");
+                }
+
+                validate_scope.finish();
+
+                records = std::move(this->records);
+                functions = std::move(this->functions);
+                if (sink != nullptr) {
+                    size_t total_instructions = 0;
+                    for (const Code& code : codes) {
+                        total_instructions += code.get_instructions().size();
+                    }
+                    decode_scope.set_instructions(total_instructions);
+                }
+            }
+
+            size_t get_offset() const noexcept { return in.get_offset(); }
+
+            /**
+             * Returns the first error, if any.
+             */
+            std::optional<decode_error> get_error() const noexcept {
+                if (error.kind != decode_errc{}) return error;
+                if (in.is_truncated()) return decode_error{ decode_errc::truncated, in.get_offset(), "Unexpected end of module!" };
+                return std::nullopt;
+            }
+
+        private:
+            friend class instruction_decoder<module_reader>;
+
+            bool ok() const noexcept {
+                return error.kind == decode_errc{} && !in.is_truncated();
+            }
+
+            /**
+             * Records an error (unless there already is one).  Values read after an error are meaningless, so every caller
+             * returns, or only carries on to a check of ok() without using them.
+             */
+            void fail(const char* description, decode_errc kind = decode_errc::malformed) noexcept {
+                if (!ok()) return; // a truncated module fails all later checks too; report where it ended instead
+                error = decode_error{ kind, in.get_offset(), description };
+            }
+
+            template <typename T>
+            T read_varuint() {
+                static_assert(std::is_unsigned_v<T>);
+                T ret;
+                if (!reader.try_read_varint(ret)) fail("Varint too large!", decode_errc::varint_overflow);
+                return ret;
+            }
+
+            template <typename T>
+            T read_varint() {
+                static_assert(std::is_signed_v<T>);
+                T ret;
+                if (!reader.try_read_varint(ret)) fail("Varint too large!", decode_errc::varint_overflow);
+                return ret;
+            }
+
+            std::string read_string() {
+                const size_t size = read_varuint<size_t>();
+                std::string ret;
+                ret.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    ret.push_back(static_cast<char>(std::to_integer<uint8_t>(in.read())));
+                }
+                return ret;
+            }
+
+            typeid_t read_typeid() {
+                int32_t array_dimension = 0;
+                typeid_underlying_t type = read_varint<typeid_underlying_t>();
+                while (type == TypeIDs::Array) {
+                    ++array_dimension;
+                    type = read_varint<typeid_underlying_t>();
+                }
+                if (type == 0 || (type < 0 && primitive_width(type) == 0)) {
+                    fail("Invalid typeid!");
+                    return typeid_t();
+                }
+                if (type > 0) record_references.push_back(static_cast<recordid_t>(type));
+                return typeid_t(type, array_dimension);
+            }
+
+            std::vector<typeid_t> read_typeids() {
+                const size_t size = read_varuint<size_t>();
+                std::vector<typeid_t> ret;
+                ret.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    ret.push_back(read_typeid());
+                }
+                return ret;
+            }
+
+            /**
+             * Checks the records named by the typeids read since the last check.
+             */
+            void check_record_references() {
+                for (const recordid_t recordid : record_references) {
+                    if (recordid > records.size()) return fail("Reference to nonexistent record!");
+                }
+                record_references.clear();
+            }
+
+            functionid_t read_functionid() {
+                const functionid_t functionid = read_varuint<functionid_t>();
+                if (functionid == 0 || functionid > functions.size()) fail("Reference to nonexistent function!");
+                return functionid;
+            }
+
+            void read_records() {
+                const size_t size = read_varuint<size_t>();
+                records.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    records.emplace_back(read_typeids());
+                }
+                if (ok()) check_record_references();
+            }
+
+            void read_sharedrecords(std::vector<SharedRecord>& sharedrecords) {
+                const size_t size = read_varuint<size_t>();
+                sharedrecords.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    const recordid_t recordid = read_varuint<recordid_t>();
+                    if (recordid == 0 || recordid > records.size()) return fail("Reference to nonexistent record!");
+                    sharedrecords.emplace_back(recordid, read_string());
+                }
+            }
+
+            void read_functions() {
+                const size_t size = read_varuint<size_t>();
+                functions.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    std::vector<typeid_t> inputs = read_typeids();
+                    std::vector<typeid_t> outputs = read_typeids();
+                    functions.emplace_back(std::move(inputs), std::move(outputs));
+                }
+                if (ok()) check_record_references();
+                defined.assign(functions.size(), false);
+            }
+
+            void read_imports(std::vector<Import>& imports) {
+                const size_t size = read_varuint<size_t>();
+                imports.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    const functionid_t functionid = read_functionid();
+                    imports.emplace_back(functionid, read_string());
+                }
+            }
+
+            void read_exports(std::vector<Export>& exports) {
+                const size_t size = read_varuint<size_t>();
+                exports.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    const functionid_t functionid = read_functionid();
+                    exports.emplace_back(functionid, read_string());
+                }
+            }
+
+            void read_codes(std::vector<Code>& codes) {
+                const size_t size = read_varuint<size_t>();
+                codes.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    const functionid_t functionid = read_functionid();
+                    if (!ok()) return;
+                    telemetry::scope function_scope(sink, "decode_function", functionid);
+                    if (defined[functionid - 1]) return fail("Function is defined more than once!");
+                    defined[functionid - 1] = true;
+                    std::vector<typeid_t> locals = read_typeids();
+                    if (ok()) check_record_references();
+                    const size_t num_bytes = read_varuint<size_t>();
+                    if (!ok()) return;
+                    const size_t code_start = in.get_offset();
+                    std::vector<referenceid_t> call_operands;
+                    std::vector<Instruction> instructions = read_instructions(functions[functionid - 1], locals, call_operands);
+                    if (ok() && in.get_offset() - code_start != num_bytes) return fail("Code length does not match its instructions!");
+                    function_scope.set_instructions(instructions.size());
+                    codes.emplace_back(functionid, std::move(locals), std::move(instructions), std::move(call_operands));
+                }
+            }
+
+            void read_globals(std::vector<Global>& globals) {
+                const size_t size = read_varuint<size_t>();
+                globals.reserve(std::min(size, max_reserve));
+                for (size_t i = 0; i != size && ok(); ++i) {
+                    const typeid_t type = read_typeid();
+                    if (!type.is_primitive()) return fail("Globals must be primitives!");
+                    const uint32_t flags = read_varuint<uint32_t>();
+                    if (flags & ~static_cast<uint32_t>(GlobalFlags::All)) return fail("Unknown global flags!");
+                    globals.emplace_back(type.get_typeid(), flags);
+                }
+            }
+
+            InstructionParamTypes::any_signed_integral read_immediate(typeid_primitive_t type) {
+                InstructionParamTypes::any_signed_integral ret;
+                switch (type) {
+                case typeid_primitive_t::I8:
+                    ret.i8 = read_varint<int8_t>();
+                    break;
+                case typeid_primitive_t::I16:
+                    ret.i16 = read_varint<int16_t>();
+                    break;
+                case typeid_primitive_t::I32:
+                    ret.i32 = read_varint<int32_t>();
+                    break;
+                case typeid_primitive_t::I64:
+                    ret.i64 = read_varint<int64_t>();
+                    break;
+                case typeid_primitive_t::I128: {
+                    // varint of up to 19 bytes, read 7 bits at a time
+                    uint64_t lower = 0, upper = 0;
+                    size_t shift = 0;
+                    uint8_t curr;
+                    do {
+                        if (shift >= 128) {
+                            fail("Immediate too large!", decode_errc::varint_overflow);
+                            return ret;
+                        }
+                        curr = std::to_integer<uint8_t>(in.read());
+                        const uint64_t bits = curr & 0x7f;
+                        if (shift < 64) {
+                            lower |= bits << shift;
+                            if (shift > 57) upper |= bits >> (64 - shift);
+                        }
+                        else {
+                            upper |= bits << (shift - 64);
+                        }
+                        shift += 7;
+                    } while (curr & 0x80);
+                    if (shift < 128 && (curr & 0x40)) {
+                        // sign extension
+                        if (shift < 64) {
+                            lower |= ~static_cast<uint64_t>(0) << shift;
+                            upper = ~static_cast<uint64_t>(0);
+                        }
+                        else {
+                            upper |= ~static_cast<uint64_t>(0) << (shift - 64);
+                        }
+                    }
+                    ret.i128 = int128_t(lower, static_cast<int64_t>(upper));
+                    break;
+                }
+                case typeid_primitive_t::F32: {
+                    uint32_t bits;
+                    reader.read_integral(bits);
+                    ret.i32 = static_cast<int32_t>(bits);
+                    break;
+                }
+                case typeid_primitive_t::F64: {
+                    uint64_t bits;
+                    reader.read_integral(bits);
+                    ret.i64 = static_cast<int64_t>(bits);
+                    break;
+                }
+                default:
+                    fail("Unsupported immediate type!");
+                }
+                return ret;
+            }
+
+            std::vector<Instruction> read_instructions(const Function& function, const std::vector<typeid_t>& locals, std::vector<referenceid_t>& call_operands) {
+                num_instructions = read_varuint<size_t>();
+                instruction_decoder<module_reader> decoder(*this, records, functions, function, locals, call_operands);
+                std::vector<Instruction> ret;
+                ret.reserve(std::min(num_instructions, max_reserve));
+                for (size_t i = 0; i != num_instructions && ok(); ++i) {
+                    const opcode_t opcode = static_cast<opcode_t>(read_varuint<uint32_t>());
+                    if (!is_valid(opcode)) {
+                        fail("Invalid opcode!");
+                        break;
+                    }
+                    decoder.decode(opcode, ret);
+                }
+                return ret;
+            }
+
+            // operands of instructions, for instruction_decoder
+
+            instructionid_t read_target() {
+                const instructionid_t target = read_varuint<instructionid_t>();
+                if (target > num_instructions) fail("Jump target out of range!");
+                return target;
+            }
+
+            globalid_t read_globalid() {
+                return read_varuint<globalid_t>();
+            }
+
+            void check_global(globalid_t globalid, typeid_primitive_t type) {
+                // the global section comes after the code section, so global accesses are checked at the end
+                global_references.push_back(global_reference{ globalid, type });
+            }
+
+            variableid_t read_variableid() {
+                return read_varint<variableid_t>();
+            }
+
+            ssize_t read_appendage(ssize_t) {
+                return read_varint<ssize_t>();
+            }
+
+            struct global_reference {
+                globalid_t globalid;
+                typeid_primitive_t type;
+            };
+
+            counting_buf<IBinaryBuf> in;
+            binarybuf_reader<counting_buf<IBinaryBuf>> reader;
+            std::vector<Record> records;
+            std::vector<Function> functions;
+            std::vector<recordid_t> record_references;
+            std::vector<bool> defined;
+            std::vector<global_reference> global_references;
+            size_t num_instructions = 0; // of the code currently being decoded
+            decode_error error{};
+            telemetry* sink;
+        };
+    }
+
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cassert>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/record.hpp>
+#include <spiral/detail/sharedrecord.hpp>
+#include <spiral/detail/function.hpp>
+#include <spiral/detail/import.hpp>
+#include <spiral/detail/export.hpp>
+#include <spiral/detail/instruction.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/global.hpp>
+#include <spiral/detail/binarybuf_writer.hpp>
+#include <spiral/detail/module_reader.hpp>
+
+/**
+ * Encoder for the binary module format (see docs/Specification.md), the counterpart of module_reader.
+ * The format puts the length of each section and each code before its payload, so the constructor first runs the
+ * encoder over a binarybuf_sizer, recording those lengths (in the order they are written); write() then emits
+ * everything in one pass, without backpatching, into a buffer that can be allocated at exactly get_size() bytes.
+ */
+
+namespace spiral {
+
+    namespace detail {
+
+        class module_writer {
+        public:
+            module_writer(const std::vector<Record>& records, const std::vector<SharedRecord>& sharedrecords, const std::vector<Function>& functions, const std::vector<Import>& imports, const std::vector<Export>& exports, const std::vector<Code>& codes, const std::vector<Global>& globals) :
+                records(records), sharedrecords(sharedrecords), functions(functions), imports(imports), exports(exports), codes(codes), globals(globals) {
+                binarybuf_sizer sizer;
+                size_t next_length = 0;
+                encode(sizer, next_length);
+                size = sizer.get_size();
+            }
+
+            /**
+             * Number of bytes of the encoded module.
+             */
+            size_t get_size() const noexcept { return size; }
+
+            /**
+             * Writes the module.  Throws the exceptions of the binary buffer (e.g. eof_exception if it is too small).
+             */
+            template <typename OBinaryBuf>
+            void write(OBinaryBuf& buf) {
+                binarybuf_writer<OBinaryBuf> writer(buf);
+                size_t next_length = 0;
+                encode(writer, next_length);
+                assert(next_length == lengths.size());
+            }
+
+        private:
+            /**
+             * Writes the length of the payload, and then the payload.  The lengths are measured in the sizing pass.
+             */
+            template <typename Writer, typename Payload>
+            void write_with_length(Writer& out, size_t& next_length, Payload&& payload) {
+                if constexpr (std::is_same_v<Writer, binarybuf_sizer>) {
+                    const size_t slot = lengths.size();
+                    lengths.push_back(0);
+                    binarybuf_sizer inner;
+                    payload(inner);
+                    lengths[slot] = inner.get_size();
+                    ++next_length;
+                    out.write_varint(lengths[slot]);
+                    out.write_bytes(nullptr, lengths[slot]);
+                }
+                else {
+                    out.write_varint(lengths[next_length++]);
+                    payload(out);
+                }
+            }
+
+            template <typename Writer>
+            void encode(Writer& out, size_t& next_length) {
+                for (const char c : module_magic) {
+                    out.write_integral(static_cast<uint8_t>(c));
+                }
+                out.write_varint(module_version);
+
+                const bool has_section[] = { !records.empty(), !sharedrecords.empty(), !functions.empty(), !imports.empty(), !exports.empty(), !codes.empty(), !globals.empty() };
+                size_t num_sections = 0;
+                for (const bool has : has_section) num_sections += has;
+                out.write_varint(num_sections);
+
+                const auto section = [&](size_t section_code, auto&& payload) {
+                    if (!has_section[section_code - 1]) return;
+                    out.write_varint(section_code);
+                    write_with_length(out, next_length, payload);
+                };
+                section(SectionCodes::Record, [&](auto& payload) {
+                    payload.write_varint(records.size());
+                    for (const Record& record : records) write_typeids(payload, record.get_fields());
+                });
+                section(SectionCodes::SharedRecord, [&](auto& payload) {
+                    payload.write_varint(sharedrecords.size());
+                    for (const SharedRecord& sharedrecord : sharedrecords) {
+                        payload.write_varint(sharedrecord.get_recordid());
+                        write_string(payload, sharedrecord.get_name());
+                    }
+                });
+                section(SectionCodes::Function, [&](auto& payload) {
+                    payload.write_varint(functions.size());
+                    for (const Function& function : functions) {
+                        write_typeids(payload, function.get_inputs());
+                        write_typeids(payload, function.get_outputs());
+                    }
+                });
+                section(SectionCodes::Import, [&](auto& payload) {
+                    payload.write_varint(imports.size());
+                    for (const Import& import : imports) {
+                        payload.write_varint(import.get_functionid());
+                        write_string(payload, import.get_name());
+                    }
+                });
+                section(SectionCodes::Export, [&](auto& payload) {
+                    payload.write_varint(exports.size());
+                    for (const Export& exp : exports) {
+                        payload.write_varint(exp.get_functionid());
+                        write_string(payload, exp.get_name());
+                    }
+                });
+                section(SectionCodes::Code, [&](auto& payload) {
+                    payload.write_varint(codes.size());
+                    for (const Code& code : codes) {
+                        payload.write_varint(code.get_functionid());
+                        write_typeids(payload, code.get_locals());
+                        write_with_length(payload, next_length, [&](auto& body) {
+                            write_instructions(body, code);
+                        });
+                    }
+                });
+                section(SectionCodes::Global, [&](auto& payload) {
+                    payload.write_varint(globals.size());
+                    for (const Global& global : globals) {
+                        payload.write_varint(global.get_type());
+                        payload.write_varint(global.get_flags());
+                    }
+                });
+            }
+
+            template <typename Writer>
+            static void write_string(Writer& out, const std::string& str) {
+                out.write_varint(str.size());
+                out.write_bytes(reinterpret_cast<const byte*>(str.data()), str.size());
+            }
+
+            template <typename Writer>
+            static void write_typeid(Writer& out, const typeid_t& type) {
+                for (int32_t i = 0; i != type.get_array_dimension(); ++i) {
+                    out.write_varint(static_cast<typeid_underlying_t>(TypeIDs::Array));
+                }
+                out.write_varint(type.get_typeid());
+            }
+
+            template <typename Writer>
+            static void write_typeids(Writer& out, const std::vector<typeid_t>& types) {
+                out.write_varint(types.size());
+                for (const typeid_t& type : types) write_typeid(out, type);
+            }
+
+            template <typename Writer>
+            void write_instructions(Writer& out, const Code& code) const {
+                namespace P = InstructionParamTypes;
+                const Function& function = functions[code.get_functionid() - 1];
+                const std::vector<typeid_t>& locals = code.get_locals();
+                // the appendage of a reference is only encoded for arrays and records
+                const auto write_reference = [&](const referenceid_t& ref) {
+                    out.write_varint(ref.variableid);
+                    if (ref.variableid == 0) return;
+                    const typeid_t* type;
+                    if (ref.variableid > 0) {
+                        type = &locals[ref.variableid - 1];
+                    }
+                    else {
+                        const size_t index = static_cast<size_t>(-ref.variableid) - 1;
+                        const size_t num_inputs = function.get_inputs().size();
+                        type = index < num_inputs ? &function.get_inputs()[index] : &function.get_outputs()[index - num_inputs];
+                    }
+                    if (type->is_array()) {
+                        out.write_varint(ref.array_index_variableid);
+                    }
+                    else if (type->is_record()) {
+                        out.write_varint(ref.record_fieldindex);
+                    }
+                };
+                out.write_varint(code.get_instructions().size());
+                for (const Instruction& instruction : code.get_instructions()) {
+                    out.write_varint(static_cast<uint32_t>(instruction.get_opcode()));
+                    instruction.get_params([&](const auto& params) {
+                        using params_type = std::decay_t<decltype(params)>;
+                        if constexpr (std::is_same_v<params_type, P::Empty>) {
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::Jump>) {
+                            out.write_varint(params.target);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::JumpConditional>) {
+                            out.write_varint(params.target);
+                            write_reference(params.condition);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::Call>) {
+                            out.write_varint(params.target);
+                            const Function& target = functions[params.target - 1];
+                            const size_t num_params = target.get_inputs().size() + target.get_outputs().size();
+                            const referenceid_t* const call_params = code.get_call_params(params);
+                            for (size_t k = 0; k != num_params; ++k) write_reference(call_params[k]);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::Immediate>) {
+                            write_reference(params.variable);
+                            write_immediate(out, params.type, params.value);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::Transfer>) {
+                            write_reference(params.source);
+                            write_reference(params.destination);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::GlobalAccess>) {
+                            out.write_varint(params.global);
+                            write_reference(params.variable);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::OneOperandInt> || std::is_same_v<params_type, P::BitCount> || std::is_same_v<params_type, P::Convert> || std::is_same_v<params_type, P::Reinterpret>) {
+                            write_reference(params.operand);
+                            write_reference(params.result);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::TwoOperandInt> || std::is_same_v<params_type, P::MulEx>) {
+                            write_reference(params.operand1);
+                            write_reference(params.operand2);
+                            write_reference(params.result);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::Divide> || std::is_same_v<params_type, P::DivEx>) {
+                            write_reference(params.dividend);
+                            write_reference(params.divisor);
+                            write_reference(params.quotient);
+                            write_reference(params.remainder);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::Shift>) {
+                            write_reference(params.operand);
+                            write_reference(params.shamt);
+                            write_reference(params.result);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::ArraySized>) {
+                            write_reference(params.array);
+                            write_reference(params.size);
+                        }
+                        else if constexpr (std::is_same_v<params_type, P::ArrayClear>) {
+                            write_reference(params.array);
+                        }
+                        else {
+                            static_assert(always_false<params_type>::value, "Unhandled instruction parameter type!");
+                        }
+                    });
+                }
+            }
+
+            template <typename Writer>
+            static void write_immediate(Writer& out, typeid_primitive_t type, const InstructionParamTypes::any_signed_integral& value) {
+                switch (type) {
+                case typeid_primitive_t::I8:
+                    out.write_varint(value.i8);
+                    break;
+                case typeid_primitive_t::I16:
+                    out.write_varint(value.i16);
+                    break;
+                case typeid_primitive_t::I32:
+                    out.write_varint(value.i32);
+                    break;
+                case typeid_primitive_t::I64:
+                    out.write_varint(value.i64);
+                    break;
+                case typeid_primitive_t::I128:
+                    out.write_varint(value.i128);
+                    break;
+                case typeid_primitive_t::F32:
+                    out.write_integral(static_cast<uint32_t>(value.i32));
+                    break;
+                case typeid_primitive_t::F64:
+                    out.write_integral(static_cast<uint64_t>(value.i64));
+                    break;
+                default:
+                    // not accepted by the decoder, so a Module cannot contain it
+                    assert(false);
+                }
+            }
+
+            const std::vector<Record>& records;
+            const std::vector<SharedRecord>& sharedrecords;
+            const std::vector<Function>& functions;
+            const std::vector<Import>& imports;
+            const std::vector<Export>& exports;
+            const std::vector<Code>& codes;
+            const std::vector<Global>& globals;
+            std::vector<size_t> lengths; // of each section and code, in the order they are written
+            size_t size;
+        };
+    }
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/hash.hpp>
+#include <spiral/detail/wide_arithmetic.hpp>
+
+/**
+ * Minimal perfect hash over the export or import names of a module (hash and displace): every name hashes to a
+ * bucket, and the pilot of the bucket, found when the table is built, sends each name of the bucket to its own slot.
+ * A lookup is then one hash of the name, two multiplies and one string compare, whatever the number of names.
+ */
+
+namespace spiral {
+
+    /**
+     * A name together with its hash, for callers that look up the same export or import repeatedly.
+     * The name is not copied, so it must outlive this object.
+     */
+    class hashed_name {
+    public:
+        explicit hashed_name(std::string_view name) noexcept : name(name), hash(hash_bytes(reinterpret_cast<const byte*>(name.data()), name.size())) {}
+
+        std::string_view get_name() const noexcept { return name; }
+        uint64_t get_hash() const noexcept { return hash; }
+
+    private:
+        std::string_view name;
+        uint64_t hash;
+    };
+
+    namespace detail {
+
+        /**
+         * Maps names to indices into the vector they were built from (of Export or Import).
+         * With several items of the same name, the first one is found.
+         */
+        class name_table {
+        public:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            name_table() = default;
+
+            template <typename T>
+            explicit name_table(const std::vector<T>& items) {
+                const size_t num_items = items.size();
+                if (num_items == 0) return;
+                std::vector<uint64_t> hashes(num_items);
+                for (size_t i = 0; i != num_items; ++i) {
+                    hashes[i] = hashed_name(items[i].get_name()).get_hash();
+                }
+
+                // group the items by bucket (in increasing index within each bucket), dropping repeated names
+                pilots.assign(num_items / 4 + 1, 0);
+                std::vector<uint32_t> bucket_begin(pilots.size() + 1, 0);
+                for (const uint64_t hash : hashes) ++bucket_begin[reduce(hash, pilots.size()) + 1];
+                for (size_t b = 0; b != pilots.size(); ++b) bucket_begin[b + 1] += bucket_begin[b];
+                std::vector<uint32_t> bucket_items(num_items);
+                {
+                    std::vector<uint32_t> next(bucket_begin.begin(), bucket_begin.end() - 1);
+                    for (size_t i = 0; i != num_items; ++i) bucket_items[next[reduce(hashes[i], pilots.size())]++] = static_cast<uint32_t>(i);
+                }
+                std::vector<uint32_t> bucket_size(pilots.size(), 0);
+                size_t num_slots = 0;
+                for (size_t b = 0; b != pilots.size(); ++b) {
+                    uint32_t* const begin = bucket_items.data() + bucket_begin[b];
+                    uint32_t size = 0;
+                    for (uint32_t k = 0; k != bucket_begin[b + 1] - bucket_begin[b]; ++k) {
+                        const uint32_t item = begin[k];
+                        bool repeated = false;
+                        for (uint32_t j = 0; j != size; ++j) {
+                            if (hashes[begin[j]] != hashes[item]) continue;
+                            if (items[begin[j]].get_name() != items[item].get_name()) { fall_back(); return; } // 64-bit collision
+                            repeated = true;
+                        }
+                        if (!repeated) begin[size++] = item;
+                    }
+                    bucket_size[b] = size;
+                    num_slots += size;
+                }
+
+                // place the largest buckets first, while most slots are free
+                std::vector<uint32_t> order(pilots.size());
+                {
+                    std::vector<uint32_t> size_begin(num_items + 2, 0);
+                    for (const uint32_t size : bucket_size) ++size_begin[num_items - size + 1];
+                    for (size_t s = 0; s != num_items + 1; ++s) size_begin[s + 1] += size_begin[s];
+                    for (size_t b = 0; b != pilots.size(); ++b) order[size_begin[num_items - bucket_size[b]]++] = static_cast<uint32_t>(b);
+                }
+                slots.assign(num_slots, 0);
+                std::vector<bool> taken(num_slots, false);
+                std::vector<size_t> candidate;
+                for (const uint32_t b : order) {
+                    const uint32_t* const begin = bucket_items.data() + bucket_begin[b];
+                    const uint32_t size = bucket_size[b];
+                    if (size == 0) break;
+                    for (uint32_t pilot = 0;; ++pilot) {
+                        if (pilot == max_pilot) { fall_back(); return; }
+                        candidate.clear();
+                        bool fits = true;
+                        for (uint32_t k = 0; k != size && fits; ++k) {
+                            const size_t slot = slot_of(hashes[begin[k]], pilot, num_slots);
+                            fits = !taken[slot];
+                            for (const size_t other : candidate) fits &= other != slot;
+                            candidate.push_back(slot);
+                        }
+                        if (!fits) continue;
+                        for (uint32_t k = 0; k != size; ++k) {
+                            taken[candidate[k]] = true;
+                            slots[candidate[k]] = begin[k];
+                        }
+                        pilots[b] = pilot;
+                        break;
+                    }
+                }
+            }
+
+            /**
+             * Returns the index of the first item with the given name, or npos.  items must be the vector that the table was built from.
+             */
+            template <typename T>
+            size_t find(const hashed_name& key, const std::vector<T>& items) const noexcept {
+                if (linear) {
+                    for (size_t i = 0; i != items.size(); ++i) {
+                        if (items[i].get_name() == key.get_name()) return i;
+                    }
+                    return npos;
+                }
+                if (slots.empty()) return npos;
+                const uint32_t pilot = pilots[reduce(key.get_hash(), pilots.size())];
+                const uint32_t item = slots[slot_of(key.get_hash(), pilot, slots.size())];
+                return items[item].get_name() == key.get_name() ? item : npos;
+            }
+
+        private:
+            static constexpr uint32_t max_pilot = uint32_t{ 1 } << 24;
+
+            /**
+             * Maps a hash uniformly to [0, range) with a multiply instead of a division.
+             */
+            static size_t reduce(uint64_t hash, size_t range) noexcept {
+                return static_cast<size_t>(mullu(hash, range).get_upper());
+            }
+
+            static size_t slot_of(uint64_t hash, uint32_t pilot, size_t num_slots) noexcept {
+                return reduce(hash_mix(hash ^ hash_secret[2], pilot ^ hash_secret[3]), num_slots);
+            }
+
+            /**
+             * Gives up on the perfect hash (two names with the same 64-bit hash, or no pilot found), and scans instead.
+             */
+            void fall_back() noexcept {
+                pilots.clear();
+                slots.clear();
+                linear = true;
+            }
+
+            std::vector<uint32_t> pilots; // per bucket
+            std::vector<uint32_t> slots; // index of the item in each slot
+            bool linear = false;
+        };
+    }
+
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/typeid.hpp>
+#include <spiral/detail/primitives.hpp>
+#include <spiral/detail/span.hpp>
+
+/**
+ * Native calling convention between compiled Spiral code and C++.
+ *
+ * A Spiral function with inputs I... and outputs O... is called natively with the inputs as ordinary arguments (so
+ * they are passed in registers), and returns native_return_t<O...>:
+ *  - no outputs: void
+ *  - one output: the output itself
+ *  - more outputs: native_results<O...>, a trivially copyable struct with one 8-byte slot per 64 bits of output
+ *    (so two 64-bit outputs come back in RDX:RAX)
+ * Compiled functions additionally take a native_context* as the first argument.  Host imports do not, so that a
+ * host function with a matching signature can be called directly.
+ * Compiled code calls an import through its slot in native_context::imports.  A slot that is still null (an import
+ * that is resolved lazily) is filled by calling resolve_import, once, after which calls go directly to the host function.
+ */
+
+namespace spiral {
+
+    /**
+     * Type-erased pointer to a function with the native calling convention (cast back to the real signature before calling).
+     */
+    using native_function_t = void (*)();
+
+    /**
+     * Per-instance state that compiled code receives as its first argument.
+     * The AOT backend emits a copy of this layout (sp_context in cpp_emitter.hpp), so the two must be changed together.
+     */
+    struct native_context {
+        std::atomic<native_function_t>* imports = nullptr; // one slot per import (in import section order), null until resolved
+        byte* globals = nullptr; // the global block of the instance (see global_layout.hpp)
+        native_function_t (*resolve_import)(const native_context*, size_t) noexcept = nullptr; // fills a null slot, or returns nullptr (and compiled code traps)
+        const void* import_table = nullptr; // owner of the slots, for resolve_import
+    };
+
+    // compiled code reads the slots as plain pointers (with atomic loads)
+    static_assert(sizeof(std::atomic<native_function_t>) == sizeof(native_function_t) && std::atomic<native_function_t>::is_always_lock_free);
+
+    template <typename... T>
+    struct type_list {};
+
+    /**
+     * Maps a C++ type to the Spiral primitive that it is passed as.
+     */
+    template <typename T>
+    struct native_typeid;
+    template <> struct native_typeid<int8_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I8> {};
+    template <> struct native_typeid<uint8_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I8> {};
+    template <> struct native_typeid<int16_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I16> {};
+    template <> struct native_typeid<uint16_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I16> {};
+    template <> struct native_typeid<int32_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I32> {};
+    template <> struct native_typeid<uint32_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I32> {};
+    template <> struct native_typeid<int64_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I64> {};
+    template <> struct native_typeid<uint64_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I64> {};
+    template <> struct native_typeid<int128_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I128> {};
+    template <> struct native_typeid<uint128_t> : std::integral_constant<typeid_underlying_t, TypeIDs::I128> {};
+    template <> struct native_typeid<float> : std::integral_constant<typeid_underlying_t, TypeIDs::F32> {};
+    template <> struct native_typeid<double> : std::integral_constant<typeid_underlying_t, TypeIDs::F64> {};
+
+    template <typename T, typename = void>
+    struct is_native_type : std::false_type {};
+    template <typename T>
+    struct is_native_type<T, std::void_t<decltype(native_typeid<T>::value)>> : std::true_type {};
+    template <typename T>
+    constexpr bool is_native_type_v = is_native_type<T>::value;
+
+    namespace detail {
+        constexpr size_t native_slot_count(size_t bytes) noexcept {
+            return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        }
+    }
+
+    /**
+     * Outputs of a Spiral function with more than one output, each stored (little-endian) at the start of its own 8-byte slots.
+     */
+    template <typename... T>
+    struct native_results {
+        static_assert(std::conjunction_v<is_native_type<T>...>, "native_results requires native types!");
+
+        static constexpr std::array<size_t, sizeof...(T)> offsets = [] {
+            std::array<size_t, sizeof...(T)> ret{};
+            size_t curr = 0, i = 0;
+            ((ret[i++] = curr, curr += detail::native_slot_count(sizeof(T))), ...);
+            return ret;
+        }();
+        static constexpr size_t num_slots = (detail::native_slot_count(sizeof(T)) + ... + 0);
+
+        template <size_t I>
+        std::tuple_element_t<I, std::tuple<T...>> get() const noexcept {
+            std::tuple_element_t<I, std::tuple<T...>> ret;
+            std::memcpy(&ret, slots + offsets[I], sizeof(ret));
+            return ret;
+        }
+        template <size_t I>
+        void set(std::tuple_element_t<I, std::tuple<T...>> value) noexcept {
+            std::memcpy(slots + offsets[I], &value, sizeof(value));
+        }
+
+        uint64_t slots[num_slots];
+    };
+
+    template <typename... T>
+    struct native_return {
+        using type = native_results<T...>;
+    };
+    template <>
+    struct native_return<> {
+        using type = void;
+    };
+    template <typename T>
+    struct native_return<T> {
+        using type = T;
+    };
+    template <typename... T>
+    struct native_return<type_list<T...>> : native_return<T...> {};
+
+    template <typename... T>
+    using native_return_t = typename native_return<T...>::type;
+
+    /**
+     * The Spiral outputs corresponding to a C++ return type: void, a single native type, or a std::tuple of native types.
+     */
+    template <typename R>
+    struct host_outputs {
+        static_assert(is_native_type_v<R>, "Host functions must return void, a native type, or a std::tuple of native types!");
+        using type = type_list<R>;
+    };
+    template <>
+    struct host_outputs<void> {
+        using type = type_list<>;
+    };
+    template <typename... T>
+    struct host_outputs<std::tuple<T...>> {
+        static_assert(std::conjunction_v<is_native_type<T>...>, "Host functions must return void, a native type, or a std::tuple of native types!");
+        using type = type_list<T...>;
+    };
+
+    template <typename... T>
+    constexpr std::array<typeid_underlying_t, sizeof...(T)> native_typeids(type_list<T...>) noexcept {
+        return { native_typeid<T>::value... };
+    }
+
+    namespace detail {
+
+        /**
+         * Checks whether a list of Spiral types is exactly the given list of primitives.
+         */
+        inline bool types_match(const std::vector<typeid_t>& types, span<const typeid_underlying_t> native_types) noexcept {
+            if (types.size() != static_cast<size_t>(native_types.size())) return false;
+            for (size_t i = 0; i != types.size(); ++i) {
+                if (!types[i].is_primitive() || types[i].get_typeid() != native_types[i]) return false;
+            }
+            return true;
+        }
+
+        template <typename... T, size_t... I>
+        inline native_results<T...> to_native_results(const std::tuple<T...>& values, std::index_sequence<I...>) noexcept {
+            native_results<T...> ret;
+            (ret.template set<I>(std::get<I>(values)), ...);
+            return ret;
+        }
+
+        template <typename... T, size_t... I>
+        inline std::tuple<T...> from_native_results(const native_results<T...>& results, std::index_sequence<I...>) noexcept {
+            return { results.template get<I>()... };
+        }
+
+        template <auto F, typename R, typename... Args>
+        struct host_thunk_impl {
+            static_assert(std::conjunction_v<is_native_type<Args>...>, "Host function parameters must be native types passed by value!");
+            using inputs = type_list<Args...>;
+            using outputs = typename host_outputs<R>::type;
+            using return_type = native_return_t<outputs>;
+
+            /**
+             * Whether F itself already has the native signature (in which case compiled code calls F directly).
+             */
+            static constexpr bool is_direct = std::is_same_v<return_type, R>;
+
+            static return_type call(Args... args) noexcept(noexcept(F(args...))) {
+                if constexpr (is_direct) {
+                    return F(args...);
+                }
+                else {
+                    return to_native_results(F(args...), std::make_index_sequence<std::tuple_size_v<R>>{});
+                }
+            }
+
+            static native_function_t entry() noexcept {
+                if constexpr (is_direct) {
+                    return reinterpret_cast<native_function_t>(F);
+                }
+                else {
+                    return reinterpret_cast<native_function_t>(&call);
+                }
+            }
+
+            static constexpr std::array<typeid_underlying_t, sizeof...(Args)> input_typeids = native_typeids(inputs{});
+            static constexpr std::array<typeid_underlying_t, std::tuple_size_v<decltype(native_typeids(outputs{}))>> output_typeids = native_typeids(outputs{});
+        };
+    }
+
+    /**
+     * Compile-time thunk that adapts the host function F to the native calling convention (only needed when F returns multiple outputs).
+     */
+    template <auto F, typename = decltype(F)>
+    struct host_thunk;
+    template <auto F, typename R, typename... Args>
+    struct host_thunk<F, R (*)(Args...)> : detail::host_thunk_impl<F, R, Args...> {};
+    template <auto F, typename R, typename... Args>
+    struct host_thunk<F, R (*)(Args...) noexcept> : detail::host_thunk_impl<F, R, Args...> {};
+
+    /**
+     * A host function with its signature, type-erased so that it can be chosen at run time (e.g. by an import resolver).
+     * A null entry means that there is no such function.
+     */
+    struct host_function {
+        native_function_t entry = nullptr;
+        span<const typeid_underlying_t> inputs;
+        span<const typeid_underlying_t> outputs;
+
+        template <auto F>
+        static host_function of() noexcept {
+            using thunk = host_thunk<F>;
+            return { thunk::entry(), span<const typeid_underlying_t>(thunk::input_typeids.data(), thunk::input_typeids.size()), span<const typeid_underlying_t>(thunk::output_typeids.data(), thunk::output_typeids.size()) };
+        }
+    };
+
+}
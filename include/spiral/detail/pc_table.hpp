@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/function.hpp>
+
+namespace spiral {
+
+    /**
+     * Spiral location of a native PC.  Only the function is known (see perf.hpp for why not the instruction).
+     */
+    struct pc_location {
+        functionid_t functionid;
+    };
+
+    /**
+     * Maps native PCs in generated code back to Spiral functions.
+     * Backends add the code ranges while preparing a CompiledModule; lookups may then be done concurrently (e.g. from a profiler).
+     */
+    class pc_table {
+    public:
+        /**
+         * Adds the code of a function at [start, start + size).
+         */
+        void add(uintptr_t start, size_t size, functionid_t functionid) {
+            const code_range range{ start, start + size, functionid };
+            ranges.insert(std::upper_bound(ranges.begin(), ranges.end(), start, [](uintptr_t pc, const code_range& r) { return pc < r.start; }), range);
+        }
+
+        std::optional<pc_location> lookup(uintptr_t pc) const noexcept {
+            auto it = std::upper_bound(ranges.begin(), ranges.end(), pc, [](uintptr_t value, const code_range& r) { return value < r.start; });
+            if (it == ranges.begin()) return std::nullopt;
+            --it;
+            if (pc >= it->end) return std::nullopt;
+            return pc_location{ it->functionid };
+        }
+
+        bool empty() const noexcept { return ranges.empty(); }
+
+    private:
+        struct code_range {
+            uintptr_t start;
+            uintptr_t end;
+            functionid_t functionid;
+        };
+
+        std::vector<code_range> ranges; // sorted by start
+    };
+
+}
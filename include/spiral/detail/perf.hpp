@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define SPIRAL_PERF_LINUX
+#endif
+
+#include <spiral/detail/typedefs.hpp>
+
+/**
+ * Linux perf integration for generated code that perf cannot symbolize by itself (e.g. code in anonymous memory, or in
+ * a shared object that has been deleted since it was loaded, as aot_load_cached does); aot_load reports the code it
+ * loads to a perf_output if given one.
+ *
+ * Two outputs are supported:
+ *  - the perf map (/tmp/perf-<pid>.map), which only names address ranges;
+ *  - jitdump (<directory>/jit-<pid>.dump), which also records the code bytes (for perf annotate).
+ * To use jitdump, run `perf record -k mono`, then `perf inject --jit` before `perf report`.
+ * Both are no-ops on platforms other than Linux.
+ *
+ * Both name whole functions only.  The AOT backend does not know where the code of each instruction ended up (the
+ * compiler is free to move it), so the only mapping of PCs to Spiral instructions is the debug info of the shared
+ * object, built with aot_options::debug_info from the #line directives of cpp_emitter.hpp.  perf reads that itself,
+ * but only while the shared object is on disk (aot_compile and aot_load, not aot_load_cached).
+ */
+
+namespace spiral {
+
+    struct perf_options {
+        bool perf_map = true;
+        bool jitdump = false;
+        std::filesystem::path jitdump_directory = "/tmp";
+    };
+
+    namespace detail {
+
+        struct jitdump_file_header {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t total_size;
+            uint32_t elf_mach;
+            uint32_t pad1;
+            uint32_t pid;
+            uint64_t timestamp;
+            uint64_t flags;
+        };
+
+        struct jitdump_record_header {
+            uint32_t id;
+            uint32_t total_size;
+            uint64_t timestamp;
+        };
+
+        enum : uint32_t {
+            jitdump_code_load = 0
+        };
+
+        constexpr uint32_t jitdump_magic = 0x4A695444;
+
+        /**
+         * Timestamp in the clock that `perf record -k mono` uses.
+         */
+        inline uint64_t perf_timestamp() noexcept {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+        }
+
+        template <typename T>
+        inline void append_bytes(std::vector<byte>& out, const T& value) {
+            const byte* const data = reinterpret_cast<const byte*>(&value);
+            out.insert(out.end(), data, data + sizeof(T));
+        }
+
+        inline void append_string(std::vector<byte>& out, const std::string& str) {
+            const byte* const data = reinterpret_cast<const byte*>(str.c_str());
+            out.insert(out.end(), data, data + str.size() + 1);
+        }
+    }
+
+    /**
+     * Reports generated code to perf.  Safe to use from several threads.
+     */
+    class perf_output {
+    public:
+        explicit perf_output(const perf_options& options = {}) {
+#ifdef SPIRAL_PERF_LINUX
+            const std::string pid = std::to_string(getpid());
+            if (options.perf_map) {
+                map_file = std::fopen(("/tmp/perf-" + pid + ".map").c_str(), "a");
+            }
+            if (options.jitdump) {
+                open_jitdump(options.jitdump_directory / ("jit-" + pid + ".dump"));
+            }
+#else
+            (void)options;
+#endif
+        }
+        perf_output(const perf_output&) = delete;
+        perf_output& operator=(const perf_output&) = delete;
+        ~perf_output() {
+#ifdef SPIRAL_PERF_LINUX
+            if (map_file != nullptr) std::fclose(map_file);
+            if (jitdump_marker != nullptr) munmap(jitdump_marker, jitdump_marker_size);
+            if (jitdump_fd != -1) close(jitdump_fd);
+#endif
+        }
+
+        /**
+         * Reports that code of the given size has been placed at code (and is executable from now on).
+         */
+        void code_load(const void* code, size_t size, const std::string& name) {
+#ifdef SPIRAL_PERF_LINUX
+            const std::lock_guard<std::mutex> lock(mutex);
+            if (map_file != nullptr) {
+                std::fprintf(map_file, "%llx %zx %s\n", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(code)), size, name.c_str());
+                std::fflush(map_file);
+            }
+            if (jitdump_fd != -1) write_code_load(code, size, name);
+#else
+            (void)code;
+            (void)size;
+            (void)name;
+#endif
+        }
+
+        bool is_enabled() const noexcept {
+            return map_file != nullptr || jitdump_fd != -1;
+        }
+
+    private:
+#ifdef SPIRAL_PERF_LINUX
+        void open_jitdump(const std::filesystem::path& path) {
+            jitdump_fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+            if (jitdump_fd == -1) return;
+            // perf finds the dump through this executable mapping of it
+            jitdump_marker_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            void* const marker = mmap(nullptr, jitdump_marker_size, PROT_READ | PROT_EXEC, MAP_PRIVATE, jitdump_fd, 0);
+            jitdump_marker = marker == MAP_FAILED ? nullptr : marker;
+            detail::jitdump_file_header header{};
+            header.magic = detail::jitdump_magic;
+            header.version = 1;
+            header.total_size = sizeof(header);
+#if defined(__x86_64__)
+            header.elf_mach = EM_X86_64;
+#elif defined(__aarch64__)
+            header.elf_mach = EM_AARCH64;
+#endif
+            header.pid = static_cast<uint32_t>(getpid());
+            header.timestamp = detail::perf_timestamp();
+            std::vector<byte> out;
+            detail::append_bytes(out, header);
+            write_jitdump(out);
+        }
+
+        void write_code_load(const void* code, size_t size, const std::string& name) {
+            std::vector<byte> out;
+            const uint64_t address = reinterpret_cast<uintptr_t>(code);
+            detail::jitdump_record_header header{ detail::jitdump_code_load, 0, detail::perf_timestamp() };
+            header.total_size = static_cast<uint32_t>(sizeof(header) + 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t) + name.size() + 1 + size);
+            detail::append_bytes(out, header);
+            detail::append_bytes(out, static_cast<uint32_t>(getpid()));
+            detail::append_bytes(out, static_cast<uint32_t>(syscall(SYS_gettid)));
+            detail::append_bytes(out, address); // vma
+            detail::append_bytes(out, address); // code_addr
+            detail::append_bytes(out, static_cast<uint64_t>(size));
+            detail::append_bytes(out, code_index++);
+            detail::append_string(out, name);
+            const byte* const bytes = static_cast<const byte*>(code);
+            out.insert(out.end(), bytes, bytes + size);
+            write_jitdump(out);
+        }
+
+        void write_jitdump(const std::vector<byte>& out) {
+            const byte* data = out.data();
+            size_t remaining = out.size();
+            while (remaining != 0) {
+                const ssize_t written = write(jitdump_fd, data, remaining);
+                if (written <= 0) return;
+                data += written;
+                remaining -= static_cast<size_t>(written);
+            }
+        }
+#endif
+
+        std::mutex mutex;
+        std::FILE* map_file = nullptr;
+        int jitdump_fd = -1;
+        void* jitdump_marker = nullptr;
+        size_t jitdump_marker_size = 0;
+        uint64_t code_index = 0;
+    };
+
+}
@@ -27,4 +27,35 @@ namespace spiral {
         };
     }
 
+    inline bool is_integral_typeid(typeid_underlying_t type) noexcept {
+        return type <= TypeIDs::I8 && type >= TypeIDs::I128;
+    }
+
+    inline bool is_float_typeid(typeid_underlying_t type) noexcept {
+        return type <= TypeIDs::F32 && type >= TypeIDs::F128;
+    }
+
+    /**
+     * Returns the width (in bits) of a primitive type, or zero if the typeid is not a primitive.
+     */
+    inline size_t primitive_width(typeid_underlying_t type) noexcept {
+        switch (type) {
+        case TypeIDs::I8:
+            return 8;
+        case TypeIDs::I16:
+            return 16;
+        case TypeIDs::I32:
+        case TypeIDs::F32:
+            return 32;
+        case TypeIDs::I64:
+        case TypeIDs::F64:
+            return 64;
+        case TypeIDs::I128:
+        case TypeIDs::F128:
+            return 128;
+        default:
+            return 0;
+        }
+    }
+
 }
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#define SPIRAL_PROFILER_LINUX
+#endif
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/compiled_module.hpp>
+#include <spiral/detail/pc_table.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+/**
+ * Sampling profiler for compiled Spiral code.
+ *
+ * A SIGPROF timer (ITIMER_PROF, so it only ticks while the process uses CPU) interrupts the running thread, whose signal
+ * handler records the PC and the return addresses found by walking the frame pointers (build generated code with
+ * -fno-omit-frame-pointer for complete stacks).  The handler only writes to a lock-free single-producer ring buffer of
+ * the interrupted thread, so it never blocks.  collect() drains the buffers and maps the PCs to Spiral functions through
+ * the pc_table of the compiled module.
+ *
+ * Only threads that called attach_thread are sampled.  Only one profiler may be running at a time.  Linux only.
+ */
+
+namespace spiral {
+
+    struct profiler_options {
+        unsigned frequency = 1000; // samples per second of CPU time
+        size_t max_depth = 32; // frames per sample
+        size_t buffer_words = size_t{ 1 } << 16; // per thread (rounded up to a power of two)
+    };
+
+    namespace detail {
+
+        /**
+         * Samples of one thread: each is a frame count followed by that many PCs (leaf first).
+         */
+        class profiler_buffer {
+        public:
+            profiler_buffer(size_t words, uintptr_t stack_low, uintptr_t stack_high) : stack_low(stack_low), stack_high(stack_high) {
+                size_t capacity = 1;
+                while (capacity < words) capacity <<= 1;
+                this->words = std::make_unique<uintptr_t[]>(capacity);
+                mask = capacity - 1;
+            }
+
+            /**
+             * Called only from the signal handler of the owning thread.
+             */
+            void push(const uintptr_t* pcs, size_t depth) noexcept {
+                const size_t h = head.load(std::memory_order_relaxed);
+                const size_t t = tail.load(std::memory_order_acquire);
+                if (mask + 1 - (h - t) < depth + 1) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                words[h & mask] = depth;
+                for (size_t i = 0; i != depth; ++i) {
+                    words[(h + 1 + i) & mask] = pcs[i];
+                }
+                head.store(h + 1 + depth, std::memory_order_release);
+            }
+
+            /**
+             * Calls callback(pcs, depth) for every pending sample.  Only one thread may drain at a time.
+             */
+            template <typename Callback>
+            void drain(Callback&& callback) {
+                const size_t h = head.load(std::memory_order_acquire);
+                size_t t = tail.load(std::memory_order_relaxed);
+                std::vector<uintptr_t> pcs;
+                while (t != h) {
+                    const size_t depth = words[t & mask];
+                    pcs.resize(depth);
+                    for (size_t i = 0; i != depth; ++i) {
+                        pcs[i] = words[(t + 1 + i) & mask];
+                    }
+                    t += 1 + depth;
+                    callback(pcs.data(), depth);
+                }
+                tail.store(t, std::memory_order_release);
+            }
+
+            uint64_t get_dropped() const noexcept { return dropped.load(std::memory_order_relaxed); }
+
+            const uintptr_t stack_low;
+            const uintptr_t stack_high;
+
+        private:
+            std::unique_ptr<uintptr_t[]> words;
+            size_t mask;
+            std::atomic<size_t> head{ 0 };
+            std::atomic<size_t> tail{ 0 };
+            std::atomic<uint64_t> dropped{ 0 };
+        };
+
+        /**
+         * The buffer of the calling thread, and the id of the profiler that owns it.  The signal handler only writes to the
+         * buffer if that profiler is the running one, so a slot left behind by a destroyed profiler (whose buffer is freed)
+         * is ignored.  Ids are never reused, unlike the addresses of profilers.
+         */
+        struct profiler_thread_slot {
+            profiler_buffer* buffer = nullptr;
+            uint64_t owner = 0;
+        };
+
+        inline thread_local profiler_thread_slot profiler_thread;
+
+        inline uint64_t next_profiler_id() noexcept {
+            static std::atomic<uint64_t> counter{ 0 };
+            return ++counter;
+        }
+
+        constexpr size_t profiler_max_depth = 128;
+    }
+
+    class sampling_profiler {
+    public:
+        explicit sampling_profiler(std::shared_ptr<const CompiledModule> compiled, const profiler_options& options = {}) : compiled(std::move(compiled)), options(options), id(detail::next_profiler_id()) {
+            if (this->options.max_depth > detail::profiler_max_depth) this->options.max_depth = detail::profiler_max_depth;
+            if (this->options.max_depth == 0) this->options.max_depth = 1;
+        }
+        sampling_profiler(const sampling_profiler&) = delete;
+        sampling_profiler& operator=(const sampling_profiler&) = delete;
+        ~sampling_profiler() {
+            stop();
+        }
+
+        /**
+         * Makes the calling thread sampled by this profiler (from the next tick on).
+         * The thread must not exit while the profiler is running, unless it calls detach_thread first.
+         */
+        void attach_thread() {
+#ifdef SPIRAL_PROFILER_LINUX
+            uintptr_t stack_low = 0, stack_high = 0;
+            pthread_attr_t attr;
+            if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+                void* addr;
+                size_t size;
+                if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+                    stack_low = reinterpret_cast<uintptr_t>(addr);
+                    stack_high = stack_low + size;
+                }
+                pthread_attr_destroy(&attr);
+            }
+            auto buffer = std::make_unique<detail::profiler_buffer>(options.buffer_words, stack_low, stack_high);
+            detail::profiler_buffer* const slot_buffer = buffer.get();
+            const std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::move(buffer));
+            // the handler may interrupt this thread between the stores, so the buffer is only set once the owner matches it
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            detail::profiler_thread.buffer = nullptr;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            detail::profiler_thread.owner = id;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            detail::profiler_thread.buffer = slot_buffer;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+        }
+
+        /**
+         * Stops sampling the calling thread (if it is attached to this profiler).  Its pending samples are kept until the next collect().
+         */
+        void detach_thread() noexcept {
+            if (detail::profiler_thread.owner != id) return;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            detail::profiler_thread.buffer = nullptr;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+
+        /**
+         * Starts the timer.  Throws profiler_exception if another profiler is running, or the timer cannot be set up.
+         */
+        void start() {
+#ifdef SPIRAL_PROFILER_LINUX
+            sampling_profiler* expected = nullptr;
+            if (!active().compare_exchange_strong(expected, this)) throw profiler_exception("Another profiler is already running!");
+            struct sigaction action {};
+            action.sa_sigaction = &handle_signal;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGPROF, &action, &previous_action);
+            const long interval = 1000000 / static_cast<long>(options.frequency == 0 ? 1 : options.frequency);
+            itimerval timer{};
+            timer.it_interval.tv_sec = interval / 1000000;
+            timer.it_interval.tv_usec = interval % 1000000;
+            timer.it_value = timer.it_interval;
+            if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+                sigaction(SIGPROF, &previous_action, nullptr);
+                active().store(nullptr);
+                throw profiler_exception("Cannot start the profiling timer!");
+            }
+            running = true;
+#else
+            throw profiler_exception("The sampling profiler is not supported on this platform!");
+#endif
+        }
+
+        void stop() noexcept {
+#ifdef SPIRAL_PROFILER_LINUX
+            if (!running) return;
+            itimerval timer{};
+            setitimer(ITIMER_PROF, &timer, nullptr);
+            sigaction(SIGPROF, &previous_action, nullptr);
+            active().store(nullptr);
+            running = false;
+#endif
+        }
+
+        /**
+         * Drains the samples of all threads into the profile.  May be called while the profiler is running.
+         */
+        void collect() {
+            const std::lock_guard<std::mutex> lock(mutex);
+            const pc_table& pcs = compiled->get_pc_table();
+            std::string stack;
+            for (const std::unique_ptr<detail::profiler_buffer>& buffer : buffers) {
+                buffer->drain([&](const uintptr_t* frames, size_t depth) {
+                    // collapsed stacks are root first
+                    stack.clear();
+                    bool last_native = false;
+                    for (size_t i = depth; i-- != 0;) {
+                        // return addresses point after the call, so look up the byte before them
+                        const std::optional<pc_location> location = pcs.lookup(i == 0 ? frames[i] : frames[i] - 1);
+                        if (!location && last_native) continue;
+                        last_native = !location;
+                        if (!stack.empty()) stack += ';';
+                        stack += location ? frame_name(*location) : "[native]";
+                    }
+                    ++profile[stack];
+                    ++num_samples;
+                });
+            }
+        }
+
+        /**
+         * Writes the collected profile as collapsed stacks ("frame;frame;frame count" per line), e.g. for flamegraph.pl.
+         */
+        void write_collapsed(std::ostream& out) const {
+            const std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& [stack, count] : profile) {
+                out << stack << ' ' << count << '\n';
+            }
+        }
+
+        uint64_t get_num_samples() const {
+            const std::lock_guard<std::mutex> lock(mutex);
+            return num_samples;
+        }
+
+        /**
+         * Returns the number of samples that were lost because a thread's buffer was full.
+         */
+        uint64_t get_num_dropped() const {
+            const std::lock_guard<std::mutex> lock(mutex);
+            uint64_t ret = 0;
+            for (const std::unique_ptr<detail::profiler_buffer>& buffer : buffers) {
+                ret += buffer->get_dropped();
+            }
+            return ret;
+        }
+
+    private:
+        static std::atomic<sampling_profiler*>& active() noexcept {
+            static std::atomic<sampling_profiler*> ret{ nullptr };
+            return ret;
+        }
+
+        static std::string frame_name(const pc_location& location) {
+            return "spiral/function_" + std::to_string(location.functionid);
+        }
+
+#ifdef SPIRAL_PROFILER_LINUX
+        static void handle_signal(int, siginfo_t*, void* context) noexcept {
+            sampling_profiler* const profiler = active().load(std::memory_order_relaxed);
+            detail::profiler_buffer* const buffer = detail::profiler_thread.buffer;
+            // the buffer may belong to a profiler that was destroyed since the thread attached to it
+            if (buffer == nullptr || profiler == nullptr || detail::profiler_thread.owner != profiler->id) return;
+            const mcontext_t& mcontext = static_cast<const ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+            uintptr_t pc = static_cast<uintptr_t>(mcontext.gregs[REG_RIP]);
+            uintptr_t fp = static_cast<uintptr_t>(mcontext.gregs[REG_RBP]);
+#else
+            uintptr_t pc = static_cast<uintptr_t>(mcontext.pc);
+            uintptr_t fp = static_cast<uintptr_t>(mcontext.regs[29]);
+#endif
+            uintptr_t frames[detail::profiler_max_depth];
+            size_t depth = 0;
+            frames[depth++] = pc;
+            // frame records are { previous frame pointer, return address } on both architectures
+            while (depth != profiler->options.max_depth && fp % sizeof(uintptr_t) == 0 && fp >= buffer->stack_low && fp + 2 * sizeof(uintptr_t) <= buffer->stack_high) {
+                const uintptr_t* const record = reinterpret_cast<const uintptr_t*>(fp);
+                if (record[1] == 0) break;
+                frames[depth++] = record[1];
+                if (record[0] <= fp) break; // the stack grows down, so callers' frames are at higher addresses
+                fp = record[0];
+            }
+            buffer->push(frames, depth);
+        }
+
+        struct sigaction previous_action {};
+#endif
+
+        std::shared_ptr<const CompiledModule> compiled;
+        profiler_options options;
+        const uint64_t id; // owner of the thread slots of this profiler (see detail::profiler_thread_slot)
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<detail::profiler_buffer>> buffers;
+        std::map<std::string, uint64_t> profile;
+        uint64_t num_samples = 0;
+        bool running = false;
+    };
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <utility>
 #include <vector>
 
 #include <spiral/detail/typedefs.hpp>
@@ -10,6 +11,13 @@ namespace spiral {
     using recordid_t = size_t;
 
     class Record {
+    public:
+        Record() = default;
+        explicit Record(std::vector<typeid_t> fields) : fields(std::move(fields)) {}
+
+        const std::vector<typeid_t>& get_fields() const noexcept { return fields; }
+
+    private:
         std::vector<typeid_t> fields;
     };
 
@@ -1,13 +1,22 @@
 #pragma once
 
 #include <string>
+#include <utility>
 
 #include <spiral/detail/record.hpp>
 
 namespace spiral {
 
     class SharedRecord {
-        recordid_t recordid;
+    public:
+        SharedRecord() = default;
+        SharedRecord(recordid_t recordid, std::string name) : recordid(recordid), name(std::move(name)) {}
+
+        recordid_t get_recordid() const noexcept { return recordid; }
+        const std::string& get_name() const noexcept { return name; }
+
+    private:
+        recordid_t recordid = 0;
         std::string name;
     };
 
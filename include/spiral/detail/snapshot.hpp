@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SPIRAL_SNAPSHOT_POSIX
+#endif
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/global_layout.hpp>
+#include <spiral/detail/exceptions.hpp>
+
+/**
+ * Snapshots of instance state, so that an expensive initialization can be run once and new instances started from its result.
+ *
+ * An image holds a header and the global block of an instance (which is all the state that outlives a call; arrays only
+ * live in the variables of running functions).  The block starts on its own page, so that new instances can map it
+ * MAP_PRIVATE: starting an instance is then a single mapping, and pages are only copied when the instance writes to them.
+ * Snapshots are only supported on POSIX platforms.
+ */
+
+namespace spiral {
+
+    namespace detail {
+
+        struct snapshot_header {
+            char magic[8];
+            uint64_t fingerprint; // global_layout::get_fingerprint of the module
+            uint64_t module_hash; // Module::content_hash, so that a module with the same globals but different code does not match
+            uint64_t block_offset;
+            uint64_t block_size;
+        };
+
+        constexpr char snapshot_magic[8] = { 'S', 'P', 'R', 'L', 'S', 'S', '\0', '\2' };
+
+        inline uint64_t snapshot_page_size() noexcept {
+#ifdef SPIRAL_SNAPSHOT_POSIX
+            return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+            return 4096;
+#endif
+        }
+    }
+
+    /**
+     * Writes a global block with the given layout, of the module with the given content hash, to an image at path
+     * (atomically and durably replacing any existing file).  Throws snapshot_exception on failure.
+     */
+    inline void write_snapshot(const global_layout& layout, uint64_t module_hash, const byte* block, const std::filesystem::path& path) {
+#ifdef SPIRAL_SNAPSHOT_POSIX
+        detail::snapshot_header header;
+        std::memcpy(header.magic, detail::snapshot_magic, sizeof(header.magic));
+        header.fingerprint = layout.get_fingerprint();
+        header.module_hash = module_hash;
+        header.block_offset = detail::snapshot_page_size();
+        header.block_size = layout.get_size();
+
+        std::vector<byte> contents(header.block_offset + header.block_size);
+        std::memcpy(contents.data(), &header, sizeof(header));
+        if (header.block_size != 0) std::memcpy(contents.data() + header.block_offset, block, header.block_size);
+
+        static std::atomic<uint64_t> counter{ 0 };
+        const std::string temp_path = path.string() + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++);
+        const int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd == -1) throw snapshot_exception("Cannot create " + temp_path + "!");
+        bool ok = true;
+        for (const byte* data = contents.data(), *end = data + contents.size(); ok && data != end;) {
+            const ssize_t written = write(fd, data, static_cast<size_t>(end - data));
+            ok = written > 0;
+            if (ok) data += written;
+        }
+        ok = ok && fsync(fd) == 0; // the contents must be on disk before the rename can be
+        ok = close(fd) == 0 && ok;
+        if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+            unlink(temp_path.c_str());
+            throw snapshot_exception("Cannot write " + path.string() + "!");
+        }
+        // and the rename itself is only durable once the directory is synced
+        const std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+        const int directory_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directory_fd == -1) throw snapshot_exception("Cannot open " + directory.string() + "!");
+        ok = fsync(directory_fd) == 0;
+        close(directory_fd);
+        if (!ok) throw snapshot_exception("Cannot sync " + directory.string() + "!");
+#else
+        (void)layout;
+        (void)module_hash;
+        (void)block;
+        (void)path;
+        throw snapshot_exception("Snapshots are not supported on this platform!");
+#endif
+    }
+
+    /**
+     * An open snapshot image, from which any number of instances of the module can be started (see Instance).
+     */
+    class snapshot_image {
+    public:
+        /**
+         * Opens and validates the image at path.  Throws snapshot_exception if it cannot be opened or is malformed.
+         */
+        explicit snapshot_image(const std::filesystem::path& path) {
+#ifdef SPIRAL_SNAPSHOT_POSIX
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) throw snapshot_exception("Cannot open " + path.string() + "!");
+            struct stat st;
+            const bool ok = fstat(fd, &st) == 0 && pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+            if (!ok || std::memcmp(header.magic, detail::snapshot_magic, sizeof(header.magic)) != 0 || header.block_offset % detail::snapshot_page_size() != 0 || header.block_offset > static_cast<uint64_t>(st.st_size) || header.block_size != static_cast<uint64_t>(st.st_size) - header.block_offset) {
+                close(fd);
+                throw snapshot_exception(path.string() + " is not a valid snapshot image!");
+            }
+#else
+            (void)path;
+            throw snapshot_exception("Snapshots are not supported on this platform!");
+#endif
+        }
+        snapshot_image(snapshot_image&& other) noexcept : fd(std::exchange(other.fd, -1)), header(other.header) {}
+        snapshot_image& operator=(snapshot_image&& other) noexcept {
+            std::swap(fd, other.fd);
+            std::swap(header, other.header);
+            return *this;
+        }
+        ~snapshot_image() {
+#ifdef SPIRAL_SNAPSHOT_POSIX
+            if (fd != -1) close(fd);
+#endif
+        }
+
+        /**
+         * Maps a private (copy-on-write) copy of the global block, which must have the given layout and come from the module
+         * with the given content hash.  Throws snapshot_exception on failure.
+         */
+        global_block map_globals(const global_layout& layout, uint64_t module_hash) const {
+            if (header.fingerprint != layout.get_fingerprint() || header.module_hash != module_hash || header.block_size != layout.get_size()) throw snapshot_exception("Snapshot does not match the module!");
+            if (header.block_size == 0) return nullptr;
+#ifdef SPIRAL_SNAPSHOT_POSIX
+            void* const mapping = mmap(nullptr, header.block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, static_cast<off_t>(header.block_offset));
+            if (mapping == MAP_FAILED) throw snapshot_exception("Cannot map snapshot!");
+            return global_block(static_cast<byte*>(mapping), detail::global_block_deleter{ header.block_size });
+#else
+            throw snapshot_exception("Snapshots are not supported on this platform!");
+#endif
+        }
+
+        uint64_t get_fingerprint() const noexcept { return header.fingerprint; }
+        uint64_t get_module_hash() const noexcept { return header.module_hash; }
+        uint64_t get_block_size() const noexcept { return header.block_size; }
+
+    private:
+        int fd = -1;
+        detail::snapshot_header header{};
+    };
+
+}
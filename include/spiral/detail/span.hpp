@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdexcept> // span-lite throws std::out_of_range without including this
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/span-lite/span.hpp>
+
+namespace spiral {
+
+    template <typename T, ssize_t Extent = nonstd::dynamic_extent>
+    using span = nonstd::span<T, Extent>;
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <spiral/detail/typedefs.hpp>
+#include <spiral/detail/function.hpp>
+
+/**
+ * Telemetry of the compilation pipeline: how long each phase (decode, each optimization pass, emission, native
+ * compilation, code installation) takes, per module and per function, with instruction counts and bytes allocated.
+ *
+ * Every phase takes an optional telemetry*; with nullptr, the only cost is a null check per phase.
+ * Bytes allocated are only counted if the host expands SPIRAL_DEFINE_ALLOCATION_COUNTER() in one translation unit
+ * (which replaces the global operator new/delete); otherwise they are reported as zero.
+ */
+
+namespace spiral {
+
+    struct telemetry_event {
+        std::string name; // phase name
+        functionid_t functionid; // zero for phases over the whole module
+        uint64_t start_ns; // since the telemetry object was created
+        uint64_t duration_ns;
+        uint64_t bytes_allocated;
+        uint64_t instructions; // instructions processed (or produced) by the phase
+        std::thread::id thread;
+    };
+
+    /**
+     * Sums of the events of one phase.
+     */
+    struct telemetry_totals {
+        uint64_t count = 0;
+        uint64_t duration_ns = 0;
+        uint64_t bytes_allocated = 0;
+        uint64_t instructions = 0;
+    };
+
+    namespace detail {
+        /**
+         * Bytes allocated by the current thread (only counted if SPIRAL_DEFINE_ALLOCATION_COUNTER() is expanded somewhere).
+         */
+        inline thread_local uint64_t allocated_bytes = 0;
+    }
+
+    /**
+     * Collects telemetry events.  Safe to use from several threads.
+     */
+    class telemetry {
+    public:
+        telemetry() : origin(std::chrono::steady_clock::now()) {}
+
+        /**
+         * Records the duration of a phase from construction to destruction (or finish()).
+         */
+        class scope {
+        public:
+            scope(telemetry* sink, std::string_view name, functionid_t functionid = 0) : sink(sink) {
+                if (sink == nullptr) return;
+                event.name = name;
+                event.functionid = functionid;
+                event.instructions = 0;
+                event.thread = std::this_thread::get_id();
+                start_bytes = detail::allocated_bytes;
+                start = std::chrono::steady_clock::now();
+            }
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+            ~scope() {
+                finish();
+            }
+
+            void set_instructions(uint64_t instructions) noexcept {
+                event.instructions = instructions;
+            }
+
+            void finish() {
+                if (sink == nullptr) return;
+                const auto end = std::chrono::steady_clock::now();
+                event.start_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - sink->origin).count());
+                event.duration_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                event.bytes_allocated = detail::allocated_bytes - start_bytes;
+                sink->add(std::move(event));
+                sink = nullptr;
+            }
+
+        private:
+            telemetry* sink;
+            telemetry_event event;
+            uint64_t start_bytes = 0;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        void add(telemetry_event event) {
+            const std::lock_guard<std::mutex> lock(mutex);
+            events.push_back(std::move(event));
+        }
+
+        std::vector<telemetry_event> get_events() const {
+            const std::lock_guard<std::mutex> lock(mutex);
+            return events;
+        }
+
+        /**
+         * Returns the totals of each phase, by phase name.
+         */
+        std::map<std::string, telemetry_totals> get_totals() const {
+            const std::lock_guard<std::mutex> lock(mutex);
+            std::map<std::string, telemetry_totals> ret;
+            for (const telemetry_event& event : events) {
+                telemetry_totals& totals = ret[event.name];
+                ++totals.count;
+                totals.duration_ns += event.duration_ns;
+                totals.bytes_allocated += event.bytes_allocated;
+                totals.instructions += event.instructions;
+            }
+            return ret;
+        }
+
+        /**
+         * Writes the events in the Chrome trace-event format (for chrome://tracing or Perfetto).
+         */
+        void write_chrome_trace(std::ostream& out) const {
+            const std::lock_guard<std::mutex> lock(mutex);
+            out << "{\"traceEvents\":[";
+            bool first = true;
+            std::map<std::thread::id, size_t> tids;
+            for (const telemetry_event& event : events) {
+                const size_t tid = tids.emplace(event.thread, tids.size() + 1).first->second;
+                char times[64];
+                std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", event.start_ns / 1000.0, event.duration_ns / 1000.0);
+                out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name;
+                if (event.functionid != 0) out << " (function " << event.functionid << ')';
+                out << "\",\"cat\":\"spiral\",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"functionid\":" << event.functionid << ",\"instructions\":" << event.instructions << ",\"bytes_allocated\":" << event.bytes_allocated << "}}";
+                first = false;
+            }
+            out << "\n]}\n";
+        }
+
+    private:
+        std::chrono::steady_clock::time_point origin;
+        mutable std::mutex mutex;
+        std::vector<telemetry_event> events;
+    };
+
+}
+
+#if defined(__GNUC__)
+#define SPIRAL_ALLOCATION_COUNTER_NOINLINE __attribute__((noinline))
+#else
+#define SPIRAL_ALLOCATION_COUNTER_NOINLINE
+#endif
+
+/**
+ * Replaces the global operator new/delete with versions that count the bytes allocated by each thread (for telemetry).
+ * Expand in exactly one translation unit of the program.
+ * (They are kept out of line, otherwise GCC sees malloc/free through inlined std::allocator calls and warns of mismatches.)
+ */
+#define SPIRAL_DEFINE_ALLOCATION_COUNTER() \
+    SPIRAL_ALLOCATION_COUNTER_NOINLINE void* operator new(std::size_t size) { \
+        spiral::detail::allocated_bytes += size; \
+        if (void* const ret = std::malloc(size == 0 ? 1 : size)) return ret; \
+        throw std::bad_alloc(); \
+    } \
+    SPIRAL_ALLOCATION_COUNTER_NOINLINE void* operator new[](std::size_t size) { \
+        return ::operator new(size); \
+    } \
+    SPIRAL_ALLOCATION_COUNTER_NOINLINE void operator delete(void* ptr) noexcept { \
+        std::free(ptr); \
+    } \
+    SPIRAL_ALLOCATION_COUNTER_NOINLINE void operator delete[](void* ptr) noexcept { \
+        std::free(ptr); \
+    } \
+    SPIRAL_ALLOCATION_COUNTER_NOINLINE void operator delete(void* ptr, std::size_t) noexcept { \
+        std::free(ptr); \
+    } \
+    SPIRAL_ALLOCATION_COUNTER_NOINLINE void operator delete[](void* ptr, std::size_t) noexcept { \
+        std::free(ptr); \
+    }
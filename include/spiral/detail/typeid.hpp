@@ -10,12 +10,22 @@ namespace spiral {
     class typeid_t {
     
     public:
-        explicit typeid_t() noexcept : curr_typeid(0) {}
+        explicit typeid_t() noexcept : curr_typeid(0), array_dimension(0) {}
         explicit typeid_t(typeid_underlying_t curr_typeid, int32_t array_dimension = 0) noexcept : curr_typeid(curr_typeid), array_dimension(array_dimension) {
             assert(curr_typeid != TypeIDs::Array);
             assert(curr_typeid != 0 || array_dimension == 0);
         }
 
+        /**
+         * Returns the innermost element type (i.e. the type itself if this is not an array).
+         */
+        typeid_underlying_t get_typeid() const noexcept { return curr_typeid; }
+        int32_t get_array_dimension() const noexcept { return array_dimension; }
+
+        bool is_array() const noexcept { return array_dimension != 0; }
+        bool is_record() const noexcept { return array_dimension == 0 && curr_typeid > 0; }
+        bool is_primitive() const noexcept { return array_dimension == 0 && curr_typeid < 0; }
+
     private:
         typeid_underlying_t curr_typeid;
         int32_t array_dimension;
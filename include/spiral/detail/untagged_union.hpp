@@ -1,6 +1,6 @@
 #pragma once
 
-#include <memory>
+#include <new>
 #include <type_traits>
 #include <tuple>
 
@@ -11,32 +11,24 @@ namespace spiral {
     /**
      * Represents an untagged union, i.e. a variant that does not know the type that is currently stored.
      * It is a simple wrapper over union that allows get<T>(x) to work.
-     * Construction and destruction of this type is trivial, no matter what T... is.  Users of this type should manage their own construction/destruction.
-     * This class cannot be copied or moved.  Users have to move/copy the data manually (using get())
+     * All of T... must be trivially copyable, so the union is too: copies and moves copy the bytes, whichever type is stored, and nothing needs destruction.
      */
 
     template <typename... T>
     class untagged_union {
+        static_assert(std::conjunction_v<std::is_trivially_copyable<T>...>, "untagged_union requires trivially copyable types!");
+
     public:
         untagged_union() noexcept {}
-        untagged_union(const untagged_union& other) = delete;
-        untagged_union(untagged_union&& other) = delete;
-        untagged_union& operator=(const untagged_union& other) = delete;
-        untagged_union& operator=(untagged_union&& other) = delete;
-        ~untagged_union() {}
         template <typename U, typename = std::enable_if_t<std::disjunction_v<std::is_constructible<T, U>...>>>
         untagged_union(U&& u) {
             initialize_impl<0>(std::forward<U>(u));
         }
-        template <typename U, typename... Args, typename = std::enable_if_t<std::conjunction<std::is_constructible<U, Args...>, std::disjunction_v<std::is_same<T, U>...>>>>
+        template <typename U, typename... Args, typename = std::enable_if_t<std::conjunction_v<std::is_constructible<U, Args...>, std::disjunction<std::is_same<T, U>...>>>>
         U& emplace(Args&&... args) {
             return *(new (&data) U(std::forward<Args>(args)...));
         }
         template <typename U, typename = std::enable_if_t<std::disjunction_v<std::is_same<T, U>...>>>
-        void destroy() {
-            std::destroy_at(reinterpret_cast<U*>(&data));
-        }
-        template <typename U, typename = std::enable_if_t<std::disjunction_v<std::is_same<T, U>...>>>
         U& get() & noexcept {
             return reinterpret_cast<U&>(data);
         }
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <type_traits>
+
+#include <spiral/detail/typedefs.hpp>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#elif defined(__BMI2__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Widening multiplication and narrowing division, as used by mulex/muluex/divex/divuex.
+ * For every width, the operation lowers to a single machine instruction:
+ * narrower widths compute in a native register of twice the width, while the 64-bit forms use the one-operand
+ * mul/imul/div/idiv (or mulx, when compiled with BMI2) with the 128-bit value held in RDX:RAX.
+ * The 128-bit values never go through memory, because int128_t/uint128_t are returned in a register pair.
+ */
+
+namespace spiral {
+
+    template <typename T>
+    struct widened;
+    template <> struct widened<int8_t> { using type = int16_t; };
+    template <> struct widened<uint8_t> { using type = uint16_t; };
+    template <> struct widened<int16_t> { using type = int32_t; };
+    template <> struct widened<uint16_t> { using type = uint32_t; };
+    template <> struct widened<int32_t> { using type = int64_t; };
+    template <> struct widened<uint32_t> { using type = uint64_t; };
+    template <> struct widened<int64_t> { using type = int128_t; };
+    template <> struct widened<uint64_t> { using type = uint128_t; };
+
+    template <typename T>
+    using widened_t = typename widened<T>::type;
+
+    template <typename T>
+    struct divex_result {
+        T quotient;
+        T remainder;
+    };
+
+    namespace detail {
+
+        /**
+         * Shift-subtract division of (hi:lo) by d.  Requires hi < d (i.e. the quotient fits in 64 bits).
+         * Only used when the compiler gives us no access to a native 128-by-64 division.
+         */
+        constexpr divex_result<uint64_t> divlu_portable(uint64_t hi, uint64_t lo, uint64_t d) noexcept {
+            for (int i = 0; i < 64; ++i) {
+                const uint64_t carry = static_cast<uint64_t>(static_cast<int64_t>(hi) >> 63);
+                hi = (hi << 1) | (lo >> 63);
+                lo <<= 1;
+                if ((hi | carry) >= d) {
+                    hi -= d;
+                    lo |= 1;
+                }
+            }
+            return { lo, hi };
+        }
+
+        inline divex_result<uint64_t> divlu(uint64_t hi, uint64_t lo, uint64_t d) noexcept {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+            uint64_t quotient, remainder;
+            __asm__("divq %[d]" : "=a"(quotient), "=d"(remainder) : [d] "rm"(d), "a"(lo), "d"(hi));
+            return { quotient, remainder };
+#elif defined(_MSC_VER) && defined(_M_X64) && _MSC_VER >= 1920
+            uint64_t remainder;
+            const uint64_t quotient = _udiv128(hi, lo, d, &remainder);
+            return { quotient, remainder };
+#else
+            return divlu_portable(hi, lo, d);
+#endif
+        }
+
+        inline divex_result<int64_t> divls(int64_t hi, uint64_t lo, int64_t d) noexcept {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+            int64_t quotient, remainder;
+            __asm__("idivq %[d]" : "=a"(quotient), "=d"(remainder) : [d] "rm"(d), "a"(lo), "d"(hi));
+            return { quotient, remainder };
+#elif defined(_MSC_VER) && defined(_M_X64) && _MSC_VER >= 1920
+            int64_t remainder;
+            const int64_t quotient = _div128(hi, static_cast<int64_t>(lo), d, &remainder);
+            return { quotient, remainder };
+#else
+            // divide the magnitudes, then fix up the signs (truncating division, like idiv)
+            const bool negative_dividend = hi < 0;
+            const bool negative_divisor = d < 0;
+            uint64_t uhi = static_cast<uint64_t>(hi);
+            uint64_t ulo = lo;
+            if (negative_dividend) {
+                ulo = ~ulo + 1;
+                uhi = ~uhi + (ulo == 0 ? 1 : 0);
+            }
+            const uint64_t ud = negative_divisor ? ~static_cast<uint64_t>(d) + 1 : static_cast<uint64_t>(d);
+            const divex_result<uint64_t> res = divlu_portable(uhi, ulo, ud);
+            const uint64_t quotient = (negative_dividend != negative_divisor) ? ~res.quotient + 1 : res.quotient;
+            const uint64_t remainder = negative_dividend ? ~res.remainder + 1 : res.remainder;
+            return { static_cast<int64_t>(quotient), static_cast<int64_t>(remainder) };
+#endif
+        }
+
+        inline uint128_t mullu(uint64_t a, uint64_t b) noexcept {
+#if defined(__BMI2__) && defined(__x86_64__)
+            unsigned long long upper;
+            const uint64_t lower = _mulx_u64(a, b, &upper);
+            return uint128_t(lower, upper);
+#elif defined(__SIZEOF_INT128__)
+            const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+            return uint128_t(static_cast<uint64_t>(product), static_cast<uint64_t>(product >> 64));
+#elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned __int64 upper;
+            const uint64_t lower = _umul128(a, b, &upper);
+            return uint128_t(lower, upper);
+#else
+            // schoolbook multiplication on 32-bit halves
+            const uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+            const uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+            const uint64_t lo_lo = a_lo * b_lo;
+            const uint64_t hi_lo = a_hi * b_lo;
+            const uint64_t lo_hi = a_lo * b_hi;
+            const uint64_t hi_hi = a_hi * b_hi;
+            const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+            return uint128_t((cross << 32) | (lo_lo & 0xFFFFFFFFu), (hi_lo >> 32) + (cross >> 32) + hi_hi);
+#endif
+        }
+
+        inline int128_t mulls(int64_t a, int64_t b) noexcept {
+#if defined(__SIZEOF_INT128__)
+            const __int128 product = static_cast<__int128>(a) * b;
+            return int128_t(static_cast<uint64_t>(product), static_cast<int64_t>(product >> 64));
+#elif defined(_MSC_VER) && defined(_M_X64)
+            __int64 upper;
+            const int64_t lower = _mul128(a, b, &upper);
+            return int128_t(static_cast<uint64_t>(lower), upper);
+#else
+            // the unsigned product, with the upper half corrected for the signs of the operands
+            const uint128_t product = mullu(static_cast<uint64_t>(a), static_cast<uint64_t>(b));
+            uint64_t upper = product.get_upper();
+            if (a < 0) upper -= static_cast<uint64_t>(b);
+            if (b < 0) upper -= static_cast<uint64_t>(a);
+            return int128_t(product.get_lower(), static_cast<int64_t>(upper));
+#endif
+        }
+    }
+
+    /**
+     * Multiplies two integers, returning the full product with twice the width of the operands (mulex/muluex).
+     */
+    template <typename T>
+    inline widened_t<T> mulex(T operand1, T operand2) noexcept {
+        static_assert(std::is_integral_v<T>, "mulex only works on integral types!");
+        if constexpr (std::is_same_v<T, uint64_t>) {
+            return detail::mullu(operand1, operand2);
+        }
+        else if constexpr (std::is_same_v<T, int64_t>) {
+            return detail::mulls(operand1, operand2);
+        }
+        else {
+            return static_cast<widened_t<T>>(static_cast<widened_t<T>>(operand1) * static_cast<widened_t<T>>(operand2));
+        }
+    }
+
+    /**
+     * Divides an integer of twice the width of the divisor, returning the quotient and remainder (divex/divuex).
+     * Undefined behaviour if the divisor is zero or the quotient does not fit in T.
+     */
+    template <typename T>
+    inline divex_result<T> divex(widened_t<T> dividend, T divisor) noexcept {
+        static_assert(std::is_integral_v<T>, "divex only works on integral types!");
+        if constexpr (std::is_same_v<T, uint64_t>) {
+            return detail::divlu(dividend.get_upper(), dividend.get_lower(), divisor);
+        }
+        else if constexpr (std::is_same_v<T, int64_t>) {
+            return detail::divls(dividend.get_upper(), dividend.get_lower(), divisor);
+        }
+        else {
+            return { static_cast<T>(dividend / divisor), static_cast<T>(dividend % divisor) };
+        }
+    }
+
+}
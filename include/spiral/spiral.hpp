@@ -10,44 +10,33 @@
 #include <spiral/detail/function.hpp>
 #include <spiral/detail/import.hpp>
 #include <spiral/detail/export.hpp>
+#include <spiral/detail/global.hpp>
 #include <spiral/detail/instruction.hpp>
-
-#include <spiral/detail/span-lite/span.hpp>
+#include <spiral/detail/wide_arithmetic.hpp>
+#include <spiral/detail/constant_divisor.hpp>
+#include <spiral/detail/code.hpp>
+#include <spiral/detail/telemetry.hpp>
+#include <spiral/detail/constant_propagation.hpp>
+#include <spiral/detail/inliner.hpp>
+#include <spiral/detail/module.hpp>
+#include <spiral/detail/module_builder.hpp>
+#include <spiral/detail/global_layout.hpp>
+#include <spiral/detail/compiled_module.hpp>
+#include <spiral/detail/snapshot.hpp>
+#include <spiral/detail/linker.hpp>
+#include <spiral/detail/instance.hpp>
+#include <spiral/detail/span.hpp>
+#include <spiral/detail/batch.hpp>
+#include <spiral/detail/hash.hpp>
+#include <spiral/detail/name_table.hpp>
+#include <spiral/detail/code_cache.hpp>
+#include <spiral/detail/decode_result.hpp>
+#include <spiral/detail/module_reader.hpp>
+#include <spiral/detail/module_writer.hpp>
+#include <spiral/detail/cpp_emitter.hpp>
+#include <spiral/detail/aot.hpp>
+#include <spiral/detail/perf.hpp>
+#include <spiral/detail/pc_table.hpp>
+#include <spiral/detail/profiler.hpp>
 
 #include <spiral/binarybuf/memorybuf.hpp>
-
-namespace spiral {
-
-    template <typename T, ssize_t Extent = nonstd::dynamic_extent>
-    using span = nonstd::span<T, Extent>;
-
-
-    /**
-     * Represents spiral bytecode (in uncompiled form).
-     */
-    class Module {
-    public:
-        Module() = default;
-        Module(Module&&) = default;
-        Module(const Module&) = default;
-        Module& operator=(Module&&) = default;
-        Module& operator=(const Module&) = default;
-
-        /**
-         * Constructs a module from a raw byte buffer.
-         */
-        template <typename IBinaryBuf, typename = std::enable_if_t<std::is_same_v<typename IBinaryBuf::element_type, byte>>>
-        void read(IBinaryBuf& binary_buf) {
-        }
-
-    private:
-        std::vector<Record> records;
-        std::vector<SharedRecord> sharedrecords;
-        std::vector<Function> functions;
-        std::vector<Import> imports;
-        std::vector<Export> exports;
-        std::vector<Instruction> instructions;
-    };
-
-    
-}
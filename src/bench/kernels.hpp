@@ -0,0 +1,589 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+/**
+ * Kernels for end-to-end performance tracking: realistic Spiral modules built here (and checked in under bench/corpus,
+ * regenerated by `spiral_bench --write-corpus bench/corpus`), each with a reference C++ implementation of the same algorithm.
+ *
+ * Every kernel module exports "run", of type (i64 n, i64 seed) -> (i64), which computes a checksum of its result so
+ * that the guest can be checked against the reference.  Inputs are generated by the same 64-bit LCG on both sides.
+ */
+
+namespace spiral_bench {
+
+    struct kernel {
+        const char* name;
+        std::vector<spiral::byte> (*build)();
+        int64_t (*reference)(int64_t n, int64_t seed);
+        int64_t n; // default problem size
+    };
+
+    namespace kernels {
+
+        using O = spiral::Operand;
+        using Op = spiral::opcode_t;
+        using label = size_t;
+
+        constexpr uint64_t lcg_multiplier = 6364136223846793005ull;
+        constexpr uint64_t lcg_increment = 1442695040888963407ull;
+
+        inline uint64_t lcg(uint64_t& x) noexcept {
+            x = x * lcg_multiplier + lcg_increment;
+            return x;
+        }
+
+        /**
+         * A variable of the code being built, usable as the operand that refers to the whole variable.
+         */
+        struct var {
+            spiral::variableid_t id;
+
+            operator spiral::Operand() const noexcept { return O::reference(id); }
+        };
+
+        /**
+         * Operand for the element array[index], where index is an integral variable.
+         */
+        inline spiral::Operand at(var array, var index) noexcept {
+            return O::element(array.id, index.id);
+        }
+
+        /**
+         * CodeBuilder that declares its locals as vars.
+         */
+        class code_writer : public spiral::CodeBuilder {
+        public:
+            explicit code_writer(spiral::CodeBuilder&& code) : CodeBuilder(std::move(code)) {}
+
+            var local(spiral::typeid_underlying_t base, int32_t dimensions = 0) { return var{ add_local(spiral::typeid_t(base, dimensions)) }; }
+            var i64() { return local(spiral::TypeIDs::I64); }
+        };
+
+        /**
+         * code_writer with helpers for the variables that every kernel uses.
+         * Parameters of "run": -1 is n, -2 is seed, -3 is the result.
+         */
+        class kernel_writer : public code_writer {
+        public:
+            static constexpr var n{ -1 };
+            static constexpr var seed{ -2 };
+            static constexpr var result{ -3 };
+
+            explicit kernel_writer(spiral::CodeBuilder&& code) : code_writer(std::move(code)) {
+                multiplier = constant(static_cast<int64_t>(lcg_multiplier));
+                increment = constant(static_cast<int64_t>(lcg_increment));
+            }
+
+            var constant(int64_t value, spiral::typeid_underlying_t base = spiral::TypeIDs::I64) {
+                const var ret = local(base);
+                add(Op::IMM, { ret, O::immediate(value) });
+                return ret;
+            }
+
+            /**
+             * x = lcg(x); the caller shifts the result down to the bits it needs.
+             */
+            void lcg_step(var x) {
+                add(Op::MULU, { x, multiplier, x });
+                add(Op::ADDU, { x, increment, x });
+            }
+
+            /**
+             * Emits for (i = from; i < to; ++i) body(), with one being a variable holding 1.
+             */
+            template <typename Body>
+            void for_range(var i, var from, var to, var one, Body&& body) {
+                const var cond = i64();
+                const label loop = new_label(), done = new_label();
+                add(Op::COPY, { from, i });
+                bind(loop);
+                add(Op::SLT, { i, to, cond });
+                add(Op::JZ, { O::label(done), cond });
+                body();
+                add(Op::ADD, { i, one, i });
+                add(Op::JMP, { O::label(loop) });
+                bind(done);
+            }
+
+        private:
+            var multiplier;
+            var increment;
+        };
+
+        /**
+         * Module with the single exported function "run" (and any helpers that build adds), in the binary format.
+         */
+        template <typename Build>
+        std::vector<spiral::byte> run_module(Build&& build) {
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder module;
+            const spiral::functionid_t run = module.add_function({ i64, i64 }, { i64 });
+            module.add_export(run, "run");
+            build(module, run);
+            return std::move(module).build().write();
+        }
+
+        /**
+         * Sum of the elements, weighted by position, as a checksum of an array.
+         */
+        inline void emit_checksum(kernel_writer& c, var array, var size, var one, var sum) {
+            const var k31 = c.constant(31);
+            const var i = c.i64();
+            const var zero = c.constant(0);
+            c.add(Op::IMM, { sum, O::immediate(0) });
+            c.for_range(i, zero, size, one, [&] {
+                c.add(Op::MULU, { sum, k31, sum });
+                c.add(Op::ADDU, { sum, at(array, i), sum });
+            });
+        }
+
+        inline uint64_t checksum(const std::vector<int64_t>& values) noexcept {
+            uint64_t sum = 0;
+            for (const int64_t value : values) sum = sum * 31 + static_cast<uint64_t>(value);
+            return sum;
+        }
+
+        // sort: heapsort of n random values
+
+        inline std::vector<spiral::byte> build_sort() {
+            return run_module([](spiral::ModuleBuilder& module, spiral::functionid_t run) {
+                kernel_writer c(module.begin_code(run));
+                const var a = c.local(spiral::TypeIDs::I64, 1);
+                const var x = c.i64(), i = c.i64(), cond = c.i64(), root = c.i64(), child = c.i64(), next = c.i64(), end = c.i64(), start = c.i64();
+                const var zero = c.constant(0), one = c.constant(1), two = c.constant(2), shift = c.constant(33);
+                c.add(Op::CREATE, { a, kernel_writer::n });
+                c.add(Op::COPY, { kernel_writer::seed, x });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    c.lcg_step(x);
+                    c.add(Op::SRL, { x, shift, at(a, i) });
+                });
+                // sift a[root] down within a[0, end)
+                const auto sift = [&] {
+                    const label loop = c.new_label(), no_right = c.new_label(), done = c.new_label();
+                    c.bind(loop);
+                    c.add(Op::MUL, { root, two, child });
+                    c.add(Op::ADD, { child, one, child });
+                    c.add(Op::SLT, { child, end, cond });
+                    c.add(Op::JZ, { O::label(done), cond });
+                    c.add(Op::ADD, { child, one, next });
+                    c.add(Op::SLT, { next, end, cond });
+                    c.add(Op::JZ, { O::label(no_right), cond });
+                    c.add(Op::SLT, { at(a, child), at(a, next), cond });
+                    c.add(Op::JZ, { O::label(no_right), cond });
+                    c.add(Op::COPY, { next, child });
+                    c.bind(no_right);
+                    c.add(Op::SLT, { at(a, root), at(a, child), cond });
+                    c.add(Op::JZ, { O::label(done), cond });
+                    c.add(Op::SWAP, { at(a, root), at(a, child) });
+                    c.add(Op::COPY, { child, root });
+                    c.add(Op::JMP, { O::label(loop) });
+                    c.bind(done);
+                };
+                // heapify
+                const label build_loop = c.new_label(), build_done = c.new_label();
+                c.add(Op::SRA, { kernel_writer::n, one, start });
+                c.bind(build_loop);
+                c.add(Op::SUB, { start, one, start });
+                c.add(Op::SLT, { start, zero, cond });
+                c.add(Op::JNZ, { O::label(build_done), cond });
+                c.add(Op::COPY, { start, root });
+                c.add(Op::COPY, { kernel_writer::n, end });
+                sift();
+                c.add(Op::JMP, { O::label(build_loop) });
+                c.bind(build_done);
+                // pop the maximum to the back
+                const label sort_loop = c.new_label(), sort_done = c.new_label();
+                const var last = c.i64();
+                c.add(Op::SUB, { kernel_writer::n, one, last });
+                c.bind(sort_loop);
+                c.add(Op::SLT, { zero, last, cond });
+                c.add(Op::JZ, { O::label(sort_done), cond });
+                c.add(Op::SWAP, { at(a, zero), at(a, last) });
+                c.add(Op::IMM, { root, O::immediate(0) });
+                c.add(Op::COPY, { last, end });
+                sift();
+                c.add(Op::SUB, { last, one, last });
+                c.add(Op::JMP, { O::label(sort_loop) });
+                c.bind(sort_done);
+                const var sum = c.i64();
+                emit_checksum(c, a, kernel_writer::n, one, sum);
+                c.add(Op::COPY, { sum, kernel_writer::result });
+                module.add_code(std::move(c));
+            });
+        }
+
+        inline void sift(std::vector<int64_t>& a, int64_t root, int64_t end) noexcept {
+            while (true) {
+                int64_t child = root * 2 + 1;
+                if (child >= end) return;
+                if (child + 1 < end && a[child] < a[child + 1]) ++child;
+                if (!(a[root] < a[child])) return;
+                std::swap(a[root], a[child]);
+                root = child;
+            }
+        }
+
+        inline int64_t reference_sort(int64_t n, int64_t seed) {
+            std::vector<int64_t> a(static_cast<size_t>(n));
+            uint64_t x = static_cast<uint64_t>(seed);
+            for (int64_t& value : a) value = static_cast<int64_t>(lcg(x) >> 33);
+            for (int64_t start = n / 2 - 1; start >= 0; --start) sift(a, start, n);
+            for (int64_t last = n - 1; last > 0; --last) {
+                std::swap(a[0], a[last]);
+                sift(a, 0, last);
+            }
+            return static_cast<int64_t>(checksum(a));
+        }
+
+        // hash_table: n inserts then 2n lookups (half of them misses) in an open-addressing table over arrays
+
+        constexpr uint64_t hash_multiplier = 0x9E3779B97F4A7C15ull;
+
+        inline std::vector<spiral::byte> build_hash_table() {
+            return run_module([](spiral::ModuleBuilder& module, spiral::functionid_t run) {
+                kernel_writer c(module.begin_code(run));
+                const var keys = c.local(spiral::TypeIDs::I64, 1), values = c.local(spiral::TypeIDs::I64, 1);
+                const var x = c.i64(), i = c.i64(), cond = c.i64(), capacity = c.i64(), mask = c.i64(), key = c.i64(), slot = c.i64(), limit = c.i64(), sum = c.i64();
+                const var zero = c.constant(0), one = c.constant(1), two = c.constant(2), shift = c.constant(33), hash_shift = c.constant(40), multiplier = c.constant(static_cast<int64_t>(hash_multiplier));
+                // capacity: the smallest power of two that is at least 2n
+                const label grow = c.new_label(), grown = c.new_label();
+                c.add(Op::MUL, { kernel_writer::n, two, limit });
+                c.add(Op::IMM, { capacity, O::immediate(1) });
+                c.bind(grow);
+                c.add(Op::SLT, { capacity, limit, cond });
+                c.add(Op::JZ, { O::label(grown), cond });
+                c.add(Op::SLL, { capacity, one, capacity });
+                c.add(Op::JMP, { O::label(grow) });
+                c.bind(grown);
+                c.add(Op::SUB, { capacity, one, mask });
+                c.add(Op::CREATE, { keys, capacity });
+                c.add(Op::CREATE, { values, capacity });
+                // probe for key: slot is then its slot, or the empty slot where it would go
+                const auto probe = [&] {
+                    const label loop = c.new_label(), done = c.new_label();
+                    c.add(Op::MULU, { key, multiplier, slot });
+                    c.add(Op::SRL, { slot, hash_shift, slot });
+                    c.add(Op::AND, { slot, mask, slot });
+                    c.bind(loop);
+                    c.add(Op::SEQ, { at(keys, slot), zero, cond });
+                    c.add(Op::JNZ, { O::label(done), cond });
+                    c.add(Op::SEQ, { at(keys, slot), key, cond });
+                    c.add(Op::JNZ, { O::label(done), cond });
+                    c.add(Op::ADD, { slot, one, slot });
+                    c.add(Op::AND, { slot, mask, slot });
+                    c.add(Op::JMP, { O::label(loop) });
+                    c.bind(done);
+                };
+                const auto next_key = [&] {
+                    c.lcg_step(x);
+                    c.add(Op::SRL, { x, shift, key });
+                    c.add(Op::OR, { key, one, key });
+                };
+                c.add(Op::COPY, { kernel_writer::seed, x });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    next_key();
+                    probe();
+                    c.add(Op::COPY, { key, at(keys, slot) });
+                    c.add(Op::ADDU, { at(values, slot), i, at(values, slot) });
+                });
+                c.add(Op::COPY, { kernel_writer::seed, x });
+                c.add(Op::IMM, { sum, O::immediate(0) });
+                c.for_range(i, zero, limit, one, [&] {
+                    const label miss = c.new_label(), next = c.new_label();
+                    next_key();
+                    probe();
+                    c.add(Op::SEQ, { at(keys, slot), zero, cond });
+                    c.add(Op::JNZ, { O::label(miss), cond });
+                    c.add(Op::ADDU, { sum, at(values, slot), sum });
+                    c.add(Op::JMP, { O::label(next) });
+                    c.bind(miss);
+                    c.add(Op::ADDU, { sum, one, sum });
+                    c.bind(next);
+                });
+                c.add(Op::COPY, { sum, kernel_writer::result });
+                module.add_code(std::move(c));
+            });
+        }
+
+        inline int64_t reference_hash_table(int64_t n, int64_t seed) {
+            uint64_t capacity = 1;
+            while (capacity < static_cast<uint64_t>(2 * n)) capacity <<= 1;
+            const uint64_t mask = capacity - 1;
+            std::vector<uint64_t> keys(capacity), values(capacity);
+            const auto probe = [&](uint64_t key) {
+                uint64_t slot = ((key * hash_multiplier) >> 40) & mask;
+                while (keys[slot] != 0 && keys[slot] != key) slot = (slot + 1) & mask;
+                return slot;
+            };
+            uint64_t x = static_cast<uint64_t>(seed);
+            for (int64_t i = 0; i != n; ++i) {
+                const uint64_t key = (lcg(x) >> 33) | 1;
+                const uint64_t slot = probe(key);
+                keys[slot] = key;
+                values[slot] += static_cast<uint64_t>(i);
+            }
+            x = static_cast<uint64_t>(seed);
+            uint64_t sum = 0;
+            for (int64_t i = 0; i != 2 * n; ++i) {
+                const uint64_t slot = probe((lcg(x) >> 33) | 1);
+                sum += keys[slot] != 0 ? values[slot] : 1;
+            }
+            return static_cast<int64_t>(sum);
+        }
+
+        // matmul: C = A * B on n x n matrices of Array<Array<i64>> (B stored transposed, as BT)
+
+        inline std::vector<spiral::byte> build_matmul() {
+            return run_module([](spiral::ModuleBuilder& module, spiral::functionid_t run) {
+                kernel_writer c(module.begin_code(run));
+                const var a = c.local(spiral::TypeIDs::I64, 2), bt = c.local(spiral::TypeIDs::I64, 2), product = c.local(spiral::TypeIDs::I64, 2);
+                const var row = c.local(spiral::TypeIDs::I64, 1), column = c.local(spiral::TypeIDs::I64, 1), out = c.local(spiral::TypeIDs::I64, 1);
+                const var x = c.i64(), i = c.i64(), j = c.i64(), k = c.i64(), dot = c.i64(), term = c.i64(), sum = c.i64();
+                const var zero = c.constant(0), one = c.constant(1), k31 = c.constant(31), shift = c.constant(54);
+                c.add(Op::COPY, { kernel_writer::seed, x });
+                for (const var matrix : { a, bt }) {
+                    c.add(Op::CREATE, { matrix, kernel_writer::n });
+                    c.for_range(i, zero, kernel_writer::n, one, [&] {
+                        c.add(Op::CREATE, { row, kernel_writer::n });
+                        c.for_range(j, zero, kernel_writer::n, one, [&] {
+                            c.lcg_step(x);
+                            c.add(Op::SRL, { x, shift, at(row, j) });
+                        });
+                        c.add(Op::MOVE, { row, at(matrix, i) });
+                    });
+                }
+                c.add(Op::CREATE, { product, kernel_writer::n });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    c.add(Op::MOVE, { at(a, i), row });
+                    c.add(Op::CREATE, { out, kernel_writer::n });
+                    c.for_range(j, zero, kernel_writer::n, one, [&] {
+                        c.add(Op::MOVE, { at(bt, j), column });
+                        c.add(Op::IMM, { dot, O::immediate(0) });
+                        c.for_range(k, zero, kernel_writer::n, one, [&] {
+                            c.add(Op::MULU, { at(row, k), at(column, k), term });
+                            c.add(Op::ADDU, { dot, term, dot });
+                        });
+                        c.add(Op::COPY, { dot, at(out, j) });
+                        c.add(Op::MOVE, { column, at(bt, j) });
+                    });
+                    c.add(Op::MOVE, { row, at(a, i) });
+                    c.add(Op::MOVE, { out, at(product, i) });
+                });
+                c.add(Op::IMM, { sum, O::immediate(0) });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    c.add(Op::MOVE, { at(product, i), row });
+                    c.for_range(j, zero, kernel_writer::n, one, [&] {
+                        c.add(Op::MULU, { sum, k31, sum });
+                        c.add(Op::ADDU, { sum, at(row, j), sum });
+                    });
+                    c.add(Op::MOVE, { row, at(product, i) });
+                });
+                c.add(Op::COPY, { sum, kernel_writer::result });
+                module.add_code(std::move(c));
+            });
+        }
+
+        inline int64_t reference_matmul(int64_t n, int64_t seed) {
+            const size_t size = static_cast<size_t>(n);
+            std::vector<std::vector<int64_t>> a(size, std::vector<int64_t>(size)), bt = a, product = a;
+            uint64_t x = static_cast<uint64_t>(seed);
+            for (auto* matrix : { &a, &bt }) {
+                for (std::vector<int64_t>& row : *matrix) {
+                    for (int64_t& value : row) value = static_cast<int64_t>(lcg(x) >> 54);
+                }
+            }
+            for (size_t i = 0; i != size; ++i) {
+                for (size_t j = 0; j != size; ++j) {
+                    uint64_t dot = 0;
+                    for (size_t k = 0; k != size; ++k) dot += static_cast<uint64_t>(a[i][k]) * static_cast<uint64_t>(bt[j][k]);
+                    product[i][j] = static_cast<int64_t>(dot);
+                }
+            }
+            uint64_t sum = 0;
+            for (const std::vector<int64_t>& row : product) {
+                for (const int64_t value : row) sum = sum * 31 + static_cast<uint64_t>(value);
+            }
+            return static_cast<int64_t>(sum);
+        }
+
+        // crc: bitwise CRC-32 of n random bytes, and the popcount of the random stream
+
+        constexpr uint32_t crc_polynomial = 0xEDB88320u;
+
+        inline std::vector<spiral::byte> build_crc() {
+            return run_module([](spiral::ModuleBuilder& module, spiral::functionid_t run) {
+                kernel_writer c(module.begin_code(run));
+                const var data = c.local(spiral::TypeIDs::I32, 1);
+                const var x = c.i64(), i = c.i64(), bit = c.i64(), bits = c.i64(), ones = c.i64(), wide = c.i64();
+                const var crc = c.local(spiral::TypeIDs::I32), low = c.local(spiral::TypeIDs::I32);
+                const var zero = c.constant(0), one = c.constant(1), eight = c.constant(8), shift = c.constant(56), high = c.constant(32);
+                const var zero32 = c.constant(0, spiral::TypeIDs::I32), one32 = c.constant(1, spiral::TypeIDs::I32), polynomial = c.constant(static_cast<int32_t>(crc_polynomial), spiral::TypeIDs::I32);
+                c.add(Op::CREATE, { data, kernel_writer::n });
+                c.add(Op::COPY, { kernel_writer::seed, x });
+                c.add(Op::IMM, { ones, O::immediate(0) });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    c.lcg_step(x);
+                    c.add(Op::POPCNT, { x, bits });
+                    c.add(Op::ADD, { ones, bits, ones });
+                    c.add(Op::SRL, { x, shift, wide });
+                    c.add(Op::CONV, { wide, at(data, i) });
+                });
+                c.add(Op::IMM, { crc, O::immediate(-1) });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    c.add(Op::XOR, { crc, at(data, i), crc });
+                    c.for_range(bit, zero, eight, one, [&] {
+                        c.add(Op::AND, { crc, one32, low });
+                        c.add(Op::SUBU, { zero32, low, low });
+                        c.add(Op::AND, { low, polynomial, low });
+                        c.add(Op::SRL, { crc, one32, crc });
+                        c.add(Op::XOR, { crc, low, crc });
+                    });
+                });
+                c.add(Op::NOT, { crc, crc });
+                c.add(Op::CONVU, { crc, wide });
+                c.add(Op::SLL, { ones, high, ones });
+                c.add(Op::XOR, { wide, ones, kernel_writer::result });
+                module.add_code(std::move(c));
+            });
+        }
+
+        inline int64_t reference_crc(int64_t n, int64_t seed) {
+            std::vector<uint32_t> data(static_cast<size_t>(n));
+            uint64_t x = static_cast<uint64_t>(seed);
+            uint64_t ones = 0;
+            for (uint32_t& value : data) {
+                lcg(x);
+                ones += static_cast<uint64_t>(__builtin_popcountll(x));
+                value = static_cast<uint32_t>(x >> 56);
+            }
+            uint32_t crc = 0xFFFFFFFFu;
+            for (const uint32_t value : data) {
+                crc ^= value;
+                for (int bit = 0; bit != 8; ++bit) crc = (crc >> 1) ^ (crc_polynomial & (0u - (crc & 1)));
+            }
+            return static_cast<int64_t>(static_cast<uint64_t>(~crc) ^ (ones << 32));
+        }
+
+        // bignum: schoolbook product of two n-limb numbers, with 64x64->128-bit limb products
+
+        inline std::vector<spiral::byte> build_bignum() {
+            return run_module([](spiral::ModuleBuilder& module, spiral::functionid_t run) {
+                kernel_writer c(module.begin_code(run));
+                const var a = c.local(spiral::TypeIDs::I64, 1), b = c.local(spiral::TypeIDs::I64, 1), product = c.local(spiral::TypeIDs::I64, 1);
+                const var x = c.i64(), i = c.i64(), j = c.i64(), ij = c.i64(), size = c.i64(), sum = c.i64();
+                const var term = c.local(spiral::TypeIDs::I128), limb = c.local(spiral::TypeIDs::I128), carry = c.local(spiral::TypeIDs::I128);
+                const var zero = c.constant(0), one = c.constant(1), two = c.constant(2), limb_bits = c.constant(64);
+                c.add(Op::COPY, { kernel_writer::seed, x });
+                for (const var number : { a, b }) {
+                    c.add(Op::CREATE, { number, kernel_writer::n });
+                    c.for_range(i, zero, kernel_writer::n, one, [&] {
+                        c.lcg_step(x);
+                        c.add(Op::COPY, { x, at(number, i) });
+                    });
+                }
+                c.add(Op::MUL, { kernel_writer::n, two, size });
+                c.add(Op::CREATE, { product, size });
+                c.for_range(i, zero, kernel_writer::n, one, [&] {
+                    c.add(Op::IMM, { carry, O::immediate(0) });
+                    c.for_range(j, zero, kernel_writer::n, one, [&] {
+                        c.add(Op::ADD, { i, j, ij });
+                        c.add(Op::MULUEX, { at(a, i), at(b, j), term });
+                        c.add(Op::CONVU, { at(product, ij), limb });
+                        c.add(Op::ADDU, { term, limb, term });
+                        c.add(Op::ADDU, { term, carry, term });
+                        c.add(Op::CONV, { term, at(product, ij) });
+                        c.add(Op::SRL, { term, limb_bits, carry });
+                    });
+                    c.add(Op::ADD, { i, kernel_writer::n, ij });
+                    c.add(Op::CONV, { carry, at(product, ij) });
+                });
+                emit_checksum(c, product, size, one, sum);
+                c.add(Op::COPY, { sum, kernel_writer::result });
+                module.add_code(std::move(c));
+            });
+        }
+
+        inline int64_t reference_bignum(int64_t n, int64_t seed) {
+            using u128 = unsigned __int128;
+            const size_t size = static_cast<size_t>(n);
+            std::vector<uint64_t> a(size), b(size);
+            std::vector<int64_t> product(2 * size);
+            uint64_t x = static_cast<uint64_t>(seed);
+            for (uint64_t& limb : a) limb = lcg(x);
+            for (uint64_t& limb : b) limb = lcg(x);
+            for (size_t i = 0; i != size; ++i) {
+                u128 carry = 0;
+                for (size_t j = 0; j != size; ++j) {
+                    const u128 term = static_cast<u128>(a[i]) * b[j] + static_cast<uint64_t>(product[i + j]) + carry;
+                    product[i + j] = static_cast<int64_t>(static_cast<uint64_t>(term));
+                    carry = term >> 64;
+                }
+                product[i + size] = static_cast<int64_t>(static_cast<uint64_t>(carry));
+            }
+            return static_cast<int64_t>(checksum(product));
+        }
+
+        // fib: naive recursive Fibonacci (call overhead)
+
+        inline std::vector<spiral::byte> build_fib() {
+            return run_module([](spiral::ModuleBuilder& module, spiral::functionid_t run) {
+                const spiral::typeid_t i64(spiral::TypeIDs::I64);
+                const spiral::functionid_t fib = module.add_function({ i64 }, { i64 });
+                {
+                    kernel_writer c(module.begin_code(run));
+                    const var value = c.i64();
+                    c.add(Op::CALL, { O::function(fib), kernel_writer::n, value });
+                    c.add(Op::ADDU, { value, kernel_writer::seed, kernel_writer::result });
+                    module.add_code(std::move(c));
+                }
+                {
+                    // fib(k): -1 is k, -2 is the result
+                    code_writer c(module.begin_code(fib));
+                    const var k{ -1 }, ret{ -2 };
+                    const var cond = c.i64(), one = c.i64(), two = c.i64(), arg = c.i64(), first = c.i64(), second = c.i64();
+                    const label recurse = c.new_label(), done = c.new_label();
+                    c.add(Op::IMM, { one, O::immediate(1) });
+                    c.add(Op::IMM, { two, O::immediate(2) });
+                    c.add(Op::SLT, { k, two, cond });
+                    c.add(Op::JZ, { O::label(recurse), cond });
+                    c.add(Op::COPY, { k, ret });
+                    c.add(Op::JMP, { O::label(done) });
+                    c.bind(recurse);
+                    c.add(Op::SUB, { k, one, arg });
+                    c.add(Op::CALL, { O::function(fib), arg, first });
+                    c.add(Op::SUB, { k, two, arg });
+                    c.add(Op::CALL, { O::function(fib), arg, second });
+                    c.add(Op::ADD, { first, second, ret });
+                    c.bind(done);
+                    module.add_code(std::move(c));
+                }
+            });
+        }
+
+        inline int64_t fib(int64_t k) noexcept {
+            return k < 2 ? k : fib(k - 1) + fib(k - 2);
+        }
+
+        inline int64_t reference_fib(int64_t n, int64_t seed) {
+            return static_cast<int64_t>(static_cast<uint64_t>(fib(n)) + static_cast<uint64_t>(seed));
+        }
+    }
+
+    inline const std::vector<kernel>& get_kernels() {
+        static const std::vector<kernel> ret = {
+            { "sort", &kernels::build_sort, &kernels::reference_sort, 100000 },
+            { "hash_table", &kernels::build_hash_table, &kernels::reference_hash_table, 100000 },
+            { "matmul", &kernels::build_matmul, &kernels::reference_matmul, 64 },
+            { "crc", &kernels::build_crc, &kernels::reference_crc, 100000 },
+            { "bignum", &kernels::build_bignum, &kernels::reference_bignum, 128 },
+            { "fib", &kernels::build_fib, &kernels::reference_fib, 25 }
+        };
+        return ret;
+    }
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define SPIRAL_BENCH_PERF_EVENTS
+#endif
+
+/**
+ * Hardware performance counters of the calling thread, read through perf_event_open.
+ *
+ * Each counter is opened on its own (not as a group), so that a counter that the CPU or the hypervisor does not provide
+ * only drops that counter, and counters are scaled for multiplexing.  When none can be opened (other platforms,
+ * perf_event_paranoid, containers without PMU access), the harness falls back to wall-clock time only.
+ */
+
+namespace spiral_bench {
+
+    class perf_counters {
+    public:
+        perf_counters() {
+#ifdef SPIRAL_BENCH_PERF_EVENTS
+            const auto cache = [](uint64_t cache, uint64_t result) {
+                return cache | (uint64_t{ PERF_COUNT_HW_CACHE_OP_READ } << 8) | (result << 16);
+            };
+            const struct {
+                const char* name;
+                uint32_t type;
+                uint64_t config;
+            } events[] = {
+                { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+                { "l1d_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+                { "l1i_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1I, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+                { "llc_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+                { "itlb_misses", PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_RESULT_MISS) }
+            };
+            int error = 0;
+            for (const auto& event : events) {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = event.type;
+                attr.config = event.config;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+                if (fd == -1) {
+                    error = errno;
+                    continue;
+                }
+                counters.push_back(counter{ event.name, fd });
+            }
+            status = counters.empty() ? "unavailable (" + std::string(std::strerror(error)) + ")" : "perf_event_open";
+#else
+            status = "unavailable (not supported on this platform)";
+#endif
+        }
+        perf_counters(const perf_counters&) = delete;
+        perf_counters& operator=(const perf_counters&) = delete;
+        ~perf_counters() {
+#ifdef SPIRAL_BENCH_PERF_EVENTS
+            for (const counter& c : counters) close(c.fd);
+#endif
+        }
+
+        bool is_available() const noexcept { return !counters.empty(); }
+
+        /**
+         * "perf_event_open" if any counter is available, otherwise why not.
+         */
+        const std::string& get_status() const noexcept { return status; }
+
+        /**
+         * Resets and starts all counters.
+         */
+        void start() noexcept {
+#ifdef SPIRAL_BENCH_PERF_EVENTS
+            for (const counter& c : counters) {
+                ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+
+        void stop() noexcept {
+#ifdef SPIRAL_BENCH_PERF_EVENTS
+            for (const counter& c : counters) ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+        }
+
+        /**
+         * Returns the count of each counter between start() and stop(), scaled up if the counter was multiplexed.
+         * Counters that never got to run are left out.
+         */
+        std::vector<std::pair<std::string, double>> read() const {
+            std::vector<std::pair<std::string, double>> ret;
+#ifdef SPIRAL_BENCH_PERF_EVENTS
+            for (const counter& c : counters) {
+                uint64_t values[3]; // value, time enabled, time running
+                if (::read(c.fd, values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[2] == 0) continue;
+                ret.emplace_back(c.name, static_cast<double>(values[0]) * static_cast<double>(values[1]) / static_cast<double>(values[2]));
+            }
+#endif
+            return ret;
+        }
+
+    private:
+        struct counter {
+            const char* name;
+            int fd;
+        };
+
+        std::vector<counter> counters;
+        std::string status;
+    };
+
+}
@@ -1,8 +1,37 @@
 #include <iostream>
 #include <spiral/spiral.hpp>
 
+#include "tests/test.hpp"
+#include "tests/wide_arithmetic.hpp"
+#include "tests/constant_divisor.hpp"
+#include "tests/constant_propagation.hpp"
+#include "tests/inliner.hpp"
+#include "tests/name_table.hpp"
+#include "tests/linker.hpp"
+#include "tests/global_layout.hpp"
+#include "tests/module_builder.hpp"
+#include "tests/module_format.hpp"
+#include "tests/telemetry.hpp"
+#include "tests/batch.hpp"
+#include "tests/code_cache.hpp"
+#include "tests/snapshot.hpp"
+#include "tests/perf.hpp"
+#include "tests/profiler.hpp"
+
 int main() {
     using std::cout;
     using std::endl;
-    //spiral::Module mod;
+    size_t failed = 0;
+    for (const spiral_tests::test_case& test : spiral_tests::registry()) {
+        try {
+            test.run();
+            cout << "[ OK ] " << test.name << endl;
+        }
+        catch (const std::exception& e) {
+            ++failed;
+            cout << "[FAIL] " << test.name << ": " << e.what() << endl;
+        }
+    }
+    cout << (spiral_tests::registry().size() - failed) << "/" << spiral_tests::registry().size() << " tests passed" << endl;
+    return failed == 0 ? 0 : 1;
 }
@@ -0,0 +1,85 @@
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+/**
+ * Ahead-of-time compiler: builds a Spiral module into a shared object that can be loaded with spiral::aot_load.
+ */
+
+namespace {
+
+    void print_usage(const char* program) {
+        std::cerr << "Usage: " << program << " [options] <input module> <output shared object>\n"
+                  << "Options:\n"
+                  << "  --cxx <compiler>  C++ compiler to use (default: c++)\n"
+                  << "  --flag <flag>     Additional compiler flag (may be repeated)\n"
+                  << "  --emit-cpp        Only write the generated C++ source to the output\n"
+                  << "  --keep-source     Keep the generated C++ source as <output>.cpp\n";
+    }
+
+    std::vector<spiral::byte> read_file(const char* path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::runtime_error(std::string("Cannot open ") + path + "!");
+        std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::vector<spiral::byte> ret(contents.size());
+        std::memcpy(ret.data(), contents.data(), contents.size());
+        return ret;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    spiral::aot_options options;
+    bool emit_only = false;
+    std::vector<const char*> positional;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--cxx") == 0 && i + 1 < argc) {
+            options.compiler = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--flag") == 0 && i + 1 < argc) {
+            options.flags.push_back(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--emit-cpp") == 0) {
+            emit_only = true;
+        }
+        else if (std::strcmp(argv[i], "--keep-source") == 0) {
+            options.keep_source = true;
+        }
+        else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return 2;
+        }
+        else {
+            positional.push_back(argv[i]);
+        }
+    }
+    if (positional.size() != 2) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    try {
+        spiral::basic_imemorybuf<spiral::byte, std::vector<spiral::byte>> buf(read_file(positional[0]));
+        spiral::Module module;
+        module.read(buf);
+        if (emit_only) {
+            std::ofstream file(positional[1], std::ios::binary | std::ios::trunc);
+            file << spiral::emit_cpp(module);
+            if (!file) throw std::runtime_error(std::string("Cannot write ") + positional[1] + "!");
+        }
+        else {
+            spiral::aot_compile(module, positional[1], options);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,548 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "bench/kernels.hpp"
+#include "bench/perf_counters.hpp"
+
+/**
+ * Benchmarks for the decoder and the compiler: varint decoding, Module::read and validation of synthetic modules,
+ * each compile tier (constant propagation, inlining, C++ emission, native compilation, installation), instantiation
+ * and call overhead, and the slowdown of the kernel corpus (see bench/kernels.hpp) relative to native C++.
+ * Results are written as JSON, so that they can be compared across releases, with hardware counters per operation
+ * where perf_event_open is available (see bench/perf_counters.hpp).
+ */
+
+namespace {
+
+    struct bench_options {
+        size_t functions = 100;
+        size_t instructions = 100; // per function
+        size_t records = 10;
+        size_t globals = 16;
+        double min_time = 0.1; // seconds per sample
+        size_t samples = 5;
+        bool native = true;
+        bool kernels = true;
+        int64_t kernel_scale = 1; // multiplies the default problem size of every kernel
+        std::string corpus; // directory to read the kernel modules from, instead of building them
+        std::string filter;
+        std::string output;
+    };
+
+    struct bench_result {
+        std::string name;
+        uint64_t iterations; // per sample
+        double median_ns; // per operation
+        double min_ns; // per operation
+        double bytes_per_op; // zero if the benchmark does not process bytes
+        double slowdown = 0; // relative to the native reference (kernels only)
+        std::vector<std::pair<std::string, double>> counters; // hardware counters per operation (if available)
+    };
+
+    void print_usage(const char* program) {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "Options:\n"
+                  << "  --functions <n>     Functions in the synthetic module (default: 100)\n"
+                  << "  --instructions <n>  Instructions per function (default: 100)\n"
+                  << "  --records <n>       Records in the synthetic module (default: 10)\n"
+                  << "  --globals <n>       Globals in the synthetic module (default: 16)\n"
+                  << "  --min-time <s>      Minimum time per sample, in seconds (default: 0.1)\n"
+                  << "  --samples <n>       Samples per benchmark (default: 5)\n"
+                  << "  --filter <text>     Only run benchmarks whose name contains text\n"
+                  << "  --no-native         Skip the benchmarks that need the system C++ compiler\n"
+                  << "  --no-kernels        Skip the kernel corpus\n"
+                  << "  --kernel-scale <n>  Multiply the problem size of every kernel by n (default: 1)\n"
+                  << "  --corpus <dir>      Read the kernel modules from dir (e.g. bench/corpus) instead of building them\n"
+                  << "  --write-corpus <dir> Write the kernel modules to dir, and exit\n"
+                  << "  --output <path>     Write the JSON results to path instead of stdout\n";
+    }
+
+    /**
+     * Builds a module with the given numbers of records, globals and functions.  Function 1 is exported as "identity";
+     * functions 2.. (exported as "f<id>") are (i64) -> (i64) with the given number of instructions of arithmetic.
+     */
+    spiral::Module build_module(const bench_options& options) {
+        using spiral::typeid_t;
+        using O = spiral::Operand;
+        using Op = spiral::opcode_t;
+        const typeid_t i32(spiral::TypeIDs::I32), i64(spiral::TypeIDs::I64);
+        spiral::ModuleBuilder module;
+        module.reserve(options.records, options.functions + 1, options.globals);
+        for (size_t i = 0; i != options.records; ++i) {
+            module.add_record({ i64, i32, i64 });
+        }
+        {
+            const spiral::functionid_t identity = module.add_function({ i64 }, { i64 });
+            module.add_export(identity, "identity");
+            spiral::CodeBuilder code = module.begin_code(identity);
+            code.add(Op::COPY, { O::reference(-1), O::reference(-2) });
+            module.add_code(std::move(code));
+        }
+        const Op arithmetic[] = { Op::ADD, Op::MUL, Op::XOR, Op::SUB, Op::ADDU, Op::AND, Op::OR, Op::MULU };
+        const size_t num_instructions = std::max<size_t>(options.instructions, 3);
+        for (size_t i = 0; i != options.functions; ++i) {
+            const spiral::functionid_t functionid = module.add_function({ i64 }, { i64 });
+            module.add_export(functionid, "f" + std::to_string(functionid));
+            spiral::CodeBuilder code = module.begin_code(functionid, { i64, i64 });
+            code.reserve(num_instructions);
+            const spiral::variableid_t constant = 1, value = 2;
+            code.add(Op::IMM, { O::reference(constant), O::immediate(static_cast<int64_t>(functionid)) });
+            code.add(Op::COPY, { O::reference(-1), O::reference(value) });
+            for (size_t k = 0; k != num_instructions - 3; ++k) {
+                code.add(arithmetic[k % std::size(arithmetic)], { O::reference(value), O::reference(k % 3 == 0 ? -1 : constant), O::reference(value) });
+            }
+            code.add(Op::COPY, { O::reference(value), O::reference(-2) });
+            module.add_code(std::move(code));
+        }
+        for (size_t i = 0; i != options.globals; ++i) {
+            module.add_global(i % 2 == 0 ? spiral::TypeIDs::I64 : spiral::TypeIDs::I32, i % 4 == 0 ? static_cast<uint32_t>(spiral::GlobalFlags::Hot) : 0);
+        }
+        return std::move(module).build();
+    }
+
+    spiral::Module read_module(const std::vector<spiral::byte>& bytes, spiral::telemetry* sink = nullptr) {
+        spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf(spiral::span<const spiral::byte>(bytes.data(), bytes.size()));
+        spiral::Module module;
+        module.read(buf, sink);
+        return module;
+    }
+
+    /**
+     * Prevents the compiler from optimizing away a computed value.
+     */
+    template <typename T>
+    void keep(const T& value) {
+#if defined(__GNUC__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const T* sink;
+        sink = &value;
+#endif
+    }
+
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && defined(NDEBUG))
+    constexpr bool optimized_build = true;
+#else
+    constexpr bool optimized_build = false; // the native references are not optimized, so kernel slowdowns are meaningless
+#endif
+
+    class bench_runner {
+    public:
+        explicit bench_runner(const bench_options& options) : options(options) {}
+
+        /**
+         * Times op (which does ops_per_call operations, processing bytes_per_op bytes each).
+         * setup is run before each sample, outside of the timed region.
+         * Returns the result, or nullptr if the benchmark is filtered out.
+         */
+        bench_result* run(const std::string& name, const std::function<void()>& op, uint64_t ops_per_call = 1, double bytes_per_op = 0, const std::function<void()>& setup = {}) {
+            if (!is_enabled(name)) return nullptr;
+            std::cerr << name << "..." << std::endl;
+            if (setup) setup();
+            // calibrate the number of calls per sample
+            uint64_t calls = 1;
+            while (true) {
+                const double elapsed = time_calls(op, calls);
+                if (elapsed >= options.min_time || calls >= (uint64_t{ 1 } << 40)) break;
+                const double scale = elapsed <= 0 ? 10 : std::min(10.0, options.min_time * 1.2 / elapsed);
+                calls = std::max(calls + 1, static_cast<uint64_t>(static_cast<double>(calls) * scale));
+            }
+            std::vector<double> per_op;
+            std::vector<std::pair<std::string, double>> totals;
+            for (size_t i = 0; i != options.samples; ++i) {
+                if (setup) setup();
+                counters.start();
+                per_op.push_back(time_calls(op, calls) * 1e9 / static_cast<double>(calls * ops_per_call));
+                counters.stop();
+                for (const auto& [counter, value] : counters.read()) {
+                    auto it = std::find_if(totals.begin(), totals.end(), [&](const auto& total) { return total.first == counter; });
+                    if (it == totals.end()) it = totals.insert(totals.end(), { counter, 0 });
+                    it->second += value;
+                }
+            }
+            std::sort(per_op.begin(), per_op.end());
+            results.push_back(bench_result{ name, calls * ops_per_call, per_op[per_op.size() / 2], per_op.front(), bytes_per_op, 0, {} });
+            for (auto& [counter, total] : totals) {
+                results.back().counters.emplace_back(counter, total / static_cast<double>(options.samples * calls * ops_per_call));
+            }
+            return &results.back();
+        }
+
+        bool is_enabled(const std::string& name) const {
+            return options.filter.empty() || name.find(options.filter) != std::string::npos;
+        }
+
+        void write_json(std::ostream& out, const std::vector<spiral::byte>& module) const {
+            out << "{\n  \"benchmark\": \"spiral_bench\",\n  \"version\": \"" << SPIRAL_BENCH_VERSION << "\",\n";
+            out << "  \"config\": {\"functions\": " << options.functions << ", \"instructions\": " << options.instructions << ", \"records\": " << options.records << ", \"globals\": " << options.globals << ", \"module_bytes\": " << module.size() << ", \"samples\": " << options.samples << ", \"min_time\": " << options.min_time << ", \"kernel_scale\": " << options.kernel_scale << ", \"optimized_build\": " << (optimized_build ? "true" : "false") << ", \"counters\": \"" << counters.get_status() << "\"},\n";
+            out << "  \"results\": [";
+            for (size_t i = 0; i != results.size(); ++i) {
+                const bench_result& result = results[i];
+                out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations << ", \"median_ns\": " << result.median_ns << ", \"min_ns\": " << result.min_ns;
+                if (result.bytes_per_op != 0) out << ", \"bytes_per_second\": " << result.bytes_per_op * 1e9 / result.median_ns;
+                if (result.slowdown != 0) out << ", \"slowdown\": " << result.slowdown;
+                if (!result.counters.empty()) {
+                    out << ", \"counters\": {";
+                    double cycles = 0, instructions = 0;
+                    for (size_t k = 0; k != result.counters.size(); ++k) {
+                        const auto& [counter, value] = result.counters[k];
+                        out << (k == 0 ? "" : ", ") << '"' << counter << "\": " << value;
+                        if (counter == "cycles") cycles = value;
+                        if (counter == "instructions") instructions = value;
+                    }
+                    if (cycles != 0 && instructions != 0) out << ", \"ipc\": " << instructions / cycles;
+                    out << "}";
+                }
+                out << "}";
+            }
+            out << "\n  ]\n}\n";
+        }
+
+    private:
+        static double time_calls(const std::function<void()>& op, uint64_t calls) {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i != calls; ++i) op();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        const bench_options& options;
+        spiral_bench::perf_counters counters;
+        std::deque<bench_result> results; // results are returned by pointer, so they must not move
+    };
+
+    void bench_varint(bench_runner& runner) {
+        constexpr size_t count = 1 << 16;
+        std::mt19937_64 rng(1);
+        std::vector<uint64_t> values(count);
+        spiral::binarybuf_sizer sizer;
+        for (size_t i = 0; i != count; ++i) {
+            // mostly small values, as in real modules
+            const unsigned bits = (i % 8 == 0) ? 64 : (i % 4 == 0) ? 21 : 7;
+            values[i] = bits == 64 ? rng() : rng() & ((uint64_t{ 1 } << bits) - 1);
+            sizer.write_varint(values[i]);
+        }
+        std::vector<spiral::byte> bytes(sizer.get_size());
+        {
+            spiral::basic_omemorybuf<spiral::byte, spiral::span<spiral::byte>> buf(spiral::span<spiral::byte>(bytes.data(), bytes.size()));
+            spiral::binarybuf_writer<decltype(buf)> writer(buf);
+            for (const uint64_t value : values) writer.write_varint(value);
+        }
+        runner.run("varint_decode", [&] {
+            spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf(spiral::span<const spiral::byte>(bytes.data(), bytes.size()));
+            spiral::binarybuf_reader<decltype(buf)> reader(buf);
+            uint64_t sum = 0;
+            for (size_t i = 0; i != count; ++i) {
+                uint64_t value;
+                reader.read_varint(value);
+                sum += value;
+            }
+            keep(sum);
+        }, count, static_cast<double>(bytes.size()) / count);
+    }
+
+    void bench_compile(bench_runner& runner, const bench_options& options, const std::vector<spiral::byte>& bytes) {
+        runner.run("module_read", [&] {
+            spiral::Module module = read_module(bytes);
+            keep(module);
+        }, 1, static_cast<double>(bytes.size()));
+
+        // rejecting a module cut off halfway, by exception and by decode_result
+        {
+            const spiral::span<const spiral::byte> truncated(bytes.data(), bytes.size() / 2);
+            runner.run("module_read_truncated", [&] {
+                spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf{ spiral::span<const spiral::byte>(truncated) };
+                try {
+                    spiral::Module module;
+                    module.read(buf);
+                    keep(module);
+                }
+                catch (const spiral::eof_exception&) {
+                }
+            }, 1, static_cast<double>(truncated.size()));
+            runner.run("module_try_read_truncated", [&] {
+                spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf{ spiral::span<const spiral::byte>(truncated) };
+                keep(spiral::Module::try_read(buf).has_value());
+            }, 1, static_cast<double>(truncated.size()));
+        }
+
+        {
+            const spiral::Module module = read_module(bytes);
+            runner.run("module_write", [&] {
+                keep(module.write());
+            }, 1, static_cast<double>(bytes.size()));
+        }
+
+        // the same module without the encode/decode round trip
+        runner.run("module_build", [&] {
+            spiral::Module module = build_module(options);
+            keep(module);
+        });
+
+        // validation is interleaved with decoding, except for the final cross-section checks, which the telemetry separates
+        {
+            spiral::telemetry sink;
+            uint64_t reads = 0;
+            runner.run("module_read_telemetry", [&] {
+                spiral::Module module = read_module(bytes, &sink);
+                keep(module);
+                ++reads;
+            }, 1, static_cast<double>(bytes.size()));
+            if (reads != 0) {
+                const auto totals = sink.get_totals();
+                const auto validate = totals.find("validate");
+                if (validate != totals.end()) std::cerr << "  validate: " << static_cast<double>(validate->second.duration_ns) / reads << " ns per module" << std::endl;
+            }
+        }
+
+        // each sample starts from a freshly decoded module; later calls within a sample run on the already optimized code
+        spiral::Module module;
+        runner.run("constant_propagation", [&] {
+            for (spiral::Code& code : module.get_codes()) keep(spiral::propagate_constants(code, module.get_functions()));
+        }, 1, 0, [&] { module = read_module(bytes); });
+        runner.run("inline", [&] {
+            keep(spiral::inline_calls(module.get_codes(), module.get_functions()));
+        }, 1, 0, [&] { module = read_module(bytes); });
+        module = read_module(bytes);
+        runner.run("emit_cpp", [&] {
+            keep(spiral::emit_cpp(module));
+        });
+
+        if (!options.native) return;
+        const std::filesystem::path library = std::filesystem::temp_directory_path() / ("spiral_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".so");
+        runner.run("native_compile", [&] {
+            spiral::aot_compile(module, library);
+        });
+        if (!std::filesystem::exists(library)) spiral::aot_compile(module, library);
+
+        auto compiled = std::make_shared<spiral::CompiledModule>(read_module(bytes));
+        runner.run("install", [&] {
+            spiral::CompiledModule fresh(compiled->get_shared_module());
+            spiral::aot_load(fresh, library);
+            keep(fresh);
+        });
+        spiral::aot_load(*compiled, library);
+        const std::shared_ptr<const spiral::import_bindings> imports = spiral::Linker(compiled->get_module()).link();
+        runner.run("instantiate", [&] {
+            spiral::Instance instance(compiled, imports);
+            keep(instance);
+        });
+
+        spiral::Instance instance(compiled, imports);
+        const auto identity = instance.get_export<int64_t(int64_t)>("identity");
+        constexpr uint64_t calls = 1024;
+        runner.run("call_identity", [&] {
+            int64_t value = 0;
+            for (uint64_t i = 0; i != calls; ++i) value = identity(value + 1);
+            keep(value);
+        }, calls);
+        runner.run("get_export", [&] {
+            keep(instance.get_export<int64_t(int64_t)>("identity"));
+        });
+        if (options.functions != 0) {
+            const std::string last_name = "f" + std::to_string(options.functions + 1);
+            runner.run("get_export_last", [&] {
+                keep(instance.get_export<int64_t(int64_t)>(last_name));
+            });
+            const spiral::hashed_name last(last_name);
+            runner.run("get_export_last_hashed", [&] {
+                keep(instance.get_export<int64_t(int64_t)>(last));
+            });
+            const auto function = instance.get_export<int64_t(int64_t)>("f2");
+            runner.run("call_f2", [&] {
+                int64_t value = 0;
+                for (uint64_t i = 0; i != calls; ++i) value = function(value + 1);
+                keep(value);
+            }, calls);
+
+            // the same rows, called one at a time and as a batch (see batch.hpp)
+            std::vector<int64_t> inputs(calls), outputs(calls);
+            std::iota(inputs.begin(), inputs.end(), 0);
+            runner.run("call_f2_rows", [&] {
+                for (uint64_t i = 0; i != calls; ++i) outputs[i] = function(inputs[i]);
+                keep(outputs.data());
+            }, calls);
+            runner.run("invoke_batch_f2", [&] {
+                spiral::invoke_batch(function, { spiral::span<const int64_t>(inputs.data(), inputs.size()) }, { spiral::span<int64_t>(outputs.data(), outputs.size()) });
+                keep(outputs.data());
+            }, calls);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(library, ec);
+    }
+
+    std::vector<spiral::byte> read_file(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::runtime_error("Cannot open " + path.string() + "!");
+        std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::vector<spiral::byte> ret(contents.size());
+        std::memcpy(ret.data(), contents.data(), contents.size());
+        return ret;
+    }
+
+    void write_corpus(const std::filesystem::path& directory) {
+        std::filesystem::create_directories(directory);
+        for (const spiral_bench::kernel& kernel : spiral_bench::get_kernels()) {
+            const std::vector<spiral::byte> bytes = kernel.build();
+            const std::filesystem::path path = directory / (std::string(kernel.name) + ".spiral");
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            if (!file) throw std::runtime_error("Cannot write " + path.string() + "!");
+        }
+    }
+
+    /**
+     * A way of compiling a module: the IR passes to run, and the flags for the system compiler.
+     */
+    struct compile_tier {
+        const char* name;
+        bool optimize_ir;
+        const char* optimization_flag;
+    };
+
+    constexpr compile_tier compile_tiers[] = {
+        { "baseline", false, "-O0" },
+        { "optimized", true, "-O2" }
+    };
+
+    /**
+     * Runs each kernel natively (the reference implementation) and in each compile tier, checks that the results agree,
+     * and reports the slowdown of each tier relative to native.
+     */
+    void bench_kernels(bench_runner& runner, const bench_options& options) {
+        for (const spiral_bench::kernel& kernel : spiral_bench::get_kernels()) {
+            const std::string prefix = std::string("kernel/") + kernel.name + "/";
+            const int64_t n = kernel.n * options.kernel_scale;
+            constexpr int64_t seed = 42;
+            const int64_t expected = kernel.reference(n, seed);
+            const bench_result* const native = runner.run(prefix + "native", [&] {
+                keep(kernel.reference(n, seed));
+            });
+            if (!options.native) continue;
+
+            const std::vector<spiral::byte> bytes = options.corpus.empty() ? kernel.build() : read_file(std::filesystem::path(options.corpus) / (std::string(kernel.name) + ".spiral"));
+            for (const compile_tier& tier : compile_tiers) {
+                const std::string name = prefix + tier.name;
+                if (!runner.is_enabled(name)) continue;
+                spiral::Module module = read_module(bytes);
+                if (tier.optimize_ir) {
+                    for (spiral::Code& code : module.get_codes()) spiral::propagate_constants(code, module.get_functions());
+                    spiral::inline_calls(module.get_codes(), module.get_functions());
+                }
+                spiral::aot_options aot;
+                std::replace(aot.flags.begin(), aot.flags.end(), std::string("-O2"), std::string(tier.optimization_flag));
+                const std::filesystem::path library = std::filesystem::temp_directory_path() / ("spiral_kernel_" + std::string(kernel.name) + "_" + tier.name + "_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".so");
+                spiral::aot_compile(module, library, aot);
+                auto compiled = std::make_shared<spiral::CompiledModule>(std::move(module));
+                spiral::aot_load(*compiled, library);
+                std::error_code ec;
+                std::filesystem::remove(library, ec); // the loaded shared object stays mapped
+                spiral::Instance instance(compiled, spiral::Linker(compiled->get_module()));
+                const auto run = instance.get_export<int64_t(int64_t, int64_t)>("run");
+                const int64_t actual = run(n, seed);
+                if (actual != expected) throw std::runtime_error("Kernel " + std::string(kernel.name) + " gives " + std::to_string(actual) + " in the " + tier.name + " tier, but the reference gives " + std::to_string(expected) + "!");
+                bench_result* const result = runner.run(name, [&] {
+                    keep(run(n, seed));
+                });
+                if (result != nullptr && native != nullptr) result->slowdown = result->median_ns / native->median_ns;
+            }
+        }
+    }
+
+}
+
+int main(int argc, char** argv) {
+    bench_options options;
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--functions") == 0 && has_value) {
+            options.functions = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--instructions") == 0 && has_value) {
+            options.instructions = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--records") == 0 && has_value) {
+            options.records = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--globals") == 0 && has_value) {
+            options.globals = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--min-time") == 0 && has_value) {
+            options.min_time = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--samples") == 0 && has_value) {
+            options.samples = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && has_value) {
+            options.filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--no-native") == 0) {
+            options.native = false;
+        }
+        else if (std::strcmp(argv[i], "--no-kernels") == 0) {
+            options.kernels = false;
+        }
+        else if (std::strcmp(argv[i], "--kernel-scale") == 0 && has_value) {
+            options.kernel_scale = std::max<int64_t>(std::strtoll(argv[++i], nullptr, 10), 1);
+        }
+        else if (std::strcmp(argv[i], "--corpus") == 0 && has_value) {
+            options.corpus = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--write-corpus") == 0 && has_value) {
+            try {
+                write_corpus(argv[++i]);
+            }
+            catch (const std::exception& e) {
+                std::cerr << argv[0] << ": " << e.what() << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && has_value) {
+            options.output = argv[++i];
+        }
+        else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    try {
+        const std::vector<spiral::byte> module = build_module(options).write();
+        bench_runner runner(options);
+        bench_varint(runner);
+        bench_compile(runner, options, module);
+        if (options.kernels) bench_kernels(runner, options);
+        if (options.output.empty()) {
+            runner.write_json(std::cout, module);
+        }
+        else {
+            std::ofstream file(options.output, std::ios::trunc);
+            runner.write_json(file, module);
+            if (!file) throw std::runtime_error("Cannot write " + options.output + "!");
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
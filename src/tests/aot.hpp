@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+
+/**
+ * Compiles a module with the system compiler and instantiates it, for tests of the generated code, and the fixtures
+ * shared by the tests that go through files.
+ */
+
+namespace spiral_tests {
+
+    /**
+     * A path in the temporary directory that no other test (or test run) uses.  Whatever is created there (a file or a
+     * directory tree) is removed when this goes out of scope, including when a check fails.
+     */
+    class temp_path {
+    public:
+        explicit temp_path(const std::string& suffix = {}) {
+            static std::atomic<uint64_t> counter{ 0 };
+            path = std::filesystem::temp_directory_path() / ("spiral_tests_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "_" + std::to_string(counter++) + suffix);
+        }
+        temp_path(const temp_path&) = delete;
+        temp_path& operator=(const temp_path&) = delete;
+        ~temp_path() {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+
+        const std::filesystem::path& get() const noexcept { return path; }
+
+    private:
+        std::filesystem::path path;
+    };
+
+    /**
+     * A module with one export "add" (i64) -> (i64) that adds the given constant.
+     */
+    inline spiral::Module make_adder(int64_t addend) {
+        using O = spiral::Operand;
+        const spiral::typeid_t i64(spiral::TypeIDs::I64);
+        spiral::ModuleBuilder builder;
+        const spiral::functionid_t functionid = builder.add_function({ i64 }, { i64 });
+        builder.add_export(functionid, "add");
+        spiral::CodeBuilder code = builder.begin_code(functionid, { i64 });
+        code.add(spiral::opcode_t::IMM, { O::reference(1), O::immediate(addend) });
+        code.add(spiral::opcode_t::ADD, { O::reference(-1), O::reference(1), O::reference(-2) });
+        builder.add_code(std::move(code));
+        return std::move(builder).build();
+    }
+
+    /**
+     * A module with an import "host" (i64) -> (i64) (function 1), and an export "call" (i64) -> (i64) that returns host of its input.
+     */
+    inline spiral::Module make_import_caller() {
+        using O = spiral::Operand;
+        const spiral::typeid_t i64(spiral::TypeIDs::I64);
+        spiral::ModuleBuilder builder;
+        const spiral::functionid_t host = builder.add_function({ i64 }, { i64 });
+        builder.add_import(host, "host");
+        const spiral::functionid_t call = builder.add_function({ i64 }, { i64 });
+        builder.add_export(call, "call");
+        spiral::CodeBuilder code = builder.begin_code(call);
+        code.add(spiral::opcode_t::CALL, { O::function(host), O::reference(-1), O::reference(-2) });
+        builder.add_code(std::move(code));
+        return std::move(builder).build();
+    }
+
+    inline std::shared_ptr<const spiral::CompiledModule> aot_compile_and_load(spiral::Module module) {
+        const temp_path library(".so"); // the loaded shared object stays mapped after it is removed
+        spiral::aot_compile(module, library.get());
+        auto compiled = std::make_shared<spiral::CompiledModule>(std::move(module));
+        spiral::aot_load(*compiled, library.get());
+        return compiled;
+    }
+
+    /**
+     * Compiles and loads a module without imports, and instantiates it.
+     */
+    inline spiral::Instance aot_instantiate(spiral::Module module) {
+        const std::shared_ptr<const spiral::CompiledModule> compiled = aot_compile_and_load(std::move(module));
+        const std::shared_ptr<const spiral::import_bindings> imports = spiral::Linker(compiled->get_module()).link();
+        return spiral::Instance(compiled, imports);
+    }
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * invoke_batch against calling the export once per row.
+ */
+
+namespace spiral_tests {
+
+    SPIRAL_TEST(invoke_batch_rows) {
+        using O = spiral::Operand;
+        const spiral::typeid_t i64(spiral::TypeIDs::I64);
+        spiral::ModuleBuilder builder;
+        const spiral::functionid_t functionid = builder.add_function({ i64, i64 }, { i64 });
+        builder.add_export(functionid, "sub");
+        spiral::CodeBuilder code = builder.begin_code(functionid);
+        code.add(spiral::opcode_t::SUB, { O::reference(-1), O::reference(-2), O::reference(-3) });
+        builder.add_code(std::move(code));
+        const spiral::Instance instance = aot_instantiate(std::move(builder).build());
+        const auto sub = instance.get_export<int64_t(int64_t, int64_t)>("sub");
+
+        std::vector<int64_t> a(10000), b(10000), results(10000);
+        for (size_t i = 0; i != a.size(); ++i) {
+            a[i] = static_cast<int64_t>(i * i);
+            b[i] = static_cast<int64_t>(i * 3);
+        }
+        spiral::invoke_batch(sub, { spiral::span<const int64_t>(a.data(), a.size()), spiral::span<const int64_t>(b.data(), b.size()) }, { spiral::span<int64_t>(results.data(), results.size()) }, 4);
+        for (size_t i = 0; i != a.size(); ++i) {
+            CHECK_EQ(results[i], sub(a[i], b[i]));
+        }
+        // columns of different lengths are rejected before any row runs
+        results.assign(results.size(), -1);
+        CHECK_THROWS(spiral::invoke_batch(sub, { spiral::span<const int64_t>(a.data(), a.size()), spiral::span<const int64_t>(b.data(), b.size() - 1) }, { spiral::span<int64_t>(results.data(), results.size()) }), std::invalid_argument);
+        CHECK_THROWS(spiral::invoke_batch(sub, { spiral::span<const int64_t>(a.data(), a.size()), spiral::span<const int64_t>(b.data(), b.size()) }, { spiral::span<int64_t>(results.data(), 1) }), std::invalid_argument);
+        CHECK_EQ(results[0], int64_t{ -1 });
+    }
+
+}
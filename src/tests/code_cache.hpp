@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Loading AOT-compiled modules through a code_cache.
+ */
+
+namespace spiral_tests {
+
+    namespace code_cache {
+
+        /**
+         * Loads the module through the cache, and returns whether it was a hit and the export applied to 1.
+         */
+        inline std::pair<bool, int64_t> load(spiral::code_cache& cache, spiral::Module module, const spiral::aot_options& options) {
+            auto compiled = std::make_shared<spiral::CompiledModule>(std::move(module));
+            const bool hit = spiral::aot_load_cached(*compiled, cache, options);
+            const spiral::Instance instance(compiled, spiral::Linker(compiled->get_module()).link());
+            return { hit, instance.get_export<int64_t(int64_t)>("add")(1) };
+        }
+    }
+
+    SPIRAL_TEST(aot_load_cached_skips_the_compiler) {
+        using namespace code_cache;
+        const temp_path directory;
+        spiral::code_cache cache(directory.get(), uint64_t{ 1 } << 30, "test compiler");
+        spiral::aot_options options;
+        CHECK(load(cache, make_adder(2), options) == std::make_pair(false, int64_t{ 3 }));
+        // a hit does not run the compiler at all
+        spiral::telemetry sink;
+        spiral::aot_options recorded = options;
+        recorded.sink = &sink;
+        CHECK(load(cache, make_adder(2), recorded) == std::make_pair(true, int64_t{ 3 }));
+        CHECK(sink.get_totals().count("native_compile") == 0);
+        CHECK(sink.get_totals().count("install") == 1);
+        // different contents, flags or compiler version are different entries
+        CHECK(load(cache, make_adder(5), options) == std::make_pair(false, int64_t{ 6 }));
+        spiral::aot_options debug = options;
+        debug.debug_info = true;
+        CHECK(load(cache, make_adder(2), debug).first == false);
+        spiral::code_cache other_version(directory.get(), uint64_t{ 1 } << 30, "other compiler");
+        CHECK(load(other_version, make_adder(2), options).first == false);
+    }
+
+}
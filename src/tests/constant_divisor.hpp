@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+#include "wide_arithmetic.hpp"
+
+/**
+ * constant_divisor and constant_divisor_ex against the hardware divide (exhaustively for 8 bits), and the constant
+ * divisions that the AOT backend emits with their magic numbers.
+ */
+
+namespace spiral_tests {
+
+    namespace constant_divisor {
+
+        template <typename T> struct wide_native;
+        template <> struct wide_native<int8_t> { using type = int16_t; };
+        template <> struct wide_native<uint8_t> { using type = uint16_t; };
+        template <> struct wide_native<int16_t> { using type = int32_t; };
+        template <> struct wide_native<uint16_t> { using type = uint32_t; };
+        template <> struct wide_native<int32_t> { using type = int64_t; };
+        template <> struct wide_native<uint32_t> { using type = uint64_t; };
+        template <> struct wide_native<int64_t> { using type = __int128; };
+        template <> struct wide_native<uint64_t> { using type = unsigned __int128; };
+        template <typename T> using wide_native_t = typename wide_native<T>::type;
+
+        /**
+         * The dividend type of divex/divuex on T, as passed to spiral (int128_t/uint128_t for 64-bit T).
+         */
+        template <typename T>
+        using wide_spiral_t = std::conditional_t<sizeof(T) == sizeof(uint64_t), std::conditional_t<std::is_signed_v<T>, spiral::int128_t, spiral::uint128_t>, wide_native_t<T>>;
+
+        template <typename T>
+        wide_spiral_t<T> to_spiral(wide_native_t<T> value) {
+            if constexpr (sizeof(T) == sizeof(uint64_t)) {
+                return wide_arithmetic::from_native(value);
+            }
+            else {
+                return value;
+            }
+        }
+
+        template <typename T>
+        bool fits(wide_native_t<T> value) {
+            return value >= std::numeric_limits<T>::min() && value <= std::numeric_limits<T>::max();
+        }
+
+        /**
+         * Random values of T, biased towards small magnitudes and including the extremes.
+         */
+        template <typename T>
+        std::vector<T> sample(std::mt19937_64& rng, size_t count) {
+            std::vector<T> ret = { 0, 1, 2, 3, 7, 10, std::numeric_limits<T>::max(), static_cast<T>(std::numeric_limits<T>::max() - 1), std::numeric_limits<T>::min(), static_cast<T>(std::numeric_limits<T>::min() + 1) };
+            if constexpr (std::is_signed_v<T>) {
+                for (const T value : { -1, -2, -3, -7, -10 }) ret.push_back(value);
+            }
+            while (ret.size() < count) {
+                ret.push_back(static_cast<T>(static_cast<int64_t>(rng()) >> (rng() % 64)));
+            }
+            return ret;
+        }
+
+        template <typename T>
+        bool overflows(T dividend, T divisor) {
+            return std::is_signed_v<T> && dividend == std::numeric_limits<T>::min() && divisor == static_cast<T>(-1);
+        }
+
+        /**
+         * The remainder of the division, or zero where it would overflow.
+         */
+        template <typename T>
+        T remainder(T dividend, T divisor) {
+            return overflows(dividend, divisor) ? 0 : static_cast<T>(dividend % divisor);
+        }
+
+        template <typename T>
+        void check_divide(T dividend, T divisor) {
+            if (overflows(dividend, divisor)) return;
+            const spiral::constant_divisor<T> d(divisor);
+            const spiral::divex_result<T> res = d.divide(dividend);
+            CHECK_EQ(res.quotient, static_cast<T>(dividend / divisor));
+            CHECK_EQ(res.remainder, static_cast<T>(dividend % divisor));
+        }
+
+        template <typename T>
+        void check_divide_ex(const spiral::constant_divisor_ex<T>& d, wide_native_t<T> dividend) {
+            const wide_native_t<T> divisor = d.get_divisor();
+            if (!fits<T>(dividend / divisor)) return;
+            const spiral::divex_result<T> res = d.divide(to_spiral<T>(dividend));
+            CHECK(res.quotient == static_cast<T>(dividend / divisor));
+            CHECK(res.remainder == static_cast<T>(dividend % divisor));
+        }
+
+        template <typename T>
+        void check_random(std::mt19937_64& rng) {
+            for (const T divisor : sample<T>(rng, 200)) {
+                if (divisor == 0) continue;
+                const spiral::constant_divisor_ex<T> ex(divisor);
+                for (const T dividend : sample<T>(rng, 500)) {
+                    check_divide<T>(dividend, divisor);
+                    // a dividend whose quotient fits, and one that is likely just out of range
+                    const T quotient = sample<T>(rng, 11).back();
+                    const wide_native_t<T> product = static_cast<wide_native_t<T>>(quotient) * divisor;
+                    check_divide_ex<T>(ex, product + remainder(dividend, divisor));
+                    check_divide_ex<T>(ex, static_cast<wide_native_t<T>>(dividend) * (static_cast<wide_native_t<T>>(1) << (sizeof(T) * 8 - 1)));
+                }
+            }
+        }
+
+        template <typename T>
+        constexpr spiral::typeid_underlying_t type_of() {
+            switch (sizeof(T)) {
+            case 1: return spiral::TypeIDs::I8;
+            case 2: return spiral::TypeIDs::I16;
+            case 4: return spiral::TypeIDs::I32;
+            default: return spiral::TypeIDs::I64;
+            }
+        }
+
+        /**
+         * Adds an export (T or the wide dividend) -> (T quotient, T remainder) that divides by the given constant.
+         */
+        template <typename T>
+        std::string add_constant_divide(spiral::ModuleBuilder& module, bool extended, T divisor) {
+            using O = spiral::Operand;
+            const spiral::typeid_t narrow(type_of<T>());
+            const spiral::typeid_t dividend(extended ? type_of<T>() - 1 : type_of<T>());
+            const spiral::functionid_t functionid = module.add_function({ dividend }, { narrow, narrow });
+            const std::string name = "f" + std::to_string(functionid);
+            module.add_export(functionid, name);
+            spiral::CodeBuilder code = module.begin_code(functionid, { narrow });
+            code.add(spiral::opcode_t::IMM, { O::reference(1), O::immediate(static_cast<int64_t>(static_cast<std::make_signed_t<T>>(divisor))) });
+            const spiral::opcode_t opcode = std::is_signed_v<T> ? (extended ? spiral::opcode_t::DIVEX : spiral::opcode_t::DIV) : (extended ? spiral::opcode_t::DIVUEX : spiral::opcode_t::DIVU);
+            code.add(opcode, { O::reference(-1), O::reference(1), O::reference(-2), O::reference(-3) });
+            module.add_code(std::move(code));
+            return name;
+        }
+
+        template <typename T>
+        struct compiled_divides {
+            std::vector<T> divisors;
+            std::vector<std::string> divides;
+            std::vector<std::string> extended_divides;
+        };
+
+        template <typename T>
+        compiled_divides<T> add_constant_divides(spiral::ModuleBuilder& module, std::mt19937_64& rng) {
+            compiled_divides<T> ret;
+            for (const T divisor : sample<T>(rng, 24)) {
+                if (divisor == 0) continue;
+                ret.divisors.push_back(divisor);
+                ret.divides.push_back(add_constant_divide<T>(module, false, divisor));
+                ret.extended_divides.push_back(add_constant_divide<T>(module, true, divisor));
+            }
+            return ret;
+        }
+
+        template <typename T>
+        void check_constant_divides(const spiral::Instance& instance, const compiled_divides<T>& divides, std::mt19937_64& rng) {
+            for (size_t i = 0; i != divides.divisors.size(); ++i) {
+                const T divisor = divides.divisors[i];
+                const auto divide = instance.get_export<std::tuple<T, T>(T)>(divides.divides[i]);
+                const auto divide_ex = instance.get_export<std::tuple<T, T>(wide_spiral_t<T>)>(divides.extended_divides[i]);
+                for (const T dividend : sample<T>(rng, 200)) {
+                    if (!overflows(dividend, divisor)) {
+                        CHECK(divide(dividend) == std::make_tuple(static_cast<T>(dividend / divisor), static_cast<T>(dividend % divisor)));
+                    }
+                    const wide_native_t<T> wide = static_cast<wide_native_t<T>>(dividend) * divisor + remainder(sample<T>(rng, 11).back(), divisor);
+                    if (fits<T>(wide / divisor)) {
+                        CHECK(divide_ex(to_spiral<T>(wide)) == std::make_tuple(static_cast<T>(wide / divisor), static_cast<T>(wide % divisor)));
+                    }
+                }
+            }
+        }
+    }
+
+    SPIRAL_TEST(constant_divisor_8bit_exhaustive) {
+        using namespace constant_divisor;
+        for (int divisor = -128; divisor != 128; ++divisor) {
+            if (divisor == 0) continue;
+            const spiral::constant_divisor_ex<int8_t> ex(static_cast<int8_t>(divisor));
+            for (int dividend = -128; dividend != 128; ++dividend) {
+                check_divide<int8_t>(static_cast<int8_t>(dividend), static_cast<int8_t>(divisor));
+            }
+            for (int dividend = -32768; dividend != 32768; ++dividend) {
+                check_divide_ex<int8_t>(ex, static_cast<int16_t>(dividend));
+            }
+        }
+        for (int divisor = 1; divisor != 256; ++divisor) {
+            const spiral::constant_divisor_ex<uint8_t> ex(static_cast<uint8_t>(divisor));
+            for (int dividend = 0; dividend != 256; ++dividend) {
+                check_divide<uint8_t>(static_cast<uint8_t>(dividend), static_cast<uint8_t>(divisor));
+            }
+            for (int dividend = 0; dividend != 65536; ++dividend) {
+                check_divide_ex<uint8_t>(ex, static_cast<uint16_t>(dividend));
+            }
+        }
+    }
+
+    SPIRAL_TEST(constant_divisor_random_wider) {
+        using namespace constant_divisor;
+        std::mt19937_64 rng(4);
+        check_random<int16_t>(rng);
+        check_random<uint16_t>(rng);
+        check_random<int32_t>(rng);
+        check_random<uint32_t>(rng);
+        check_random<int64_t>(rng);
+        check_random<uint64_t>(rng);
+    }
+
+    SPIRAL_TEST(constant_divisor_aot) {
+        using namespace constant_divisor;
+        std::mt19937_64 rng(5);
+        spiral::ModuleBuilder builder;
+        const auto i8 = add_constant_divides<int8_t>(builder, rng);
+        const auto u8 = add_constant_divides<uint8_t>(builder, rng);
+        const auto i16 = add_constant_divides<int16_t>(builder, rng);
+        const auto u16 = add_constant_divides<uint16_t>(builder, rng);
+        const auto i32 = add_constant_divides<int32_t>(builder, rng);
+        const auto u32 = add_constant_divides<uint32_t>(builder, rng);
+        const auto i64 = add_constant_divides<int64_t>(builder, rng);
+        const auto u64 = add_constant_divides<uint64_t>(builder, rng);
+        spiral::Module module = std::move(builder).build();
+        // every divisor is a constant, so no division is left for the hardware
+        const std::string source = spiral::emit_cpp(module);
+        CHECK(source.find("a / b") == std::string::npos);
+        CHECK(source.find("a % b") == std::string::npos);
+        const spiral::Instance instance = aot_instantiate(std::move(module));
+        check_constant_divides(instance, i8, rng);
+        check_constant_divides(instance, u8, rng);
+        check_constant_divides(instance, i16, rng);
+        check_constant_divides(instance, u16, rng);
+        check_constant_divides(instance, i32, rng);
+        check_constant_divides(instance, u32, rng);
+        check_constant_divides(instance, i64, rng);
+        check_constant_divides(instance, u64, rng);
+    }
+
+}
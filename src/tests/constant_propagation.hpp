@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Folding by propagate_constants, checked against the compiled module without folding.
+ */
+
+namespace spiral_tests {
+
+    namespace constant_propagation {
+
+        /**
+         * A function (i32 condition) -> (i32) that only runs divex of the given constants (and doubles the quotient) if the condition is nonzero.
+         */
+        inline spiral::Module guarded_divex(int64_t dividend, int32_t divisor) {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i32(spiral::TypeIDs::I32), i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            const spiral::functionid_t functionid = builder.add_function({ i32 }, { i32 });
+            spiral::CodeBuilder code = builder.begin_code(functionid, { i64, i32, i32 });
+            const size_t skip = code.new_label();
+            code.add(Op::IMM, { O::reference(-2), O::immediate(0) });
+            code.add(Op::IMM, { O::reference(1), O::immediate(dividend) });
+            code.add(Op::IMM, { O::reference(2), O::immediate(divisor) });
+            code.add(Op::JZ, { O::label(skip), O::reference(-1) });
+            code.add(Op::DIVEX, { O::reference(1), O::reference(2), O::reference(3), O::unused() });
+            code.add(Op::ADD, { O::reference(3), O::reference(3), O::reference(-2) });
+            code.bind(skip);
+            code.add(Op::COPY, { O::reference(-2), O::reference(-2) });
+            builder.add_code(std::move(code));
+            return std::move(builder).build();
+        }
+
+        inline bool has_opcode(const spiral::Code& code, spiral::opcode_t opcode) {
+            return std::any_of(code.get_instructions().begin(), code.get_instructions().end(), [opcode](const spiral::Instruction& instruction) { return instruction.get_opcode() == opcode; });
+        }
+
+        inline bool has_divex(const spiral::Code& code) {
+            return has_opcode(code, spiral::opcode_t::DIVEX);
+        }
+
+        inline spiral::constant_propagation_result propagate_all(spiral::Module& module) {
+            spiral::constant_propagation_result ret;
+            for (spiral::Code& code : module.get_codes()) {
+                const spiral::constant_propagation_result result = spiral::propagate_constants(code, module.get_functions());
+                ret.instructions_folded += result.instructions_folded;
+                ret.instructions_removed += result.instructions_removed;
+                ret.blocks_removed += result.blocks_removed;
+            }
+            return ret;
+        }
+
+        /**
+         * An export "branches" (i64 x) -> (i64) that computes 5x, around a jz that is never taken, a jnz that is always
+         * taken, the two blocks that only those make reachable, and a loop whose backward jump crosses the removed instructions.
+         */
+        inline spiral::Module make_branches() {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            const spiral::functionid_t functionid = builder.add_function({ i64 }, { i64 });
+            builder.add_export(functionid, "branches");
+            // 1: one, 2: loop counter, 3: three, 4: whether the counter is below three
+            spiral::CodeBuilder code = builder.begin_code(functionid, { i64, i64, i64, i64 });
+            const size_t dead = code.new_label();
+            const size_t live = code.new_label();
+            code.add(Op::IMM, { O::reference(1), O::immediate(1) });
+            code.add(Op::IMM, { O::reference(3), O::immediate(3) });
+            code.add(Op::JZ, { O::label(dead), O::reference(1) });
+            code.add(Op::ADD, { O::reference(-1), O::reference(-1), O::reference(-2) });
+            code.add(Op::JNZ, { O::label(live), O::reference(1) });
+            code.add(Op::IMM, { O::reference(-2), O::immediate(99) });
+            code.bind(dead);
+            code.add(Op::IMM, { O::reference(-2), O::immediate(77) });
+            code.bind(live);
+            code.add(Op::ADD, { O::reference(-2), O::reference(-1), O::reference(-2) });
+            code.add(Op::ADD, { O::reference(2), O::reference(1), O::reference(2) });
+            code.add(Op::SLT, { O::reference(2), O::reference(3), O::reference(4) });
+            code.add(Op::JNZ, { O::label(live), O::reference(4) });
+            builder.add_code(std::move(code));
+            return std::move(builder).build();
+        }
+
+        template <typename T>
+        using wraparound_results = std::tuple<T, T, T, T, T, int64_t, int64_t>;
+
+        /**
+         * Adds an export () -> (max + 1, max * max, 1 << (width - 1), min >> 1 (arithmetic), a truncated i64 constant,
+         * min sign-extended to i64, min zero-extended to i64) on T, where every instruction can be folded.
+         */
+        template <typename T>
+        std::string add_wraparound(spiral::ModuleBuilder& builder, spiral::typeid_underlying_t type) {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t t(type), i64(spiral::TypeIDs::I64);
+            const spiral::functionid_t functionid = builder.add_function({}, { t, t, t, t, t, i64, i64 });
+            const std::string name = "wraparound" + std::to_string(sizeof(T) * 8);
+            builder.add_export(functionid, name);
+            // 1: max, 2: one, 3: width - 1, 4: min, 5: an i64 constant
+            spiral::CodeBuilder code = builder.begin_code(functionid, { t, t, t, t, i64 });
+            code.add(Op::IMM, { O::reference(1), O::immediate(static_cast<int64_t>(std::numeric_limits<T>::max())) });
+            code.add(Op::IMM, { O::reference(2), O::immediate(1) });
+            code.add(Op::IMM, { O::reference(3), O::immediate(static_cast<int64_t>(sizeof(T) * 8 - 1)) });
+            code.add(Op::IMM, { O::reference(4), O::immediate(static_cast<int64_t>(std::numeric_limits<T>::min())) });
+            code.add(Op::IMM, { O::reference(5), O::immediate(int64_t{ 0x123456789abcdef0 }) });
+            code.add(Op::ADD, { O::reference(1), O::reference(2), O::reference(-1) });
+            code.add(Op::MUL, { O::reference(1), O::reference(1), O::reference(-2) });
+            code.add(Op::SLL, { O::reference(2), O::reference(3), O::reference(-3) });
+            code.add(Op::SRA, { O::reference(4), O::reference(2), O::reference(-4) });
+            code.add(Op::CONV, { O::reference(5), O::reference(-5) });
+            code.add(Op::CONV, { O::reference(4), O::reference(-6) });
+            code.add(Op::CONVU, { O::reference(4), O::reference(-7) });
+            builder.add_code(std::move(code));
+            return name;
+        }
+
+        inline spiral::Module make_wraparound() {
+            spiral::ModuleBuilder builder;
+            add_wraparound<int8_t>(builder, spiral::TypeIDs::I8);
+            add_wraparound<int16_t>(builder, spiral::TypeIDs::I16);
+            add_wraparound<int32_t>(builder, spiral::TypeIDs::I32);
+            add_wraparound<int64_t>(builder, spiral::TypeIDs::I64);
+            return std::move(builder).build();
+        }
+
+        template <typename T>
+        void check_wraparound(const spiral::Instance& folded, const spiral::Instance& original) {
+            const std::string name = "wraparound" + std::to_string(sizeof(T) * 8);
+            const wraparound_results<T> results = folded.get_export<wraparound_results<T>()>(name)();
+            CHECK(results == original.get_export<wraparound_results<T>()>(name)());
+            CHECK_EQ(std::get<0>(results), std::numeric_limits<T>::min());
+            CHECK_EQ(std::get<2>(results), std::numeric_limits<T>::min());
+            CHECK_EQ(std::get<3>(results), static_cast<T>(std::numeric_limits<T>::min() / 2));
+            CHECK_EQ(std::get<4>(results), static_cast<T>(int64_t{ 0x123456789abcdef0 }));
+            CHECK_EQ(std::get<5>(results), static_cast<int64_t>(std::numeric_limits<T>::min()));
+            CHECK_EQ(std::get<6>(results), static_cast<int64_t>(static_cast<std::make_unsigned_t<T>>(std::numeric_limits<T>::min())));
+        }
+
+        /**
+         * A function () -> (i32, i32, i32) that shifts -8 left, right and right arithmetically by the given amount.
+         */
+        inline spiral::Module make_shifts(int64_t shamt) {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i32(spiral::TypeIDs::I32);
+            spiral::ModuleBuilder builder;
+            const spiral::functionid_t functionid = builder.add_function({}, { i32, i32, i32 });
+            spiral::CodeBuilder code = builder.begin_code(functionid, { i32, i32 });
+            code.add(Op::IMM, { O::reference(1), O::immediate(shamt) });
+            code.add(Op::IMM, { O::reference(2), O::immediate(-8) });
+            code.add(Op::SLL, { O::reference(2), O::reference(1), O::reference(-1) });
+            code.add(Op::SRL, { O::reference(2), O::reference(1), O::reference(-2) });
+            code.add(Op::SRA, { O::reference(2), O::reference(1), O::reference(-3) });
+            builder.add_code(std::move(code));
+            return std::move(builder).build();
+        }
+    }
+
+    SPIRAL_TEST(constant_propagation_divex_overflow_is_not_folded) {
+        using namespace constant_propagation;
+        spiral::Module module = guarded_divex(std::numeric_limits<int64_t>::min(), -1);
+        spiral::Code& code = module.get_codes()[0];
+        CHECK(spiral::find_constant_divisors(code, module.get_functions())[4].has_value());
+        CHECK_EQ(spiral::propagate_constants(code, module.get_functions()).instructions_folded, size_t{ 0 });
+        CHECK(has_divex(code));
+        // a quotient that is one past the largest i32 does not fit either
+        spiral::Module past_max = guarded_divex(int64_t{ std::numeric_limits<int32_t>::max() } + 1, 1);
+        CHECK_EQ(spiral::propagate_constants(past_max.get_codes()[0], past_max.get_functions()).instructions_folded, size_t{ 0 });
+        CHECK(has_divex(past_max.get_codes()[0]));
+    }
+
+    SPIRAL_TEST(constant_propagation_divex_folds) {
+        using namespace constant_propagation;
+        spiral::Module module = guarded_divex(std::numeric_limits<int32_t>::min(), -2);
+        // the quotient (2^30) is known, so the add of it is folded
+        CHECK_EQ(spiral::propagate_constants(module.get_codes()[0], module.get_functions()).instructions_folded, size_t{ 1 });
+    }
+
+    SPIRAL_TEST(constant_propagation_folds_branches_and_removes_blocks) {
+        using namespace constant_propagation;
+        using Op = spiral::opcode_t;
+        spiral::Module module = make_branches();
+        const spiral::constant_propagation_result result = propagate_all(module);
+        // the jnz becomes a jmp, the jz is dropped with the two blocks that only it and the jnz's fallthrough reach
+        CHECK_EQ(result.instructions_folded, size_t{ 1 });
+        CHECK_EQ(result.blocks_removed, size_t{ 2 });
+        CHECK_EQ(result.instructions_removed, size_t{ 3 });
+        const std::vector<spiral::Instruction>& instructions = module.get_codes()[0].get_instructions();
+        CHECK_EQ(instructions.size(), size_t{ 8 });
+        CHECK(!has_opcode(module.get_codes()[0], Op::JZ));
+        CHECK(instructions[3].get_opcode() == Op::JMP);
+        CHECK(instructions[7].get_opcode() == Op::JNZ);
+        // both jumps go to the first instruction of the loop, which moved from 7 to 4
+        for (const size_t i : { size_t{ 3 }, size_t{ 7 } }) {
+            instructions[i].get_params([&](const auto& params) {
+                using params_type = std::decay_t<decltype(params)>;
+                if constexpr (std::is_same_v<params_type, spiral::InstructionParamTypes::Jump> || std::is_same_v<params_type, spiral::InstructionParamTypes::JumpConditional>) {
+                    CHECK_EQ(params.target, spiral::instructionid_t{ 4 });
+                }
+            });
+        }
+        const spiral::Instance folded = aot_instantiate(std::move(module));
+        const spiral::Instance original = aot_instantiate(make_branches());
+        for (const int64_t x : { int64_t{ 0 }, int64_t{ 1 }, int64_t{ -7 }, int64_t{ 1000 } }) {
+            CHECK_EQ(folded.get_export<int64_t(int64_t)>("branches")(x), original.get_export<int64_t(int64_t)>("branches")(x));
+            CHECK_EQ(folded.get_export<int64_t(int64_t)>("branches")(x), 5 * x);
+        }
+    }
+
+    SPIRAL_TEST(constant_propagation_wraps_around_per_width) {
+        using namespace constant_propagation;
+        spiral::Module module = make_wraparound();
+        // add, mul, sll, sra and the three conversions of each width
+        CHECK_EQ(propagate_all(module).instructions_folded, size_t{ 4 * 7 });
+        for (const spiral::Code& code : module.get_codes()) {
+            for (const spiral::Instruction& instruction : code.get_instructions()) {
+                CHECK(instruction.get_opcode() == spiral::opcode_t::IMM);
+            }
+        }
+        const spiral::Instance folded = aot_instantiate(std::move(module));
+        const spiral::Instance original = aot_instantiate(make_wraparound());
+        check_wraparound<int8_t>(folded, original);
+        check_wraparound<int16_t>(folded, original);
+        check_wraparound<int32_t>(folded, original);
+        check_wraparound<int64_t>(folded, original);
+    }
+
+    SPIRAL_TEST(constant_propagation_leaves_oversized_shifts) {
+        using namespace constant_propagation;
+        for (const int64_t shamt : { int64_t{ 32 }, int64_t{ 33 }, int64_t{ -1 } }) {
+            spiral::Module module = make_shifts(shamt);
+            CHECK_EQ(propagate_all(module).instructions_folded, size_t{ 0 });
+            CHECK(has_opcode(module.get_codes()[0], spiral::opcode_t::SLL));
+            CHECK(has_opcode(module.get_codes()[0], spiral::opcode_t::SRL));
+            CHECK(has_opcode(module.get_codes()[0], spiral::opcode_t::SRA));
+        }
+        // one less than the width is folded
+        spiral::Module module = make_shifts(31);
+        CHECK_EQ(propagate_all(module).instructions_folded, size_t{ 3 });
+    }
+
+}
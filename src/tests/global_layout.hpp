@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Placement of globals in the global block, and access to them from the host.
+ */
+
+namespace spiral_tests {
+
+    namespace global_layout {
+
+        /**
+         * Globals of every width, hot and cold, some of them shared.
+         */
+        inline std::vector<spiral::Global> make_globals() {
+            using F = uint32_t;
+            const F hot = spiral::GlobalFlags::Hot, shared = spiral::GlobalFlags::Shared;
+            return {
+                { spiral::TypeIDs::I8, 0 },
+                { spiral::TypeIDs::I64, hot },
+                { spiral::TypeIDs::I32, hot },
+                { spiral::TypeIDs::I128, 0 },
+                { spiral::TypeIDs::I16, hot },
+                { spiral::TypeIDs::F32, shared },
+                { spiral::TypeIDs::I64, hot | shared },
+                { spiral::TypeIDs::I8, hot },
+                { spiral::TypeIDs::F64, 0 },
+                { spiral::TypeIDs::I128, shared },
+                { spiral::TypeIDs::I16, 0 },
+                { spiral::TypeIDs::I128, hot }
+            };
+        }
+
+        inline size_t width_of(const spiral::Global& global) {
+            return spiral::primitive_width(global.get_type()) / 8;
+        }
+    }
+
+    SPIRAL_TEST(global_layout_orders_and_separates_globals) {
+        using namespace global_layout;
+        const std::vector<spiral::Global> globals = make_globals();
+        const spiral::global_layout layout(globals);
+        constexpr size_t line = spiral::global_cache_line_size;
+        std::vector<spiral::globalid_t> hot, cold, shared;
+        for (spiral::globalid_t globalid = 1; globalid <= globals.size(); ++globalid) {
+            const spiral::Global& global = globals[globalid - 1];
+            (global.is_shared() ? shared : global.is_hot() ? hot : cold).push_back(globalid);
+            CHECK_EQ(layout.get_offset(globalid) % width_of(global), size_t{ 0 });
+            CHECK(layout.get_offset(globalid) + width_of(global) <= layout.get_size());
+        }
+        const auto by_offset = [&](spiral::globalid_t a, spiral::globalid_t b) { return layout.get_offset(a) < layout.get_offset(b); };
+        for (std::vector<spiral::globalid_t>* group : { &hot, &cold }) {
+            std::sort(group->begin(), group->end(), by_offset);
+            for (size_t i = 1; i < group->size(); ++i) {
+                const spiral::Global& prev = globals[(*group)[i - 1] - 1];
+                // decreasing alignment, so without padding
+                CHECK(width_of(prev) >= width_of(globals[(*group)[i] - 1]));
+                CHECK_EQ(layout.get_offset((*group)[i]), layout.get_offset((*group)[i - 1]) + width_of(prev));
+            }
+        }
+        CHECK_EQ(layout.get_offset(hot.front()), size_t{ 0 });
+        // the cold globals follow, after padding to the alignment of the widest
+        const size_t hot_end = layout.get_offset(hot.back()) + width_of(globals[hot.back() - 1]);
+        CHECK(layout.get_offset(cold.front()) >= hot_end);
+        CHECK(layout.get_offset(cold.front()) < hot_end + width_of(globals[cold.front() - 1]));
+        // every shared global starts a cache line that no other global touches
+        std::sort(shared.begin(), shared.end(), by_offset);
+        for (const spiral::globalid_t globalid : shared) {
+            const size_t start = layout.get_offset(globalid);
+            CHECK_EQ(start % line, size_t{ 0 });
+            CHECK(start >= layout.get_offset(cold.back()) + width_of(globals[cold.back() - 1]));
+            for (spiral::globalid_t other = 1; other <= globals.size(); ++other) {
+                if (other == globalid) continue;
+                const size_t other_start = layout.get_offset(other);
+                CHECK(other_start + width_of(globals[other - 1]) <= start || other_start >= start + line);
+            }
+        }
+        // one line for each shared global after the others, rounded up to whole lines
+        CHECK_EQ(layout.get_size() % line, size_t{ 0 });
+        CHECK_EQ(layout.get_size(), layout.get_offset(shared.back()) + line);
+        CHECK_EQ(layout.get_offset(shared.front()), (layout.get_offset(cold.back()) + width_of(globals[cold.back() - 1]) + line - 1) / line * line);
+        CHECK_EQ(spiral::global_layout(std::vector<spiral::Global>{ { spiral::TypeIDs::I8, 0 } }).get_size(), line);
+        CHECK_EQ(spiral::global_layout(std::vector<spiral::Global>{}).get_size(), size_t{ 0 });
+    }
+
+    SPIRAL_TEST(instance_get_global_checks_id_and_type) {
+        using namespace global_layout;
+        using O = spiral::Operand;
+        const spiral::typeid_t i16(spiral::TypeIDs::I16), i64(spiral::TypeIDs::I64);
+        const std::vector<spiral::Global> globals = make_globals();
+        spiral::ModuleBuilder builder;
+        for (const spiral::Global& global : globals) builder.add_global(global.get_type(), global.get_flags());
+        // "set" stores to the shared hot i64 (7), "get" loads the cold i16 (11)
+        const spiral::functionid_t set = builder.add_function({ i64 }, {});
+        builder.add_export(set, "set");
+        spiral::CodeBuilder set_code = builder.begin_code(set);
+        set_code.add(spiral::opcode_t::GSET, { O::global(7), O::reference(-1) });
+        builder.add_code(std::move(set_code));
+        const spiral::functionid_t get = builder.add_function({}, { i16 });
+        builder.add_export(get, "get");
+        spiral::CodeBuilder get_code = builder.begin_code(get);
+        get_code.add(spiral::opcode_t::GGET, { O::global(11), O::reference(-1) });
+        builder.add_code(std::move(get_code));
+        const spiral::Instance instance = aot_instantiate(std::move(builder).build());
+
+        instance.get_export<void(int64_t)>("set")(-123456789);
+        CHECK_EQ(instance.get_global<int64_t>(7), int64_t{ -123456789 });
+        instance.get_global<int16_t>(11) = 4321;
+        CHECK_EQ(instance.get_export<int16_t()>("get")(), int16_t{ 4321 });
+        // the neighbours of both are untouched
+        CHECK_EQ(instance.get_global<int16_t>(5), int16_t{ 0 });
+        CHECK_EQ(instance.get_global<double>(9), 0.0);
+
+        CHECK_THROWS(instance.get_global<int32_t>(7), spiral::link_exception);
+        CHECK_THROWS(instance.get_global<uint64_t>(9), spiral::link_exception);
+        CHECK_THROWS(instance.get_global<float>(3), spiral::link_exception);
+        CHECK_THROWS(instance.get_global<int64_t>(0), spiral::link_exception);
+        CHECK_THROWS(instance.get_global<int8_t>(globals.size() + 1), spiral::link_exception);
+    }
+
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Inlining by inline_calls, checked against the compiled module without inlining.
+ */
+
+namespace spiral_tests {
+
+    namespace inliner {
+
+        constexpr size_t bounded_size = 6;
+        constexpr size_t bounded_locals = 4;
+
+        /**
+         * A module with:
+         * 1: bounded (x) -> (y), which is 0 if x < 0 (by jumping to its end, past the last instruction) and otherwise 2x + 1,
+         *    through a local that must start at zero;
+         * 2: export "hot" (n) -> (s), the sum of bounded(i - 3) over i in [0, n), so its call site is in a loop;
+         * 3: export "cold" (x) -> (y), which is bounded(x), plus bounded of that if x is nonzero (jumping over the second call otherwise).
+         */
+        inline spiral::Module make_module() {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+
+            const spiral::functionid_t bounded = builder.add_function({ i64 }, { i64 });
+            // 1: accumulator, 2: zero, 3: whether x < 0, 4: one
+            spiral::CodeBuilder bounded_code = builder.begin_code(bounded, { i64, i64, i64, i64 });
+            const size_t ret = bounded_code.new_label();
+            bounded_code.add(Op::IMM, { O::reference(4), O::immediate(1) });
+            bounded_code.add(Op::SLT, { O::reference(-1), O::reference(2), O::reference(3) });
+            bounded_code.add(Op::JNZ, { O::label(ret), O::reference(3) });
+            bounded_code.add(Op::ADD, { O::reference(1), O::reference(-1), O::reference(1) });
+            bounded_code.add(Op::ADD, { O::reference(1), O::reference(1), O::reference(-2) });
+            bounded_code.add(Op::ADD, { O::reference(-2), O::reference(4), O::reference(-2) });
+            bounded_code.bind(ret);
+            builder.add_code(std::move(bounded_code));
+
+            const spiral::functionid_t hot = builder.add_function({ i64 }, { i64 });
+            builder.add_export(hot, "hot");
+            // 1: i, 2: one, 3: whether i < n, 4: argument and result of bounded, 5: three
+            spiral::CodeBuilder hot_code = builder.begin_code(hot, { i64, i64, i64, i64, i64 });
+            const size_t loop = hot_code.new_label();
+            const size_t end = hot_code.new_label();
+            hot_code.add(Op::IMM, { O::reference(2), O::immediate(1) });
+            hot_code.add(Op::IMM, { O::reference(5), O::immediate(3) });
+            hot_code.bind(loop);
+            hot_code.add(Op::SLT, { O::reference(1), O::reference(-1), O::reference(3) });
+            hot_code.add(Op::JZ, { O::label(end), O::reference(3) });
+            hot_code.add(Op::SUB, { O::reference(1), O::reference(5), O::reference(4) });
+            hot_code.add(Op::CALL, { O::function(bounded), O::reference(4), O::reference(4) });
+            hot_code.add(Op::ADD, { O::reference(-2), O::reference(4), O::reference(-2) });
+            hot_code.add(Op::ADD, { O::reference(1), O::reference(2), O::reference(1) });
+            hot_code.add(Op::JMP, { O::label(loop) });
+            hot_code.bind(end);
+            builder.add_code(std::move(hot_code));
+
+            const spiral::functionid_t cold = builder.add_function({ i64 }, { i64 });
+            builder.add_export(cold, "cold");
+            spiral::CodeBuilder cold_code = builder.begin_code(cold, { i64 });
+            const size_t skip = cold_code.new_label();
+            cold_code.add(Op::CALL, { O::function(bounded), O::reference(-1), O::reference(-2) });
+            cold_code.add(Op::JZ, { O::label(skip), O::reference(-1) });
+            cold_code.add(Op::CALL, { O::function(bounded), O::reference(-2), O::reference(1) });
+            cold_code.add(Op::ADD, { O::reference(-2), O::reference(1), O::reference(-2) });
+            cold_code.bind(skip);
+            builder.add_code(std::move(cold_code));
+            return std::move(builder).build();
+        }
+
+        inline size_t count_calls(const spiral::Code& code) {
+            return static_cast<size_t>(std::count_if(code.get_instructions().begin(), code.get_instructions().end(), [](const spiral::Instruction& instruction) { return instruction.get_opcode() == spiral::opcode_t::CALL; }));
+        }
+
+        /**
+         * Inlines with the given options, checks the calls left in hot and cold, and compares the compiled exports with the module without inlining.
+         */
+        inline spiral::inliner_result check_inlined(const spiral::inliner_options& options, size_t hot_calls, size_t cold_calls) {
+            spiral::Module module = make_module();
+            const spiral::inliner_result result = spiral::inline_calls(module.get_codes(), module.get_functions(), options);
+            CHECK_EQ(count_calls(module.get_codes()[1]), hot_calls);
+            CHECK_EQ(count_calls(module.get_codes()[2]), cold_calls);
+            const spiral::Instance inlined = aot_instantiate(std::move(module));
+            const spiral::Instance original = aot_instantiate(make_module());
+            for (int64_t x = -4; x != 12; ++x) {
+                CHECK_EQ(inlined.get_export<int64_t(int64_t)>("hot")(x), original.get_export<int64_t(int64_t)>("hot")(x));
+                CHECK_EQ(inlined.get_export<int64_t(int64_t)>("cold")(x), original.get_export<int64_t(int64_t)>("cold")(x));
+            }
+            return result;
+        }
+    }
+
+    SPIRAL_TEST(inline_calls_matches_the_original) {
+        using namespace inliner;
+        // the hot site re-initializes bounded's output and locals, since a previous iteration left them nonzero
+        const spiral::inliner_result result = check_inlined({}, 0, 0);
+        CHECK_EQ(result.calls_inlined, size_t{ 3 });
+        const size_t cold_added = 1 + bounded_size + 1 - 1; // input copy, body, output move, less the call
+        const size_t hot_added = cold_added + 1 + bounded_locals; // and the reset of the output and the locals
+        CHECK_EQ(result.instructions_added, hot_added + 2 * cold_added);
+        // the reference values, so that the comparison does not only pin a bug that both sides share
+        const spiral::Instance original = aot_instantiate(make_module());
+        CHECK_EQ(original.get_export<int64_t(int64_t)>("hot")(6), int64_t{ 0 + 0 + 0 + 1 + 3 + 5 });
+        CHECK_EQ(original.get_export<int64_t(int64_t)>("cold")(3), int64_t{ 7 + 15 });
+        CHECK_EQ(original.get_export<int64_t(int64_t)>("cold")(-3), int64_t{ 0 + 1 });
+    }
+
+    SPIRAL_TEST(inline_calls_respects_the_limits) {
+        using namespace inliner;
+        spiral::inliner_options options;
+        // too large for the cold sites, but not for the hot one
+        options.max_callee_size = bounded_size - 1;
+        CHECK_EQ(check_inlined(options, 0, 2).calls_inlined, size_t{ 1 });
+        options = {};
+        options.max_hot_callee_size = bounded_size - 1;
+        CHECK_EQ(check_inlined(options, 1, 0).calls_inlined, size_t{ 2 });
+        // enough for one cold site (7 instructions), but not for the hot one (12) or both cold ones
+        options = {};
+        options.module_budget = 7;
+        const spiral::inliner_result budgeted = check_inlined(options, 1, 1);
+        CHECK_EQ(budgeted.calls_inlined, size_t{ 1 });
+        CHECK_EQ(budgeted.instructions_added, size_t{ 7 });
+        options.module_budget = 6;
+        CHECK_EQ(check_inlined(options, 1, 2).calls_inlined, size_t{ 0 });
+    }
+
+    SPIRAL_TEST(inline_calls_refuses_recursion_imports_and_records) {
+        using O = spiral::Operand;
+        using Op = spiral::opcode_t;
+        const spiral::typeid_t i64(spiral::TypeIDs::I64);
+        spiral::ModuleBuilder builder;
+        const spiral::typeid_t record(static_cast<spiral::typeid_underlying_t>(builder.add_record({ i64 })));
+
+        const spiral::functionid_t recursive = builder.add_function({ i64 }, { i64 });
+        spiral::CodeBuilder recursive_code = builder.begin_code(recursive);
+        const size_t ret = recursive_code.new_label();
+        recursive_code.add(Op::JZ, { O::label(ret), O::reference(-1) });
+        recursive_code.add(Op::CALL, { O::function(recursive), O::reference(-2), O::reference(-2) });
+        recursive_code.bind(ret);
+        builder.add_code(std::move(recursive_code));
+
+        const spiral::functionid_t imported = builder.add_function({ i64 }, { i64 });
+        builder.add_import(imported, "imported");
+
+        const spiral::functionid_t record_local = builder.add_function({ i64 }, { i64 });
+        spiral::CodeBuilder record_local_code = builder.begin_code(record_local, { record });
+        record_local_code.add(Op::COPY, { O::reference(-1), O::reference(-2) });
+        builder.add_code(std::move(record_local_code));
+
+        const spiral::functionid_t record_input = builder.add_function({ record }, {});
+        builder.add_code(builder.begin_code(record_input));
+
+        const spiral::functionid_t caller = builder.add_function({ i64 }, { i64 });
+        spiral::CodeBuilder caller_code = builder.begin_code(caller, { record });
+        caller_code.add(Op::CALL, { O::function(imported), O::reference(-1), O::reference(-2) });
+        caller_code.add(Op::CALL, { O::function(record_local), O::reference(-2), O::reference(-2) });
+        caller_code.add(Op::CALL, { O::function(record_input), O::reference(1) });
+        builder.add_code(std::move(caller_code));
+        spiral::Module module = std::move(builder).build();
+
+        const spiral::inliner_result result = spiral::inline_calls(module.get_codes(), module.get_functions());
+        CHECK_EQ(result.calls_inlined, size_t{ 0 });
+        CHECK_EQ(result.instructions_added, size_t{ 0 });
+        // the recursive function is not inlined into itself (though it may be into other callers)
+        CHECK_EQ(module.get_codes()[0].get_instructions().size(), size_t{ 2 });
+        CHECK_EQ(module.get_codes().back().get_instructions().size(), size_t{ 3 });
+        CHECK_EQ(inliner::count_calls(module.get_codes().back()), size_t{ 3 });
+    }
+
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#include <spiral/spiral.hpp>
+
+#if defined(__linux__)
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Binding and lazy resolution of imports, and typed access to exports.
+ */
+
+namespace spiral_tests {
+
+    namespace linker {
+
+        inline int64_t negate(int64_t x) noexcept {
+            return -x;
+        }
+
+        inline int64_t widen(int32_t x) noexcept {
+            return x;
+        }
+
+        inline int32_t narrow(int64_t x) noexcept {
+            return static_cast<int32_t>(x);
+        }
+
+        inline std::tuple<int64_t, int64_t> negate_both(int64_t x) noexcept {
+            return { -x, x };
+        }
+
+        inline std::tuple<int64_t, int32_t> split(int64_t x) noexcept {
+            return { x >> 32, static_cast<int32_t>(x) };
+        }
+
+        /**
+         * A module with an import "split" (i64) -> (i64, i32), and an export "call" of the same type that returns what it returns.
+         */
+        inline spiral::Module make_split_caller() {
+            using O = spiral::Operand;
+            const spiral::typeid_t i32(spiral::TypeIDs::I32), i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            const spiral::functionid_t host = builder.add_function({ i64 }, { i64, i32 });
+            builder.add_import(host, "split");
+            const spiral::functionid_t call = builder.add_function({ i64 }, { i64, i32 });
+            builder.add_export(call, "call");
+            spiral::CodeBuilder code = builder.begin_code(call);
+            code.add(spiral::opcode_t::CALL, { O::function(host), O::reference(-1), O::reference(-2), O::reference(-3) });
+            builder.add_code(std::move(code));
+            return std::move(builder).build();
+        }
+
+        /**
+         * Exits the process, so that a child process that calls it shows that it was called.
+         */
+        inline int64_t exit_narrow(int32_t) noexcept {
+            std::_Exit(2);
+        }
+
+        /**
+         * Calls "call" of an instance linked with the given resolver in a child process, and checks that it traps
+         * (the resolver is only run in the child).
+         */
+        inline void check_call_traps(const std::shared_ptr<const spiral::CompiledModule>& compiled, const spiral::import_resolver& resolver) {
+#if defined(__linux__)
+            spiral::Linker linker(compiled->get_module());
+            linker.set_resolver(resolver);
+            const spiral::Instance instance(compiled, linker.link());
+            const auto call = instance.get_export<int64_t(int64_t)>("call");
+            const pid_t pid = fork();
+            if (pid == 0) {
+                call(1);
+                std::_Exit(0);
+            }
+            CHECK(pid != -1);
+            int status = 0;
+            CHECK_EQ(waitpid(pid, &status, 0), pid);
+            CHECK(WIFSIGNALED(status));
+            CHECK(WTERMSIG(status) == SIGILL || WTERMSIG(status) == SIGTRAP);
+#else
+            (void)compiled;
+            (void)resolver;
+#endif
+        }
+    }
+
+    SPIRAL_TEST(import_bindings_resolve_once) {
+        using namespace linker;
+        const std::shared_ptr<const spiral::CompiledModule> compiled = aot_compile_and_load(make_import_caller());
+        CHECK_THROWS(spiral::Linker(compiled->get_module()).link(), spiral::link_exception);
+        spiral::Linker linker(compiled->get_module());
+        size_t num_resolved = 0;
+        linker.set_resolver([&](const spiral::Import& import) {
+            ++num_resolved;
+            CHECK_EQ(import.get_name(), std::string("host"));
+            return spiral::host_function::of<&negate>();
+        });
+        const std::shared_ptr<const spiral::import_bindings> bindings = linker.link();
+        CHECK(bindings->get(0) == nullptr);
+        const spiral::Instance instance(compiled, bindings);
+        const auto call = instance.get_export<int64_t(int64_t)>("call");
+        CHECK_EQ(call(5), int64_t{ -5 });
+        // the slot now holds the host function, which later calls (of any instance sharing the bindings) go to directly
+        CHECK(bindings->get(0) == spiral::host_function::of<&negate>().entry);
+        const spiral::Instance other(compiled, bindings);
+        CHECK_EQ(call(-6), int64_t{ 6 });
+        CHECK_EQ(other.get_export<int64_t(int64_t)>("call")(7), int64_t{ -7 });
+        CHECK_EQ(num_resolved, size_t{ 1 });
+    }
+
+    SPIRAL_TEST(import_bindings_trap_when_unresolved) {
+        using namespace linker;
+        const std::shared_ptr<const spiral::CompiledModule> compiled = aot_compile_and_load(make_import_caller());
+        check_call_traps(compiled, [](const spiral::Import&) { return spiral::host_function::of<&exit_narrow>(); });
+        check_call_traps(compiled, [](const spiral::Import&) { return spiral::host_function{}; });
+        check_call_traps(compiled, [](const spiral::Import&) -> spiral::host_function { throw std::runtime_error("no host function"); });
+    }
+
+    SPIRAL_TEST(linker_bind_checks_the_signature) {
+        using namespace linker;
+        const spiral::Module module = make_import_caller();
+        spiral::Linker linker(module);
+        CHECK_THROWS(linker.bind<&widen>("host"), spiral::link_exception);
+        CHECK_THROWS(linker.bind<&narrow>("host"), spiral::link_exception);
+        CHECK_THROWS(linker.bind<&negate_both>("host"), spiral::link_exception);
+        CHECK_THROWS(linker.bind<&exit_narrow>("host"), spiral::link_exception);
+        CHECK_THROWS(linker.bind<&negate>("missing"), spiral::link_exception);
+        // nothing was bound by the failed attempts
+        CHECK(linker.get_binding(0) == nullptr);
+        CHECK(!linker.is_complete());
+        linker.bind<&negate>("host");
+        CHECK(linker.get_binding(0) == reinterpret_cast<spiral::native_function_t>(&negate));
+    }
+
+    SPIRAL_TEST(linker_binds_tuple_returning_host_functions) {
+        using namespace linker;
+        const std::shared_ptr<const spiral::CompiledModule> compiled = aot_compile_and_load(make_split_caller());
+        spiral::Linker linker(compiled->get_module());
+        linker.bind<&split>("split");
+        // split does not return native_results, so it is called through a thunk
+        CHECK(linker.get_binding(0) != reinterpret_cast<spiral::native_function_t>(&split));
+        const spiral::Instance instance(compiled, linker.link());
+        const auto call = instance.get_export<std::tuple<int64_t, int32_t>(int64_t)>("call");
+        CHECK(call(int64_t{ 0x123456789 }) == std::make_tuple(int64_t{ 1 }, int32_t{ 0x23456789 }));
+        CHECK(call(int64_t{ -2 }) == std::make_tuple(int64_t{ -1 }, int32_t{ -2 }));
+    }
+
+    SPIRAL_TEST(instance_get_export_checks_the_signature) {
+        const spiral::Instance instance = aot_instantiate(make_adder(3));
+        CHECK_THROWS(instance.get_export<int32_t(int64_t)>("add"), spiral::link_exception);
+        CHECK_THROWS(instance.get_export<int64_t(int32_t)>("add"), spiral::link_exception);
+        CHECK_THROWS((instance.get_export<int64_t(int64_t, int64_t)>("add")), spiral::link_exception);
+        CHECK_THROWS(instance.get_export<void(int64_t)>("add"), spiral::link_exception);
+        CHECK_THROWS((instance.get_export<std::tuple<int64_t, int64_t>(int64_t)>("add")), spiral::link_exception);
+        CHECK_THROWS(instance.get_export<double(double)>("add"), spiral::link_exception);
+        CHECK_THROWS(instance.get_export<int64_t(int64_t)>("sub"), spiral::link_exception);
+        // signedness is a property of the operation, so unsigned types match too
+        CHECK_EQ(instance.get_export<uint64_t(uint64_t)>("add")(uint64_t{ 4 }), uint64_t{ 7 });
+
+        // a compiled module whose code was never loaded
+        const auto uncompiled = std::make_shared<const spiral::CompiledModule>(make_adder(3));
+        const spiral::Instance not_loaded(uncompiled, spiral::Linker(uncompiled->get_module()).link());
+        CHECK_THROWS(not_loaded.get_export<int64_t(int64_t)>("add"), spiral::link_exception);
+    }
+
+}
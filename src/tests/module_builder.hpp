@@ -0,0 +1,40 @@
+#pragma once
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+
+/**
+ * Checking of instructions by CodeBuilder.
+ */
+
+namespace spiral_tests {
+
+    SPIRAL_TEST(code_builder_rejected_instruction_leaves_no_trace) {
+        using O = spiral::Operand;
+        using Op = spiral::opcode_t;
+        const spiral::typeid_t i32(spiral::TypeIDs::I32), i64(spiral::TypeIDs::I64);
+        spiral::ModuleBuilder builder;
+        const spiral::functionid_t callee = builder.add_function({ i64, i64 }, {});
+        builder.add_import(callee, "callee");
+        const spiral::functionid_t caller = builder.add_function({}, {});
+        spiral::CodeBuilder code = builder.begin_code(caller, { i64, i32 });
+        // the second parameter has the wrong type, after the first was already accepted
+        CHECK_THROWS(code.add(Op::CALL, { O::function(callee), O::reference(1), O::reference(2) }), spiral::build_exception);
+        // a jump target that would be out of range, on an instruction with too many operands
+        CHECK_THROWS(code.add(Op::JMP, { O::target(100), O::reference(1) }), spiral::build_exception);
+        CHECK_EQ(code.get_num_instructions(), spiral::instructionid_t{ 0 });
+        code.add(Op::CALL, { O::function(callee), O::reference(1), O::reference(1) });
+        builder.add_code(std::move(code));
+        const spiral::Module module = std::move(builder).build();
+        const spiral::Code& built = module.get_codes()[0];
+        CHECK_EQ(built.get_instructions().size(), size_t{ 1 });
+        CHECK_EQ(built.get_call_operands().size(), size_t{ 2 });
+        built.get_instructions()[0].get_params([&](const auto& params) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(params)>, spiral::InstructionParamTypes::Call>) {
+                CHECK_EQ(params.params, size_t{ 0 });
+            }
+        });
+    }
+
+}
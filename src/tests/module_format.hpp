@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+
+/**
+ * The binary module format: Module::write and Module::read are inverses, and Module::try_read reports where and how a
+ * module is broken.
+ */
+
+namespace spiral_tests {
+
+    namespace module_format {
+
+        inline spiral::Module read_module(const std::vector<spiral::byte>& bytes) {
+            spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf(spiral::span<const spiral::byte>(bytes.data(), bytes.size()));
+            spiral::Module module;
+            module.read(buf);
+            return module;
+        }
+
+        inline spiral::decode_result<spiral::Module> try_read_module(const spiral::byte* data, size_t size) {
+            spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf(spiral::span<const spiral::byte>(data, size));
+            return spiral::Module::try_read(buf);
+        }
+
+        /**
+         * Checks that try_read fails with the given kind of error at the given offset, and read with the matching exception.
+         */
+        inline void check_decode_error(const std::vector<spiral::byte>& bytes, spiral::decode_errc kind, size_t offset) {
+            const spiral::decode_result<spiral::Module> result = try_read_module(bytes.data(), bytes.size());
+            CHECK(!result.has_value());
+            CHECK(result.error().kind == kind);
+            CHECK_EQ(result.error().offset, offset);
+            CHECK_THROWS(read_module(bytes), spiral::decode_exception);
+        }
+
+        /**
+         * The magic number and version, followed by the given bytes.
+         */
+        inline std::vector<spiral::byte> after_header(std::initializer_list<uint8_t> rest) {
+            std::vector<spiral::byte> ret;
+            for (const char c : spiral::detail::module_magic) ret.push_back(static_cast<spiral::byte>(c));
+            ret.push_back(spiral::byte{ spiral::detail::module_version });
+            for (const uint8_t b : rest) ret.push_back(spiral::byte{ b });
+            return ret;
+        }
+
+        inline std::vector<spiral::byte> read_file(const std::filesystem::path& path) {
+            std::ifstream file(path, std::ios::binary);
+            CHECK(file.good());
+            const std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            std::vector<spiral::byte> ret(contents.size());
+            std::memcpy(ret.data(), contents.data(), contents.size());
+            return ret;
+        }
+
+        /**
+         * Writes the module, reads it back and writes it again, checks that both writes are the same, and returns them.
+         */
+        inline std::vector<spiral::byte> check_round_trip(const spiral::Module& module) {
+            const std::vector<spiral::byte> written = module.write();
+            CHECK(read_module(written).write() == written);
+            return written;
+        }
+
+        /**
+         * A module with every section, whose code has calls, immediates of i128/f32/f64, element and field references,
+         * and global accesses.
+         */
+        inline spiral::Module make_everything() {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i32(spiral::TypeIDs::I32), i64(spiral::TypeIDs::I64), i128(spiral::TypeIDs::I128), f32(spiral::TypeIDs::F32), f64(spiral::TypeIDs::F64);
+            spiral::ModuleBuilder builder;
+            const spiral::typeid_t pair(static_cast<spiral::typeid_underlying_t>(builder.add_record({ i64, i32 })));
+            builder.add_sharedrecord(1, "pair");
+            const spiral::globalid_t counter = builder.add_global(spiral::TypeIDs::I64, spiral::GlobalFlags::Hot | spiral::GlobalFlags::Shared);
+            const spiral::globalid_t scale = builder.add_global(spiral::TypeIDs::F64);
+
+            const spiral::functionid_t host = builder.add_function({ i64 }, { i64 });
+            builder.add_import(host, "host");
+            const spiral::functionid_t run = builder.add_function({ i64 }, { i64, f32 });
+            builder.add_export(run, "run");
+            // 1: i128, 2: f32, 3: f64, 4: i64[], 5: pair, 6: index
+            spiral::CodeBuilder code = builder.begin_code(run, { i128, f32, f64, spiral::typeid_t(spiral::TypeIDs::I64, 1), pair, i64 });
+            const size_t end = code.new_label();
+            code.add(Op::IMM, { O::reference(1), O::immediate(spiral::int128_t(0x0123456789abcdefull, -5)) });
+            code.add(Op::IMM, { O::reference(2), O::immediate(int64_t{ 0xc0490fdb }) }); // -pi, as an unsigned bit pattern
+            code.add(Op::IMM, { O::reference(3), O::immediate(int64_t{ 0x4004000000000000 }) }); // 2.5
+            code.add(Op::IMM, { O::reference(6), O::immediate(int64_t{ -1 }) });
+            code.add(Op::CREATE, { O::reference(4), O::reference(-1) });
+            code.add(Op::COPY, { O::reference(-1), O::element(4, 6) });
+            code.add(Op::COPY, { O::element(4, 6), O::field(5, 0) });
+            code.add(Op::CONV, { O::field(5, 0), O::field(5, 1) });
+            code.add(Op::CALL, { O::function(host), O::field(5, 0), O::reference(-2) });
+            code.add(Op::CALL, { O::function(host), O::reference(-2), O::unused() });
+            code.add(Op::JZ, { O::label(end), O::reference(-2) });
+            code.add(Op::GSET, { O::global(counter), O::reference(-2) });
+            code.add(Op::GGET, { O::global(scale), O::reference(3) });
+            code.add(Op::COPY, { O::reference(2), O::reference(-3) });
+            code.bind(end);
+            builder.add_code(std::move(code));
+            return std::move(builder).build();
+        }
+    }
+
+    SPIRAL_TEST(module_write_read_corpus) {
+        using namespace module_format;
+        size_t num_modules = 0;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(SPIRAL_CORPUS_DIR)) {
+            if (entry.path().extension() != ".spiral") continue;
+            const std::vector<spiral::byte> bytes = read_file(entry.path());
+            // the corpus is written by Module::write, so the encoding is already canonical
+            CHECK(check_round_trip(read_module(bytes)) == bytes);
+            ++num_modules;
+        }
+        CHECK(num_modules != 0);
+    }
+
+    SPIRAL_TEST(module_write_read_built) {
+        using namespace module_format;
+        const spiral::Module built = make_everything();
+        const std::vector<spiral::byte> bytes = check_round_trip(built);
+        const spiral::Module read = read_module(bytes);
+        CHECK_EQ(read.get_sharedrecords().size(), size_t{ 1 });
+        CHECK_EQ(read.get_globals()[0].get_flags(), static_cast<uint32_t>(spiral::GlobalFlags::Hot | spiral::GlobalFlags::Shared));
+        CHECK_EQ(read.get_codes()[0].get_instructions().size(), built.get_codes()[0].get_instructions().size());
+        CHECK_EQ(read.get_codes()[0].get_call_operands().size(), size_t{ 4 });
+        CHECK_EQ(read.content_hash(), built.content_hash());
+    }
+
+    SPIRAL_TEST(module_try_read_truncated) {
+        using namespace module_format;
+        const std::vector<spiral::byte> bytes = make_everything().write();
+        for (size_t n = 0; n != bytes.size(); ++n) {
+            const spiral::decode_result<spiral::Module> result = try_read_module(bytes.data(), n);
+            CHECK(!result.has_value());
+            CHECK(result.error().kind == spiral::decode_errc::truncated);
+            CHECK(result.error().offset <= n);
+        }
+        CHECK(try_read_module(bytes.data(), bytes.size()).has_value());
+        CHECK_THROWS(read_module(std::vector<spiral::byte>(bytes.begin(), bytes.end() - 1)), spiral::eof_exception);
+    }
+
+    SPIRAL_TEST(module_try_read_errors) {
+        using namespace module_format;
+        // the number of sections, in ten bytes that all continue: 70 bits, which is more than size_t holds
+        const size_t header_size = sizeof(spiral::detail::module_magic) + 1;
+        check_decode_error(after_header({ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }), spiral::decode_errc::varint_overflow, header_size + 10);
+        // 2^64, whose last byte has a bit past the 64 of size_t
+        check_decode_error(after_header({ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02 }), spiral::decode_errc::varint_overflow, header_size + 10);
+
+        std::vector<spiral::byte> bad_magic = after_header({ 0x00 });
+        bad_magic[7] = spiral::byte{ 'X' };
+        check_decode_error(bad_magic, spiral::decode_errc::malformed, sizeof(spiral::detail::module_magic));
+        std::vector<spiral::byte> bad_version = after_header({ 0x00 });
+        bad_version[sizeof(spiral::detail::module_magic)] = spiral::byte{ 2 };
+        check_decode_error(bad_version, spiral::decode_errc::malformed, header_size);
+        // one section, with an unknown code and no payload
+        check_decode_error(after_header({ 0x01, 0x63, 0x00 }), spiral::decode_errc::malformed, header_size + 3);
+        // two function sections
+        check_decode_error(after_header({ 0x02, spiral::SectionCodes::Function, 0x01, 0x00, spiral::SectionCodes::Function, 0x01, 0x00 }), spiral::decode_errc::malformed, header_size + 5);
+        // a function section whose length does not cover its payload
+        check_decode_error(after_header({ 0x01, spiral::SectionCodes::Function, 0x02, 0x00 }), spiral::decode_errc::malformed, header_size + 4);
+    }
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Lookup of exports and imports by name, through the perfect hash of name_table.
+ */
+
+namespace spiral_tests {
+
+    namespace name_table {
+
+        /**
+         * A module with num_names exports named "name_<i>" (in order) and as many imports named "import_<i>", followed by a
+         * repeat of the export and the import with i = repeated.
+         */
+        inline spiral::Module make_named(size_t num_names, size_t repeated) {
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            const spiral::functionid_t exported = builder.add_function({ i64 }, { i64 });
+            builder.add_code(builder.begin_code(exported));
+            for (size_t i = 0; i != num_names; ++i) {
+                builder.add_export(exported, "name_" + std::to_string(i));
+                builder.add_import(builder.add_function({ i64 }, {}), "import_" + std::to_string(i));
+            }
+            if (repeated < num_names) {
+                builder.add_export(exported, "name_" + std::to_string(repeated));
+                builder.add_import(builder.add_function({}, {}), "import_" + std::to_string(repeated));
+            }
+            return std::move(builder).build();
+        }
+
+        /**
+         * Checks that every name is found at its own index (the repeated one at its first occurrence), and that other names are not found.
+         */
+        inline void check_lookups(size_t num_names, size_t repeated) {
+            const spiral::Module module = make_named(num_names, repeated);
+            for (size_t i = 0; i != num_names; ++i) {
+                const std::string index = std::to_string(i);
+                CHECK(module.find_export("name_" + index) == &module.get_exports()[i]);
+                CHECK(module.find_import("import_" + index) == std::optional<size_t>(i));
+            }
+            for (const std::string& miss : std::vector<std::string>{ "", "name_", "name_" + std::to_string(num_names), "import_0", "Name_0" }) {
+                CHECK(module.find_export(miss) == nullptr);
+            }
+            for (const std::string& miss : std::vector<std::string>{ "", "import_", "import_" + std::to_string(num_names), "name_0" }) {
+                CHECK(!module.find_import(miss));
+            }
+        }
+
+        inline int64_t square(int64_t x) noexcept {
+            return x * x;
+        }
+    }
+
+    SPIRAL_TEST(name_table_finds_every_name) {
+        using namespace name_table;
+        for (const size_t num_names : { 0, 1, 2, 3, 4, 5, 17, 100 }) {
+            check_lookups(num_names, num_names / 2);
+        }
+        check_lookups(40000, 12345);
+    }
+
+    SPIRAL_TEST(name_table_hashed_name_overloads) {
+        using namespace name_table;
+        const std::shared_ptr<const spiral::CompiledModule> compiled = aot_compile_and_load(make_import_caller());
+        const spiral::hashed_name host("host");
+        const spiral::hashed_name call("call");
+        spiral::Linker linker(compiled->get_module());
+        CHECK_THROWS(linker.bind<&square>(spiral::hashed_name("")), spiral::link_exception);
+        CHECK_THROWS(linker.bind<&square>(call), spiral::link_exception);
+        linker.bind<&square>(host);
+        const spiral::Instance instance(compiled, linker.link());
+        CHECK_EQ(instance.get_export<int64_t(int64_t)>(call)(-7), int64_t{ 49 });
+        CHECK_THROWS(instance.get_export<int64_t(int64_t)>(spiral::hashed_name("")), spiral::link_exception);
+        CHECK_THROWS(instance.get_export<int64_t(int64_t)>(host), spiral::link_exception);
+    }
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Reporting AOT-loaded code to perf.
+ */
+
+namespace spiral_tests {
+
+    SPIRAL_TEST(aot_load_writes_jitdump) {
+#if defined(__linux__)
+        const temp_path directory;
+        std::filesystem::create_directories(directory.get());
+        const std::filesystem::path library = directory.get() / "module.so";
+        auto compiled = std::make_shared<spiral::CompiledModule>(make_adder(1));
+        spiral::aot_compile(compiled->get_module(), library);
+        std::string dump;
+        {
+            spiral::perf_options options;
+            options.perf_map = false;
+            options.jitdump = true;
+            options.jitdump_directory = directory.get();
+            spiral::perf_output perf(options);
+            CHECK(perf.is_enabled());
+            spiral::aot_load(*compiled, library, nullptr, &perf);
+            std::ifstream file(directory.get() / ("jit-" + std::to_string(getpid()) + ".dump"), std::ios::binary);
+            dump.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        // a code load record, named like the entry point in the shared object
+        CHECK(dump.size() > sizeof(spiral::detail::jitdump_file_header));
+        CHECK(dump.find(spiral::aot_entry_symbol(1)) != std::string::npos);
+#endif
+    }
+
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Sampling AOT-compiled code with sampling_profiler.
+ */
+
+namespace spiral_tests {
+
+    namespace profiler {
+
+        /**
+         * A module with an export "spin" (i64 n) -> (i64) that calls function 1 (x -> 3x + 1) n times in a loop.
+         * spin is function 2.
+         */
+        inline spiral::Module make_spin() {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            const spiral::functionid_t step = builder.add_function({ i64 }, { i64 });
+            spiral::CodeBuilder step_code = builder.begin_code(step, { i64 });
+            step_code.add(Op::IMM, { O::reference(1), O::immediate(3) });
+            step_code.add(Op::MUL, { O::reference(-1), O::reference(1), O::reference(-2) });
+            step_code.add(Op::IMM, { O::reference(1), O::immediate(1) });
+            step_code.add(Op::ADD, { O::reference(-2), O::reference(1), O::reference(-2) });
+            builder.add_code(std::move(step_code));
+
+            const spiral::functionid_t spin = builder.add_function({ i64 }, { i64 });
+            builder.add_export(spin, "spin");
+            // 1: counter, 2: accumulator, 3: one, 4: whether the counter is below n
+            spiral::CodeBuilder code = builder.begin_code(spin, { i64, i64, i64, i64 });
+            const size_t loop = code.new_label();
+            const size_t end = code.new_label();
+            code.add(Op::IMM, { O::reference(1), O::immediate(0) });
+            code.add(Op::IMM, { O::reference(2), O::immediate(0) });
+            code.add(Op::IMM, { O::reference(3), O::immediate(1) });
+            code.bind(loop);
+            code.add(Op::SLT, { O::reference(1), O::reference(-1), O::reference(4) });
+            code.add(Op::JZ, { O::label(end), O::reference(4) });
+            code.add(Op::CALL, { O::function(step), O::reference(2), O::reference(2) });
+            code.add(Op::ADD, { O::reference(1), O::reference(3), O::reference(1) });
+            code.add(Op::JMP, { O::label(loop) });
+            code.bind(end);
+            code.add(Op::COPY, { O::reference(2), O::reference(-2) });
+            builder.add_code(std::move(code));
+            return std::move(builder).build();
+        }
+
+        /**
+         * Runs spin for about the given CPU-bound duration.
+         */
+        inline void run_for(const spiral::Instance& instance, std::chrono::milliseconds duration) {
+            const auto spin = instance.get_export<int64_t(int64_t)>("spin");
+            const auto start = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - start < duration) {
+                spin(int64_t{ 1 } << 20);
+            }
+        }
+
+        /**
+         * Runs spin until the collected profile has a stack that contains the given frame (or a few seconds have passed),
+         * and returns the profile as collapsed stacks.
+         */
+        inline std::string profile_until(spiral::sampling_profiler& profiler, const spiral::Instance& instance, const std::string& frame) {
+            std::ostringstream out;
+            for (int round = 0; round != 100; ++round) {
+                run_for(instance, std::chrono::milliseconds(50));
+                profiler.collect();
+                out.str({});
+                profiler.write_collapsed(out);
+                if (out.str().find(frame) != std::string::npos) break;
+            }
+            return out.str();
+        }
+    }
+
+    SPIRAL_TEST(sampling_profiler_names_spiral_functions) {
+#if defined(SPIRAL_PROFILER_LINUX)
+        using namespace profiler;
+        const spiral::Instance instance = aot_instantiate(make_spin());
+        spiral::sampling_profiler profiler(instance.get_compiled());
+        profiler.attach_thread();
+        profiler.start();
+        const std::string collapsed = profile_until(profiler, instance, "spiral/function_2");
+        profiler.stop();
+        profiler.detach_thread();
+        CHECK(collapsed.find("spiral/function_2") != std::string::npos);
+        CHECK(profiler.get_num_samples() != 0);
+#endif
+    }
+
+    SPIRAL_TEST(sampling_profiler_ignores_threads_of_destroyed_profilers) {
+#if defined(SPIRAL_PROFILER_LINUX)
+        using namespace profiler;
+        const spiral::Instance instance = aot_instantiate(make_spin());
+        {
+            spiral::sampling_profiler destroyed(instance.get_compiled());
+            destroyed.attach_thread();
+        }
+        // this thread is still in the slot of the destroyed profiler, whose buffer is gone
+        spiral::sampling_profiler profiler(instance.get_compiled());
+        profiler.start();
+        run_for(instance, std::chrono::milliseconds(200));
+        profiler.collect();
+        CHECK_EQ(profiler.get_num_samples(), uint64_t{ 0 });
+        // attaching to the running profiler takes the slot over
+        profiler.attach_thread();
+        const std::string collapsed = profile_until(profiler, instance, "spiral/function_2");
+        profiler.stop();
+        profiler.detach_thread();
+        CHECK(collapsed.find("spiral/function_2") != std::string::npos);
+#endif
+    }
+
+}
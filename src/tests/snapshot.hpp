@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * Starting instances from snapshots.
+ */
+
+namespace spiral_tests {
+
+    namespace snapshot {
+
+        /**
+         * A module with one i64 global, and exports "set" and "get" of it; get returns the global plus addend.
+         */
+        inline spiral::Module make_module(int64_t addend) {
+            using O = spiral::Operand;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            const spiral::globalid_t global = builder.add_global(spiral::TypeIDs::I64);
+            const spiral::functionid_t set = builder.add_function({ i64 }, {});
+            builder.add_export(set, "set");
+            spiral::CodeBuilder set_code = builder.begin_code(set);
+            set_code.add(spiral::opcode_t::GSET, { O::global(global), O::reference(-1) });
+            builder.add_code(std::move(set_code));
+            const spiral::functionid_t get = builder.add_function({}, { i64 });
+            builder.add_export(get, "get");
+            spiral::CodeBuilder get_code = builder.begin_code(get, { i64 });
+            get_code.add(spiral::opcode_t::GGET, { O::global(global), O::reference(-1) });
+            get_code.add(spiral::opcode_t::IMM, { O::reference(1), O::immediate(addend) });
+            get_code.add(spiral::opcode_t::ADD, { O::reference(-1), O::reference(1), O::reference(-1) });
+            builder.add_code(std::move(get_code));
+            return std::move(builder).build();
+        }
+    }
+
+    SPIRAL_TEST(snapshot_matches_the_module_contents) {
+        using namespace snapshot;
+        const temp_path path;
+        const spiral::Instance original = aot_instantiate(make_module(0));
+        original.get_export<void(int64_t)>("set")(42);
+        original.save_snapshot(path.get());
+
+        const spiral::snapshot_image image(path.get());
+        CHECK_EQ(image.get_module_hash(), original.get_compiled()->get_content_hash());
+        const spiral::Instance restored(original.get_compiled(), spiral::Linker(original.get_module()).link(), image);
+        CHECK_EQ(restored.get_export<int64_t()>("get")(), int64_t{ 42 });
+        // writes go to the instance's own copy of the block
+        restored.get_export<void(int64_t)>("set")(7);
+        CHECK_EQ(spiral::Instance(original.get_compiled(), spiral::Linker(original.get_module()).link(), image).get_export<int64_t()>("get")(), int64_t{ 42 });
+
+        // the same global section, but different code
+        const auto other = std::make_shared<const spiral::CompiledModule>(make_module(1));
+        CHECK_EQ(other->get_global_layout().get_fingerprint(), original.get_compiled()->get_global_layout().get_fingerprint());
+        CHECK_THROWS(spiral::Instance(other, spiral::Linker(other->get_module()).link(), image), spiral::snapshot_exception);
+    }
+
+}
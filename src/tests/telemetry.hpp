@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+
+/**
+ * Telemetry of reading a module, and its Chrome trace output.
+ */
+
+namespace spiral_tests {
+
+    namespace telemetry {
+
+        /**
+         * A parsed JSON value (only what the trace needs: numbers are kept as doubles).
+         */
+        struct json_value {
+            enum class kind_t { null, boolean, number, string, array, object } kind = kind_t::null;
+            bool boolean = false;
+            double number = 0;
+            std::string string;
+            std::vector<json_value> array;
+            std::map<std::string, json_value> object;
+        };
+
+        /**
+         * Strict parser of a JSON document; a check fails on anything that is not well-formed.
+         */
+        class json_parser {
+        public:
+            explicit json_parser(const std::string& text) : text(text) {}
+
+            json_value parse_document() {
+                json_value ret = parse_value();
+                skip_space();
+                CHECK_EQ(pos, text.size());
+                return ret;
+            }
+
+        private:
+            void skip_space() {
+                while (pos != text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')) ++pos;
+            }
+
+            char next() {
+                CHECK(pos != text.size());
+                return text[pos++];
+            }
+
+            void expect(const char* literal) {
+                for (const char* c = literal; *c != '\0'; ++c) CHECK_EQ(next(), *c);
+            }
+
+            json_value parse_value() {
+                skip_space();
+                CHECK(pos != text.size());
+                json_value ret;
+                switch (text[pos]) {
+                case '{':
+                    ret.kind = json_value::kind_t::object;
+                    ++pos;
+                    skip_space();
+                    if (text[pos] == '}') {
+                        ++pos;
+                        break;
+                    }
+                    while (true) {
+                        skip_space();
+                        const std::string key = parse_string();
+                        skip_space();
+                        CHECK_EQ(next(), ':');
+                        CHECK(ret.object.emplace(key, parse_value()).second);
+                        skip_space();
+                        const char c = next();
+                        if (c == '}') break;
+                        CHECK_EQ(c, ',');
+                    }
+                    break;
+                case '[':
+                    ret.kind = json_value::kind_t::array;
+                    ++pos;
+                    skip_space();
+                    if (text[pos] == ']') {
+                        ++pos;
+                        break;
+                    }
+                    while (true) {
+                        ret.array.push_back(parse_value());
+                        skip_space();
+                        const char c = next();
+                        if (c == ']') break;
+                        CHECK_EQ(c, ',');
+                    }
+                    break;
+                case '"':
+                    ret.kind = json_value::kind_t::string;
+                    ret.string = parse_string();
+                    break;
+                case 't':
+                    expect("true");
+                    ret.kind = json_value::kind_t::boolean;
+                    ret.boolean = true;
+                    break;
+                case 'f':
+                    expect("false");
+                    ret.kind = json_value::kind_t::boolean;
+                    break;
+                case 'n':
+                    expect("null");
+                    break;
+                default:
+                    ret.kind = json_value::kind_t::number;
+                    ret.number = parse_number();
+                }
+                return ret;
+            }
+
+            std::string parse_string() {
+                CHECK_EQ(next(), '"');
+                std::string ret;
+                while (true) {
+                    const char c = next();
+                    if (c == '"') return ret;
+                    CHECK(static_cast<unsigned char>(c) >= 0x20);
+                    if (c != '\\') {
+                        ret.push_back(c);
+                        continue;
+                    }
+                    const char escaped = next();
+                    CHECK(std::string("\"\\/bfnrt").find(escaped) != std::string::npos); // \u is not needed by the trace
+                    ret.push_back(escaped);
+                }
+            }
+
+            double parse_number() {
+                const size_t start = pos;
+                if (text[pos] == '-') ++pos;
+                const auto digits = [&] {
+                    const size_t first = pos;
+                    while (pos != text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) ++pos;
+                    CHECK(pos != first);
+                };
+                CHECK(pos != text.size());
+                if (text[pos] == '0') ++pos;
+                else digits();
+                if (pos != text.size() && text[pos] == '.') {
+                    ++pos;
+                    digits();
+                }
+                if (pos != text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+                    ++pos;
+                    if (pos != text.size() && (text[pos] == '+' || text[pos] == '-')) ++pos;
+                    digits();
+                }
+                return std::stod(text.substr(start, pos - start));
+            }
+
+            const std::string& text;
+            size_t pos = 0;
+        };
+
+        /**
+         * A module with three functions of 1, 3 and 2 instructions.
+         */
+        inline spiral::Module make_module() {
+            using O = spiral::Operand;
+            using Op = spiral::opcode_t;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64);
+            spiral::ModuleBuilder builder;
+            for (const size_t size : { 1, 3, 2 }) {
+                const spiral::functionid_t functionid = builder.add_function({ i64 }, { i64 });
+                builder.add_export(functionid, "f" + std::to_string(functionid));
+                spiral::CodeBuilder code = builder.begin_code(functionid);
+                code.add(Op::COPY, { O::reference(-1), O::reference(-2) });
+                for (size_t i = 1; i != size; ++i) code.add(Op::ADD, { O::reference(-2), O::reference(-1), O::reference(-2) });
+                builder.add_code(std::move(code));
+            }
+            return std::move(builder).build();
+        }
+    }
+
+    SPIRAL_TEST(telemetry_records_decode_and_validate) {
+        using namespace telemetry;
+        const std::vector<spiral::byte> bytes = make_module().write();
+        spiral::telemetry sink;
+        spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf(spiral::span<const spiral::byte>(bytes.data(), bytes.size()));
+        spiral::Module module;
+        module.read(buf, &sink);
+
+        const std::vector<spiral::telemetry_event> events = sink.get_events();
+        std::vector<const spiral::telemetry_event*> functions;
+        const spiral::telemetry_event* decode = nullptr;
+        const spiral::telemetry_event* validate = nullptr;
+        for (const spiral::telemetry_event& event : events) {
+            if (event.name == "decode_function") functions.push_back(&event);
+            else if (event.name == "decode") decode = &event;
+            else if (event.name == "validate") validate = &event;
+        }
+        CHECK_EQ(events.size(), size_t{ 5 });
+        CHECK(decode != nullptr && validate != nullptr);
+        CHECK_EQ(decode->functionid, spiral::functionid_t{ 0 });
+        CHECK_EQ(decode->instructions, uint64_t{ 1 + 3 + 2 });
+        CHECK_EQ(validate->functionid, spiral::functionid_t{ 0 });
+        CHECK_EQ(functions.size(), size_t{ 3 });
+        const uint64_t sizes[] = { 1, 3, 2 };
+        for (size_t i = 0; i != functions.size(); ++i) {
+            CHECK_EQ(functions[i]->functionid, spiral::functionid_t{ i + 1 });
+            CHECK_EQ(functions[i]->instructions, sizes[i]);
+        }
+        // every other phase runs within decode, after the functions that it decodes
+        for (const spiral::telemetry_event& event : events) {
+            CHECK(event.start_ns >= decode->start_ns);
+            CHECK(event.start_ns + event.duration_ns <= decode->start_ns + decode->duration_ns);
+        }
+        CHECK(validate->start_ns >= functions.back()->start_ns + functions.back()->duration_ns);
+
+        const std::map<std::string, spiral::telemetry_totals> totals = sink.get_totals();
+        CHECK_EQ(totals.at("decode_function").count, uint64_t{ 3 });
+        CHECK_EQ(totals.at("decode_function").instructions, uint64_t{ 6 });
+    }
+
+    SPIRAL_TEST(telemetry_writes_chrome_trace_json) {
+        using namespace telemetry;
+        spiral::telemetry sink;
+        {
+            spiral::telemetry::scope outer(&sink, "outer");
+            spiral::telemetry::scope inner(&sink, "inner", 7);
+            inner.set_instructions(12);
+        }
+        const std::vector<spiral::byte> bytes = make_module().write();
+        spiral::basic_imemorybuf<spiral::byte, spiral::span<const spiral::byte>> buf(spiral::span<const spiral::byte>(bytes.data(), bytes.size()));
+        spiral::Module module;
+        module.read(buf, &sink);
+
+        std::ostringstream out;
+        sink.write_chrome_trace(out);
+        const json_value trace = json_parser(out.str()).parse_document();
+        CHECK(trace.kind == json_value::kind_t::object);
+        const json_value& events = trace.object.at("traceEvents");
+        CHECK(events.kind == json_value::kind_t::array);
+        const std::vector<spiral::telemetry_event> recorded = sink.get_events();
+        CHECK_EQ(events.array.size(), recorded.size());
+        for (size_t i = 0; i != events.array.size(); ++i) {
+            const spiral::telemetry_event& expected = recorded[i];
+            const json_value& event = events.array[i];
+            CHECK(event.object.at("ph").string == "X");
+            CHECK(event.object.at("name").string.rfind(expected.name, 0) == 0);
+            CHECK(event.object.at("ts").kind == json_value::kind_t::number);
+            CHECK(event.object.at("dur").number >= 0);
+            CHECK(event.object.at("tid").number == 1);
+            CHECK(event.object.at("args").object.at("functionid").number == static_cast<double>(expected.functionid));
+            CHECK(event.object.at("args").object.at("instructions").number == static_cast<double>(expected.instructions));
+        }
+        CHECK(events.array[0].object.at("name").string == "inner (function 7)");
+        CHECK(events.array[1].object.at("name").string == "outer");
+    }
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Minimal test harness for spiraljit_tests: SPIRAL_TEST defines and registers a test case, and CHECK/CHECK_EQ fail it.
+ * A failed check throws, so a test stops at its first failure; main (in spiral.cpp) runs every case and reports.
+ */
+
+namespace spiral_tests {
+
+    struct test_case {
+        const char* name;
+        void (*run)();
+    };
+
+    inline std::vector<test_case>& registry() {
+        static std::vector<test_case> ret;
+        return ret;
+    }
+
+    struct registrar {
+        registrar(const char* name, void (*run)()) {
+            registry().push_back({ name, run });
+        }
+    };
+
+    class check_failure : public std::exception {
+    public:
+        explicit check_failure(std::string message) : message(std::move(message)) {}
+        const char* what() const noexcept override { return message.c_str(); }
+
+    private:
+        std::string message;
+    };
+
+    template <typename T>
+    std::string describe(const T& value) {
+        std::ostringstream ret;
+        if constexpr (std::is_integral_v<T> && sizeof(T) == 1) {
+            ret << static_cast<int>(value);
+        }
+        else {
+            ret << value;
+        }
+        return ret.str();
+    }
+
+    [[noreturn]] inline void fail(const char* file, int line, const std::string& message) {
+        throw check_failure(std::string(file) + ":" + std::to_string(line) + ": " + message);
+    }
+
+}
+
+#define SPIRAL_TEST_CONCAT_IMPL(a, b) a##b
+#define SPIRAL_TEST_CONCAT(a, b) SPIRAL_TEST_CONCAT_IMPL(a, b)
+
+#define SPIRAL_TEST(name) \
+    static void name(); \
+    static const ::spiral_tests::registrar SPIRAL_TEST_CONCAT(name, _registrar)(#name, &name); \
+    static void name()
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) ::spiral_tests::fail(__FILE__, __LINE__, "CHECK(" #expr ") failed"); \
+    } while (false)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        const auto& spiral_test_actual = (actual); \
+        const auto& spiral_test_expected = (expected); \
+        if (!(spiral_test_actual == spiral_test_expected)) { \
+            ::spiral_tests::fail(__FILE__, __LINE__, "CHECK_EQ(" #actual ", " #expected ") failed: " + ::spiral_tests::describe(spiral_test_actual) + " != " + ::spiral_tests::describe(spiral_test_expected)); \
+        } \
+    } while (false)
+
+#define CHECK_THROWS(expr, exception_type) \
+    do { \
+        bool spiral_test_thrown = false; \
+        try { \
+            (void)(expr); \
+        } \
+        catch (const exception_type&) { \
+            spiral_test_thrown = true; \
+        } \
+        if (!spiral_test_thrown) ::spiral_tests::fail(__FILE__, __LINE__, "CHECK_THROWS(" #expr ", " #exception_type ") failed"); \
+    } while (false)
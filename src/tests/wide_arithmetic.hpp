@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+
+#include <spiral/spiral.hpp>
+
+#include "test.hpp"
+#include "aot.hpp"
+
+/**
+ * mulex/divex helpers (wide_arithmetic.hpp) against the compiler's own 128-bit arithmetic, and the AOT backend's divex against them.
+ */
+
+namespace spiral_tests {
+
+    namespace wide_arithmetic {
+
+        using i128 = __int128;
+        using u128 = unsigned __int128;
+
+        inline i128 to_native(spiral::int128_t value) noexcept {
+            return static_cast<i128>((static_cast<u128>(static_cast<uint64_t>(value.get_upper())) << 64) | value.get_lower());
+        }
+
+        inline u128 to_native(spiral::uint128_t value) noexcept {
+            return (static_cast<u128>(value.get_upper()) << 64) | value.get_lower();
+        }
+
+        inline spiral::int128_t from_native(i128 value) noexcept {
+            return spiral::int128_t(static_cast<uint64_t>(value), static_cast<int64_t>(value >> 64));
+        }
+
+        inline spiral::uint128_t from_native(u128 value) noexcept {
+            return spiral::uint128_t(static_cast<uint64_t>(value), static_cast<uint64_t>(value >> 64));
+        }
+
+        /**
+         * Checks divex<int64_t> on (quotient * divisor + remainder), which must not overflow.
+         */
+        inline void check_divls(int64_t quotient, int64_t divisor, int64_t remainder) {
+            const i128 dividend = static_cast<i128>(quotient) * divisor + remainder;
+            const spiral::divex_result<int64_t> res = spiral::divex<int64_t>(from_native(dividend), divisor);
+            CHECK_EQ(res.quotient, static_cast<int64_t>(dividend / divisor));
+            CHECK_EQ(res.remainder, static_cast<int64_t>(dividend % divisor));
+        }
+
+        /**
+         * Adds an export (i64, i64) -> (i128) of mulex or muluex.
+         */
+        inline void add_multiply_ex(spiral::ModuleBuilder& module, spiral::opcode_t opcode, const std::string& name) {
+            using O = spiral::Operand;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64), i128(spiral::TypeIDs::I128);
+            const spiral::functionid_t functionid = module.add_function({ i64, i64 }, { i128 });
+            module.add_export(functionid, name);
+            spiral::CodeBuilder code = module.begin_code(functionid);
+            code.add(opcode, { O::reference(-1), O::reference(-2), O::reference(-3) });
+            module.add_code(std::move(code));
+        }
+
+        /**
+         * Adds an export (i128 dividend, i64 divisor) -> (i64 quotient, i64 remainder) of divex or divuex.
+         */
+        inline void add_divide_ex(spiral::ModuleBuilder& module, spiral::opcode_t opcode, const std::string& name) {
+            using O = spiral::Operand;
+            const spiral::typeid_t i64(spiral::TypeIDs::I64), i128(spiral::TypeIDs::I128);
+            const spiral::functionid_t functionid = module.add_function({ i128, i64 }, { i64, i64 });
+            module.add_export(functionid, name);
+            spiral::CodeBuilder code = module.begin_code(functionid);
+            code.add(opcode, { O::reference(-1), O::reference(-2), O::reference(-3), O::reference(-4) });
+            module.add_code(std::move(code));
+        }
+    }
+
+    SPIRAL_TEST(mulex_64_matches_int128) {
+        using namespace wide_arithmetic;
+        std::mt19937_64 rng(1);
+        const uint64_t edges[] = { 0, 1, 2, 0x7FFFFFFFFFFFFFFFull, 0x8000000000000000ull, 0xFFFFFFFFFFFFFFFFull, 0xFFFFFFFFull, 0x100000000ull };
+        std::vector<uint64_t> values(std::begin(edges), std::end(edges));
+        for (int i = 0; i != 64; ++i) values.push_back(rng());
+        for (const uint64_t a : values) {
+            for (const uint64_t b : values) {
+                CHECK(to_native(spiral::mulex<uint64_t>(a, b)) == static_cast<u128>(a) * b);
+                CHECK(to_native(spiral::mulex<int64_t>(static_cast<int64_t>(a), static_cast<int64_t>(b))) == static_cast<i128>(static_cast<int64_t>(a)) * static_cast<int64_t>(b));
+            }
+        }
+    }
+
+    SPIRAL_TEST(mulex_narrow_widths) {
+        CHECK_EQ(spiral::mulex<int8_t>(-128, -128), int16_t{ 16384 });
+        CHECK_EQ(spiral::mulex<uint8_t>(255, 255), uint16_t{ 65025 });
+        CHECK_EQ(spiral::mulex<int16_t>(-32768, 32767), int32_t{ -1073709056 });
+        CHECK_EQ(spiral::mulex<uint32_t>(0xFFFFFFFFu, 0xFFFFFFFFu), uint64_t{ 0xFFFFFFFE00000001ull });
+        CHECK_EQ(spiral::mulex<int32_t>(std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min()), int64_t{ 0x4000000000000000ll });
+    }
+
+    SPIRAL_TEST(mulex_64_aot) {
+        using namespace wide_arithmetic;
+        spiral::ModuleBuilder builder;
+        add_multiply_ex(builder, spiral::opcode_t::MULEX, "mulex");
+        add_multiply_ex(builder, spiral::opcode_t::MULUEX, "muluex");
+        const spiral::Instance instance = aot_instantiate(std::move(builder).build());
+        const auto mulex = instance.get_export<spiral::int128_t(int64_t, int64_t)>("mulex");
+        const auto muluex = instance.get_export<spiral::uint128_t(uint64_t, uint64_t)>("muluex");
+        std::mt19937_64 rng(7);
+        const uint64_t edges[] = { 0, 1, 0x7FFFFFFFFFFFFFFFull, 0x8000000000000000ull, 0xFFFFFFFFFFFFFFFFull };
+        std::vector<uint64_t> values(std::begin(edges), std::end(edges));
+        for (int i = 0; i != 32; ++i) values.push_back(rng());
+        for (const uint64_t a : values) {
+            for (const uint64_t b : values) {
+                CHECK(to_native(muluex(a, b)) == to_native(spiral::mulex<uint64_t>(a, b)));
+                CHECK(to_native(mulex(static_cast<int64_t>(a), static_cast<int64_t>(b))) == to_native(spiral::mulex<int64_t>(static_cast<int64_t>(a), static_cast<int64_t>(b))));
+            }
+        }
+    }
+
+    SPIRAL_TEST(divuex_64_matches_int128) {
+        using namespace wide_arithmetic;
+        std::mt19937_64 rng(2);
+        for (int i = 0; i != 100000; ++i) {
+            uint64_t divisor = rng() >> (rng() % 64);
+            if (divisor == 0) divisor = 1;
+            const uint64_t upper = rng() % divisor; // so that the quotient fits
+            const u128 dividend = (static_cast<u128>(upper) << 64) | rng();
+            const spiral::divex_result<uint64_t> res = spiral::divex<uint64_t>(from_native(dividend), divisor);
+            CHECK(res.quotient == static_cast<uint64_t>(dividend / divisor));
+            CHECK(res.remainder == static_cast<uint64_t>(dividend % divisor));
+            const spiral::divex_result<uint64_t> portable = spiral::detail::divlu_portable(upper, static_cast<uint64_t>(dividend), divisor);
+            CHECK(portable.quotient == res.quotient && portable.remainder == res.remainder);
+        }
+        const spiral::divex_result<uint64_t> largest = spiral::divex<uint64_t>(spiral::uint128_t(~0ull, ~0ull - 1), ~0ull);
+        CHECK_EQ(largest.quotient, ~0ull);
+        CHECK_EQ(largest.remainder, ~0ull - 1);
+    }
+
+    SPIRAL_TEST(divex_64_signed_edge_cases) {
+        using namespace wide_arithmetic;
+        constexpr int64_t min = std::numeric_limits<int64_t>::min();
+        constexpr int64_t max = std::numeric_limits<int64_t>::max();
+        // truncation towards zero, with the remainder taking the sign of the dividend
+        check_divls(-3, 2, -1);
+        check_divls(-3, -2, 1);
+        check_divls(3, -2, -1);
+        check_divls(0, -1, 0);
+        check_divls(min, 1, 0);
+        check_divls(max, -1, 0);
+        check_divls(-max, -1, 0);
+        check_divls(min, max, 0);
+        check_divls(min, max, -(max - 1));
+        check_divls(max, min, max);
+        check_divls(min + 1, min, min + 1);
+        check_divls(max, max, max - 1);
+        check_divls(min, -1, 0); // dividend 2^63, the largest whose quotient by -1 fits
+        std::mt19937_64 rng(3);
+        for (int i = 0; i != 100000; ++i) {
+            int64_t divisor = static_cast<int64_t>(rng()) >> (rng() % 64);
+            if (divisor == 0) divisor = -1;
+            const int64_t quotient = static_cast<int64_t>(rng()) >> (rng() % 64);
+            // a remainder with the sign of the dividend and smaller in magnitude than the divisor
+            const uint64_t magnitude = divisor == min ? rng() >> 1 : rng() % static_cast<uint64_t>(divisor < 0 ? -divisor : divisor);
+            const i128 product = static_cast<i128>(quotient) * divisor;
+            const int64_t remainder = product < 0 ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude);
+            check_divls(quotient, divisor, product == 0 ? 0 : remainder);
+        }
+    }
+
+    SPIRAL_TEST(divex_64_aot) {
+        using namespace wide_arithmetic;
+        spiral::ModuleBuilder builder;
+        add_divide_ex(builder, spiral::opcode_t::DIVEX, "divex");
+        add_divide_ex(builder, spiral::opcode_t::DIVUEX, "divuex");
+        spiral::Module module = std::move(builder).build();
+        // one hardware divide (divq/idivq) instead of the 128-bit division
+        const std::string source = spiral::emit_cpp(module);
+        CHECK(source.find("a / b") == std::string::npos);
+        const spiral::Instance instance = aot_instantiate(std::move(module));
+        const auto divex = instance.get_export<std::tuple<int64_t, int64_t>(spiral::int128_t, int64_t)>("divex");
+        const auto divuex = instance.get_export<std::tuple<uint64_t, uint64_t>(spiral::uint128_t, uint64_t)>("divuex");
+        constexpr int64_t min = std::numeric_limits<int64_t>::min();
+        constexpr int64_t max = std::numeric_limits<int64_t>::max();
+        const int64_t edges[][3] = { { -3, 2, -1 }, { -3, -2, 1 }, { 3, -2, -1 }, { min, 1, 0 }, { max, -1, 0 }, { min, max, -(max - 1) }, { max, min, max }, { min, -1, 0 } };
+        for (const auto& edge : edges) {
+            const i128 dividend = static_cast<i128>(edge[0]) * edge[1] + edge[2];
+            CHECK(divex(from_native(dividend), edge[1]) == std::make_tuple(static_cast<int64_t>(dividend / edge[1]), static_cast<int64_t>(dividend % edge[1])));
+        }
+        std::mt19937_64 rng(6);
+        for (int i = 0; i != 10000; ++i) {
+            uint64_t divisor = rng() >> (rng() % 64);
+            if (divisor == 0) divisor = 1;
+            const u128 dividend = (static_cast<u128>(rng() % divisor) << 64) | rng();
+            const spiral::divex_result<uint64_t> expected = spiral::divex<uint64_t>(from_native(dividend), divisor);
+            CHECK(divuex(from_native(dividend), divisor) == std::make_tuple(expected.quotient, expected.remainder));
+            const int64_t signed_divisor = static_cast<int64_t>(rng()) >> (rng() % 64);
+            if (signed_divisor == 0) continue;
+            const i128 signed_dividend = static_cast<i128>(static_cast<int64_t>(rng()) >> (rng() % 64)) * signed_divisor + static_cast<int64_t>(rng() % 2);
+            if (signed_dividend / signed_divisor < min || signed_dividend / signed_divisor > max) continue;
+            const spiral::divex_result<int64_t> signed_expected = spiral::divex<int64_t>(from_native(signed_dividend), signed_divisor);
+            CHECK(divex(from_native(signed_dividend), signed_divisor) == std::make_tuple(signed_expected.quotient, signed_expected.remainder));
+        }
+    }
+
+    SPIRAL_TEST(divex_narrow_widths) {
+        const spiral::divex_result<int32_t> a = spiral::divex<int32_t>(int64_t{ -0x3FFFFFFF80000000ll }, std::numeric_limits<int32_t>::min());
+        CHECK_EQ(a.quotient, std::numeric_limits<int32_t>::max());
+        CHECK_EQ(a.remainder, 0);
+        const spiral::divex_result<uint16_t> b = spiral::divex<uint16_t>(uint32_t{ 0xFFFEFFFFu }, uint16_t{ 0xFFFF });
+        CHECK_EQ(b.quotient, uint16_t{ 0xFFFF });
+        CHECK_EQ(b.remainder, uint16_t{ 0xFFFE });
+        const spiral::divex_result<int8_t> c = spiral::divex<int8_t>(int16_t{ -16383 }, int8_t{ -128 });
+        CHECK_EQ(c.quotient, int8_t{ 127 });
+        CHECK_EQ(c.remainder, int8_t{ -127 });
+    }
+
+}